@@ -0,0 +1,198 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+
+#include "arena.h"
+#include "log.h"
+
+/* A page is enough for the task, its target and its strings, so most
+   arenas never need a second block. */
+#define MSU_ARENA_BLOCK_SIZE 4096
+
+/* Allocations larger than this get a block of their own, which is not
+   kept in the pool. */
+#define MSU_ARENA_MAX_SMALL_SIZE (MSU_ARENA_BLOCK_SIZE / 4)
+
+/* Blocks kept for reuse, enough for a few dozen tasks in flight. */
+#define MSU_ARENA_POOL_MAX_BLOCKS 64
+
+#define MSU_ARENA_ALIGN(size) (((size) + 15) & ~((gsize) 15))
+
+typedef struct msu_arena_block_t_ msu_arena_block_t;
+struct msu_arena_block_t_ {
+	msu_arena_block_t *next;
+	gsize size;
+};
+
+#define MSU_ARENA_BLOCK_HEADER MSU_ARENA_ALIGN(sizeof(msu_arena_block_t))
+
+/* The arena lives at the start of its first block, which is the last one
+   in blocks. */
+struct msu_arena_t_ {
+	msu_arena_block_t *blocks;
+	guint8 *pos;
+	guint8 *end;
+};
+
+static msu_arena_block_t *g_pool;
+static guint g_pool_blocks;
+
+static msu_arena_block_t *prv_block_new(gsize size)
+{
+	msu_arena_block_t *block;
+
+	if (size == MSU_ARENA_BLOCK_SIZE && g_pool) {
+		block = g_pool;
+		g_pool = block->next;
+		g_pool_blocks--;
+	} else {
+		block = g_malloc(size);
+		block->size = size;
+	}
+
+	block->next = NULL;
+
+	return block;
+}
+
+static void prv_block_release(msu_arena_block_t *block)
+{
+	if (block->size == MSU_ARENA_BLOCK_SIZE &&
+	    g_pool_blocks < MSU_ARENA_POOL_MAX_BLOCKS) {
+		block->next = g_pool;
+		g_pool = block;
+		g_pool_blocks++;
+	} else {
+		g_free(block);
+	}
+}
+
+msu_arena_t *msu_arena_new(void)
+{
+	msu_arena_block_t *block;
+	msu_arena_t *arena;
+
+	block = prv_block_new(MSU_ARENA_BLOCK_SIZE);
+
+	arena = (msu_arena_t *)((guint8 *)block + MSU_ARENA_BLOCK_HEADER);
+	arena->blocks = block;
+	arena->pos = (guint8 *)arena + MSU_ARENA_ALIGN(sizeof(*arena));
+	arena->end = (guint8 *)block + MSU_ARENA_BLOCK_SIZE;
+
+	return arena;
+}
+
+void msu_arena_delete(msu_arena_t *arena)
+{
+	msu_arena_block_t *block;
+	msu_arena_block_t *next;
+
+	if (!arena)
+		goto finished;
+
+	/* The arena itself goes with its first block. */
+	block = arena->blocks;
+
+	while (block) {
+		next = block->next;
+		prv_block_release(block);
+		block = next;
+	}
+
+finished:
+
+	return;
+}
+
+gpointer msu_arena_alloc0(msu_arena_t *arena, gsize size)
+{
+	msu_arena_block_t *block;
+	gpointer retval;
+
+	if (!arena) {
+		retval = g_malloc(size);
+		goto finished;
+	}
+
+	size = MSU_ARENA_ALIGN(size);
+
+	if (size > MSU_ARENA_MAX_SMALL_SIZE) {
+		block = prv_block_new(MSU_ARENA_BLOCK_HEADER + size);
+		retval = (guint8 *)block + MSU_ARENA_BLOCK_HEADER;
+
+		/* Large blocks go after the current one, which keeps its
+		   free space. */
+		block->next = arena->blocks->next;
+		arena->blocks->next = block;
+
+		goto finished;
+	}
+
+	if (size > (gsize)(arena->end - arena->pos)) {
+		block = prv_block_new(MSU_ARENA_BLOCK_SIZE);
+		block->next = arena->blocks;
+		arena->blocks = block;
+
+		arena->pos = (guint8 *)block + MSU_ARENA_BLOCK_HEADER;
+		arena->end = (guint8 *)block + MSU_ARENA_BLOCK_SIZE;
+	}
+
+	retval = arena->pos;
+	arena->pos += size;
+
+finished:
+
+	return memset(retval, 0, size);
+}
+
+gchar *msu_arena_strndup(msu_arena_t *arena, const gchar *str, gsize n)
+{
+	gchar *retval = NULL;
+
+	if (str) {
+		retval = msu_arena_alloc0(arena, n + 1);
+		memcpy(retval, str, n);
+	}
+
+	return retval;
+}
+
+gchar *msu_arena_strdup(msu_arena_t *arena, const gchar *str)
+{
+	return str ? msu_arena_strndup(arena, str, strlen(str)) : NULL;
+}
+
+/* Gives the blocks kept for reuse back to the system, when memory is
+   short or at shutdown. */
+void msu_arena_flush_pool(void)
+{
+	msu_arena_block_t *block;
+
+	MSU_LOG_DEBUG("Freeing %u arena blocks", g_pool_blocks);
+
+	while (g_pool) {
+		block = g_pool;
+		g_pool = block->next;
+		g_free(block);
+	}
+
+	g_pool_blocks = 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_ARENA_H__
+#define MSU_ARENA_H__
+
+#include <glib.h>
+
+/* Memory owned by a task and released all at once with it.  Allocations
+   are zero-filled and can not be freed individually.  Arenas may only be
+   used from the main loop.  A NULL arena allocates from the heap, in
+   which case the memory returned must be freed with g_free. */
+typedef struct msu_arena_t_ msu_arena_t;
+
+msu_arena_t *msu_arena_new(void);
+void msu_arena_delete(msu_arena_t *arena);
+
+gpointer msu_arena_alloc0(msu_arena_t *arena, gsize size);
+gchar *msu_arena_strdup(msu_arena_t *arena, const gchar *str);
+gchar *msu_arena_strndup(msu_arena_t *arena, const gchar *str, gsize n);
+
+void msu_arena_flush_pool(void);
+
+#endif
@@ -21,6 +21,7 @@
  */
 
 #include "async.h"
+#include "device.h"
 #include "error.h"
 #include "log.h"
 
@@ -29,13 +30,18 @@ void msu_async_task_delete(msu_async_task_t *cb_data)
 	switch (cb_data->task.type) {
 	case MSU_TASK_GET_CHILDREN:
 	case MSU_TASK_SEARCH:
-		if (cb_data->ut.bas.vbs)
-			g_ptr_array_unref(cb_data->ut.bas.vbs);
+		msu_writer_delete(cb_data->ut.bas.writer);
+		if (cb_data->ut.bas.counts)
+			g_ptr_array_unref(cb_data->ut.bas.counts);
+		msu_matcher_unref(cb_data->ut.bas.matcher);
+		break;
+	case MSU_TASK_GET_PROP:
+		msu_matcher_unref(cb_data->ut.get_prop.matcher);
 		break;
 	case MSU_TASK_GET_ALL_PROPS:
 	case MSU_TASK_GET_RESOURCE:
-		if (cb_data->ut.get_all.vb)
-			g_variant_builder_unref(cb_data->ut.get_all.vb);
+		msu_writer_delete(cb_data->ut.get_all.writer);
+		msu_matcher_unref(cb_data->ut.get_all.matcher);
 		break;
 	case MSU_TASK_UPLOAD_TO_ANY:
 	case MSU_TASK_UPLOAD:
@@ -55,6 +61,17 @@ void msu_async_task_delete(msu_async_task_t *cb_data)
 		break;
 	}
 
+	if (cb_data->timeout_id)
+		(void) g_source_remove(cb_data->timeout_id);
+
+	if (cb_data->job)
+		msu_worker_cancel(cb_data->job);
+
+	if (cb_data->flights) {
+		msu_async_task_cancel_flights(cb_data);
+		g_ptr_array_unref(cb_data->flights);
+	}
+
 	if (cb_data->cancellable)
 		g_object_unref(cb_data->cancellable);
 }
@@ -66,6 +83,11 @@ gboolean msu_async_task_complete(gpointer user_data)
 	MSU_LOG_DEBUG("Enter. Error %p", (void *)cb_data->error);
 	MSU_LOG_DEBUG_NL();
 
+	if (cb_data->timeout_id) {
+		(void) g_source_remove(cb_data->timeout_id);
+		cb_data->timeout_id = 0;
+	}
+
 	if (cb_data->proxy != NULL)
 		g_object_remove_weak_pointer((G_OBJECT(cb_data->proxy)),
 					     (gpointer *)&cb_data->proxy);
@@ -79,16 +101,92 @@ void msu_async_task_cancelled_cb(GCancellable *cancellable, gpointer user_data)
 {
 	msu_async_task_t *cb_data = user_data;
 
-	if (cb_data->proxy != NULL)
+	if (cb_data->job) {
+		msu_worker_cancel(cb_data->job);
+		cb_data->job = NULL;
+	} else if (cb_data->flights && cb_data->flights->len) {
+		msu_async_task_cancel_flights(cb_data);
+	} else if (cb_data->proxy != NULL) {
 		gupnp_service_proxy_cancel_action(cb_data->proxy,
 						  cb_data->action);
+	}
 
-	if (!cb_data->error)
+	if (!cb_data->error && cb_data->timed_out)
+		cb_data->error = g_error_new(MSU_ERROR, MSU_ERROR_TIMEOUT,
+					     "Operation timed out.");
+	else if (!cb_data->error)
 		cb_data->error = g_error_new(MSU_ERROR, MSU_ERROR_CANCELLED,
 					     "Operation cancelled.");
 	(void) g_idle_add(msu_async_task_complete, cb_data);
 }
 
+static gboolean prv_async_task_timeout_cb(gpointer user_data)
+{
+	msu_async_task_t *cb_data = user_data;
+	msu_device_t *device = cb_data->task.target.device;
+
+	cb_data->timeout_id = 0;
+
+	if (!cb_data->cancellable ||
+	    g_cancellable_is_cancelled(cb_data->cancellable))
+		goto finished;
+
+	cb_data->timed_out = TRUE;
+
+	if (device) {
+		device->timeouts++;
+		MSU_LOG_WARNING("Request timed out on %s (%u timeouts)",
+				device->path, device->timeouts);
+	}
+
+	g_cancellable_cancel(cb_data->cancellable);
+
+finished:
+
+	return FALSE;
+}
+
+void msu_async_task_set_timeout(msu_async_task_t *cb_data, guint timeout)
+{
+	if (timeout)
+		cb_data->timeout_id = g_timeout_add_seconds(
+						timeout,
+						prv_async_task_timeout_cb,
+						cb_data);
+}
+
+void msu_async_task_add_flight(msu_async_task_t *cb_data,
+			       msu_flight_waiter_t *flight)
+{
+	if (!cb_data->flights)
+		cb_data->flights = g_ptr_array_new();
+
+	g_ptr_array_add(cb_data->flights, flight);
+}
+
+void msu_async_task_flight_landed(msu_async_task_t *cb_data,
+				  msu_flight_waiter_t *flight)
+{
+	(void) g_ptr_array_remove_fast(cb_data->flights, flight);
+}
+
+void msu_async_task_cancel_flights(msu_async_task_t *cb_data)
+{
+	guint i;
+
+	if (!cb_data->flights)
+		goto finished;
+
+	for (i = 0; i < cb_data->flights->len; ++i)
+		msu_flight_cancel(g_ptr_array_index(cb_data->flights, i));
+
+	g_ptr_array_set_size(cb_data->flights, 0);
+
+finished:
+
+	return;
+}
+
 void msu_async_task_cancel(msu_async_task_t *cb_data)
 {
 	if (cb_data->cancellable)
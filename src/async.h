@@ -26,10 +26,14 @@
 #include <libgupnp/gupnp-control-point.h>
 #include <libgupnp-av/gupnp-media-collection.h>
 
+#include "flight.h"
+#include "matcher.h"
 #include "media-service-upnp.h"
 #include "task-atom.h"
 #include "task.h"
 #include "upnp.h"
+#include "worker.h"
+#include "writer.h"
 
 typedef struct msu_async_task_t_ msu_async_task_t;
 typedef guint64 msu_upnp_prop_mask;
@@ -39,26 +43,32 @@ typedef void (*msu_async_cb_t)(msu_async_task_t *cb_data);
 typedef struct msu_async_bas_t_ msu_async_bas_t;
 struct msu_async_bas_t_ {
 	msu_upnp_prop_mask filter_mask;
-	GPtrArray *vbs;
-	const gchar *protocol_info;
+	msu_writer_t *writer;
+	GPtrArray *counts;
+	msu_matcher_t *matcher;
 	gboolean need_child_count;
 	guint retrieved;
+	guint pending;
 	guint max_count;
 	msu_async_cb_t get_children_cb;
+	gchar *upnp_filter;
+	gchar *sort_by;
+	gboolean read_ahead;
+	gboolean streaming;
 };
 
 typedef struct msu_async_get_prop_t_ msu_async_get_prop_t;
 struct msu_async_get_prop_t_ {
 	GCallback prop_func;
-	const gchar *protocol_info;
+	msu_matcher_t *matcher;
 };
 
 typedef struct msu_async_get_all_t_ msu_async_get_all_t;
 struct msu_async_get_all_t_ {
 	GCallback prop_func;
-	GVariantBuilder *vb;
+	msu_writer_t *writer;
 	msu_upnp_prop_mask filter_mask;
-	const gchar *protocol_info;
+	msu_matcher_t *matcher;
 	gboolean need_child_count;
 	gboolean device_object;
 };
@@ -89,8 +99,13 @@ struct msu_async_task_t_ {
 	GError *error;
 	GUPnPServiceProxyAction *action;
 	GUPnPServiceProxy *proxy;
+	GPtrArray *flights;
+	msu_worker_job_t *job;
 	GCancellable *cancellable;
 	gulong cancel_id;
+	guint timeout_id;
+	gboolean timed_out;
+	gboolean server_failed; /* unreachable, or no valid response */
 	union {
 		msu_async_bas_t bas;
 		msu_async_get_prop_t get_prop;
@@ -105,5 +120,11 @@ void msu_async_task_delete(msu_async_task_t *cb_data);
 gboolean msu_async_task_complete(gpointer user_data);
 void msu_async_task_cancelled_cb(GCancellable *cancellable, gpointer user_data);
 void msu_async_task_cancel(msu_async_task_t *cb_data);
+void msu_async_task_set_timeout(msu_async_task_t *cb_data, guint timeout);
+void msu_async_task_add_flight(msu_async_task_t *cb_data,
+			       msu_flight_waiter_t *flight);
+void msu_async_task_flight_landed(msu_async_task_t *cb_data,
+				  msu_flight_waiter_t *flight);
+void msu_async_task_cancel_flights(msu_async_task_t *cb_data);
 
 #endif
@@ -0,0 +1,897 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+
+#include <libxml/tree.h>
+
+#include "cache.h"
+#include "interface.h"
+#include "log.h"
+
+/* Number of objects whose metadata is cached for each server */
+#define MSU_CACHE_MAX_OBJECTS 256
+
+/* Number of pages of children cached for each server */
+#define MSU_CACHE_MAX_PAGES 64
+
+/* Number of container child counts cached for each server */
+#define MSU_CACHE_MAX_COUNTS 1024
+
+typedef gboolean (*msu_cache_match_t)(gpointer data, gpointer user_data);
+
+typedef struct msu_cache_table_t_ msu_cache_table_t;
+struct msu_cache_table_t_ {
+	msu_cache_t *cache;
+	GHashTable *entries;
+	GQueue *lru;
+	guint max_size;
+	gsize bytes;
+	guint hits;
+	guint misses;
+	GDestroyNotify free_func;
+};
+
+typedef struct msu_cache_entry_t_ msu_cache_entry_t;
+struct msu_cache_entry_t_ {
+	msu_cache_table_t *table;
+	gpointer data;
+	gsize size;
+	GList *link;
+	GPtrArray *docs;
+};
+
+/* Cached objects keep the whole XML document they were parsed from
+   alive.  Each document is charged once to the table of the entry that
+   first referred to it, until no entry refers to it anymore. */
+typedef struct msu_cache_doc_t_ msu_cache_doc_t;
+struct msu_cache_doc_t_ {
+	msu_cache_table_t *table;
+	gsize size;
+	guint refs;
+};
+
+typedef struct msu_cache_match_data_t_ msu_cache_match_data_t;
+struct msu_cache_match_data_t_ {
+	msu_cache_match_t match;
+	gpointer user_data;
+};
+
+struct msu_cache_t_ {
+	msu_cache_table_t objects;
+	msu_cache_table_t pages;
+	msu_cache_table_t counts;
+	GHashTable *docs;
+};
+
+/* The caches of all the servers share a global memory budget, on top of
+   the budget of each of them.  0 means unlimited. */
+static GList *g_caches;
+static gsize g_total_bytes;
+static gsize g_max_bytes;
+static gsize g_server_max_bytes;
+
+static gsize prv_node_size(xmlNode *node)
+{
+	xmlAttr *attr;
+	xmlNode *child;
+	gsize size = sizeof(*node);
+
+	if (node->content)
+		size += strlen((const char *) node->content) + 1;
+
+	for (attr = node->properties; attr; attr = attr->next) {
+		size += sizeof(*attr);
+		for (child = attr->children; child; child = child->next)
+			size += prv_node_size(child);
+	}
+
+	for (child = node->children; child; child = child->next)
+		size += prv_node_size(child);
+
+	return size;
+}
+
+/* Names are shared by the whole document and not counted. */
+static gsize prv_doc_size(xmlDoc *doc)
+{
+	xmlNode *child;
+	gsize size = sizeof(*doc);
+
+	for (child = doc->children; child; child = child->next)
+		size += prv_node_size(child);
+
+	return size;
+}
+
+/* Returns the size of the documents of docs not charged to cache yet */
+static gsize prv_docs_size(msu_cache_t *cache, GPtrArray *docs)
+{
+	gsize size = 0;
+	xmlDoc *doc;
+	guint i;
+
+	for (i = 0; docs && i < docs->len; ++i) {
+		doc = g_ptr_array_index(docs, i);
+		if (!g_hash_table_lookup(cache->docs, doc))
+			size += prv_doc_size(doc);
+	}
+
+	return size;
+}
+
+static void prv_docs_ref(msu_cache_table_t *table, GPtrArray *docs)
+{
+	msu_cache_doc_t *cached;
+	xmlDoc *doc;
+	guint i;
+
+	for (i = 0; docs && i < docs->len; ++i) {
+		doc = g_ptr_array_index(docs, i);
+		cached = g_hash_table_lookup(table->cache->docs, doc);
+		if (!cached) {
+			cached = g_new(msu_cache_doc_t, 1);
+			cached->table = table;
+			cached->size = prv_doc_size(doc);
+			cached->refs = 0;
+
+			table->bytes += cached->size;
+			g_total_bytes += cached->size;
+
+			g_hash_table_insert(table->cache->docs, doc, cached);
+		}
+
+		cached->refs++;
+	}
+}
+
+/* Must be called before the objects that keep the documents alive are
+   released, as a freed document could be replaced by a new one at the
+   same address. */
+static void prv_docs_unref(msu_cache_t *cache, GPtrArray *docs)
+{
+	msu_cache_doc_t *cached;
+	xmlDoc *doc;
+	guint i;
+
+	for (i = 0; docs && i < docs->len; ++i) {
+		doc = g_ptr_array_index(docs, i);
+		cached = g_hash_table_lookup(cache->docs, doc);
+		if (!cached || --cached->refs)
+			continue;
+
+		cached->table->bytes -= cached->size;
+		g_total_bytes -= cached->size;
+
+		(void) g_hash_table_remove(cache->docs, doc);
+	}
+}
+
+static void prv_entry_delete(gpointer data)
+{
+	msu_cache_entry_t *entry = data;
+	msu_cache_table_t *table = entry->table;
+
+	table->bytes -= entry->size;
+	g_total_bytes -= entry->size;
+
+	prv_docs_unref(table->cache, entry->docs);
+	if (entry->docs)
+		g_ptr_array_unref(entry->docs);
+
+	g_queue_delete_link(table->lru, entry->link);
+	table->free_func(entry->data);
+	g_free(entry);
+}
+
+static void prv_table_init(msu_cache_t *cache, msu_cache_table_t *table,
+			   guint max_size, GDestroyNotify free_func)
+{
+	table->cache = cache;
+	table->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+					       g_free, prv_entry_delete);
+	table->lru = g_queue_new();
+	table->max_size = max_size;
+	table->free_func = free_func;
+}
+
+static void prv_table_free(msu_cache_table_t *table)
+{
+	g_hash_table_unref(table->entries);
+	g_queue_free(table->lru);
+}
+
+static gpointer prv_table_lookup(msu_cache_table_t *table, const gchar *key)
+{
+	msu_cache_entry_t *entry;
+	gpointer data = NULL;
+
+	entry = g_hash_table_lookup(table->entries, key);
+	if (!entry) {
+		table->misses++;
+		goto finished;
+	}
+
+	table->hits++;
+	g_queue_unlink(table->lru, entry->link);
+	g_queue_push_tail_link(table->lru, entry->link);
+	data = entry->data;
+
+finished:
+
+	return data;
+}
+
+static gpointer prv_table_peek(msu_cache_table_t *table, const gchar *key)
+{
+	msu_cache_entry_t *entry;
+
+	entry = g_hash_table_lookup(table->entries, key);
+
+	return entry ? entry->data : NULL;
+}
+
+static gsize prv_cache_bytes(msu_cache_t *cache)
+{
+	return cache->objects.bytes + cache->pages.bytes + cache->counts.bytes;
+}
+
+/* Evicts the least recently used entry of the table of cache that uses
+   the most memory.  A table can still be charged for documents that
+   only the entries of other tables refer to, so only tables with
+   entries are candidates. */
+static gboolean prv_cache_evict(msu_cache_t *cache)
+{
+	msu_cache_table_t *tables[] = { &cache->objects, &cache->pages,
+					&cache->counts };
+	msu_cache_table_t *fullest = NULL;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(tables); ++i)
+		if (!g_queue_is_empty(tables[i]->lru) &&
+		    (!fullest || tables[i]->bytes > fullest->bytes))
+			fullest = tables[i];
+
+	if (fullest)
+		(void) g_hash_table_remove(fullest->entries,
+					   g_queue_peek_head(fullest->lru));
+
+	return fullest != NULL;
+}
+
+static msu_cache_t *prv_fullest_cache(void)
+{
+	GList *link;
+	msu_cache_t *fullest = NULL;
+
+	for (link = g_caches; link; link = link->next)
+		if (!fullest || prv_cache_bytes(link->data) >
+		    prv_cache_bytes(fullest))
+			fullest = link->data;
+
+	return fullest;
+}
+
+/* Entries are evicted from cache until size more bytes fit in its
+   budget, then from the largest caches until they fit in the global
+   budget. */
+static void prv_make_room(msu_cache_t *cache, gsize size)
+{
+	if (g_server_max_bytes)
+		while (prv_cache_bytes(cache) + size > g_server_max_bytes &&
+		       prv_cache_evict(cache))
+			;
+
+	if (g_max_bytes)
+		while (g_total_bytes + size > g_max_bytes &&
+		       prv_cache_evict(prv_fullest_cache()))
+			;
+}
+
+/* Takes ownership of key, data and docs, the XML documents data keeps
+   alive.  The least recently used entries are evicted to make room for
+   the new one, which is dropped if it does not fit in the memory
+   budgets on its own. */
+static gboolean prv_table_add(msu_cache_t *cache, msu_cache_table_t *table,
+			      gchar *key, gpointer data, gsize size,
+			      GPtrArray *docs)
+{
+	msu_cache_entry_t *entry;
+	gboolean added = FALSE;
+	gsize total;
+
+	size += sizeof(*entry) + strlen(key) + 1;
+
+	(void) g_hash_table_remove(table->entries, key);
+
+	total = size + prv_docs_size(cache, docs);
+
+	if ((g_server_max_bytes && total > g_server_max_bytes) ||
+	    (g_max_bytes && total > g_max_bytes)) {
+		MSU_LOG_DEBUG("Entry of %"G_GSIZE_FORMAT" bytes not cached",
+			      total);
+
+		table->free_func(data);
+		g_free(key);
+		if (docs)
+			g_ptr_array_unref(docs);
+		goto finished;
+	}
+
+	while (g_hash_table_size(table->entries) >= table->max_size)
+		(void) g_hash_table_remove(table->entries,
+					   g_queue_peek_head(table->lru));
+
+	/* The documents are charged first, so that the entries evicted to
+	   make room for them cannot release them. */
+	prv_docs_ref(table, docs);
+	prv_make_room(cache, size);
+
+	g_queue_push_tail(table->lru, key);
+
+	entry = g_new(msu_cache_entry_t, 1);
+	entry->table = table;
+	entry->data = data;
+	entry->size = size;
+	entry->link = g_queue_peek_tail_link(table->lru);
+	entry->docs = docs;
+
+	g_hash_table_insert(table->entries, key, entry);
+
+	table->bytes += size;
+	g_total_bytes += size;
+	added = TRUE;
+
+finished:
+
+	return added;
+}
+
+static gboolean prv_table_remove(msu_cache_table_t *table, const gchar *key)
+{
+	return g_hash_table_remove(table->entries, key);
+}
+
+static gboolean prv_entry_match(gpointer key, gpointer value,
+				gpointer user_data)
+{
+	msu_cache_entry_t *entry = value;
+	msu_cache_match_data_t *match_data = user_data;
+
+	return match_data->match(entry->data, match_data->user_data);
+}
+
+static guint prv_table_remove_matching(msu_cache_table_t *table,
+				       msu_cache_match_t match,
+				       gpointer user_data)
+{
+	msu_cache_match_data_t match_data;
+
+	match_data.match = match;
+	match_data.user_data = user_data;
+
+	return g_hash_table_foreach_remove(table->entries, prv_entry_match,
+					   &match_data);
+}
+
+static void prv_page_delete(gpointer data)
+{
+	msu_cache_page_t *page = data;
+
+	g_ptr_array_unref(page->objects);
+	g_free(page->container_id);
+	g_free(page);
+}
+
+static void prv_table_foreach(msu_cache_table_t *table, GHFunc func,
+			      gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key;
+	msu_cache_entry_t *entry;
+
+	g_hash_table_iter_init(&iter, table->entries);
+	while (g_hash_table_iter_next(&iter, &key, (gpointer *) &entry))
+		func(key, entry->data, user_data);
+}
+
+/* The memory used by an object is mostly that of the XML document it
+   keeps alive, which is charged separately. */
+static void prv_add_object_doc(GPtrArray *docs, GUPnPDIDLLiteObject *object)
+{
+	xmlNode *node;
+	guint i;
+
+	node = gupnp_didl_lite_object_get_xml_node(object);
+	if (!node || !node->doc)
+		goto finished;
+
+	for (i = 0; i < docs->len; ++i)
+		if (g_ptr_array_index(docs, i) == node->doc)
+			goto finished;
+
+	g_ptr_array_add(docs, node->doc);
+
+finished:
+
+	return;
+}
+
+static gsize prv_page_size(msu_cache_page_t *page)
+{
+	return sizeof(*page) + strlen(page->container_id) + 1 +
+		page->objects->len * sizeof(gpointer);
+}
+
+gchar *msu_cache_page_key(const gchar *container_id, const gchar *filter,
+			  const gchar *sort_by, guint start, guint count)
+{
+	return g_strdup_printf("%s\n%s\n%s\n%u\n%u", container_id, filter,
+			       sort_by, start, count);
+}
+
+static gboolean prv_object_is_child(gpointer data, gpointer user_data)
+{
+	const gchar *parent_id;
+
+	parent_id = gupnp_didl_lite_object_get_parent_id(data);
+
+	return parent_id && !strcmp(parent_id, user_data);
+}
+
+static gboolean prv_page_of_container(gpointer data, gpointer user_data)
+{
+	msu_cache_page_t *page = data;
+
+	return !strcmp(page->container_id, user_data);
+}
+
+static gboolean prv_page_contains(gpointer data, gpointer user_data)
+{
+	msu_cache_page_t *page = data;
+	const gchar *id;
+	guint i;
+
+	for (i = 0; i < page->objects->len; ++i) {
+		id = gupnp_didl_lite_object_get_id(
+					g_ptr_array_index(page->objects, i));
+		if (id && !strcmp(id, user_data))
+			break;
+	}
+
+	return i < page->objects->len;
+}
+
+static gboolean prv_page_outdated(gpointer data, gpointer user_data)
+{
+	msu_cache_page_t *page = data;
+	msu_cache_page_t *current = user_data;
+
+	return !strcmp(page->container_id, current->container_id) &&
+		page->update_id != current->update_id;
+}
+
+/* The parent of an object is known if the object, or a page it is part
+   of, is cached. */
+static gchar *prv_find_parent(msu_cache_t *cache, const gchar *id)
+{
+	GUPnPDIDLLiteObject *object;
+	GHashTableIter iter;
+	msu_cache_entry_t *entry;
+	msu_cache_page_t *page;
+	const gchar *parent_id = NULL;
+	guint i;
+
+	object = prv_table_peek(&cache->objects, id);
+	if (object) {
+		parent_id = gupnp_didl_lite_object_get_parent_id(object);
+		goto finished;
+	}
+
+	g_hash_table_iter_init(&iter, cache->pages.entries);
+	while (!parent_id && g_hash_table_iter_next(&iter, NULL,
+						    (gpointer *) &entry)) {
+		page = entry->data;
+
+		for (i = 0; i < page->objects->len; ++i) {
+			object = g_ptr_array_index(page->objects, i);
+			if (!g_strcmp0(gupnp_didl_lite_object_get_id(object),
+				       id)) {
+				parent_id = page->container_id;
+				break;
+			}
+		}
+	}
+
+finished:
+
+	return g_strdup(parent_id);
+}
+
+/* An UpdateID identical to the cached one means the change is already
+   included in the cached count. */
+static void prv_count_changed(msu_cache_t *cache, const gchar *id,
+			      gint delta, guint update_id)
+{
+	msu_cache_count_t *count;
+
+	count = prv_table_peek(&cache->counts, id);
+	if (!count || count->update_id == update_id)
+		goto finished;
+
+	if ((gint) count->count + delta < 0) {
+		(void) prv_table_remove(&cache->counts, id);
+		goto finished;
+	}
+
+	count->count += delta;
+	count->update_id = update_id;
+
+finished:
+
+	return;
+}
+
+msu_cache_t *msu_cache_new(void)
+{
+	msu_cache_t *cache = g_new0(msu_cache_t, 1);
+
+	cache->docs = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					    NULL, g_free);
+
+	prv_table_init(cache, &cache->objects, MSU_CACHE_MAX_OBJECTS,
+		       g_object_unref);
+	prv_table_init(cache, &cache->pages, MSU_CACHE_MAX_PAGES,
+		       prv_page_delete);
+	prv_table_init(cache, &cache->counts, MSU_CACHE_MAX_COUNTS, g_free);
+
+	g_caches = g_list_prepend(g_caches, cache);
+
+	return cache;
+}
+
+void msu_cache_delete(msu_cache_t *cache)
+{
+	if (cache) {
+		g_caches = g_list_remove(g_caches, cache);
+
+		prv_table_free(&cache->objects);
+		prv_table_free(&cache->pages);
+		prv_table_free(&cache->counts);
+		g_hash_table_unref(cache->docs);
+		g_free(cache);
+	}
+}
+
+void msu_cache_flush(msu_cache_t *cache)
+{
+	MSU_LOG_DEBUG("Flushing cache");
+
+	g_hash_table_remove_all(cache->objects.entries);
+	g_hash_table_remove_all(cache->pages.entries);
+	g_hash_table_remove_all(cache->counts.entries);
+}
+
+void msu_cache_set_budgets(gsize max_bytes, gsize server_max_bytes)
+{
+	GList *link;
+
+	if (max_bytes == g_max_bytes && server_max_bytes == g_server_max_bytes)
+		goto finished;
+
+	MSU_LOG_DEBUG("Cache budgets: %"G_GSIZE_FORMAT" bytes, %"
+		      G_GSIZE_FORMAT" bytes per server", max_bytes,
+		      server_max_bytes);
+
+	g_max_bytes = max_bytes;
+	g_server_max_bytes = server_max_bytes;
+
+	for (link = g_caches; link; link = link->next)
+		prv_make_room(link->data, 0);
+
+finished:
+
+	return;
+}
+
+/* Under memory pressure, every cache gives back at least half of the
+   memory it uses, starting with its least recently used entries. */
+void msu_cache_shed(void)
+{
+	GList *link;
+	gsize target;
+
+	MSU_LOG_INFO("Shedding %"G_GSIZE_FORMAT" bytes of cache",
+		     g_total_bytes);
+
+	for (link = g_caches; link; link = link->next) {
+		target = prv_cache_bytes(link->data) / 2;
+		while (prv_cache_bytes(link->data) > target &&
+		       prv_cache_evict(link->data))
+			;
+	}
+}
+
+GUPnPDIDLLiteObject *msu_cache_lookup_object(msu_cache_t *cache,
+					     const gchar *id)
+{
+	GUPnPDIDLLiteObject *object;
+
+	object = prv_table_lookup(&cache->objects, id);
+
+	if (object)
+		MSU_LOG_DEBUG("Object %s found in cache", id);
+
+	return object;
+}
+
+void msu_cache_add_object(msu_cache_t *cache, GUPnPDIDLLiteObject *object)
+{
+	const gchar *id;
+	GPtrArray *docs;
+
+	id = gupnp_didl_lite_object_get_id(object);
+	if (!id)
+		goto finished;
+
+	docs = g_ptr_array_new();
+	prv_add_object_doc(docs, object);
+
+	(void) prv_table_add(cache, &cache->objects, g_strdup(id),
+			     g_object_ref(object), 0, docs);
+
+finished:
+
+	return;
+}
+
+const msu_cache_page_t *msu_cache_lookup_page(msu_cache_t *cache,
+					      const gchar *container_id,
+					      const gchar *filter,
+					      const gchar *sort_by,
+					      guint start, guint count)
+{
+	msu_cache_page_t *page;
+	gchar *key;
+
+	key = msu_cache_page_key(container_id, filter, sort_by, start, count);
+	page = prv_table_lookup(&cache->pages, key);
+	g_free(key);
+
+	if (page)
+		MSU_LOG_DEBUG("Children of %s found in cache (UpdateID %u)",
+			      container_id, page->update_id);
+
+	return page;
+}
+
+/* Takes ownership of objects.  A different UpdateID means that the
+   container changed since its other pages were cached.  Returns NULL if
+   the page is too large to be cached. */
+const msu_cache_page_t *msu_cache_add_page(msu_cache_t *cache,
+					   const gchar *container_id,
+					   const gchar *filter,
+					   const gchar *sort_by,
+					   guint start, guint count,
+					   guint update_id,
+					   guint total_matches,
+					   GPtrArray *objects)
+{
+	msu_cache_page_t *page;
+	GPtrArray *docs;
+	gsize size;
+	guint i;
+
+	page = g_new(msu_cache_page_t, 1);
+	page->container_id = g_strdup(container_id);
+	page->update_id = update_id;
+	page->total_matches = total_matches;
+	page->objects = objects;
+
+	(void) prv_table_remove_matching(&cache->pages, prv_page_outdated,
+					 page);
+
+	size = prv_page_size(page);
+
+	docs = g_ptr_array_new();
+	for (i = 0; i < objects->len; ++i)
+		prv_add_object_doc(docs, g_ptr_array_index(objects, i));
+
+	if (!prv_table_add(cache, &cache->pages,
+			   msu_cache_page_key(container_id, filter, sort_by,
+					      start, count),
+			   page, size, docs))
+		page = NULL;
+
+	return page;
+}
+
+gboolean msu_cache_lookup_child_count(msu_cache_t *cache, const gchar *id,
+				      guint *count)
+{
+	msu_cache_count_t *cached;
+
+	cached = prv_table_lookup(&cache->counts, id);
+	if (cached)
+		*count = cached->count;
+
+	return cached != NULL;
+}
+
+void msu_cache_add_child_count(msu_cache_t *cache, const gchar *id,
+			       guint count, guint update_id)
+{
+	msu_cache_count_t *cached;
+
+	cached = g_new(msu_cache_count_t, 1);
+	cached->count = count;
+	cached->update_id = update_id;
+
+	(void) prv_table_add(cache, &cache->counts, g_strdup(id), cached,
+			     sizeof(*cached), NULL);
+}
+
+/* The UpdateID of a container changes when the container or one of its
+   direct children is modified. */
+void msu_cache_container_updated(msu_cache_t *cache, const gchar *id,
+				 guint update_id)
+{
+	msu_cache_page_t current;
+	msu_cache_count_t *count;
+
+	current.container_id = (gchar *) id;
+	current.update_id = update_id;
+
+	(void) prv_table_remove(&cache->objects, id);
+	(void) prv_table_remove_matching(&cache->objects, prv_object_is_child,
+					 (gpointer) id);
+	(void) prv_table_remove_matching(&cache->pages, prv_page_outdated,
+					 &current);
+
+	count = prv_table_peek(&cache->counts, id);
+	if (count && count->update_id != update_id)
+		(void) prv_table_remove(&cache->counts, id);
+}
+
+static void prv_object_added(msu_cache_t *cache, const gchar *parent_id)
+{
+	(void) prv_table_remove(&cache->objects, parent_id);
+	(void) prv_table_remove_matching(&cache->pages, prv_page_of_container,
+					 (gpointer) parent_id);
+}
+
+void msu_cache_object_added(msu_cache_t *cache, const gchar *parent_id)
+{
+	prv_object_added(cache, parent_id);
+	(void) prv_table_remove(&cache->counts, parent_id);
+}
+
+/* Unlike msu_cache_object_added, this is called for LastChange events,
+   which tell us the UpdateID the parent reached. */
+void msu_cache_child_added(msu_cache_t *cache, const gchar *parent_id,
+			   guint update_id)
+{
+	prv_object_added(cache, parent_id);
+	prv_count_changed(cache, parent_id, 1, update_id);
+}
+
+void msu_cache_object_modified(msu_cache_t *cache, const gchar *id)
+{
+	(void) prv_table_remove(&cache->objects, id);
+	(void) prv_table_remove_matching(&cache->pages, prv_page_contains,
+					 (gpointer) id);
+}
+
+/* Removing an object also changes the child count of its parent. */
+static void prv_object_removed(msu_cache_t *cache, const gchar *id,
+			       const gchar *parent_id)
+{
+	(void) prv_table_remove(&cache->objects, id);
+	(void) prv_table_remove_matching(&cache->objects, prv_object_is_child,
+					 (gpointer) id);
+
+	if (parent_id)
+		(void) prv_table_remove(&cache->objects, parent_id);
+
+	(void) prv_table_remove_matching(&cache->pages, prv_page_of_container,
+					 (gpointer) id);
+	(void) prv_table_remove_matching(&cache->pages, prv_page_contains,
+					 (gpointer) id);
+	(void) prv_table_remove(&cache->counts, id);
+}
+
+void msu_cache_object_removed(msu_cache_t *cache, const gchar *id)
+{
+	gchar *parent_id;
+
+	parent_id = prv_find_parent(cache, id);
+
+	prv_object_removed(cache, id, parent_id);
+
+	if (parent_id)
+		(void) prv_table_remove(&cache->counts, parent_id);
+
+	g_free(parent_id);
+}
+
+/* The child count of the parent can only be adjusted if we know which
+   container the object was in.  Otherwise, the count is removed when
+   the parent's ContainerUpdateID changes.  Returns the id of that
+   container, or NULL if it is not known. */
+gchar *msu_cache_child_removed(msu_cache_t *cache, const gchar *id,
+			       guint update_id)
+{
+	gchar *parent_id;
+
+	parent_id = prv_find_parent(cache, id);
+
+	prv_object_removed(cache, id, parent_id);
+
+	if (parent_id)
+		prv_count_changed(cache, parent_id, -1, update_id);
+
+	return parent_id;
+}
+
+void msu_cache_foreach_object(msu_cache_t *cache, GHFunc func,
+			      gpointer user_data)
+{
+	prv_table_foreach(&cache->objects, func, user_data);
+}
+
+void msu_cache_foreach_page(msu_cache_t *cache, GHFunc func,
+			    gpointer user_data)
+{
+	prv_table_foreach(&cache->pages, func, user_data);
+}
+
+void msu_cache_foreach_child_count(msu_cache_t *cache, GHFunc func,
+				   gpointer user_data)
+{
+	prv_table_foreach(&cache->counts, func, user_data);
+}
+
+void msu_cache_add_statistics(msu_cache_t *cache, GVariantBuilder *vb)
+{
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_BYTES,
+			      g_variant_new_uint32(prv_cache_bytes(cache)));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_OBJECTS,
+			      g_variant_new_uint32(
+				g_hash_table_size(cache->objects.entries)));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_OBJECT_HITS,
+			      g_variant_new_uint32(cache->objects.hits));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_OBJECT_MISSES,
+			      g_variant_new_uint32(cache->objects.misses));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_PAGES,
+			      g_variant_new_uint32(
+				g_hash_table_size(cache->pages.entries)));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_PAGE_HITS,
+			      g_variant_new_uint32(cache->pages.hits));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_PAGE_MISSES,
+			      g_variant_new_uint32(cache->pages.misses));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_CHILD_COUNTS,
+			      g_variant_new_uint32(
+				g_hash_table_size(cache->counts.entries)));
+	g_variant_builder_add(vb, "{sv}", MSU_INTERFACE_STAT_CHILD_COUNT_HITS,
+			      g_variant_new_uint32(cache->counts.hits));
+	g_variant_builder_add(vb, "{sv}",
+			      MSU_INTERFACE_STAT_CHILD_COUNT_MISSES,
+			      g_variant_new_uint32(cache->counts.misses));
+}
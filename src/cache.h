@@ -0,0 +1,96 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_CACHE_H__
+#define MSU_CACHE_H__
+
+#include <glib.h>
+#include <libgupnp-av/gupnp-av.h>
+
+typedef struct msu_cache_t_ msu_cache_t;
+
+typedef struct msu_cache_page_t_ msu_cache_page_t;
+struct msu_cache_page_t_ {
+	gchar *container_id;
+	guint update_id;
+	guint total_matches;
+	GPtrArray *objects;
+};
+
+/* update_id is the UpdateID of the container when count was last known
+   to be right. */
+typedef struct msu_cache_count_t_ msu_cache_count_t;
+struct msu_cache_count_t_ {
+	guint count;
+	guint update_id;
+};
+
+msu_cache_t *msu_cache_new(void);
+void msu_cache_delete(msu_cache_t *cache);
+void msu_cache_flush(msu_cache_t *cache);
+
+void msu_cache_set_budgets(gsize max_bytes, gsize server_max_bytes);
+void msu_cache_shed(void);
+
+GUPnPDIDLLiteObject *msu_cache_lookup_object(msu_cache_t *cache,
+					     const gchar *id);
+void msu_cache_add_object(msu_cache_t *cache, GUPnPDIDLLiteObject *object);
+
+const msu_cache_page_t *msu_cache_lookup_page(msu_cache_t *cache,
+					      const gchar *container_id,
+					      const gchar *filter,
+					      const gchar *sort_by,
+					      guint start, guint count);
+const msu_cache_page_t *msu_cache_add_page(msu_cache_t *cache,
+					   const gchar *container_id,
+					   const gchar *filter,
+					   const gchar *sort_by,
+					   guint start, guint count,
+					   guint update_id,
+					   guint total_matches,
+					   GPtrArray *objects);
+gchar *msu_cache_page_key(const gchar *container_id, const gchar *filter,
+			  const gchar *sort_by, guint start, guint count);
+
+gboolean msu_cache_lookup_child_count(msu_cache_t *cache, const gchar *id,
+				      guint *count);
+void msu_cache_add_child_count(msu_cache_t *cache, const gchar *id,
+			       guint count, guint update_id);
+
+void msu_cache_container_updated(msu_cache_t *cache, const gchar *id,
+				 guint update_id);
+void msu_cache_object_added(msu_cache_t *cache, const gchar *parent_id);
+void msu_cache_object_modified(msu_cache_t *cache, const gchar *id);
+void msu_cache_object_removed(msu_cache_t *cache, const gchar *id);
+void msu_cache_child_added(msu_cache_t *cache, const gchar *parent_id,
+			   guint update_id);
+gchar *msu_cache_child_removed(msu_cache_t *cache, const gchar *id,
+			       guint update_id);
+
+void msu_cache_foreach_object(msu_cache_t *cache, GHFunc func,
+			      gpointer user_data);
+void msu_cache_foreach_page(msu_cache_t *cache, GHFunc func,
+			    gpointer user_data);
+void msu_cache_foreach_child_count(msu_cache_t *cache, GHFunc func,
+				   gpointer user_data);
+
+void msu_cache_add_statistics(msu_cache_t *cache, GVariantBuilder *vb);
+
+#endif
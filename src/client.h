@@ -25,11 +25,25 @@
 
 #include <glib.h>
 
+#include "matcher.h"
+#include "task-atom.h"
+
 typedef struct msu_client_t_ msu_client_t;
 struct msu_client_t_ {
 	guint id;
 	gchar *protocol_info;
+	msu_matcher_t *matcher;
 	gboolean prefer_local_addresses;
+	gboolean override_priority;
+	msu_task_priority_t priority;
+	guint request_timeout;
+	guint tasks_started;
+	guint64 total_wait;
+	guint64 max_wait;
+	gboolean read_ahead;
+	gboolean streaming_didl;
+	gchar *browse_path;
+	guint browse_next;
 };
 
 
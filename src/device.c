@@ -31,7 +31,9 @@
 #include <libsoup/soup.h>
 
 #include "device.h"
+#include "didl.h"
 #include "error.h"
+#include "flight.h"
 #include "interface.h"
 #include "log.h"
 #include "path.h"
@@ -42,25 +44,93 @@
 #define MSU_LAST_CHANGE_VAR "LastChange"
 #define MEDIA_SERVER_DEVICE_TYPE "urn:schemas-upnp-org:device:MediaServer:"
 
+/* Number of capability probes sent in parallel to a new server */
+#define MSU_DEVICE_MAX_PROBES 4
+
 #define MSU_UPLOAD_STATUS_IN_PROGRESS "IN_PROGRESS"
 #define MSU_UPLOAD_STATUS_CANCELLED "CANCELLED"
 #define MSU_UPLOAD_STATUS_ERROR "ERROR"
 #define MSU_UPLOAD_STATUS_COMPLETED "COMPLETED"
 
+/* Number of child counts retrieved at the same time for a list of objects */
+#define MSU_DEVICE_MAX_CHILD_COUNTS 8
+
+/* Shortest time, in seconds, a circuit stays open before it is probed */
+#define MSU_DEVICE_MIN_COOL_DOWN 1
+
+/* Number of pages read ahead, for different clients or containers, that
+   a server can have at the same time */
+#define MSU_DEVICE_MAX_PREFETCHES 16
+
+static guint g_max_failures;
+static guint g_cool_down = MSU_DEVICE_MIN_COOL_DOWN;
+
 typedef gboolean(*msu_device_count_cb_t)(msu_async_task_t *cb_data,
-					 gint count);
+					 gint count, gpointer user_data);
+
+typedef void (*msu_device_object_cb_t)(GUPnPDIDLLiteParser *parser,
+				       GUPnPDIDLLiteObject *object,
+				       gpointer user_data);
 
 typedef struct msu_device_count_data_t_ msu_device_count_data_t;
 struct msu_device_count_data_t_ {
 	msu_device_count_cb_t cb;
 	msu_async_task_t *cb_data;
+	gchar *id;
+	gpointer user_data;
 };
 
-typedef struct msu_device_object_builder_t_ msu_device_object_builder_t;
-struct msu_device_object_builder_t_ {
-	GVariantBuilder *vb;
+/* A container of a list whose ChildCount has to be retrieved from the
+   server.  object is its index in the writer of the list.  Those of a
+   task are allocated from its arena. */
+typedef struct msu_device_child_count_t_ msu_device_child_count_t;
+struct msu_device_child_count_t_ {
+	guint object;
 	gchar *id;
-	gboolean needs_child_count;
+};
+
+/* The results of a task decoded by a worker thread.  The task can be
+   cancelled and deleted while the job runs, so the job works on copies
+   of what it needs from it.  Either didl is decoded by the streaming
+   decoder, or objects, the GUPnPDIDLLiteObjects parsed by a flight or
+   kept by the cache, are converted.  end is called once the objects
+   have been handed to the task.  counts lists the containers without a
+   ChildCount, whose cached counts are only looked up in the main
+   loop. */
+typedef struct msu_device_decode_t_ msu_device_decode_t;
+struct msu_device_decode_t_ {
+	msu_async_task_t *cb_data;
+	msu_worker_job_t *job;
+	const gchar *operation;
+	msu_async_cb_t end;
+	gchar *didl;
+	GPtrArray *objects;
+	msu_upnp_prop_mask filter_mask;
+	msu_matcher_t *matcher;
+	gchar *root_path;
+	gchar *parent_path;
+	gboolean containers;
+	gboolean items;
+	msu_writer_t *writer;
+	GPtrArray *counts;
+	GError *error;
+};
+
+/* The next page of children that a client paging through a container
+   is expected to request.  The key, owned by the device's table of
+   read-aheads, identifies the client and the container. */
+typedef struct msu_device_prefetch_t_ msu_device_prefetch_t;
+struct msu_device_prefetch_t_ {
+	msu_device_t *device;
+	const gchar *key;
+	GUPnPServiceProxy *proxy;
+	gchar *container_id;
+	gchar *upnp_filter;
+	gchar *sort_by;
+	guint start;
+	guint count;
+	guint idle_id;
+	msu_flight_waiter_t *flight;
 };
 
 typedef struct msu_device_upload_t_ msu_device_upload_t;
@@ -90,6 +160,24 @@ struct prv_new_device_ct_t_ {
 	const GDBusSubtreeVTable *vtable;
 	void *user_data;
 	GHashTable *property_map;
+	gchar *location;
+	msu_store_caps_t caps;
+	gboolean restored;
+};
+
+/* The capabilities of a server declared with those saved by a previous
+   run are retrieved again, one after the other, once it is declared. */
+struct msu_device_refresh_t_ {
+	prv_new_device_ct_t priv_t;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
+	guint probe;
+};
+
+typedef struct prv_probe_t_ prv_probe_t;
+struct prv_probe_t_ {
+	const gchar *action;
+	GUPnPServiceProxyActionCallback cb;
 };
 
 typedef struct prv_new_playlist_ct_t_ prv_new_playlist_ct_t;
@@ -100,8 +188,9 @@ struct prv_new_playlist_ct_t_ {
 };
 
 static void prv_get_child_count(msu_async_task_t *cb_data,
-				msu_device_count_cb_t cb, const gchar *id);
-static void prv_retrieve_child_count_for_list(msu_async_task_t *cb_data);
+				msu_device_count_cb_t cb, const gchar *id,
+				gpointer user_data);
+static gboolean prv_retrieve_child_count_for_list(msu_async_task_t *cb_data);
 static void prv_container_update_cb(GUPnPServiceProxy *proxy,
 				const char *variable,
 				GValue *value,
@@ -116,25 +205,51 @@ static void prv_last_change_cb(GUPnPServiceProxy *proxy,
 				gpointer user_data);
 static void prv_msu_device_upload_delete(gpointer up);
 static void prv_msu_upload_job_delete(gpointer up);
+static gboolean prv_device_subscribed(const msu_device_t *device);
+static gboolean prv_update_check_cb(gpointer user_data);
+static void prv_update_check_schedule(msu_device_t *device);
+static void prv_prefetch_discard(msu_device_t *device,
+				 const gchar *container_id);
 static void prv_get_sr_token_for_props(GUPnPServiceProxy *proxy,
 			     const msu_device_t *device,
 			     msu_async_task_t *cb_data);
+static int prv_get_media_server_version(const msu_device_t *device);
+static void prv_refresh_delete(msu_device_refresh_t *refresh);
 
-static void prv_msu_device_object_builder_delete(void *dob)
+static void prv_msu_device_child_count_delete(void *dcc)
 {
-	msu_device_object_builder_t *builder = dob;
+	msu_device_child_count_t *child_count = dcc;
 
-	if (builder) {
-		if (builder->vb)
-			g_variant_builder_unref(builder->vb);
-
-		g_free(builder->id);
-		g_free(builder);
+	if (child_count) {
+		g_free(child_count->id);
+		g_free(child_count);
 	}
 }
 
+static void prv_msu_device_child_count_add(msu_arena_t *arena,
+					   GPtrArray *counts, guint object,
+					   const gchar *id)
+{
+	msu_device_child_count_t *child_count;
+
+	child_count = msu_arena_alloc0(arena,
+				       sizeof(msu_device_child_count_t));
+	child_count->object = object;
+	child_count->id = msu_arena_strdup(arena, id);
+
+	g_ptr_array_add(counts, child_count);
+}
+
+static void prv_bas_results_new(msu_async_bas_t *cb_task_data)
+{
+	cb_task_data->writer = msu_writer_new();
+	cb_task_data->counts = g_ptr_array_new();
+}
+
 static void prv_msu_device_count_data_new(msu_async_task_t *cb_data,
 					  msu_device_count_cb_t cb,
+					  const gchar *id,
+					  gpointer user_data,
 					  msu_device_count_data_t **count_data)
 {
 	msu_device_count_data_t *cd;
@@ -142,10 +257,20 @@ static void prv_msu_device_count_data_new(msu_async_task_t *cb_data,
 	cd = g_new(msu_device_count_data_t, 1);
 	cd->cb = cb;
 	cd->cb_data = cb_data;
+	cd->id = g_strdup(id);
+	cd->user_data = user_data;
 
 	*count_data = cd;
 }
 
+static void prv_msu_device_count_data_delete(gpointer data)
+{
+	msu_device_count_data_t *cd = data;
+
+	g_free(cd->id);
+	g_free(cd);
+}
+
 static void prv_msu_context_unsubscribe(msu_device_context_t *ctx)
 {
 	if (ctx->timeout_id) {
@@ -190,6 +315,9 @@ static void prv_msu_context_delete(gpointer context)
 		if (ctx->service_proxy)
 			g_object_unref(ctx->service_proxy);
 
+		if (ctx->props)
+			g_variant_unref(ctx->props);
+
 		g_free(ctx->ip_address);
 		g_free(ctx);
 	}
@@ -213,10 +341,182 @@ static void prv_msu_context_new(const gchar *ip_address,
 					      service_type);
 	ctx->subscribed = FALSE;
 	ctx->timeout_id = 0;
+	ctx->props = NULL;
 
 	*context = ctx;
 }
 
+static void prv_circuit_end_probe(msu_device_t *device)
+{
+	if (!device->probe_proxy)
+		goto finished;
+
+	if (device->probe_action)
+		gupnp_service_proxy_cancel_action(device->probe_proxy,
+						  device->probe_action);
+
+	g_object_unref(device->probe_proxy);
+	device->probe_proxy = NULL;
+	device->probe_action = NULL;
+
+finished:
+
+	return;
+}
+
+/* The content of the server is known to match the store once both its
+   ServiceResetToken and its SystemUpdateID have been retrieved. */
+static gboolean prv_store_checked(const msu_device_t *device)
+{
+	return device->reset_token && !device->store_proxy;
+}
+
+static void prv_store_end_check(msu_device_t *device)
+{
+	if (!device->store_proxy)
+		goto finished;
+
+	if (device->store_action) {
+		gupnp_service_proxy_cancel_action(device->store_proxy,
+						  device->store_action);
+		g_free(device->reset_token);
+		device->reset_token = NULL;
+	}
+
+	g_object_unref(device->store_proxy);
+	device->store_proxy = NULL;
+	device->store_action = NULL;
+
+finished:
+
+	return;
+}
+
+static void prv_store_check_failed(msu_device_t *device)
+{
+	msu_store_invalidate(device->store);
+
+	g_free(device->reset_token);
+	device->reset_token = NULL;
+
+	prv_store_end_check(device);
+}
+
+static void prv_store_invalidate(msu_device_t *device)
+{
+	if (device->store)
+		msu_store_invalidate(device->store);
+}
+
+/* Called for each SystemUpdateID evented by the server */
+static void prv_store_update(msu_device_t *device, guint system_update_id)
+{
+	if (!device->store || !prv_store_checked(device))
+		goto finished;
+
+	if (system_update_id != device->store_update_id)
+		msu_store_invalidate(device->store);
+
+	device->store_update_id = system_update_id;
+
+finished:
+
+	return;
+}
+
+/* The SystemUpdateID is retrieved last, so that the store is validated
+   as soon as it is known.  Changes evented from then on are handled by
+   prv_store_update. */
+static void prv_store_update_id_cb(GUPnPServiceProxy *proxy,
+				   GUPnPServiceProxyAction *action,
+				   gpointer user_data)
+{
+	msu_device_t *device = user_data;
+	GError *error = NULL;
+
+	device->store_action = NULL;
+
+	if (!gupnp_service_proxy_end_action(proxy, action, &error,
+					    "Id", G_TYPE_UINT,
+					    &device->store_update_id,
+					    NULL)) {
+		MSU_LOG_WARNING("Unable to retrieve SystemUpdateID: %s",
+				error->message);
+		g_error_free(error);
+		prv_store_check_failed(device);
+		goto finished;
+	}
+
+	(void) msu_store_validate(device->store, device->store_update_id,
+				  device->reset_token);
+	prv_store_end_check(device);
+
+finished:
+
+	return;
+}
+
+static void prv_store_get_update_id(msu_device_t *device)
+{
+	device->store_action = gupnp_service_proxy_begin_action(
+						device->store_proxy,
+						"GetSystemUpdateID",
+						prv_store_update_id_cb,
+						device, NULL);
+}
+
+static void prv_store_reset_token_cb(GUPnPServiceProxy *proxy,
+				     GUPnPServiceProxyAction *action,
+				     gpointer user_data)
+{
+	msu_device_t *device = user_data;
+	GError *error = NULL;
+
+	device->store_action = NULL;
+
+	if (!gupnp_service_proxy_end_action(proxy, action, &error,
+					    "ResetToken", G_TYPE_STRING,
+					    &device->reset_token,
+					    NULL)) {
+		MSU_LOG_WARNING("Unable to retrieve ServiceResetToken: %s",
+				error->message);
+		g_error_free(error);
+		prv_store_check_failed(device);
+		goto finished;
+	}
+
+	prv_store_get_update_id(device);
+
+finished:
+
+	return;
+}
+
+/* Servers older than MediaServer:3 have no ServiceResetToken. */
+static void prv_store_begin_check(msu_device_t *device,
+				  GUPnPServiceProxy *proxy)
+{
+	if (!device->store || device->store_proxy || device->reset_token)
+		goto finished;
+
+	device->store_proxy = g_object_ref(proxy);
+
+	if (prv_get_media_server_version(device) < 3) {
+		device->reset_token = g_strdup("");
+		prv_store_get_update_id(device);
+	} else {
+		device->store_action = gupnp_service_proxy_begin_action(
+						device->store_proxy,
+						"GetServiceResetToken",
+						prv_store_reset_token_cb,
+						device, NULL);
+	}
+
+finished:
+
+	return;
+}
+
 void msu_device_delete(void *device)
 {
 	msu_device_t *dev = device;
@@ -229,6 +529,34 @@ void msu_device_delete(void *device)
 		if (dev->timeout_id)
 			(void) g_source_remove(dev->timeout_id);
 
+		if (dev->circuit_id)
+			(void) g_source_remove(dev->circuit_id);
+
+		/* The cache is only saved once it accounts for all the
+		   changes evented by the server */
+		if (dev->update_check_id) {
+			(void) g_source_remove(dev->update_check_id);
+			(void) prv_update_check_cb(dev);
+		}
+
+		prv_circuit_end_probe(dev);
+
+		g_hash_table_unref(dev->prefetch_table);
+
+		if (dev->store && prv_store_checked(dev))
+			msu_store_save(dev->store, dev->cache,
+				       dev->store_update_id, dev->reset_token);
+
+		prv_store_end_check(dev);
+
+		if (dev->refresh)
+			prv_refresh_delete(dev->refresh);
+
+		msu_store_delete(dev->store);
+		g_free(dev->reset_token);
+
+		msu_cache_delete(dev->cache);
+
 		if (dev->id)
 			(void) g_dbus_connection_unregister_subtree(
 				dev->connection, dev->id);
@@ -257,159 +585,581 @@ void msu_device_unsubscribe(void *device)
 	}
 }
 
-
-static void prv_last_change_decode(GUPnPCDSLastChangeEntry *entry,
-				   GVariantBuilder *array,
-				   const char *root_path)
+/* Cached metadata can only be trusted while the server tells us about
+   the changes made to its content, so the cache is bypassed for
+   servers we are not subscribed to.  The object returned is a new
+   reference, as serving it may evict it from the cache. */
+static GUPnPDIDLLiteObject *prv_cache_lookup_object(msu_device_t *device,
+						    const gchar *id)
 {
-	GUPnPCDSLastChangeEvent event;
-	GVariant *state;
-	const char *object_id;
-	const char *parent_id;
-	const char *mclass;
-	const char *media_class;
-	char *key[] = {"ADD", "DEL", "MOD", "DONE"};
-	char *parent_path;
-	char *path = NULL;
-	gboolean sub_update;
-	guint32 update_id;
+	GUPnPDIDLLiteObject *object = NULL;
+	GUPnPDIDLLiteObject *stored;
 
-	object_id = gupnp_cds_last_change_entry_get_object_id(entry);
-	if (!object_id)
-		goto on_error;
-
-	sub_update = gupnp_cds_last_change_entry_is_subtree_update(entry);
-	update_id = gupnp_cds_last_change_entry_get_update_id(entry);
-	path = msu_path_from_id(root_path, object_id);
-	event = gupnp_cds_last_change_entry_get_event(entry);
+	if (!prv_device_subscribed(device))
+		goto finished;
 
-	switch (event) {
-	case GUPNP_CDS_LAST_CHANGE_EVENT_OBJECT_ADDED:
-		parent_id = gupnp_cds_last_change_entry_get_parent_id(entry);
-		if (!parent_id)
-			goto on_error;
-
-		mclass = gupnp_cds_last_change_entry_get_class(entry);
-		if (!mclass)
-			goto on_error;
+	object = msu_cache_lookup_object(device->cache, id);
+	if (object || !device->store)
+		goto finished;
 
-		media_class = msu_props_upnp_class_to_media_spec(mclass);
-		if (!media_class)
-			goto on_error;
+	stored = msu_store_lookup_object(device->store, id);
+	if (stored) {
+		msu_cache_add_object(device->cache, stored);
+		g_object_unref(stored);
 
-		parent_path = msu_path_from_id(root_path, parent_id);
-		state = g_variant_new("(oubos)", path, update_id, sub_update,
-				      parent_path, media_class);
-		g_free(parent_path);
-		break;
-	case GUPNP_CDS_LAST_CHANGE_EVENT_OBJECT_REMOVED:
-	case GUPNP_CDS_LAST_CHANGE_EVENT_OBJECT_MODIFIED:
-		state = g_variant_new("(oub)", path, update_id, sub_update);
-		break;
-	case GUPNP_CDS_LAST_CHANGE_EVENT_ST_DONE:
-		state = g_variant_new("(ou)", path, update_id);
-		break;
-	case GUPNP_CDS_LAST_CHANGE_EVENT_INVALID:
-	default:
-		goto on_error;
-		break;
+		object = msu_cache_lookup_object(device->cache, id);
+		device->store_hits++;
 	}
 
-	g_variant_builder_add(array, "(sv)", key[event - 1], state);
+finished:
 
-on_error:
+	return object ? g_object_ref(object) : NULL;
+}
 
-	g_free(path);
+/* A page is only valid as long as the UpdateID of its container, so
+   pages are not cached for servers that have never evented a change of
+   UpdateID. */
+static gboolean prv_cache_pages(const msu_device_t *device)
+{
+	return device->changes_evented && prv_device_subscribed(device);
 }
 
-static void prv_last_change_cb(GUPnPServiceProxy *proxy,
-			       const char *variable,
-			       GValue *value,
-			       gpointer user_data)
+static const msu_cache_page_t *prv_cache_lookup_page(msu_device_t *device,
+						     const gchar *container_id,
+						     const gchar *filter,
+						     const gchar *sort_by,
+						     guint start, guint count)
 {
-	const gchar *last_change;
-	GVariantBuilder array;
-	GVariant *val;
-	msu_device_t *device = user_data;
-	GUPnPCDSLastChangeParser *parser;
-	GList *list;
-	GList *next;
-	GError *error = NULL;
+	const msu_cache_page_t *page = NULL;
+	GPtrArray *objects;
+	gchar *key;
+	guint update_id;
+	guint total_matches;
 
-	last_change = g_value_get_string(value);
+	if (!prv_cache_pages(device))
+		goto finished;
 
-	MSU_LOG_DEBUG_NL();
-	MSU_LOG_DEBUG("LastChange XML: %s", last_change);
-	MSU_LOG_DEBUG_NL();
+	page = msu_cache_lookup_page(device->cache, container_id, filter,
+				     sort_by, start, count);
+	if (page || !device->store)
+		goto finished;
 
-	parser = gupnp_cds_last_change_parser_new();
-	list = gupnp_cds_last_change_parser_parse(parser, last_change, &error);
+	key = msu_cache_page_key(container_id, filter, sort_by, start, count);
+	objects = msu_store_lookup_page(device->store, key, &update_id,
+					&total_matches);
+	g_free(key);
 
-	if (error != NULL) {
-		MSU_LOG_WARNING(
-			"gupnp_cds_last_change_parser_parse parsing failed: %s",
-			error->message);
-		goto on_error;
-	}
+	if (!objects)
+		goto finished;
 
-	g_variant_builder_init(&array, G_VARIANT_TYPE("a(sv)"));
-	next = list;
-	while (next) {
-		prv_last_change_decode(next->data, &array, device->path);
-		gupnp_cds_last_change_entry_unref(next->data);
-		next = g_list_next(next);
-	}
+	page = msu_cache_add_page(device->cache, container_id, filter,
+				  sort_by, start, count, update_id,
+				  total_matches, objects);
+	if (page)
+		device->store_hits++;
 
-	val = g_variant_new("(@a(sv))", g_variant_builder_end(&array));
+finished:
 
-	(void) g_dbus_connection_emit_signal(
-					device->connection,
-					NULL,
-					device->path,
-					MSU_INTERFACE_MEDIA_DEVICE,
-					MSU_INTERFACE_ESV_LAST_CHANGE,
-					val,
-					NULL);
+	return page;
+}
 
-on_error:
+static void prv_cache_add_object(msu_device_t *device,
+				 GUPnPDIDLLiteObject *object)
+{
+	if (prv_device_subscribed(device))
+		msu_cache_add_object(device->cache, object);
+}
 
-	g_list_free(list);
-	g_object_unref(parser);
+/* Servers that do not know the number of matches return 0 as
+   TotalMatches. */
+static void prv_cache_add_child_count(msu_device_t *device, const gchar *id,
+				      const msu_flight_result_t *result)
+{
+	if (!result->total_matches && result->objects->len)
+		goto finished;
 
-	if (error != NULL)
-		g_error_free(error);
+	if (prv_device_subscribed(device))
+		msu_cache_add_child_count(device->cache, id,
+					  result->total_matches,
+					  result->update_id);
+
+finished:
+
+	return;
 }
 
-static void prv_build_container_update_array(const gchar *root_path,
-					     const gchar *value,
-					     GVariantBuilder *builder)
+static gboolean prv_cache_lookup_child_count(msu_device_t *device,
+					     const gchar *id, guint *count)
 {
-	gchar **str_array;
-	int pos = 0;
-	gchar *path;
-	guint id;
+	msu_cache_count_t stored;
+	gboolean found = FALSE;
 
-	str_array = g_strsplit(value, ",", 0);
+	if (!prv_device_subscribed(device))
+		goto finished;
 
-	MSU_LOG_DEBUG_NL();
+	found = msu_cache_lookup_child_count(device->cache, id, count);
+	if (found || !device->store)
+		goto finished;
 
-	while (str_array[pos] && str_array[pos + 1]) {
-		path = msu_path_from_id(root_path, str_array[pos++]);
-		id = atoi(str_array[pos++]);
-		g_variant_builder_add(builder, "(ou)", path, id);
-		MSU_LOG_DEBUG("@Id [%s] - Path [%s] - id[%d]",
-			      str_array[pos-2], path, id);
-		g_free(path);
+	found = msu_store_lookup_child_count(device->store, id, &stored);
+	if (found) {
+		msu_cache_add_child_count(device->cache, id, stored.count,
+					  stored.update_id);
+
+		*count = stored.count;
+		device->store_hits++;
 	}
 
-	MSU_LOG_DEBUG_NL();
+finished:
 
-	g_strfreev(str_array);
+	return found;
 }
 
-static void prv_container_update_cb(GUPnPServiceProxy *proxy,
-				    const char *variable,
-				    GValue *value,
+static gboolean prv_add_cached_child_count(msu_device_t *device,
+					   const gchar *id,
+					   msu_writer_t *writer)
+{
+	guint count;
+	gboolean found = FALSE;
+
+	if (!id)
+		goto finished;
+
+	found = prv_cache_lookup_child_count(device, id, &count);
+	if (found)
+		msu_props_add_child_count(writer, count);
+
+finished:
+
+	return found;
+}
+
+GVariant *msu_device_get_cache_statistics(const msu_device_t *device)
+{
+	GVariantBuilder vb;
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sv}"));
+	msu_cache_add_statistics(device->cache, &vb);
+	g_variant_builder_add(&vb, "{sv}", MSU_INTERFACE_STAT_PREFETCHES,
+			      g_variant_new_uint32(device->prefetches));
+	g_variant_builder_add(&vb, "{sv}", MSU_INTERFACE_STAT_PREFETCH_HITS,
+			      g_variant_new_uint32(device->prefetch_hits));
+	g_variant_builder_add(&vb, "{sv}", MSU_INTERFACE_STAT_STORE_HITS,
+			      g_variant_new_uint32(device->store_hits));
+	g_variant_builder_add(&vb, "{sv}", MSU_INTERFACE_STAT_TIMEOUTS,
+			      g_variant_new_uint32(device->timeouts));
+
+	return g_variant_builder_end(&vb);
+}
+
+static void prv_prefetch_delete_cb(gpointer data)
+{
+	msu_device_prefetch_t *prefetch = data;
+
+	if (prefetch->idle_id)
+		(void) g_source_remove(prefetch->idle_id);
+
+	if (prefetch->flight)
+		msu_flight_cancel(prefetch->flight);
+
+	g_object_unref(prefetch->proxy);
+	g_free(prefetch->container_id);
+	g_free(prefetch->upnp_filter);
+	g_free(prefetch->sort_by);
+	g_free(prefetch);
+}
+
+/* Unique bus names contain no slash, so the client and the container
+   cannot be confused */
+static gchar *prv_prefetch_key(msu_task_t *task)
+{
+	return g_strdup_printf("%s/%s",
+			g_dbus_method_invocation_get_sender(task->invocation),
+			task->target.id);
+}
+
+static gboolean prv_prefetch_of_container(gpointer key, gpointer value,
+					  gpointer user_data)
+{
+	msu_device_prefetch_t *prefetch = value;
+
+	return !strcmp(prefetch->container_id, user_data);
+}
+
+/* A NULL container_id discards the read-aheads of all the containers. */
+static void prv_prefetch_discard(msu_device_t *device,
+				 const gchar *container_id)
+{
+	if (!container_id) {
+		g_hash_table_remove_all(device->prefetch_table);
+		goto finished;
+	}
+
+	(void) g_hash_table_foreach_remove(device->prefetch_table,
+					   prv_prefetch_of_container,
+					   (gpointer) container_id);
+
+finished:
+
+	return;
+}
+
+static void prv_prefetch_remove(msu_device_prefetch_t *prefetch)
+{
+	MSU_LOG_DEBUG("Discarding read-ahead of %s", prefetch->container_id);
+
+	(void) g_hash_table_remove(prefetch->device->prefetch_table,
+				   prefetch->key);
+}
+
+static void prv_prefetch_cb(msu_flight_waiter_t *waiter,
+			    const msu_flight_result_t *result,
+			    gpointer user_data)
+{
+	msu_device_prefetch_t *prefetch = user_data;
+	msu_device_t *device = prefetch->device;
+
+	MSU_LOG_DEBUG("Enter");
+
+	prefetch->flight = NULL;
+
+	if (result->error || !prv_cache_pages(device)) {
+		prv_prefetch_remove(prefetch);
+		goto finished;
+	}
+
+	prv_cache_add_child_count(device, prefetch->container_id, result);
+	msu_cache_add_page(device->cache, prefetch->container_id,
+			   prefetch->upnp_filter, prefetch->sort_by,
+			   prefetch->start, prefetch->count,
+			   result->update_id, result->total_matches,
+			   g_ptr_array_ref(result->objects));
+
+finished:
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+/* The read-ahead does not go through the task processor.  It is only
+   sent to a server that is usable and has a free slot that no request
+   of a client is waiting for, so that it never delays these requests
+   nor bypasses the limits set on the server. */
+static gboolean prv_prefetch_start(gpointer user_data)
+{
+	msu_device_prefetch_t *prefetch = user_data;
+	msu_device_t *device = prefetch->device;
+
+	prefetch->idle_id = 0;
+
+	if (!msu_device_is_available(device) ||
+	    !msu_task_processor_sink_has_capacity(
+				msu_media_service_get_task_processor(),
+				device->path)) {
+		MSU_LOG_DEBUG("Server %s is busy: no read-ahead", device->path);
+
+		prv_prefetch_remove(prefetch);
+		goto finished;
+	}
+
+	MSU_LOG_DEBUG("Reading ahead children %u-%u of %s", prefetch->start,
+		      prefetch->start + prefetch->count - 1,
+		      prefetch->container_id);
+	prefetch->flight = msu_flight_browse(prefetch->proxy,
+					     prefetch->container_id,
+					     "BrowseDirectChildren",
+					     prefetch->upnp_filter,
+					     prefetch->start, prefetch->count,
+					     prefetch->sort_by, FALSE,
+					     prv_prefetch_cb, prefetch, NULL);
+	device->prefetches++;
+
+finished:
+
+	return FALSE;
+}
+
+/* The next page is only requested once the current one has been
+   returned, and after the requests the server is already processing.
+   A client paging through a container replaces its previous read-ahead
+   of that container. */
+static void prv_prefetch_schedule(msu_async_task_t *cb_data)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_task_t *task = &cb_data->task;
+	msu_device_t *device = task->target.device;
+	msu_device_prefetch_t *prefetch;
+	gchar *key;
+	guint start;
+
+	start = task->ut.get_children.start + task->ut.get_children.count;
+
+	if (!cb_task_data->read_ahead || !cb_data->proxy ||
+	    (cb_task_data->max_count && start >= cb_task_data->max_count) ||
+	    !prv_cache_pages(device) || !msu_device_is_available(device))
+		goto finished;
+
+	key = prv_prefetch_key(task);
+
+	if (!g_hash_table_remove(device->prefetch_table, key) &&
+	    g_hash_table_size(device->prefetch_table) >=
+	    MSU_DEVICE_MAX_PREFETCHES) {
+		MSU_LOG_DEBUG("Too many read-aheads on %s", device->path);
+
+		g_free(key);
+		goto finished;
+	}
+
+	prefetch = g_new0(msu_device_prefetch_t, 1);
+	prefetch->device = device;
+	prefetch->key = key;
+	prefetch->proxy = g_object_ref(cb_data->proxy);
+	prefetch->container_id = g_strdup(task->target.id);
+	prefetch->upnp_filter = g_strdup(cb_task_data->upnp_filter);
+	prefetch->sort_by = g_strdup(cb_task_data->sort_by);
+	prefetch->start = start;
+	prefetch->count = task->ut.get_children.count;
+	prefetch->idle_id = g_idle_add_full(G_PRIORITY_LOW, prv_prefetch_start,
+					    prefetch, NULL);
+
+	g_hash_table_insert(device->prefetch_table, key, prefetch);
+
+finished:
+
+	return;
+}
+
+/* A request for the page read ahead is a hit if the page is in the cache
+   or if it joined the read-ahead request while it was in progress. */
+static void prv_prefetch_check(msu_async_task_t *cb_data,
+			       const msu_cache_page_t *page)
+{
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_task_t *task = &cb_data->task;
+	msu_device_t *device = task->target.device;
+	msu_device_prefetch_t *prefetch;
+	gchar *key;
+
+	key = prv_prefetch_key(task);
+	prefetch = g_hash_table_lookup(device->prefetch_table, key);
+	g_free(key);
+
+	if (!prefetch || prefetch->start != task->ut.get_children.start ||
+	    prefetch->count != task->ut.get_children.count ||
+	    strcmp(prefetch->upnp_filter, cb_task_data->upnp_filter) ||
+	    strcmp(prefetch->sort_by, cb_task_data->sort_by))
+		goto finished;
+
+	if (page || prefetch->flight)
+		device->prefetch_hits++;
+
+	prv_prefetch_remove(prefetch);
+
+finished:
+
+	return;
+}
+
+/* Clients page sequentially when each ListChildren request starts where
+   their previous one, on the same container, ended. */
+static gboolean prv_is_paging(msu_client_t *client, msu_task_t *task)
+{
+	msu_task_get_children_t *task_data = &task->ut.get_children;
+	gboolean paging;
+
+	paging = task_data->start && task_data->count &&
+		client->browse_path && client->browse_next == task_data->start &&
+		!strcmp(client->browse_path, task->target.path);
+
+	g_free(client->browse_path);
+	client->browse_path = g_strdup(task->target.path);
+	client->browse_next = task_data->start + task_data->count;
+
+	return paging;
+}
+
+static void prv_last_change_decode(GUPnPCDSLastChangeEntry *entry,
+				   GVariantBuilder *array,
+				   msu_device_t *device)
+{
+	GUPnPCDSLastChangeEvent event;
+	GVariant *state;
+	const char *object_id;
+	const char *parent_id;
+	const char *mclass;
+	const char *media_class;
+	char *key[] = {"ADD", "DEL", "MOD", "DONE"};
+	const char *root_path = device->path;
+	char *parent_path;
+	char *removed_from;
+	char *path = NULL;
+	gboolean sub_update;
+	guint32 update_id;
+
+	object_id = gupnp_cds_last_change_entry_get_object_id(entry);
+	if (!object_id)
+		goto on_error;
+
+	sub_update = gupnp_cds_last_change_entry_is_subtree_update(entry);
+	update_id = gupnp_cds_last_change_entry_get_update_id(entry);
+	path = msu_path_from_id(root_path, object_id);
+	event = gupnp_cds_last_change_entry_get_event(entry);
+
+	switch (event) {
+	case GUPNP_CDS_LAST_CHANGE_EVENT_OBJECT_ADDED:
+		parent_id = gupnp_cds_last_change_entry_get_parent_id(entry);
+		if (!parent_id)
+			goto on_error;
+
+		/* The container changed even if the new object cannot be
+		   described to our clients */
+		msu_cache_child_added(device->cache, parent_id, update_id);
+		prv_prefetch_discard(device, parent_id);
+
+		mclass = gupnp_cds_last_change_entry_get_class(entry);
+		if (!mclass)
+			goto on_error;
+
+		media_class = msu_props_upnp_class_to_media_spec(mclass);
+		if (!media_class)
+			goto on_error;
+
+		parent_path = msu_path_from_id(root_path, parent_id);
+		state = g_variant_new("(oubos)", path, update_id, sub_update,
+				      parent_path, media_class);
+		g_free(parent_path);
+		break;
+	case GUPNP_CDS_LAST_CHANGE_EVENT_OBJECT_REMOVED:
+		removed_from = msu_cache_child_removed(device->cache,
+						       object_id, update_id);
+		prv_prefetch_discard(device, object_id);
+
+		/* If the container is not known, any page read ahead may
+		   hold the object */
+		prv_prefetch_discard(device, removed_from);
+		g_free(removed_from);
+
+		state = g_variant_new("(oub)", path, update_id, sub_update);
+		break;
+	case GUPNP_CDS_LAST_CHANGE_EVENT_OBJECT_MODIFIED:
+		msu_cache_object_modified(device->cache, object_id);
+		state = g_variant_new("(oub)", path, update_id, sub_update);
+		break;
+	case GUPNP_CDS_LAST_CHANGE_EVENT_ST_DONE:
+		state = g_variant_new("(ou)", path, update_id);
+		break;
+	case GUPNP_CDS_LAST_CHANGE_EVENT_INVALID:
+	default:
+		goto on_error;
+		break;
+	}
+
+	g_variant_builder_add(array, "(sv)", key[event - 1], state);
+
+on_error:
+
+	g_free(path);
+}
+
+static void prv_last_change_cb(GUPnPServiceProxy *proxy,
+			       const char *variable,
+			       GValue *value,
+			       gpointer user_data)
+{
+	const gchar *last_change;
+	GVariantBuilder array;
+	GVariant *val;
+	msu_device_t *device = user_data;
+	GUPnPCDSLastChangeParser *parser;
+	GList *list;
+	GList *next;
+	GError *error = NULL;
+
+	last_change = g_value_get_string(value);
+
+	MSU_LOG_DEBUG_NL();
+	MSU_LOG_DEBUG("LastChange XML: %s", last_change);
+	MSU_LOG_DEBUG_NL();
+
+	parser = gupnp_cds_last_change_parser_new();
+	list = gupnp_cds_last_change_parser_parse(parser, last_change, &error);
+
+	if (error != NULL) {
+		MSU_LOG_WARNING(
+			"gupnp_cds_last_change_parser_parse parsing failed: %s",
+			error->message);
+		goto on_error;
+	}
+
+	if (list) {
+		prv_store_invalidate(device);
+		device->changes_described = TRUE;
+		device->changes_evented = TRUE;
+		prv_update_check_schedule(device);
+	}
+
+	g_variant_builder_init(&array, G_VARIANT_TYPE("a(sv)"));
+	next = list;
+	while (next) {
+		prv_last_change_decode(next->data, &array, device);
+		gupnp_cds_last_change_entry_unref(next->data);
+		next = g_list_next(next);
+	}
+
+	val = g_variant_new("(@a(sv))", g_variant_builder_end(&array));
+
+	(void) g_dbus_connection_emit_signal(
+					device->connection,
+					NULL,
+					device->path,
+					MSU_INTERFACE_MEDIA_DEVICE,
+					MSU_INTERFACE_ESV_LAST_CHANGE,
+					val,
+					NULL);
+
+on_error:
+
+	g_list_free(list);
+	g_object_unref(parser);
+
+	if (error != NULL)
+		g_error_free(error);
+}
+
+static void prv_build_container_update_array(msu_device_t *device,
+					     const gchar *value,
+					     GVariantBuilder *builder)
+{
+	gchar **str_array;
+	int pos = 0;
+	gchar *path;
+	guint id;
+
+	str_array = g_strsplit(value, ",", 0);
+
+	MSU_LOG_DEBUG_NL();
+
+	while (str_array[pos] && str_array[pos + 1]) {
+		device->changes_described = TRUE;
+		device->changes_evented = TRUE;
+		path = msu_path_from_id(device->path, str_array[pos++]);
+		id = atoi(str_array[pos++]);
+		msu_cache_container_updated(device->cache, str_array[pos - 2],
+					    id);
+		prv_prefetch_discard(device, str_array[pos - 2]);
+		g_variant_builder_add(builder, "(ou)", path, id);
+		MSU_LOG_DEBUG("@Id [%s] - Path [%s] - id[%d]",
+			      str_array[pos-2], path, id);
+		g_free(path);
+	}
+
+	MSU_LOG_DEBUG_NL();
+
+	g_strfreev(str_array);
+}
+
+static void prv_container_update_cb(GUPnPServiceProxy *proxy,
+				    const char *variable,
+				    GValue *value,
 				    gpointer user_data)
 {
 	msu_device_t *device = user_data;
@@ -417,9 +1167,10 @@ static void prv_container_update_cb(GUPnPServiceProxy *proxy,
 
 	g_variant_builder_init(&array, G_VARIANT_TYPE("a(ou)"));
 
-	prv_build_container_update_array(device->path,
+	prv_build_container_update_array(device,
 					 g_value_get_string(value),
 					 &array);
+	prv_update_check_schedule(device);
 
 	(void) g_dbus_connection_emit_signal(
 				device->connection,
@@ -432,6 +1183,43 @@ static void prv_container_update_cb(GUPnPServiceProxy *proxy,
 				NULL);
 }
 
+/* A change of SystemUpdateID that no LastChange or ContainerUpdateIDs
+   event described may have modified any object, so the whole cache is
+   flushed and the store, which may still be under validation, is
+   dropped.  The check runs once all the variables of an event have been
+   notified, as servers send them in any order. */
+static gboolean prv_update_check_cb(gpointer user_data)
+{
+	msu_device_t *device = user_data;
+
+	device->update_check_id = 0;
+
+	if (device->system_update_id != device->accounted_update_id &&
+	    !device->changes_described && prv_device_subscribed(device)) {
+		MSU_LOG_DEBUG("SystemUpdateID %u: changes not described",
+			      device->system_update_id);
+
+		msu_cache_flush(device->cache);
+		prv_prefetch_discard(device, NULL);
+		prv_store_invalidate(device);
+	}
+
+	device->accounted_update_id = device->system_update_id;
+	device->changes_described = FALSE;
+
+	return FALSE;
+}
+
+/* The check takes precedence over the idle sources that start tasks,
+   so that no task is served from outdated entries. */
+static void prv_update_check_schedule(msu_device_t *device)
+{
+	if (!device->update_check_id)
+		device->update_check_id = g_idle_add_full(G_PRIORITY_DEFAULT,
+							  prv_update_check_cb,
+							  device, NULL);
+}
+
 static void prv_system_update_cb(GUPnPServiceProxy *proxy,
 				 const char *variable,
 				 GValue *value,
@@ -445,6 +1233,8 @@ static void prv_system_update_cb(GUPnPServiceProxy *proxy,
 	MSU_LOG_DEBUG("System Update %u", suid);
 
 	device->system_update_id = suid;
+	prv_update_check_schedule(device);
+	prv_store_update(device, suid);
 
 	array = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
 	g_variant_builder_add(array, "{sv}",
@@ -504,6 +1294,10 @@ static void prv_subscription_lost_cb(GUPnPServiceProxy *proxy,
 
 		context->timeout_id = 0;
 		context->subscribed = FALSE;
+
+		msu_cache_flush(context->device->cache);
+		prv_prefetch_discard(context->device, NULL);
+		prv_store_invalidate(context->device);
 	}
 }
 
@@ -543,6 +1337,41 @@ void msu_device_subscribe_to_contents_change(msu_device_t *device)
 			 context);
 }
 
+static GVariant *prv_get_device_props(msu_device_context_t *context)
+{
+	if (!context->props)
+		context->props = msu_props_build_device(
+				(GUPnPDeviceInfo *)context->device_proxy,
+				context->device);
+
+	return context->props;
+}
+
+/* The device properties include the capabilities of the server. */
+static void prv_capabilities_changed(msu_device_t *device)
+{
+	msu_device_context_t *context;
+	unsigned int i;
+
+	for (i = 0; i < device->contexts->len; ++i) {
+		context = g_ptr_array_index(device->contexts, i);
+
+		if (context->props) {
+			g_variant_unref(context->props);
+			context->props = NULL;
+		}
+	}
+}
+
+/* The raw results of the capability actions are kept so that they can
+   be saved. */
+static void prv_keep_result(gchar **kept, gchar **result)
+{
+	g_free(*kept);
+	*kept = *result;
+	*result = NULL;
+}
+
 static void prv_feature_list_add_feature(gchar *root_path,
 					 GUPnPFeature *feature,
 					 GVariantBuilder *vb)
@@ -610,7 +1439,11 @@ static void prv_get_feature_list_analyze(msu_device_t *device, gchar *result)
 		item = g_list_next(item);
 	}
 
+	if (device->feature_list)
+		g_variant_unref(device->feature_list);
+
 	device->feature_list = g_variant_ref_sink(g_variant_builder_end(&vb));
+	prv_capabilities_changed(device);
 
 #if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
 	str = g_variant_print(device->feature_list, FALSE);
@@ -645,6 +1478,7 @@ static void prv_get_feature_list_cb(GUPnPServiceProxy *proxy,
 	MSU_LOG_DEBUG("GetFeatureList result: %s", result);
 
 	prv_get_feature_list_analyze(priv_t->dev, result);
+	prv_keep_result(&priv_t->caps.feature_list, &result);
 
 on_error:
 	if (error != NULL)
@@ -688,8 +1522,12 @@ static void prv_get_sort_ext_capabilities_analyze(msu_device_t *device,
 
 	g_strfreev(saved);
 
+	if (device->sort_ext_caps)
+		g_variant_unref(device->sort_ext_caps);
+
 	device->sort_ext_caps = g_variant_ref_sink(g_variant_builder_end(
 							&sort_ext_caps_vb));
+	prv_capabilities_changed(device);
 
 #if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
 	props = g_variant_print(device->sort_ext_caps, FALSE);
@@ -719,6 +1557,7 @@ static void prv_get_sort_ext_capabilities_cb(GUPnPServiceProxy *proxy,
 	MSU_LOG_DEBUG("GetSortExtensionCapabilities result: %s", result);
 
 	prv_get_sort_ext_capabilities_analyze(priv_t->dev, result);
+	prv_keep_result(&priv_t->caps.sort_ext_caps, &result);
 
 on_error:
 
@@ -767,6 +1606,9 @@ static void prv_get_capabilities_analyze(GHashTable *property_map,
 
 	g_strfreev(saved);
 
+	if (*variant)
+		g_variant_unref(*variant);
+
 	*variant = g_variant_ref_sink(g_variant_builder_end(&caps_vb));
 
 #if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
@@ -795,6 +1637,8 @@ static void prv_get_sort_capabilities_cb(GUPnPServiceProxy *proxy,
 
 	prv_get_capabilities_analyze(priv_t->property_map, result,
 				     &priv_t->dev->sort_caps);
+	prv_keep_result(&priv_t->caps.sort_caps, &result);
+	prv_capabilities_changed(priv_t->dev);
 
 on_error:
 
@@ -818,45 +1662,164 @@ static GUPnPServiceProxyAction *prv_get_sort_capabilities(
 					task, NULL);
 }
 
-static void prv_get_search_capabilities_cb(GUPnPServiceProxy *proxy,
-					   GUPnPServiceProxyAction *action,
-					   gpointer user_data)
+static void prv_get_search_capabilities_cb(GUPnPServiceProxy *proxy,
+					   GUPnPServiceProxyAction *action,
+					   gpointer user_data)
+{
+	gchar *result = NULL;
+	GError *error = NULL;
+	prv_new_device_ct_t *priv_t = (prv_new_device_ct_t *)user_data;
+
+	if (!gupnp_service_proxy_end_action(proxy, action, &error, "SearchCaps",
+					    G_TYPE_STRING, &result, NULL)) {
+		MSU_LOG_WARNING("GetSearchCapabilities operation failed: %s",
+				error->message);
+		goto on_error;
+	}
+
+	MSU_LOG_DEBUG("GetSearchCapabilities result: %s", result);
+
+	prv_get_capabilities_analyze(priv_t->property_map, result,
+				     &priv_t->dev->search_caps);
+	prv_keep_result(&priv_t->caps.search_caps, &result);
+	prv_capabilities_changed(priv_t->dev);
+
+on_error:
+
+	if (error)
+		g_error_free(error);
+
+	g_free(result);
+}
+
+static GUPnPServiceProxyAction *prv_get_search_capabilities(
+					msu_service_task_t *task,
+					GUPnPServiceProxy *proxy,
+					gboolean *failed)
+{
+	*failed = FALSE;
+
+	return gupnp_service_proxy_begin_action(
+					proxy, "GetSearchCapabilities",
+					msu_service_task_begin_action_cb,
+					task, NULL);
+}
+
+static void prv_new_device_ct_clear(prv_new_device_ct_t *priv_t)
+{
+	g_free(priv_t->location);
+	msu_store_clear_capabilities(&priv_t->caps);
+}
+
+static void prv_new_device_ct_delete(gpointer data)
+{
+	prv_new_device_ct_t *priv_t = data;
+
+	prv_new_device_ct_clear(priv_t);
+	g_free(priv_t);
+}
+
+static const prv_probe_t g_probes[] = {
+	{ "GetSearchCapabilities", prv_get_search_capabilities_cb },
+	{ "GetSortCapabilities", prv_get_sort_capabilities_cb },
+	{ "GetSortExtensionCapabilities", prv_get_sort_ext_capabilities_cb },
+	{ "GetFeatureList", prv_get_feature_list_cb }
+};
+
+static void prv_refresh_delete(msu_device_refresh_t *refresh)
+{
+	if (refresh->action)
+		gupnp_service_proxy_cancel_action(refresh->proxy,
+						  refresh->action);
+
+	g_object_unref(refresh->proxy);
+	prv_new_device_ct_clear(&refresh->priv_t);
+	g_free(refresh);
+}
+
+static void prv_refresh_next(msu_device_refresh_t *refresh);
+
+static void prv_refresh_cb(GUPnPServiceProxy *proxy,
+			   GUPnPServiceProxyAction *action,
+			   gpointer user_data)
+{
+	msu_device_refresh_t *refresh = user_data;
+
+	refresh->action = NULL;
+	g_probes[refresh->probe].cb(proxy, action, &refresh->priv_t);
+	refresh->probe++;
+
+	prv_refresh_next(refresh);
+}
+
+/* A probe that fails leaves the capability restored for it unchanged. */
+static void prv_refresh_next(msu_device_refresh_t *refresh)
 {
-	gchar *result = NULL;
-	GError *error = NULL;
-	prv_new_device_ct_t *priv_t = (prv_new_device_ct_t *)user_data;
-
-	if (!gupnp_service_proxy_end_action(proxy, action, &error, "SearchCaps",
-					    G_TYPE_STRING, &result, NULL)) {
-		MSU_LOG_WARNING("GetSearchCapabilities operation failed: %s",
-				error->message);
-		goto on_error;
+	msu_device_t *device = refresh->priv_t.dev;
+
+	if (refresh->probe < G_N_ELEMENTS(g_probes)) {
+		refresh->action = gupnp_service_proxy_begin_action(
+					refresh->proxy,
+					g_probes[refresh->probe].action,
+					prv_refresh_cb, refresh, NULL);
+		goto finished;
 	}
 
-	MSU_LOG_DEBUG("GetSearchCapabilities result: %s", result);
+	MSU_LOG_DEBUG("Capabilities of %s refreshed", device->path);
 
-	prv_get_capabilities_analyze(priv_t->property_map, result,
-				     &priv_t->dev->search_caps);
+	msu_store_save_capabilities(device->store, refresh->priv_t.location,
+				    &refresh->priv_t.caps);
 
-on_error:
+	device->refresh = NULL;
+	prv_refresh_delete(refresh);
 
-	if (error)
-		g_error_free(error);
+finished:
 
-	g_free(result);
+	return;
 }
 
-static GUPnPServiceProxyAction *prv_get_search_capabilities(
-					msu_service_task_t *task,
-					GUPnPServiceProxy *proxy,
-					gboolean *failed)
+/* Takes over the location and capabilities of priv_t */
+static void prv_refresh_begin(msu_device_t *device, GUPnPServiceProxy *proxy,
+			      prv_new_device_ct_t *priv_t)
 {
-	*failed = FALSE;
+	msu_device_refresh_t *refresh;
 
-	return gupnp_service_proxy_begin_action(
-					proxy, "GetSearchCapabilities",
-					msu_service_task_begin_action_cb,
-					task, NULL);
+	refresh = g_new0(msu_device_refresh_t, 1);
+	refresh->priv_t = *priv_t;
+	refresh->proxy = g_object_ref(proxy);
+
+	priv_t->location = NULL;
+	memset(&priv_t->caps, 0, sizeof(priv_t->caps));
+
+	device->refresh = refresh;
+	prv_refresh_next(refresh);
+}
+
+static void prv_restore_capabilities(prv_new_device_ct_t *priv_t)
+{
+	msu_device_t *device = priv_t->dev;
+	msu_store_caps_t *caps = &priv_t->caps;
+
+	MSU_LOG_DEBUG("Restoring capabilities of %s", device->path);
+
+	if (caps->search_caps)
+		prv_get_capabilities_analyze(priv_t->property_map,
+					     caps->search_caps,
+					     &device->search_caps);
+
+	if (caps->sort_caps)
+		prv_get_capabilities_analyze(priv_t->property_map,
+					     caps->sort_caps,
+					     &device->sort_caps);
+
+	if (caps->sort_ext_caps)
+		prv_get_sort_ext_capabilities_analyze(device,
+						      caps->sort_ext_caps);
+
+	if (caps->feature_list)
+		prv_get_feature_list_analyze(device, caps->feature_list);
+
+	priv_t->restored = TRUE;
 }
 
 static GUPnPServiceProxyAction *prv_subscribe(msu_service_task_t *task,
@@ -867,6 +1830,7 @@ static GUPnPServiceProxyAction *prv_subscribe(msu_service_task_t *task,
 
 	device = msu_service_task_get_device(task);
 	msu_device_subscribe_to_contents_change(device);
+	prv_store_begin_check(device, proxy);
 
 	*failed = FALSE;
 
@@ -907,6 +1871,13 @@ static GUPnPServiceProxyAction *prv_declare(msu_service_task_t *task,
 						g_free,
 						prv_msu_upload_job_delete);
 
+		if (priv_t->restored && proxy)
+			prv_refresh_begin(device, proxy, priv_t);
+		else if (device->store && priv_t->location)
+			msu_store_save_capabilities(device->store,
+						    priv_t->location,
+						    &priv_t->caps);
+
 	} else {
 		MSU_LOG_WARNING("g_dbus_connection_register_subtree FAILED");
 	}
@@ -942,16 +1913,40 @@ msu_device_t *msu_device_new(GDBusConnection *connection,
 	dev->connection = connection;
 	dev->contexts = g_ptr_array_new_with_free_func(prv_msu_context_delete);
 	dev->path = new_path;
+	dev->cache = msu_cache_new();
+	dev->prefetch_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    g_free,
+						    prv_prefetch_delete_cb);
+	dev->store = msu_store_open(gupnp_device_info_get_udn(
+					    (GUPnPDeviceInfo *)proxy));
 
 	priv_t->dev = dev;
 	priv_t->connection = connection;
 	priv_t->vtable = vtable;
 	priv_t->user_data = user_data;
 	priv_t->property_map = property_map;
+	priv_t->location = g_strdup(gupnp_device_info_get_location(
+					    (GUPnPDeviceInfo *)proxy));
 
 	context = msu_device_append_new_context(dev, ip_address, proxy);
 	s_proxy = context->service_proxy;
 
+	/* A server seen before at the same location is declared as soon as
+	   we are subscribed to it, with the capabilities it had then.  They
+	   are refreshed in the background once it is declared. */
+	if (dev->store && priv_t->location &&
+	    msu_store_lookup_capabilities(dev->store, priv_t->location,
+					  &priv_t->caps)) {
+		prv_restore_capabilities(priv_t);
+		goto subscribe;
+	}
+
+	/* The capability probes are independent of each other and are
+	   sent in parallel.  Subscribing acts as a barrier: the server is
+	   only declared once all of them have completed, successfully or
+	   not. */
+	msu_task_queue_set_max_running(queue_id, MSU_DEVICE_MAX_PROBES);
+
 	msu_service_task_add(queue_id, prv_get_search_capabilities,
 			     dev, s_proxy,
 			     prv_get_search_capabilities_cb, NULL, priv_t);
@@ -967,11 +1962,13 @@ msu_device_t *msu_device_new(GDBusConnection *connection,
 	msu_service_task_add(queue_id, prv_get_feature_list, dev, s_proxy,
 			     prv_get_feature_list_cb, NULL, priv_t);
 
-	msu_service_task_add(queue_id, prv_subscribe, dev, s_proxy,
-			     NULL, NULL, NULL);
+subscribe:
+
+	msu_service_task_add_barrier(queue_id, prv_subscribe, dev, s_proxy,
+				     NULL, NULL, NULL);
 
 	msu_service_task_add(queue_id, prv_declare, dev, s_proxy,
-			     NULL, g_free, priv_t);
+			     NULL, prv_new_device_ct_delete, priv_t);
 
 	msu_task_queue_start(queue_id);
 
@@ -987,137 +1984,580 @@ msu_device_context_t *msu_device_append_new_context(msu_device_t *device,
 	prv_msu_context_new(ip_address, proxy, device, &context);
 	g_ptr_array_add(device->contexts, context);
 
-	return context;
-}
+	return context;
+}
+
+msu_device_t *msu_device_from_path(const gchar *path, GHashTable *device_list)
+{
+	GHashTableIter iter;
+	gpointer value;
+	msu_device_t *device;
+	msu_device_t *retval = NULL;
+
+	g_hash_table_iter_init(&iter, device_list);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		device = value;
+
+		if (!strcmp(device->path, path)) {
+			retval = device;
+			break;
+		}
+	}
+
+	return retval;
+}
+
+msu_device_context_t *msu_device_get_context(const msu_device_t *device,
+					     msu_client_t *client)
+{
+	msu_device_context_t *context;
+	unsigned int i;
+	const char ip4_local_prefix[] = "127.0.0.";
+	gboolean prefer_local;
+	gboolean is_local;
+
+	prefer_local = (client && client->prefer_local_addresses);
+
+	for (i = 0; i < device->contexts->len; ++i) {
+		context = g_ptr_array_index(device->contexts, i);
+
+		is_local = (!strncmp(context->ip_address, ip4_local_prefix,
+						sizeof(ip4_local_prefix) - 1) ||
+			    !strcmp(context->ip_address, "::1") ||
+			    !strcmp(context->ip_address, "0:0:0:0:0:0:0:1"));
+
+		if (prefer_local == is_local)
+			break;
+	}
+
+	if (i == device->contexts->len)
+		context = g_ptr_array_index(device->contexts, 0);
+
+	return context;
+}
+
+const gchar *msu_device_get_circuit_state(const msu_device_t *device)
+{
+	const gchar *state;
+
+	switch (device->circuit) {
+	case MSU_DEVICE_CIRCUIT_OPEN:
+		state = "open";
+		break;
+	case MSU_DEVICE_CIRCUIT_HALF_OPEN:
+		state = "half-open";
+		break;
+	default:
+		state = "closed";
+		break;
+	}
+
+	return state;
+}
+
+static void prv_circuit_changed(msu_device_t *device,
+				msu_device_circuit_t circuit)
+{
+	GVariantBuilder *array;
+	GVariant *val;
+
+	if (device->circuit == circuit)
+		goto finished;
+
+	device->circuit = circuit;
+
+	MSU_LOG_INFO("Circuit of %s is %s", device->path,
+		     msu_device_get_circuit_state(device));
+
+	array = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(array, "{sv}",
+			      MSU_INTERFACE_PROP_CIRCUIT_STATE,
+			      g_variant_new_string(
+					msu_device_get_circuit_state(device)));
+	val = g_variant_new("(s@a{sv}as)", MSU_INTERFACE_MEDIA_DEVICE,
+			    g_variant_builder_end(array),
+			    NULL);
+
+	(void) g_dbus_connection_emit_signal(device->connection,
+					     NULL,
+					     device->path,
+					     MSU_INTERFACE_PROPERTIES,
+					     MSU_INTERFACE_PROPERTIES_CHANGED,
+					     val,
+					     NULL);
+
+	g_variant_builder_unref(array);
+
+finished:
+
+	return;
+}
+
+static gboolean prv_circuit_half_open_cb(gpointer user_data);
+
+static void prv_circuit_open(msu_device_t *device)
+{
+	prv_circuit_changed(device, MSU_DEVICE_CIRCUIT_OPEN);
+
+	device->circuit_id = g_timeout_add_seconds(g_cool_down,
+						   prv_circuit_half_open_cb,
+						   device);
+}
+
+static gboolean prv_circuit_probe_timeout_cb(gpointer user_data)
+{
+	msu_device_t *device = user_data;
+
+	MSU_LOG_WARNING("Probe of %s timed out", device->path);
+
+	device->circuit_id = 0;
+	prv_circuit_end_probe(device);
+	prv_circuit_open(device);
+
+	return FALSE;
+}
+
+static void prv_circuit_probe_cb(GUPnPServiceProxy *proxy,
+				 GUPnPServiceProxyAction *action,
+				 gpointer user_data)
+{
+	msu_device_t *device = user_data;
+	GError *upnp_error = NULL;
+	guint id;
+
+	(void) g_source_remove(device->circuit_id);
+	device->circuit_id = 0;
+
+	if (!gupnp_service_proxy_end_action(proxy, action, &upnp_error,
+					    "Id", G_TYPE_UINT, &id,
+					    NULL)) {
+		MSU_LOG_WARNING("Probe of %s failed: %s", device->path,
+				upnp_error->message);
+
+		g_error_free(upnp_error);
+		prv_circuit_open(device);
+	} else {
+		device->failures = 0;
+		prv_circuit_changed(device, MSU_DEVICE_CIRCUIT_CLOSED);
+	}
+
+	device->probe_action = NULL;
+	prv_circuit_end_probe(device);
+}
+
+static gboolean prv_circuit_half_open_cb(gpointer user_data)
+{
+	msu_device_t *device = user_data;
+	msu_device_context_t *context;
+
+	device->circuit_id = 0;
+	prv_circuit_changed(device, MSU_DEVICE_CIRCUIT_HALF_OPEN);
+
+	/* A single probe decides whether the server is usable again.
+	   A probe that is not answered within the cool-down counts as
+	   a failure. */
+	context = msu_device_get_context(device, NULL);
+	device->probe_proxy = g_object_ref(context->service_proxy);
+	device->probe_action = gupnp_service_proxy_begin_action(
+						device->probe_proxy,
+						"GetSystemUpdateID",
+						prv_circuit_probe_cb,
+						device,
+						NULL);
+	device->circuit_id = g_timeout_add_seconds(g_cool_down,
+						   prv_circuit_probe_timeout_cb,
+						   device);
+
+	return FALSE;
+}
+
+void msu_device_set_circuit_limits(guint max_failures, guint cool_down)
+{
+	g_max_failures = max_failures;
+	g_cool_down = MAX(cool_down, MSU_DEVICE_MIN_COOL_DOWN);
+}
+
+void msu_device_record_result(msu_device_t *device, const GError *error,
+			      gboolean server_failed)
+{
+	if (device->circuit != MSU_DEVICE_CIRCUIT_CLOSED ||
+	    !g_max_failures)
+		goto finished;
+
+	/* Only timeouts and transport failures count.  A server that
+	   answers, even with a fault or with results that cannot be
+	   parsed, is alive.  Requests cancelled by their clients are
+	   ignored. */
+	if (server_failed) {
+		device->failures++;
+
+		if (device->failures >= g_max_failures) {
+			MSU_LOG_WARNING("%s failed %u times in a row",
+					device->path, device->failures);
+
+			prv_circuit_open(device);
+		}
+	} else if (!error || error->code != MSU_ERROR_CANCELLED) {
+		device->failures = 0;
+	}
+
+finished:
+
+	return;
+}
+
+gboolean msu_device_is_available(const msu_device_t *device)
+{
+	return device->circuit == MSU_DEVICE_CIRCUIT_CLOSED;
+}
+
+/* Records whether the server, rather than the request, is to blame for
+   an error returned by GUPnP: the server could not be reached or did not
+   return a valid response.  SOAP faults (GUPNP_CONTROL_ERROR) and
+   malformed results (GUPNP_XML_ERROR) are not held against it. */
+static void prv_note_server_error(msu_async_task_t *cb_data,
+				  const GError *error)
+{
+	if (error->domain == GUPNP_SERVER_ERROR ||
+	    error->domain == SOUP_HTTP_ERROR)
+		cb_data->server_failed = TRUE;
+}
+
+static gboolean prv_flight_succeeded(msu_async_task_t *cb_data,
+				     const msu_flight_result_t *result,
+				     const gchar *operation,
+				     gboolean empty_ok)
+{
+	GError *error = result->error;
+
+	if (!error)
+		goto finished;
+
+	if (error->domain != GUPNP_XML_ERROR) {
+		MSU_LOG_WARNING("%s operation failed: %s", operation,
+				error->message);
+
+		prv_note_server_error(cb_data, error);
+
+		cb_data->error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_OPERATION_FAILED,
+					     "%s operation failed: %s",
+					     operation, error->message);
+	} else if (error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
+		MSU_LOG_WARNING("Unable to parse results of %s: %s",
+				operation, error->message);
+
+		cb_data->error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_OPERATION_FAILED,
+					     "Unable to parse results of %s: %s",
+					     operation, error->message);
+	} else if (!empty_ok) {
+		MSU_LOG_WARNING("Property not defined for object");
+
+		cb_data->error = g_error_new(MSU_ERROR,
+					     MSU_ERROR_UNKNOWN_PROPERTY,
+					     "Property not defined for object");
+	}
+
+finished:
+
+	return !cb_data->error;
+}
+
+static void prv_device_decode_delete(msu_device_decode_t *decode)
+{
+	msu_writer_delete(decode->writer);
+	g_ptr_array_unref(decode->counts);
+
+	if (decode->error)
+		g_error_free(decode->error);
+
+	g_free(decode->parent_path);
+	g_free(decode->root_path);
+	msu_matcher_unref(decode->matcher);
+
+	if (decode->objects)
+		g_ptr_array_unref(decode->objects);
+
+	g_free(decode->didl);
+	g_free(decode);
+}
+
+/* parent_path is NULL for the results of a search, whose objects can be
+   anywhere below the target. */
+static const gchar *prv_decode_parent_path(msu_device_decode_t *decode,
+					   const gchar *parent_id,
+					   gchar **path)
+{
+	const gchar *parent_path = decode->parent_path;
+
+	if (parent_path)
+		goto finished;
+
+	if (!parent_id || !strcmp(parent_id, "-1") || !strcmp(parent_id, "")) {
+		parent_path = decode->root_path;
+	} else {
+		*path = msu_path_from_id(decode->root_path, parent_id);
+		parent_path = *path;
+	}
+
+finished:
+
+	return parent_path;
+}
+
+/* Builds the properties of the objects of the streaming decoder, called
+   from a worker thread.  The cached child counts are looked up once the
+   objects are back in the main loop. */
+static void prv_decoded_object(const msu_didl_object_t *object,
+			       gpointer user_data)
+{
+	msu_device_decode_t *decode = user_data;
+	msu_writer_t *writer = decode->writer;
+	const gchar *parent_path;
+	gboolean have_child_count;
+	gchar *path = NULL;
+	guint obj_index;
+
+	if (msu_worker_is_cancelled(decode->job))
+		goto finished;
+
+	if (!(object->container ? decode->containers : decode->items))
+		goto finished;
+
+	parent_path = prv_decode_parent_path(decode, object->parent_id, &path);
+
+	obj_index = msu_writer_begin_object(writer);
+
+	if (!msu_props_add_didl_object(writer, object, decode->root_path,
+				       parent_path, decode->filter_mask)) {
+		msu_writer_drop_object(writer);
+		goto finished;
+	}
+
+	if (object->container) {
+		msu_props_add_didl_container(writer, object,
+					     decode->filter_mask,
+					     &have_child_count);
+
+		if (!have_child_count && (decode->filter_mask &
+					  MSU_UPNP_MASK_PROP_CHILD_COUNT))
+			prv_msu_device_child_count_add(NULL, decode->counts,
+						       obj_index, object->id);
+	} else {
+		msu_props_add_didl_item(writer, object,
+					decode->root_path,
+					decode->filter_mask,
+					decode->matcher);
+	}
+
+finished:
+
+	g_free(path);
+}
+
+/* Counterpart of prv_decoded_object for the GUPnP objects of a flight or
+   of the cache.  Those are shared with other tasks, and with the cache,
+   but are never modified once parsed, so they are only read here. */
+static void prv_converted_object(GUPnPDIDLLiteObject *object,
+				 msu_device_decode_t *decode)
+{
+	msu_writer_t *writer = decode->writer;
+	const gchar *parent_id;
+	const gchar *parent_path;
+	gboolean container;
+	gboolean have_child_count;
+	gchar *path = NULL;
+	guint obj_index;
+
+	container = GUPNP_IS_DIDL_LITE_CONTAINER(object);
+	if (!(container ? decode->containers : decode->items))
+		goto finished;
 
-msu_device_t *msu_device_from_path(const gchar *path, GHashTable *device_list)
-{
-	GHashTableIter iter;
-	gpointer value;
-	msu_device_t *device;
-	msu_device_t *retval = NULL;
+	parent_id = gupnp_didl_lite_object_get_parent_id(object);
+	parent_path = prv_decode_parent_path(decode, parent_id, &path);
 
-	g_hash_table_iter_init(&iter, device_list);
+	obj_index = msu_writer_begin_object(writer);
 
-	while (g_hash_table_iter_next(&iter, NULL, &value)) {
-		device = value;
+	if (!msu_props_add_object(writer, object, decode->root_path,
+				  parent_path, decode->filter_mask)) {
+		msu_writer_drop_object(writer);
+		goto finished;
+	}
 
-		if (!strcmp(device->path, path)) {
-			retval = device;
-			break;
-		}
+	if (container) {
+		msu_props_add_container(writer,
+					(GUPnPDIDLLiteContainer *)object,
+					decode->filter_mask,
+					&have_child_count);
+
+		if (!have_child_count && (decode->filter_mask &
+					  MSU_UPNP_MASK_PROP_CHILD_COUNT))
+			prv_msu_device_child_count_add(
+				NULL, decode->counts, obj_index,
+				gupnp_didl_lite_object_get_id(object));
+	} else {
+		msu_props_add_item(writer, object,
+				   decode->root_path,
+				   decode->filter_mask,
+				   decode->matcher);
 	}
 
-	return retval;
+finished:
+
+	g_free(path);
 }
 
-msu_device_context_t *msu_device_get_context(const msu_device_t *device,
-					     msu_client_t *client)
+static void prv_decode_job(msu_worker_job_t *job, gpointer data)
 {
-	msu_device_context_t *context;
-	unsigned int i;
-	const char ip4_local_prefix[] = "127.0.0.";
-	gboolean prefer_local;
-	gboolean is_local;
-
-	prefer_local = (client && client->prefer_local_addresses);
+	msu_device_decode_t *decode = data;
+	guint i;
 
-	for (i = 0; i < device->contexts->len; ++i) {
-		context = g_ptr_array_index(device->contexts, i);
+	decode->job = job;
 
-		is_local = (!strncmp(context->ip_address, ip4_local_prefix,
-						sizeof(ip4_local_prefix) - 1) ||
-			    !strcmp(context->ip_address, "::1") ||
-			    !strcmp(context->ip_address, "0:0:0:0:0:0:0:1"));
+	if (!decode->objects) {
+		(void) msu_didl_decode(decode->didl, decode->filter_mask,
+				       prv_decoded_object, decode,
+				       &decode->error);
+		goto finished;
+	}
 
-		if (prefer_local == is_local)
+	for (i = 0; i < decode->objects->len; ++i) {
+		if (msu_worker_is_cancelled(job))
 			break;
+
+		prv_converted_object(g_ptr_array_index(decode->objects, i),
+				     decode);
 	}
 
-	if (i == device->contexts->len)
-		context = g_ptr_array_index(device->contexts, 0);
+finished:
 
-	return context;
+	return;
 }
 
-static void prv_found_child(GUPnPDIDLLiteParser *parser,
-			    GUPnPDIDLLiteObject *object,
-			    gpointer user_data)
+static void prv_decode_done(gboolean cancelled, gpointer data)
 {
-	msu_async_task_t *cb_data = user_data;
-	msu_task_t *task = &cb_data->task;
-	msu_task_get_children_t *task_data = &task->ut.get_children;
-	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	msu_device_object_builder_t *builder;
-	gboolean have_child_count;
-
-	MSU_LOG_DEBUG("Enter");
+	msu_device_decode_t *decode = data;
+	msu_async_task_t *cb_data = decode->cb_data;
+	msu_async_bas_t *cb_task_data;
+	msu_device_child_count_t *child_count;
+	msu_flight_result_t result;
+	guint i;
 
-	builder = g_new0(msu_device_object_builder_t, 1);
+	/* The task has been cancelled and may already be deleted. */
+	if (cancelled)
+		goto finished;
 
-	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
-		if (!task_data->containers)
-			goto on_error;
-	} else {
-		if (!task_data->items)
-			goto on_error;
-	}
+	cb_task_data = &cb_data->ut.bas;
+	cb_data->job = NULL;
 
-	builder->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+	memset(&result, 0, sizeof(result));
+	result.error = decode->error;
 
-	if (!msu_props_add_object(builder->vb, object, task->target.root_path,
-				  task->target.path, cb_task_data->filter_mask))
+	if (!prv_flight_succeeded(cb_data, &result, decode->operation, TRUE))
 		goto on_error;
 
-	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
-		msu_props_add_container(builder->vb,
-					(GUPnPDIDLLiteContainer *)object,
-					cb_task_data->filter_mask,
-					&have_child_count);
-
-		if (!have_child_count && (cb_task_data->filter_mask &
-					  MSU_UPNP_MASK_PROP_CHILD_COUNT)) {
-			builder->needs_child_count = TRUE;
-			builder->id = g_strdup(
-				gupnp_didl_lite_object_get_id(object));
-			cb_task_data->need_child_count = TRUE;
-		}
-	} else {
-		msu_props_add_item(builder->vb, object,
-				   task->target.root_path,
-				   cb_task_data->filter_mask,
-				   cb_task_data->protocol_info);
-	}
+	for (i = 0; i < decode->counts->len; ++i) {
+		child_count = g_ptr_array_index(decode->counts, i);
 
-	g_ptr_array_add(cb_task_data->vbs, builder);
+		msu_writer_reopen_object(decode->writer, child_count->object);
+		if (prv_add_cached_child_count(cb_data->task.target.device,
+					       child_count->id,
+					       decode->writer))
+			continue;
 
-	MSU_LOG_DEBUG("Exit with SUCCESS");
+		prv_msu_device_child_count_add(cb_data->task.arena,
+					       cb_task_data->counts,
+					       child_count->object,
+					       child_count->id);
+		cb_task_data->need_child_count = TRUE;
+	}
 
-	return;
+	msu_writer_delete(cb_task_data->writer);
+	cb_task_data->writer = decode->writer;
+	decode->writer = NULL;
 
 on_error:
 
-	prv_msu_device_object_builder_delete(builder);
+	decode->end(cb_data);
 
-	MSU_LOG_DEBUG("Exit with FAIL");
+finished:
+
+	prv_device_decode_delete(decode);
 }
 
-static GVariant *prv_children_result_to_variant(msu_async_task_t *cb_data)
+static msu_device_decode_t *prv_device_decode_new(msu_async_task_t *cb_data,
+						  const gchar *operation,
+						  const gchar *parent_path,
+						  msu_async_cb_t end)
 {
-	guint i;
-	msu_device_object_builder_t *builder;
+	msu_task_t *task = &cb_data->task;
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	GVariantBuilder vb;
+	msu_device_decode_t *decode;
+
+	decode = g_new0(msu_device_decode_t, 1);
+	decode->cb_data = cb_data;
+	decode->operation = operation;
+	decode->end = end;
+	decode->filter_mask = cb_task_data->filter_mask;
+	decode->matcher = msu_matcher_ref(cb_task_data->matcher);
+	decode->root_path = g_strdup(task->target.root_path);
+	decode->parent_path = g_strdup(parent_path);
+	decode->writer = msu_writer_new();
+	decode->counts = g_ptr_array_new_with_free_func(
+		prv_msu_device_child_count_delete);
+
+	if (task->type == MSU_TASK_GET_CHILDREN) {
+		decode->containers = task->ut.get_children.containers;
+		decode->items = task->ut.get_children.items;
+	} else {
+		decode->containers = TRUE;
+		decode->items = TRUE;
+	}
+
+	return decode;
+}
+
+/* Results are decoded by the streaming decoder, with the task's filter,
+   instead of being parsed into GUPnPDIDLLiteObjects by the flight.  The
+   objects are built by a worker thread, so that large results do not
+   hold up the main loop. */
+static void prv_decode_start(msu_async_task_t *cb_data,
+			     const msu_flight_result_t *result,
+			     const gchar *operation,
+			     const gchar *parent_path,
+			     msu_async_cb_t end)
+{
+	msu_device_decode_t *decode;
 
-	g_variant_builder_init(&vb, G_VARIANT_TYPE("aa{sv}"));
+	decode = prv_device_decode_new(cb_data, operation, parent_path, end);
+	decode->didl = g_strdup(result->didl);
 
-	for (i = 0; i < cb_task_data->vbs->len; ++i) {
-		builder = g_ptr_array_index(cb_task_data->vbs, i);
-		g_variant_builder_add(&vb, "@a{sv}",
-				      g_variant_builder_end(builder->vb));
-	}
+	cb_data->job = msu_worker_push(prv_decode_job, prv_decode_done,
+				       decode);
+}
+
+/* The properties of GUPnPDIDLLiteObjects, parsed by a flight or kept by
+   the cache, are built by a worker thread too, in a writer of the job's
+   own. */
+static void prv_convert_start(msu_async_task_t *cb_data, GPtrArray *objects,
+			      const gchar *operation,
+			      const gchar *parent_path,
+			      msu_async_cb_t end)
+{
+	msu_device_decode_t *decode;
+
+	decode = prv_device_decode_new(cb_data, operation, parent_path, end);
+	decode->objects = g_ptr_array_ref(objects);
 
-	return  g_variant_builder_end(&vb);
+	cb_data->job = msu_worker_push(prv_decode_job, prv_decode_done,
+				       decode);
+}
+
+static GVariant *prv_children_result_to_variant(msu_async_task_t *cb_data)
+{
+	return msu_writer_end(cb_data->ut.bas.writer);
 }
 
 static void prv_get_search_ex_result(msu_async_task_t *cb_data)
@@ -1139,113 +2579,124 @@ static void prv_get_children_result(msu_async_task_t *cb_data)
 }
 
 static gboolean prv_child_count_for_list_cb(msu_async_task_t *cb_data,
-					    gint count)
+					    gint count, gpointer user_data)
 {
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	msu_device_object_builder_t *builder;
+	msu_device_child_count_t *child_count = user_data;
 
-	builder = g_ptr_array_index(cb_task_data->vbs, cb_task_data->retrieved);
-	msu_props_add_child_count(builder->vb, count);
-	cb_task_data->retrieved++;
-	prv_retrieve_child_count_for_list(cb_data);
+	msu_writer_reopen_object(cb_task_data->writer, child_count->object);
+	msu_props_add_child_count(cb_task_data->writer, count);
+	cb_task_data->pending--;
 
-	return cb_task_data->retrieved >= cb_task_data->vbs->len;
+	return prv_retrieve_child_count_for_list(cb_data);
 }
 
-static void prv_retrieve_child_count_for_list(msu_async_task_t *cb_data)
+/* Up to MSU_DEVICE_MAX_CHILD_COUNTS Browse requests are kept in progress
+   until all the missing child counts have been retrieved.  Returns TRUE
+   once the result has been built. */
+static gboolean prv_retrieve_child_count_for_list(msu_async_task_t *cb_data)
 {
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	msu_device_object_builder_t *builder;
-	guint i;
+	msu_device_child_count_t *child_count;
+	gboolean done = FALSE;
 
-	for (i = cb_task_data->retrieved; i < cb_task_data->vbs->len; ++i) {
-		builder = g_ptr_array_index(cb_task_data->vbs, i);
+	while (cb_task_data->pending < MSU_DEVICE_MAX_CHILD_COUNTS &&
+	       cb_task_data->retrieved < cb_task_data->counts->len) {
+		child_count = g_ptr_array_index(cb_task_data->counts,
+						cb_task_data->retrieved);
+		cb_task_data->retrieved++;
 
-		if (builder->needs_child_count)
-			break;
+		cb_task_data->pending++;
+		prv_get_child_count(cb_data, prv_child_count_for_list_cb,
+				    child_count->id, child_count);
 	}
 
-	cb_task_data->retrieved = i;
+	if (cb_task_data->pending)
+		goto finished;
 
-	if (i < cb_task_data->vbs->len)
-		prv_get_child_count(cb_data, prv_child_count_for_list_cb,
-				    builder->id);
-	else
-		cb_task_data->get_children_cb(cb_data);
+	cb_task_data->get_children_cb(cb_data);
+	done = TRUE;
+
+finished:
+
+	return done;
 }
 
-static void prv_get_children_cb(GUPnPServiceProxy *proxy,
-				GUPnPServiceProxyAction *action,
-				gpointer user_data)
+static void prv_get_children_end(msu_async_task_t *cb_data)
 {
-	gchar *result = NULL;
-	GUPnPDIDLLiteParser *parser = NULL;
-	GError *upnp_error = NULL;
-	msu_async_task_t *cb_data = user_data;
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
 
-	MSU_LOG_DEBUG("Enter");
-
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result, NULL)) {
-		MSU_LOG_WARNING("Browse operation failed: %s",
-				upnp_error->message);
-
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Browse operation failed: %s",
-					     upnp_error->message);
-		goto on_error;
-	}
-
-	MSU_LOG_DEBUG("GetChildren result: %s", result);
-
-	parser = gupnp_didl_lite_parser_new();
-
-	g_signal_connect(parser, "object-available" ,
-			 G_CALLBACK(prv_found_child), cb_data);
-
-	cb_task_data->vbs = g_ptr_array_new_with_free_func(
-		prv_msu_device_object_builder_delete);
-
-	if (!gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error) &&
-	    upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
-		MSU_LOG_WARNING("Unable to parse results of browse: %s",
-				upnp_error->message);
+	if (cb_data->error)
+		goto on_complete;
 
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Unable to parse results of browse: %s",
-					     upnp_error->message);
-		goto on_error;
-	}
+	prv_prefetch_schedule(cb_data);
 
 	if (cb_task_data->need_child_count) {
 		MSU_LOG_DEBUG("Need to retrieve ChildCounts");
 
 		cb_task_data->get_children_cb = prv_get_children_result;
-		prv_retrieve_child_count_for_list(cb_data);
-		goto no_complete;
+		if (!prv_retrieve_child_count_for_list(cb_data))
+			goto no_complete;
 	} else {
 		prv_get_children_result(cb_data);
 	}
 
-on_error:
+on_complete:
 
 	(void) g_idle_add(msu_async_task_complete, cb_data);
 	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
 
 no_complete:
 
-	if (upnp_error)
-		g_error_free(upnp_error);
+	return;
+}
 
-	if (parser)
-		g_object_unref(parser);
+static void prv_get_children_cb(msu_flight_waiter_t *waiter,
+				const msu_flight_result_t *result,
+				gpointer user_data)
+{
+	msu_async_task_t *cb_data = user_data;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
+	msu_task_t *task = &cb_data->task;
 
-	g_free(result);
+	MSU_LOG_DEBUG("Enter");
+
+	msu_async_task_flight_landed(cb_data, waiter);
+
+	prv_bas_results_new(cb_task_data);
+
+	if (!prv_flight_succeeded(cb_data, result, "Browse", TRUE))
+		goto on_error;
+
+	cb_task_data->max_count = result->total_matches;
+	prv_cache_add_child_count(task->target.device, task->target.id, result);
+
+	if (cb_task_data->streaming) {
+		prv_decode_start(cb_data, result, "Browse", task->target.path,
+				 prv_get_children_end);
+		goto finished;
+	}
+
+	/* The page is cached before its objects are converted, which
+	   only reads them. */
+	if (prv_cache_pages(task->target.device))
+		msu_cache_add_page(task->target.device->cache, task->target.id,
+				   cb_task_data->upnp_filter,
+				   cb_task_data->sort_by,
+				   task->ut.get_children.start,
+				   task->ut.get_children.count,
+				   result->update_id, result->total_matches,
+				   g_ptr_array_ref(result->objects));
+
+	prv_convert_start(cb_data, result->objects, "Browse",
+			  task->target.path, prv_get_children_end);
+	goto finished;
+
+on_error:
+
+	prv_get_children_end(cb_data);
+
+finished:
 
 	MSU_LOG_DEBUG("Exit");
 }
@@ -1255,33 +2706,47 @@ void msu_device_get_children(msu_client_t *client,
 			     const gchar *upnp_filter, const gchar *sort_by)
 {
 	msu_async_task_t *cb_data = (msu_async_task_t *)task;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
 	msu_device_context_t *context;
+	const msu_cache_page_t *page = NULL;
+	msu_flight_waiter_t *flight;
 
 	MSU_LOG_DEBUG("Enter");
 
 	context = msu_device_get_context(task->target.device, client);
 
-	cb_data->action =
-		gupnp_service_proxy_begin_action(context->service_proxy,
-						 "Browse",
-						 prv_get_children_cb,
-						 cb_data,
-						 "ObjectID", G_TYPE_STRING,
-						 task->target.id,
-
-						 "BrowseFlag", G_TYPE_STRING,
-						 "BrowseDirectChildren",
-
-						 "Filter", G_TYPE_STRING,
-						 upnp_filter,
+	cb_task_data->upnp_filter = msu_arena_strdup(task->arena, upnp_filter);
+	cb_task_data->sort_by = msu_arena_strdup(task->arena, sort_by);
+
+	if (client->read_ahead)
+		cb_task_data->read_ahead = prv_is_paging(client, task);
+
+	/* The objects of the pages of servers we are subscribed to are
+	   needed by the cache. */
+	cb_task_data->streaming = client->streaming_didl &&
+		!prv_device_subscribed(task->target.device);
+
+	/* Pages are only cached while we are subscribed to a server that
+	   events the UpdateIDs of its containers, so they are removed as
+	   soon as the container's UpdateID changes. */
+	page = prv_cache_lookup_page(task->target.device, task->target.id,
+				     upnp_filter, sort_by,
+				     task->ut.get_children.start,
+				     task->ut.get_children.count);
+
+	if (!page) {
+		flight = msu_flight_browse(context->service_proxy,
+					   task->target.id,
+					   "BrowseDirectChildren",
+					   upnp_filter,
+					   task->ut.get_children.start,
+					   task->ut.get_children.count,
+					   sort_by, cb_task_data->streaming,
+					   prv_get_children_cb, cb_data, NULL);
+		msu_async_task_add_flight(cb_data, flight);
+	}
 
-						 "StartingIndex", G_TYPE_INT,
-						 task->ut.get_children.start,
-						 "RequestedCount", G_TYPE_INT,
-						 task->ut.get_children.count,
-						 "SortCriteria", G_TYPE_STRING,
-						 sort_by,
-						 NULL);
+	prv_prefetch_check(cb_data, page);
 
 	cb_data->proxy = context->service_proxy;
 
@@ -1293,6 +2758,16 @@ void msu_device_get_children(msu_client_t *client,
 					G_CALLBACK(msu_async_task_cancelled_cb),
 					cb_data, NULL);
 
+	/* The page may be evicted from the cache while its objects are
+	   converted, so the job references them. */
+	if (page) {
+		cb_task_data->max_count = page->total_matches;
+		prv_bas_results_new(cb_task_data);
+
+		prv_convert_start(cb_data, page->objects, "Browse",
+				  task->target.path, prv_get_children_end);
+	}
+
 	MSU_LOG_DEBUG("Exit");
 }
 
@@ -1304,10 +2779,10 @@ static void prv_get_item(GUPnPDIDLLiteParser *parser,
 	msu_async_get_all_t *cb_task_data = &cb_data->ut.get_all;
 
 	if (!GUPNP_IS_DIDL_LITE_CONTAINER(object))
-		msu_props_add_item(cb_task_data->vb, object,
+		msu_props_add_item(cb_task_data->writer, object,
 				   cb_data->task.target.root_path,
 				   MSU_UPNP_MASK_ALL_PROPS,
-				   cb_task_data->protocol_info);
+				   cb_task_data->matcher);
 	else
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_UNKNOWN_INTERFACE,
@@ -1323,11 +2798,15 @@ static void prv_get_container(GUPnPDIDLLiteParser *parser,
 	gboolean have_child_count;
 
 	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
-		msu_props_add_container(cb_task_data->vb,
+		msu_props_add_container(cb_task_data->writer,
 					(GUPnPDIDLLiteContainer *)object,
 					MSU_UPNP_MASK_ALL_PROPS,
 					&have_child_count);
-		if (!have_child_count)
+		if (!have_child_count && !prv_add_cached_child_count(
+						cb_data->task.target.device,
+						gupnp_didl_lite_object_get_id(
+							object),
+						cb_task_data->writer))
 			cb_task_data->need_child_count = TRUE;
 	} else {
 		cb_data->error = g_error_new(MSU_ERROR,
@@ -1355,7 +2834,7 @@ static void prv_get_object(GUPnPDIDLLiteParser *parser,
 		parent_path = path;
 	}
 
-	if (!msu_props_add_object(cb_task_data->vb, object,
+	if (!msu_props_add_object(cb_task_data->writer, object,
 				  cb_data->task.target.root_path,
 				  parent_path, MSU_UPNP_MASK_ALL_PROPS))
 		cb_data->error = g_error_new(MSU_ERROR, MSU_ERROR_BAD_RESULT,
@@ -1376,18 +2855,22 @@ static void prv_get_all(GUPnPDIDLLiteParser *parser,
 	if (!cb_data->error) {
 		if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
 			msu_props_add_container(
-				cb_task_data->vb,
+				cb_task_data->writer,
 				(GUPnPDIDLLiteContainer *)
 				object, MSU_UPNP_MASK_ALL_PROPS,
 				&have_child_count);
-			if (!have_child_count)
+			if (!have_child_count && !prv_add_cached_child_count(
+						cb_data->task.target.device,
+						gupnp_didl_lite_object_get_id(
+							object),
+						cb_task_data->writer))
 				cb_task_data->need_child_count = TRUE;
 		} else {
-			msu_props_add_item(cb_task_data->vb,
+			msu_props_add_item(cb_task_data->writer,
 					   object,
 					   cb_data->task.target.root_path,
 					   MSU_UPNP_MASK_ALL_PROPS,
-					   cb_task_data->protocol_info);
+					   cb_task_data->matcher);
 		}
 	}
 }
@@ -1427,6 +2910,8 @@ static void prv_system_update_id_for_prop_cb(GUPnPServiceProxy *proxy,
 				g_quark_to_string(upnp_error->domain),
 				upnp_error->message);
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(
 				   MSU_ERROR,
 				   MSU_ERROR_OPERATION_FAILED,
@@ -1507,6 +2992,8 @@ static void prv_system_update_id_for_props_cb(GUPnPServiceProxy *proxy,
 				g_quark_to_string(upnp_error->domain),
 				upnp_error->message);
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 				   MSU_ERROR_OPERATION_FAILED,
 				   "Unable to retrieve ServiceUpdateID: %s",
@@ -1515,12 +3002,11 @@ static void prv_system_update_id_for_props_cb(GUPnPServiceProxy *proxy,
 		goto on_complete;
 	}
 
-	g_variant_builder_add(cb_task_data->vb, "{sv}",
-			      MSU_SYSTEM_UPDATE_VAR,
-			      g_variant_new_uint32(id));
+	msu_writer_add_uint32(cb_task_data->writer, MSU_SYSTEM_UPDATE_VAR,
+			      id);
 
-	cb_data->task.result = g_variant_ref_sink(g_variant_builder_end(
-							cb_task_data->vb));
+	cb_data->task.result = g_variant_ref_sink(
+				msu_writer_end_object(cb_task_data->writer));
 
 on_complete:
 
@@ -1553,9 +3039,8 @@ static void prv_get_system_update_id_for_props(GUPnPServiceProxy *proxy,
 
 		cb_task_data = &cb_data->ut.get_all;
 
-		g_variant_builder_add(cb_task_data->vb, "{sv}",
-				      MSU_SYSTEM_UPDATE_VAR,
-				      g_variant_new_uint32(suid));
+		msu_writer_add_uint32(cb_task_data->writer,
+				      MSU_SYSTEM_UPDATE_VAR, suid);
 
 		prv_get_sr_token_for_props(proxy, device, cb_data);
 
@@ -1624,6 +3109,8 @@ static void prv_service_reset_for_prop_cb(GUPnPServiceProxy *proxy,
 				upnp_error->message);
 
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "GetServiceResetToken failed: %s",
@@ -1704,6 +3191,8 @@ static void prv_service_reset_for_props_cb(GUPnPServiceProxy *proxy,
 				g_quark_to_string(upnp_error->domain),
 				upnp_error->message);
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "GetServiceResetToken failed: %s",
@@ -1713,12 +3202,12 @@ static void prv_service_reset_for_props_cb(GUPnPServiceProxy *proxy,
 	}
 
 	cb_task_data = &cb_data->ut.get_all;
-	g_variant_builder_add(cb_task_data->vb, "{sv}",
+	msu_writer_add_string(cb_task_data->writer,
 			      MSU_INTERFACE_PROP_SV_SERVICE_RESET_TOKEN,
-			      g_variant_new_string(token));
+			      token);
 
-	cb_data->task.result = g_variant_ref_sink(g_variant_builder_end(
-							cb_task_data->vb));
+	cb_data->task.result = g_variant_ref_sink(
+				msu_writer_end_object(cb_task_data->writer));
 
 	MSU_LOG_DEBUG("Service Reset %s", token);
 
@@ -1746,8 +3235,8 @@ static void prv_get_sr_token_for_props(GUPnPServiceProxy *proxy,
 	if (prv_get_media_server_version(device) < 3) {
 		cb_task_data = &cb_data->ut.get_all;
 
-		cb_data->task.result = g_variant_ref_sink(g_variant_builder_end(
-							cb_task_data->vb));
+		cb_data->task.result = g_variant_ref_sink(
+				msu_writer_end_object(cb_task_data->writer));
 
 		goto on_complete; /* No error here, just skip the property */
 	}
@@ -1779,112 +3268,90 @@ on_complete:
 }
 
 static gboolean prv_get_all_child_count_cb(msu_async_task_t *cb_data,
-				       gint count)
+				       gint count, gpointer user_data)
 {
 	msu_async_get_all_t *cb_task_data = &cb_data->ut.get_all;
 
-	msu_props_add_child_count(cb_task_data->vb, count);
+	msu_props_add_child_count(cb_task_data->writer, count);
 	if (cb_task_data->device_object)
 		prv_get_system_update_id_for_props(cb_data->proxy,
 						   cb_data->task.target.device,
 						   cb_data);
 	else
-		cb_data->task.result = g_variant_ref_sink(g_variant_builder_end(
-							cb_task_data->vb));
+		cb_data->task.result = g_variant_ref_sink(
+				msu_writer_end_object(cb_task_data->writer));
 
 	return !cb_task_data->device_object;
 }
 
-static void prv_get_all_ms2spec_props_cb(GUPnPServiceProxy *proxy,
-					 GUPnPServiceProxyAction *action,
-					 gpointer user_data)
+static void prv_get_all_ms2spec_props_end(msu_async_task_t *cb_data)
 {
-	GError *upnp_error = NULL;
-	gchar *result = NULL;
-	GUPnPDIDLLiteParser *parser = NULL;
-	msu_async_task_t *cb_data = user_data;
 	msu_async_get_all_t *cb_task_data = &cb_data->ut.get_all;
 
-	MSU_LOG_DEBUG("Enter");
-
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result, NULL)) {
-		MSU_LOG_WARNING("Browse operation failed: %s",
-				upnp_error->message);
-
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Browse operation failed: %s",
-					     upnp_error->message);
-		goto on_error;
-	}
-
-	MSU_LOG_DEBUG("GetMS2SpecProps result: %s", result);
-
-	parser = gupnp_didl_lite_parser_new();
-
-	g_signal_connect(parser, "object-available" , cb_task_data->prop_func,
-			 cb_data);
-
-	if (!gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error)) {
-		if (upnp_error->code == GUPNP_XML_ERROR_EMPTY_NODE) {
-			MSU_LOG_WARNING("Property not defined for object");
-
-			cb_data->error =
-				g_error_new(MSU_ERROR,
-					    MSU_ERROR_UNKNOWN_PROPERTY,
-					    "Property not defined for object");
-		} else {
-			MSU_LOG_WARNING("Unable to parse results of browse: %s",
-					upnp_error->message);
-
-			cb_data->error =
-				g_error_new(MSU_ERROR,
-					    MSU_ERROR_OPERATION_FAILED,
-					    "Unable to parse results of browse: %s",
-					    upnp_error->message);
-		}
-		goto on_error;
-	}
-
 	if (cb_data->error)
-		goto on_error;
+		goto on_complete;
 
 	if (cb_task_data->need_child_count) {
 		MSU_LOG_DEBUG("Need Child Count");
 
 		prv_get_child_count(cb_data, prv_get_all_child_count_cb,
-				    cb_data->task.target.id);
+				    cb_data->task.target.id, NULL);
 
 		goto no_complete;
 	} else if (cb_data->task.type == MSU_TASK_GET_ALL_PROPS &&
 						cb_task_data->device_object) {
-		prv_get_system_update_id_for_props(proxy,
+		prv_get_system_update_id_for_props(cb_data->proxy,
 						   cb_data->task.target.device,
 						   cb_data);
 
 		goto no_complete;
 	} else {
-		cb_data->task.result = g_variant_ref_sink(g_variant_builder_end(
-							cb_task_data->vb));
+		cb_data->task.result = g_variant_ref_sink(
+				msu_writer_end_object(cb_task_data->writer));
 	}
 
-on_error:
+on_complete:
 
 	(void) g_idle_add(msu_async_task_complete, cb_data);
 	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
 
 no_complete:
 
-	if (upnp_error)
-		g_error_free(upnp_error);
+	return;
+}
 
-	if (parser)
-		g_object_unref(parser);
+static void prv_get_all_ms2spec_props_cb(msu_flight_waiter_t *waiter,
+					 const msu_flight_result_t *result,
+					 gpointer user_data)
+{
+	msu_async_task_t *cb_data = user_data;
+	msu_async_get_all_t *cb_task_data = &cb_data->ut.get_all;
+	msu_device_object_cb_t prop_func;
+	GUPnPDIDLLiteObject *object;
+	guint i;
+
+	MSU_LOG_DEBUG("Enter");
+
+	msu_async_task_flight_landed(cb_data, waiter);
+
+	if (!prv_flight_succeeded(cb_data, result, "Browse", FALSE))
+		goto on_error;
+
+	prop_func = (msu_device_object_cb_t)cb_task_data->prop_func;
+
+	for (i = 0; i < result->objects->len; ++i) {
+		object = g_ptr_array_index(result->objects, i);
+		prop_func(NULL, object, cb_data);
+
+		/* Only GetAll asks for all the properties of the object */
+		if (cb_data->task.type == MSU_TASK_GET_ALL_PROPS)
+			prv_cache_add_object(cb_data->task.target.device,
+					     object);
+	}
+
+on_error:
 
-	g_free(result);
+	prv_get_all_ms2spec_props_end(cb_data);
 
 	MSU_LOG_DEBUG("Exit");
 }
@@ -1895,6 +3362,9 @@ static void prv_get_all_ms2spec_props(msu_device_context_t *context,
 	msu_async_get_all_t *cb_task_data = &cb_data->ut.get_all;
 	msu_task_t *task = &cb_data->task;
 	msu_task_get_props_t *task_data = &task->ut.get_props;
+	GUPnPDIDLLiteObject *object;
+	msu_device_object_cb_t prop_func;
+	msu_flight_waiter_t *flight;
 
 	MSU_LOG_DEBUG("Enter called");
 
@@ -1917,16 +3387,16 @@ static void prv_get_all_ms2spec_props(msu_device_context_t *context,
 		goto on_error;
 	}
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-				context->service_proxy, "Browse",
-				prv_get_all_ms2spec_props_cb, cb_data,
-				"ObjectID", G_TYPE_STRING, task->target.id,
-				"BrowseFlag", G_TYPE_STRING, "BrowseMetadata",
-				"Filter", G_TYPE_STRING, "*",
-				"StartingIndex", G_TYPE_INT, 0,
-				"RequestedCount", G_TYPE_INT, 0,
-				"SortCriteria", G_TYPE_STRING,
-				"", NULL);
+	object = prv_cache_lookup_object(task->target.device, task->target.id);
+
+	if (!object) {
+		flight = msu_flight_browse(context->service_proxy,
+					   task->target.id, "BrowseMetadata",
+					   "*", 0, 0, "", FALSE,
+					   prv_get_all_ms2spec_props_cb, cb_data,
+					   NULL);
+		msu_async_task_add_flight(cb_data, flight);
+	}
 
 	cb_data->proxy = context->service_proxy;
 
@@ -1938,6 +3408,13 @@ static void prv_get_all_ms2spec_props(msu_device_context_t *context,
 					G_CALLBACK(msu_async_task_cancelled_cb),
 					cb_data, NULL);
 
+	if (object) {
+		prop_func = (msu_device_object_cb_t)cb_task_data->prop_func;
+		prop_func(NULL, object, cb_data);
+		g_object_unref(object);
+		prv_get_all_ms2spec_props_end(cb_data);
+	}
+
 	MSU_LOG_DEBUG("Exit with SUCCESS");
 
 	return;
@@ -1965,15 +3442,15 @@ void msu_device_get_all_props(msu_client_t *client,
 	context = msu_device_get_context(task->target.device, client);
 	cb_task_data = &cb_data->ut.get_all;
 
-	cb_task_data->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+	cb_task_data->writer = msu_writer_new();
+	(void) msu_writer_begin_object(cb_task_data->writer);
 	cb_task_data->device_object = root_object;
 
 	if (!strcmp(task_data->interface_name, MSU_INTERFACE_MEDIA_DEVICE)) {
 		if (root_object) {
-			msu_props_add_device(
-				(GUPnPDeviceInfo *)context->device_proxy,
-				task->target.device,
-				cb_task_data->vb);
+			msu_props_add_device(prv_get_device_props(context),
+					     task->target.device,
+					     cb_task_data->writer);
 
 			prv_get_system_update_id_for_props(
 							context->service_proxy,
@@ -1993,10 +3470,9 @@ void msu_device_get_all_props(msu_client_t *client,
 		prv_get_all_ms2spec_props(context, cb_data);
 	} else {
 		if (root_object)
-			msu_props_add_device(
-				(GUPnPDeviceInfo *)context->device_proxy,
-				task->target.device,
-				cb_task_data->vb);
+			msu_props_add_device(prv_get_device_props(context),
+					     task->target.device,
+					     cb_task_data->writer);
 
 		prv_get_all_ms2spec_props(context, cb_data);
 	}
@@ -2040,7 +3516,7 @@ static void prv_get_item_property(GUPnPDIDLLiteParser *parser,
 						task_data->prop_name,
 						task->target.root_path,
 						object,
-						cb_task_data->protocol_info);
+						cb_task_data->matcher);
 
 on_error:
 
@@ -2089,7 +3565,7 @@ on_error:
 }
 
 static gboolean prv_get_child_count_cb(msu_async_task_t *cb_data,
-				   gint count)
+				   gint count, gpointer user_data)
 {
 	MSU_LOG_DEBUG("Enter");
 
@@ -2103,141 +3579,74 @@ static gboolean prv_get_child_count_cb(msu_async_task_t *cb_data,
 	return TRUE;
 }
 
-static void prv_count_children_cb(GUPnPServiceProxy *proxy,
-				  GUPnPServiceProxyAction *action,
+static void prv_count_children_cb(msu_flight_waiter_t *waiter,
+				  const msu_flight_result_t *result,
 				  gpointer user_data)
 {
 	msu_device_count_data_t *count_data = user_data;
 	msu_async_task_t *cb_data = count_data->cb_data;
-	GError *upnp_error = NULL;
-	gint count;
 	gboolean complete = FALSE;
 
 	MSU_LOG_DEBUG("Enter");
 
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "TotalMatches", G_TYPE_INT,
-					    &count,
-					    NULL)) {
+	msu_async_task_flight_landed(cb_data, waiter);
+
+	/* Only TotalMatches is needed, the DIDL does not matter. */
+	if (result->error && result->error->domain != GUPNP_XML_ERROR) {
 		MSU_LOG_WARNING("Browse operation failed: %s",
-				upnp_error->message);
+				result->error->message);
+
+		prv_note_server_error(cb_data, result->error);
 
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "Browse operation failed: %s",
-					     upnp_error->message);
+					     result->error->message);
 		goto on_error;
 	}
 
-	complete = count_data->cb(cb_data, count);
+	prv_cache_add_child_count(cb_data->task.target.device, count_data->id,
+				  result);
 
-on_error:
+	complete = count_data->cb(cb_data, result->total_matches,
+				  count_data->user_data);
 
-	g_free(user_data);
+on_error:
 
 	if (cb_data->error || complete) {
+		msu_async_task_cancel_flights(cb_data);
 		(void) g_idle_add(msu_async_task_complete, cb_data);
 		g_cancellable_disconnect(cb_data->cancellable,
 					 cb_data->cancel_id);
 	}
 
-	if (upnp_error)
-		g_error_free(upnp_error);
-
 	MSU_LOG_DEBUG("Exit");
 }
 
 static void prv_get_child_count(msu_async_task_t *cb_data,
-				msu_device_count_cb_t cb, const gchar *id)
+				msu_device_count_cb_t cb, const gchar *id,
+				gpointer user_data)
 {
 	msu_device_count_data_t *count_data;
+	msu_flight_waiter_t *flight;
 
 	MSU_LOG_DEBUG("Enter");
 
-	prv_msu_device_count_data_new(cb_data, cb, &count_data);
-	cb_data->action =
-		gupnp_service_proxy_begin_action(cb_data->proxy,
-						 "Browse",
-						 prv_count_children_cb,
-						 count_data,
-						 "ObjectID", G_TYPE_STRING, id,
-
-						 "BrowseFlag", G_TYPE_STRING,
-						 "BrowseDirectChildren",
-
-						 "Filter", G_TYPE_STRING, "",
-
-						 "StartingIndex", G_TYPE_INT,
-						 0,
-
-						 "RequestedCount", G_TYPE_INT,
-						 1,
-
-						 "SortCriteria", G_TYPE_STRING,
-						 "",
-
-						 NULL);
+	prv_msu_device_count_data_new(cb_data, cb, id, user_data, &count_data);
+	flight = msu_flight_browse(cb_data->proxy, id, "BrowseDirectChildren",
+				   "", 0, 1, "", TRUE, prv_count_children_cb,
+				   count_data, prv_msu_device_count_data_delete);
+	msu_async_task_add_flight(cb_data, flight);
 
 	MSU_LOG_DEBUG("Exit with SUCCESS");
 }
 
-static void prv_get_ms2spec_prop_cb(GUPnPServiceProxy *proxy,
-				    GUPnPServiceProxyAction *action,
-				    gpointer user_data)
+static void prv_get_ms2spec_prop_end(msu_async_task_t *cb_data)
 {
-	GError *upnp_error = NULL;
-	gchar *result = NULL;
-	GUPnPDIDLLiteParser *parser = NULL;
-	msu_async_task_t *cb_data = user_data;
-	msu_async_get_prop_t *cb_task_data = &cb_data->ut.get_prop;
 	msu_task_get_prop_t *task_data = &cb_data->task.ut.get_prop;
+	guint count;
 
-	MSU_LOG_DEBUG("Enter");
-
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result, NULL)) {
-		MSU_LOG_WARNING("Browse operation failed: %s",
-				upnp_error->message);
-
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Browse operation failed: %s",
-					     upnp_error->message);
-		goto on_error;
-	}
-
-	MSU_LOG_DEBUG("GetMS2SpecProp result: %s", result);
-
-	parser = gupnp_didl_lite_parser_new();
-
-	g_signal_connect(parser, "object-available" , cb_task_data->prop_func,
-			 cb_data);
-
-	if (!gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error)) {
-		if (upnp_error->code == GUPNP_XML_ERROR_EMPTY_NODE) {
-			MSU_LOG_WARNING("Property not defined for object");
-
-			cb_data->error =
-				g_error_new(MSU_ERROR,
-					    MSU_ERROR_UNKNOWN_PROPERTY,
-					    "Property not defined for object");
-		} else {
-			MSU_LOG_WARNING("Unable to parse results of browse: %s",
-					upnp_error->message);
-
-			cb_data->error =
-				g_error_new(MSU_ERROR,
-					    MSU_ERROR_OPERATION_FAILED,
-					    "Unable to parse results of browse: %s",
-					    upnp_error->message);
-		}
-		goto on_error;
-	}
-
-	if (!cb_data->task.result) {
+	if (!cb_data->error && !cb_data->task.result) {
 		MSU_LOG_WARNING("Property not defined for object");
 
 		cb_data->error = g_error_new(MSU_ERROR,
@@ -2245,29 +3654,57 @@ static void prv_get_ms2spec_prop_cb(GUPnPServiceProxy *proxy,
 					     "Property not defined for object");
 	}
 
-on_error:
-
 	if (cb_data->error && !strcmp(task_data->prop_name,
 				      MSU_INTERFACE_PROP_CHILD_COUNT)) {
 		MSU_LOG_DEBUG("ChildCount not supported by server");
 
 		g_error_free(cb_data->error);
 		cb_data->error = NULL;
-		prv_get_child_count(cb_data, prv_get_child_count_cb,
-				    cb_data->task.target.id);
-	} else {
-		(void) g_idle_add(msu_async_task_complete, cb_data);
-		g_cancellable_disconnect(cb_data->cancellable,
-					 cb_data->cancel_id);
+
+		if (!prv_cache_lookup_child_count(cb_data->task.target.device,
+						  cb_data->task.target.id,
+						  &count)) {
+			prv_get_child_count(cb_data, prv_get_child_count_cb,
+					    cb_data->task.target.id, NULL);
+			goto no_complete;
+		}
+
+		(void) prv_get_child_count_cb(cb_data, count, NULL);
 	}
 
-	if (upnp_error)
-		g_error_free(upnp_error);
+	(void) g_idle_add(msu_async_task_complete, cb_data);
+	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
 
-	if (parser)
-		g_object_unref(parser);
+no_complete:
 
-	g_free(result);
+	return;
+}
+
+static void prv_get_ms2spec_prop_cb(msu_flight_waiter_t *waiter,
+				    const msu_flight_result_t *result,
+				    gpointer user_data)
+{
+	msu_async_task_t *cb_data = user_data;
+	msu_async_get_prop_t *cb_task_data = &cb_data->ut.get_prop;
+	msu_device_object_cb_t prop_func;
+	guint i;
+
+	MSU_LOG_DEBUG("Enter");
+
+	msu_async_task_flight_landed(cb_data, waiter);
+
+	if (!prv_flight_succeeded(cb_data, result, "Browse", FALSE))
+		goto on_error;
+
+	prop_func = (msu_device_object_cb_t)cb_task_data->prop_func;
+
+	for (i = 0; i < result->objects->len; ++i)
+		prop_func(NULL, g_ptr_array_index(result->objects, i),
+			  cb_data);
+
+on_error:
+
+	prv_get_ms2spec_prop_end(cb_data);
 
 	MSU_LOG_DEBUG("Exit");
 }
@@ -2279,6 +3716,9 @@ static void prv_get_ms2spec_prop(msu_device_context_t *context,
 {
 	msu_async_get_prop_t *cb_task_data;
 	const gchar *filter;
+	GUPnPDIDLLiteObject *object;
+	msu_device_object_cb_t prop_func;
+	msu_flight_waiter_t *flight;
 
 	MSU_LOG_DEBUG("Enter");
 
@@ -2314,19 +3754,17 @@ static void prv_get_ms2spec_prop(msu_device_context_t *context,
 		goto on_error;
 	}
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-			context->service_proxy, "Browse",
-			prv_get_ms2spec_prop_cb,
-			cb_data,
-			"ObjectID", G_TYPE_STRING, cb_data->task.target.id,
-			"BrowseFlag", G_TYPE_STRING,
-			"BrowseMetadata",
-			"Filter", G_TYPE_STRING, filter,
-			"StartingIndex", G_TYPE_INT, 0,
-			"RequestedCount", G_TYPE_INT, 0,
-			"SortCriteria", G_TYPE_STRING,
-			"",
-			NULL);
+	object = prv_cache_lookup_object(cb_data->task.target.device,
+					 cb_data->task.target.id);
+
+	if (!object) {
+		flight = msu_flight_browse(context->service_proxy,
+					   cb_data->task.target.id,
+					   "BrowseMetadata", filter, 0, 0, "",
+					   FALSE, prv_get_ms2spec_prop_cb,
+					   cb_data, NULL);
+		msu_async_task_add_flight(cb_data, flight);
+	}
 
 	cb_data->proxy = context->service_proxy;
 
@@ -2338,6 +3776,13 @@ static void prv_get_ms2spec_prop(msu_device_context_t *context,
 					G_CALLBACK(msu_async_task_cancelled_cb),
 					cb_data, NULL);
 
+	if (object) {
+		prop_func = (msu_device_object_cb_t)cb_task_data->prop_func;
+		prop_func(NULL, object, cb_data);
+		g_object_unref(object);
+		prv_get_ms2spec_prop_end(cb_data);
+	}
+
 	MSU_LOG_DEBUG("Exit with SUCCESS");
 
 	return;
@@ -2383,8 +3828,7 @@ void msu_device_get_prop(msu_client_t *client,
 			} else {
 				cb_data->task.result =
 					msu_props_get_device_prop(
-						(GUPnPDeviceInfo *)
-						context->device_proxy,
+						prv_get_device_props(context),
 						task->target.device,
 						task_data->prop_name);
 
@@ -2431,8 +3875,8 @@ void msu_device_get_prop(msu_client_t *client,
 			} else {
 				cb_data->task.result =
 						msu_props_get_device_prop(
-							(GUPnPDeviceInfo *)
-							context->device_proxy,
+							prv_get_device_props(
+								context),
 							task->target.device,
 							task_data->prop_name);
 				if (cb_data->task.result) {
@@ -2453,157 +3897,72 @@ void msu_device_get_prop(msu_client_t *client,
 	MSU_LOG_DEBUG("Exit");
 }
 
-static void prv_found_target(GUPnPDIDLLiteParser *parser,
-			     GUPnPDIDLLiteObject *object,
-			     gpointer user_data)
+static void prv_search_end(msu_async_task_t *cb_data)
 {
-	msu_async_task_t *cb_data = user_data;
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
-	const char *id;
-	const char *parent_path;
-	gchar *path = NULL;
-	gboolean have_child_count;
-	msu_device_object_builder_t *builder;
-
-	MSU_LOG_DEBUG("Enter");
 
-	builder = g_new0(msu_device_object_builder_t, 1);
+	if (cb_data->error)
+		goto on_complete;
 
-	id = gupnp_didl_lite_object_get_parent_id(object);
+	if (cb_task_data->need_child_count) {
+		MSU_LOG_DEBUG("Need to retrieve child count");
 
-	if (!id || !strcmp(id, "-1") || !strcmp(id, "")) {
-		parent_path = cb_data->task.target.root_path;
+		if (cb_data->task.multiple_retvals)
+			cb_task_data->get_children_cb =
+				prv_get_search_ex_result;
+		else
+			cb_task_data->get_children_cb = prv_get_children_result;
+		if (!prv_retrieve_child_count_for_list(cb_data))
+			goto no_complete;
 	} else {
-		path = msu_path_from_id(cb_data->task.target.root_path, id);
-		parent_path = path;
+		if (cb_data->task.multiple_retvals)
+			prv_get_search_ex_result(cb_data);
+		else
+			prv_get_children_result(cb_data);
 	}
 
-	builder->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
-
-	if (!msu_props_add_object(builder->vb, object,
-				  cb_data->task.target.root_path,
-				  parent_path, cb_task_data->filter_mask))
-		goto on_error;
-
-	if (GUPNP_IS_DIDL_LITE_CONTAINER(object)) {
-		msu_props_add_container(builder->vb,
-					(GUPnPDIDLLiteContainer *)object,
-					cb_task_data->filter_mask,
-					&have_child_count);
-
-		if (!have_child_count && (cb_task_data->filter_mask &
-					  MSU_UPNP_MASK_PROP_CHILD_COUNT)) {
-			builder->needs_child_count = TRUE;
-			builder->id = g_strdup(
-				gupnp_didl_lite_object_get_id(object));
-			cb_task_data->need_child_count = TRUE;
-		}
-	} else {
-		msu_props_add_item(builder->vb,
-				   object,
-				   cb_data->task.target.root_path,
-				   cb_task_data->filter_mask,
-				   cb_task_data->protocol_info);
-	}
+on_complete:
 
-	g_ptr_array_add(cb_task_data->vbs, builder);
-	g_free(path);
+	(void) g_idle_add(msu_async_task_complete, cb_data);
+	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
 
-	MSU_LOG_DEBUG("Exit with SUCCESS");
+no_complete:
 
 	return;
-
-on_error:
-
-	g_free(path);
-	prv_msu_device_object_builder_delete(builder);
-
-	MSU_LOG_DEBUG("Exit with FAIL");
 }
 
-static void prv_search_cb(GUPnPServiceProxy *proxy,
-			  GUPnPServiceProxyAction *action,
+static void prv_search_cb(msu_flight_waiter_t *waiter,
+			  const msu_flight_result_t *result,
 			  gpointer user_data)
 {
-	gchar *result = NULL;
-	GUPnPDIDLLiteParser *parser = NULL;
-	GError *upnp_error = NULL;
 	msu_async_task_t *cb_data = user_data;
 	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
 
 	MSU_LOG_DEBUG("Enter");
 
-	if (!gupnp_service_proxy_end_action(cb_data->proxy, cb_data->action,
-					    &upnp_error,
-					    "Result", G_TYPE_STRING,
-					    &result,
-					    "TotalMatches", G_TYPE_INT,
-					    &cb_task_data->max_count,
-					    NULL)) {
+	msu_async_task_flight_landed(cb_data, waiter);
 
-		MSU_LOG_WARNING("Search operation failed %s",
-				upnp_error->message);
+	prv_bas_results_new(cb_task_data);
 
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Search operation failed: %s",
-					     upnp_error->message);
+	if (!prv_flight_succeeded(cb_data, result, "Search", TRUE))
 		goto on_error;
-	}
-
-	parser = gupnp_didl_lite_parser_new();
-
-	cb_task_data->vbs = g_ptr_array_new_with_free_func(
-		prv_msu_device_object_builder_delete);
-
-	g_signal_connect(parser, "object-available" ,
-			 G_CALLBACK(prv_found_target), cb_data);
-
-	MSU_LOG_DEBUG("Server Search result: %s", result);
-
-	if (!gupnp_didl_lite_parser_parse_didl(parser, result, &upnp_error) &&
-	    upnp_error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
-		MSU_LOG_WARNING("Unable to parse results of search: %s",
-				upnp_error->message);
 
-		cb_data->error = g_error_new(MSU_ERROR,
-					     MSU_ERROR_OPERATION_FAILED,
-					     "Unable to parse results of search: %s",
-					     upnp_error->message);
-		goto on_error;
-	}
+	cb_task_data->max_count = result->total_matches;
 
-	if (cb_task_data->need_child_count) {
-		MSU_LOG_DEBUG("Need to retrieve child count");
+	if (cb_task_data->streaming)
+		prv_decode_start(cb_data, result, "Search", NULL,
+				 prv_search_end);
+	else
+		prv_convert_start(cb_data, result->objects, "Search", NULL,
+				  prv_search_end);
 
-		if (cb_data->task.multiple_retvals)
-			cb_task_data->get_children_cb =
-				prv_get_search_ex_result;
-		else
-			cb_task_data->get_children_cb = prv_get_children_result;
-		prv_retrieve_child_count_for_list(cb_data);
-		goto no_complete;
-	} else {
-		if (cb_data->task.multiple_retvals)
-			prv_get_search_ex_result(cb_data);
-		else
-			prv_get_children_result(cb_data);
-	}
+	goto finished;
 
 on_error:
 
-	(void) g_idle_add(msu_async_task_complete, cb_data);
-	g_cancellable_disconnect(cb_data->cancellable, cb_data->cancel_id);
-
-no_complete:
-
-	if (parser)
-		g_object_unref(parser);
+	prv_search_end(cb_data);
 
-	g_free(result);
-
-	if (upnp_error)
-		g_error_free(upnp_error);
+finished:
 
 	MSU_LOG_DEBUG("Exit");
 }
@@ -2614,23 +3973,23 @@ void msu_device_search(msu_client_t *client,
 		       const gchar *sort_by)
 {
 	msu_async_task_t *cb_data = (msu_async_task_t *)task;
+	msu_async_bas_t *cb_task_data = &cb_data->ut.bas;
 	msu_device_context_t *context;
+	msu_flight_waiter_t *flight;
 
 	MSU_LOG_DEBUG("Enter");
 
 	context = msu_device_get_context(task->target.device, client);
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-			context->service_proxy, "Search",
-			prv_search_cb,
-			cb_data,
-			"ContainerID", G_TYPE_STRING, task->target.id,
-			"SearchCriteria", G_TYPE_STRING, upnp_query,
-			"Filter", G_TYPE_STRING, upnp_filter,
-			"StartingIndex", G_TYPE_INT, task->ut.search.start,
-			"RequestedCount", G_TYPE_INT, task->ut.search.count,
-			"SortCriteria", G_TYPE_STRING, sort_by,
-			NULL);
+	cb_task_data->streaming = client->streaming_didl;
+
+	flight = msu_flight_search(context->service_proxy, task->target.id,
+				   upnp_query, upnp_filter,
+				   task->ut.search.start,
+				   task->ut.search.count,
+				   sort_by, cb_task_data->streaming,
+				   prv_search_cb, cb_data, NULL);
+	msu_async_task_add_flight(cb_data, flight);
 
 	cb_data->proxy = context->service_proxy;
 
@@ -2650,15 +4009,13 @@ static void prv_get_resource(GUPnPDIDLLiteParser *parser,
 			     gpointer user_data)
 {
 	msu_async_task_t *cb_data = user_data;
-	msu_task_t *task = &cb_data->task;
-	msu_task_get_resource_t *task_data = &task->ut.resource;
 	msu_async_get_all_t *cb_task_data = &cb_data->ut.get_all;
 
 	MSU_LOG_DEBUG("Enter");
 
-	msu_props_add_resource(cb_task_data->vb, object,
+	msu_props_add_resource(cb_task_data->writer, object,
 			       cb_task_data->filter_mask,
-			       task_data->protocol_info);
+			       cb_task_data->matcher);
 }
 
 void msu_device_get_resource(msu_client_t *client,
@@ -2668,24 +4025,21 @@ void msu_device_get_resource(msu_client_t *client,
 	msu_async_task_t *cb_data = (msu_async_task_t *)task;
 	msu_async_get_all_t *cb_task_data;
 	msu_device_context_t *context;
+	msu_flight_waiter_t *flight;
 
 	context = msu_device_get_context(task->target.device, client);
 	cb_task_data = &cb_data->ut.get_all;
 
-	cb_task_data->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+	cb_task_data->writer = msu_writer_new();
+	(void) msu_writer_begin_object(cb_task_data->writer);
 	cb_task_data->prop_func = G_CALLBACK(prv_get_resource);
 	cb_task_data->device_object = FALSE;
 
-	cb_data->action = gupnp_service_proxy_begin_action(
-				context->service_proxy, "Browse",
-				prv_get_all_ms2spec_props_cb, cb_data,
-				"ObjectID", G_TYPE_STRING, task->target.id,
-				"BrowseFlag", G_TYPE_STRING, "BrowseMetadata",
-				"Filter", G_TYPE_STRING, upnp_filter,
-				"StartingIndex", G_TYPE_INT, 0,
-				"RequestedCount", G_TYPE_INT, 0,
-				"SortCriteria", G_TYPE_STRING,
-				"", NULL);
+	flight = msu_flight_browse(context->service_proxy, task->target.id,
+				   "BrowseMetadata", upnp_filter, 0, 0, "",
+				   FALSE, prv_get_all_ms2spec_props_cb,
+				   cb_data, NULL);
+	msu_async_task_add_flight(cb_data, flight);
 
 	cb_data->proxy = context->service_proxy;
 
@@ -3149,6 +4503,8 @@ static void prv_create_container_cb(GUPnPServiceProxy *proxy,
 		MSU_LOG_WARNING("Create Object operation failed: %s",
 				upnp_error->message);
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "Create Object operation failed: %s",
@@ -3209,6 +4565,8 @@ static void prv_generic_upload_cb(msu_async_task_t *cb_data,
 		MSU_LOG_WARNING("Create Object operation failed: %s",
 				error->message);
 
+		prv_note_server_error(cb_data, error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "Create Object operation "
@@ -3347,6 +4705,9 @@ void msu_device_upload(msu_client_t *client,
 	context = msu_device_get_context(task->target.device, client);
 	cb_task_data = &cb_data->ut.upload;
 
+	msu_cache_object_added(task->target.device->cache, parent_id);
+	prv_store_invalidate(task->target.device);
+
 	didl = prv_create_upload_didl(parent_id, task,
 				      cb_task_data->object_class,
 				      cb_task_data->mime_type);
@@ -3480,6 +4841,8 @@ static void prv_destroy_object_cb(GUPnPServiceProxy *proxy,
 		MSU_LOG_WARNING("Destroy Object operation failed: %s",
 				upnp_error->message);
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "Destroy Object operation failed: %s",
@@ -3505,6 +4868,9 @@ void msu_device_delete_object(msu_client_t *client,
 
 	context = msu_device_get_context(task->target.device, client);
 
+	msu_cache_object_removed(task->target.device->cache, task->target.id);
+	prv_store_invalidate(task->target.device);
+
 	cb_data->action = gupnp_service_proxy_begin_action(
 				context->service_proxy, "DestroyObject",
 				prv_destroy_object_cb, cb_data,
@@ -3535,6 +4901,9 @@ void msu_device_create_container(msu_client_t *client,
 
 	context = msu_device_get_context(task->target.device, client);
 
+	msu_cache_object_added(task->target.device->cache, parent_id);
+	prv_store_invalidate(task->target.device);
+
 	didl = prv_create_new_container_didl(parent_id, task);
 
 	MSU_LOG_DEBUG("DIDL: %s", didl);
@@ -3576,6 +4945,8 @@ static void prv_update_object_update_cb(GUPnPServiceProxy *proxy,
 		MSU_LOG_WARNING("Update Object operation failed: %s",
 				upnp_error->message);
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "Update Object operation "
@@ -3796,6 +5167,8 @@ static void prv_update_object_browse_cb(GUPnPServiceProxy *proxy,
 		MSU_LOG_WARNING("Browse Object operation failed: %s",
 				upnp_error->message);
 
+		prv_note_server_error(cb_data, upnp_error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "Browse operation failed: %s",
@@ -3873,6 +5246,10 @@ void msu_device_update_object(msu_client_t *client,
 
 	context = msu_device_get_context(task->target.device, client);
 
+	msu_cache_object_modified(task->target.device->cache,
+				  task->target.id);
+	prv_store_invalidate(task->target.device);
+
 	cb_data->action = gupnp_service_proxy_begin_action(
 				context->service_proxy, "Browse",
 				prv_update_object_browse_cb, cb_data,
@@ -4007,6 +5384,8 @@ static void prv_create_didls_item_browse_cb(GUPnPServiceProxy *proxy,
 				error->message);
 		MSU_LOG_DEBUG_NL();
 
+		prv_note_server_error(cb_data, error);
+
 		cb_data->error = g_error_new(MSU_ERROR,
 					     MSU_ERROR_OPERATION_FAILED,
 					     "Browse operation failed: %s",
@@ -4103,7 +5482,8 @@ static gboolean prv_create_chain_didls_items(msu_task_t *task,
 	g_variant_iter_init(&iter, task->ut.playlist.item_path);
 
 	while (g_variant_iter_next(&iter, "&o", &path)) {
-		if (!msu_path_get_path_and_id(path, &root_path, &id, NULL)) {
+		if (!msu_path_get_path_and_id(path, NULL, &root_path, &id,
+					      NULL)) {
 			MSU_LOG_DEBUG("Can't get id for path %s", path);
 			cb_data->error = g_error_new(MSU_ERROR,
 						     MSU_ERROR_OBJECT_NOT_FOUND,
@@ -4287,6 +5667,9 @@ void msu_device_playlist_upload(msu_client_t *client,
 
 	context = msu_device_get_context(task->target.device, client);
 
+	msu_cache_object_added(task->target.device->cache, parent_id);
+	prv_store_invalidate(task->target.device);
+
 	cb_data->proxy = context->service_proxy;
 	cb_data->ut.playlist.queue_id = queue_id;
 
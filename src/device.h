@@ -26,6 +26,8 @@
 #include <libgupnp/gupnp-control-point.h>
 
 #include "async.h"
+#include "cache.h"
+#include "store.h"
 #include "task-processor.h"
 #include "client.h"
 #include "props.h"
@@ -37,8 +39,18 @@ struct msu_device_context_t_ {
 	msu_device_t *device;
 	gboolean subscribed;
 	guint timeout_id;
+	GVariant *props;
 };
 
+enum msu_device_circuit_t_ {
+	MSU_DEVICE_CIRCUIT_CLOSED,
+	MSU_DEVICE_CIRCUIT_OPEN,
+	MSU_DEVICE_CIRCUIT_HALF_OPEN
+};
+typedef enum msu_device_circuit_t_ msu_device_circuit_t;
+
+typedef struct msu_device_refresh_t_ msu_device_refresh_t;
+
 struct msu_device_t_ {
 	GDBusConnection *connection;
 	guint id;
@@ -49,11 +61,32 @@ struct msu_device_t_ {
 	GHashTable *upload_jobs;
 	guint upload_id;
 	guint system_update_id;
+	guint accounted_update_id;
+	gboolean changes_described;
+	gboolean changes_evented;
+	guint update_check_id;
 	GVariant *search_caps;
 	GVariant *sort_caps;
 	GVariant *sort_ext_caps;
 	GVariant *feature_list;
 	gboolean shutting_down;
+	guint timeouts;
+	msu_device_circuit_t circuit;
+	guint failures;
+	guint circuit_id;
+	GUPnPServiceProxy *probe_proxy;
+	GUPnPServiceProxyAction *probe_action;
+	msu_cache_t *cache;
+	GHashTable *prefetch_table;
+	guint prefetches;
+	guint prefetch_hits;
+	msu_store_t *store;
+	gchar *reset_token;
+	guint store_update_id;
+	guint store_hits;
+	GUPnPServiceProxy *store_proxy;
+	GUPnPServiceProxyAction *store_action;
+	msu_device_refresh_t *refresh;
 };
 
 msu_device_context_t *msu_device_append_new_context(msu_device_t *device,
@@ -73,6 +106,12 @@ msu_device_t *msu_device_new(GDBusConnection *connection,
 msu_device_t *msu_device_from_path(const gchar *path, GHashTable *device_list);
 msu_device_context_t *msu_device_get_context(const msu_device_t *device,
 					     msu_client_t *client);
+void msu_device_set_circuit_limits(guint max_failures, guint cool_down);
+void msu_device_record_result(msu_device_t *device, const GError *error,
+			      gboolean server_failed);
+gboolean msu_device_is_available(const msu_device_t *device);
+const gchar *msu_device_get_circuit_state(const msu_device_t *device);
+GVariant *msu_device_get_cache_statistics(const msu_device_t *device);
 void msu_device_get_children(msu_client_t *client,
 			     msu_task_t *task,
 			     const gchar *upnp_filter, const gchar *sort_by);
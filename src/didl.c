@@ -0,0 +1,576 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libgupnp-av/gupnp-av.h>
+#include <libxml/parser.h>
+
+#include "didl.h"
+#include "log.h"
+#include "props.h"
+
+/* The properties that are read from the res elements of an item */
+#define MSU_DIDL_MASK_RESOURCES (MSU_UPNP_MASK_PROP_URLS |		\
+				 MSU_UPNP_MASK_PROP_URL |		\
+				 MSU_UPNP_MASK_PROP_MIME_TYPE |		\
+				 MSU_UPNP_MASK_PROP_DLNA_PROFILE |	\
+				 MSU_UPNP_MASK_PROP_SIZE |		\
+				 MSU_UPNP_MASK_PROP_DURATION |		\
+				 MSU_UPNP_MASK_PROP_BITRATE |		\
+				 MSU_UPNP_MASK_PROP_SAMPLE_RATE |	\
+				 MSU_UPNP_MASK_PROP_BITS_PER_SAMPLE |	\
+				 MSU_UPNP_MASK_PROP_WIDTH |		\
+				 MSU_UPNP_MASK_PROP_HEIGHT |		\
+				 MSU_UPNP_MASK_PROP_COLOR_DEPTH |	\
+				 MSU_UPNP_MASK_PROP_RESOURCES |		\
+				 MSU_UPNP_MASK_PROP_UPDATE_COUNT)
+
+#define MSU_DIDL_NS_DIDL_LITE "urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/"
+#define MSU_DIDL_NS_DC "http://purl.org/dc/elements/1.1/"
+#define MSU_DIDL_NS_UPNP "urn:schemas-upnp-org:metadata-1-0/upnp/"
+
+typedef enum msu_didl_type_t_ msu_didl_type_t;
+enum msu_didl_type_t_ {
+	MSU_DIDL_TYPE_STRING,
+	MSU_DIDL_TYPE_INT,
+	MSU_DIDL_TYPE_UINT,
+	MSU_DIDL_TYPE_ARTIST,
+	MSU_DIDL_TYPE_CREATE_CLASS,
+	MSU_DIDL_TYPE_RES
+};
+
+/* Like the GUPnP getters, only the first element of each name is read,
+   except for the artists, create classes and resources.  Fields with no
+   mask are always read.  Elements of the same name from other
+   namespaces, such as vendor extensions, are ignored. */
+typedef struct msu_didl_field_t_ msu_didl_field_t;
+struct msu_didl_field_t_ {
+	const gchar *ns;
+	const gchar *name;
+	msu_upnp_prop_mask mask;
+	msu_didl_type_t type;
+	gsize offset;
+};
+
+static const msu_didl_field_t g_fields[] = {
+	{ MSU_DIDL_NS_UPNP, "class", 0, MSU_DIDL_TYPE_STRING,
+	  G_STRUCT_OFFSET(msu_didl_object_t, upnp_class) },
+	{ MSU_DIDL_NS_DC, "title", MSU_UPNP_MASK_PROP_DISPLAY_NAME,
+	  MSU_DIDL_TYPE_STRING, G_STRUCT_OFFSET(msu_didl_object_t, title) },
+	{ MSU_DIDL_NS_DC, "creator", MSU_UPNP_MASK_PROP_CREATOR,
+	  MSU_DIDL_TYPE_STRING, G_STRUCT_OFFSET(msu_didl_object_t, creator) },
+	{ MSU_DIDL_NS_UPNP, "artist",
+	  MSU_UPNP_MASK_PROP_ARTIST | MSU_UPNP_MASK_PROP_ARTISTS,
+	  MSU_DIDL_TYPE_ARTIST, G_STRUCT_OFFSET(msu_didl_object_t, artist) },
+	{ MSU_DIDL_NS_UPNP, "album", MSU_UPNP_MASK_PROP_ALBUM,
+	  MSU_DIDL_TYPE_STRING, G_STRUCT_OFFSET(msu_didl_object_t, album) },
+	{ MSU_DIDL_NS_DC, "date", MSU_UPNP_MASK_PROP_DATE,
+	  MSU_DIDL_TYPE_STRING, G_STRUCT_OFFSET(msu_didl_object_t, date) },
+	{ MSU_DIDL_NS_UPNP, "genre", MSU_UPNP_MASK_PROP_GENRE,
+	  MSU_DIDL_TYPE_STRING, G_STRUCT_OFFSET(msu_didl_object_t, genre) },
+	{ MSU_DIDL_NS_UPNP, "originalTrackNumber",
+	  MSU_UPNP_MASK_PROP_TRACK_NUMBER, MSU_DIDL_TYPE_INT,
+	  G_STRUCT_OFFSET(msu_didl_object_t, track_number) },
+	{ MSU_DIDL_NS_UPNP, "albumArtURI", MSU_UPNP_MASK_PROP_ALBUM_ART_URL,
+	  MSU_DIDL_TYPE_STRING, G_STRUCT_OFFSET(msu_didl_object_t, album_art) },
+	{ MSU_DIDL_NS_UPNP, "objectUpdateID",
+	  MSU_UPNP_MASK_PROP_OBJECT_UPDATE_ID, MSU_DIDL_TYPE_UINT,
+	  G_STRUCT_OFFSET(msu_didl_object_t, update_id) },
+	{ MSU_DIDL_NS_UPNP, "containerUpdateID",
+	  MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID, MSU_DIDL_TYPE_UINT,
+	  G_STRUCT_OFFSET(msu_didl_object_t, container_update_id) },
+	{ MSU_DIDL_NS_UPNP, "totalDeletedChildCount",
+	  MSU_UPNP_MASK_PROP_TOTAL_DELETED_CHILD_COUNT, MSU_DIDL_TYPE_UINT,
+	  G_STRUCT_OFFSET(msu_didl_object_t, total_deleted_child_count) },
+	{ MSU_DIDL_NS_UPNP, "createClass", MSU_UPNP_MASK_PROP_CREATE_CLASSES,
+	  MSU_DIDL_TYPE_CREATE_CLASS, 0 },
+	{ MSU_DIDL_NS_DIDL_LITE, "res", MSU_DIDL_MASK_RESOURCES,
+	  MSU_DIDL_TYPE_RES, 0 }
+};
+
+/* depth is the number of elements currently open.  field is the
+   element of the current object whose text is being read, at
+   text_depth. */
+typedef struct msu_didl_decoder_t_ msu_didl_decoder_t;
+struct msu_didl_decoder_t_ {
+	xmlParserCtxtPtr ctxt;
+	msu_upnp_prop_mask filter_mask;
+	msu_didl_object_cb_t cb;
+	gpointer user_data;
+	guint depth;
+	gboolean root_found;
+	gboolean empty;
+	GError *error;
+	msu_didl_object_t *object;
+	guint seen;
+	const msu_didl_field_t *field;
+	guint text_depth;
+	gboolean has_text;
+	GString *text;
+};
+
+static void prv_res_delete(gpointer data)
+{
+	msu_didl_res_t *res = data;
+
+	g_free(res->uri);
+	g_free(res->protocol_info);
+	g_free(res);
+}
+
+static void prv_create_class_delete(gpointer data)
+{
+	msu_didl_create_class_t *create_class = data;
+
+	g_free(create_class->content);
+	g_free(create_class);
+}
+
+static void prv_object_delete(msu_didl_object_t *object)
+{
+	if (object) {
+		g_free(object->id);
+		g_free(object->parent_id);
+		g_free(object->ref_id);
+		g_free(object->upnp_class);
+		g_free(object->title);
+		g_free(object->creator);
+		g_free(object->artist);
+		g_ptr_array_unref(object->artists);
+		g_free(object->album);
+		g_free(object->date);
+		g_free(object->genre);
+		g_free(object->album_art);
+		g_ptr_array_unref(object->create_classes);
+		g_ptr_array_unref(object->resources);
+		g_free(object);
+	}
+}
+
+static gchar *prv_attribute(const xmlChar **attributes, int nb_attributes,
+			    const gchar *name)
+{
+	gchar *value = NULL;
+	int i;
+
+	for (i = 0; i < nb_attributes; ++i, attributes += 5) {
+		if (!strcmp((const char *) attributes[0], name)) {
+			value = g_strndup((const gchar *) attributes[3],
+					  attributes[4] - attributes[3]);
+			break;
+		}
+	}
+
+	return value;
+}
+
+static gint64 prv_int_attribute(const xmlChar **attributes,
+				int nb_attributes, const gchar *name,
+				gint64 default_value)
+{
+	gchar *value;
+	gint64 retval = default_value;
+
+	value = prv_attribute(attributes, nb_attributes, name);
+	if (value)
+		retval = g_ascii_strtoll(value, NULL, 0);
+	g_free(value);
+
+	return retval;
+}
+
+static gboolean prv_bool_attribute(const xmlChar **attributes,
+				   int nb_attributes, const gchar *name)
+{
+	gchar *value;
+	gboolean retval = FALSE;
+
+	value = prv_attribute(attributes, nb_attributes, name);
+	if (value)
+		retval = !g_ascii_strcasecmp(value, "true") ||
+			!g_ascii_strcasecmp(value, "yes") ||
+			!strcmp(value, "1");
+	g_free(value);
+
+	return retval;
+}
+
+/* Durations are H+:MM:SS[.F+], converted to seconds. */
+static gint prv_duration_attribute(const xmlChar **attributes,
+				   int nb_attributes)
+{
+	gchar *value;
+	gchar **tokens;
+	gdouble seconds = -1;
+
+	value = prv_attribute(attributes, nb_attributes, "duration");
+	if (!value)
+		goto finished;
+
+	tokens = g_strsplit(value, ":", -1);
+	if (tokens[0] && tokens[1] && tokens[2])
+		seconds = g_strtod(tokens[2], NULL) +
+			g_strtod(tokens[1], NULL) * 60 +
+			g_strtod(tokens[0], NULL) * 3600;
+	g_strfreev(tokens);
+	g_free(value);
+
+finished:
+
+	return (gint) seconds;
+}
+
+static void prv_resolution_attribute(const xmlChar **attributes,
+				     int nb_attributes, msu_didl_res_t *res)
+{
+	gchar *value;
+	guint width;
+	guint height;
+
+	value = prv_attribute(attributes, nb_attributes, "resolution");
+	if (value && sscanf(value, "%ux%u", &width, &height) == 2) {
+		res->width = width;
+		res->height = height;
+	}
+	g_free(value);
+}
+
+static msu_didl_res_t *prv_res_new(const xmlChar **attributes,
+				   int nb_attributes)
+{
+	msu_didl_res_t *res = g_new0(msu_didl_res_t, 1);
+
+	res->protocol_info = prv_attribute(attributes, nb_attributes,
+					   "protocolInfo");
+	res->size = prv_int_attribute(attributes, nb_attributes, "size", -1);
+	res->bitrate = prv_int_attribute(attributes, nb_attributes,
+					 "bitrate", -1);
+	res->sample_freq = prv_int_attribute(attributes, nb_attributes,
+					     "sampleFrequency", -1);
+	res->bits_per_sample = prv_int_attribute(attributes, nb_attributes,
+						 "bitsPerSample", -1);
+	res->duration = prv_duration_attribute(attributes, nb_attributes);
+	res->width = -1;
+	res->height = -1;
+	prv_resolution_attribute(attributes, nb_attributes, res);
+	res->color_depth = prv_int_attribute(attributes, nb_attributes,
+					     "colorDepth", -1);
+	res->update_count = prv_int_attribute(attributes, nb_attributes,
+					      "updateCount", G_MAXUINT);
+
+	return res;
+}
+
+static msu_didl_object_t *prv_object_new(const gchar *name,
+					 const xmlChar **attributes,
+					 int nb_attributes)
+{
+	msu_didl_object_t *object = g_new0(msu_didl_object_t, 1);
+	gchar *flags;
+
+	object->container = !strcmp(name, "container");
+	object->id = prv_attribute(attributes, nb_attributes, "id");
+	object->parent_id = prv_attribute(attributes, nb_attributes,
+					  "parentID");
+	object->restricted = prv_bool_attribute(attributes, nb_attributes,
+						"restricted");
+
+	flags = prv_attribute(attributes, nb_attributes, "dlnaManaged");
+	if (flags)
+		object->dlna_managed = strtoul(flags, NULL, 16);
+	g_free(flags);
+
+	if (object->container) {
+		object->child_count = prv_int_attribute(attributes,
+							nb_attributes,
+							"childCount", -1);
+		object->searchable = prv_bool_attribute(attributes,
+							nb_attributes,
+							"searchable");
+	} else {
+		object->ref_id = prv_attribute(attributes, nb_attributes,
+					       "refID");
+		object->child_count = -1;
+	}
+
+	object->track_number = -1;
+	object->update_id = G_MAXUINT;
+	object->container_update_id = G_MAXUINT;
+	object->total_deleted_child_count = G_MAXUINT;
+	object->artists = g_ptr_array_new_with_free_func(g_free);
+	object->create_classes = g_ptr_array_new_with_free_func(
+						prv_create_class_delete);
+	object->resources = g_ptr_array_new_with_free_func(prv_res_delete);
+
+	return object;
+}
+
+static void prv_stop(msu_didl_decoder_t *decoder, gint code,
+		     const gchar *message)
+{
+	decoder->error = g_error_new_literal(GUPNP_XML_ERROR, code, message);
+	xmlStopParser(decoder->ctxt);
+}
+
+/* The text of an element is only read if the filter needs it, and if it
+   is the first element of its name in the object. */
+static void prv_start_field(msu_didl_decoder_t *decoder, const gchar *ns,
+			    const gchar *name, const xmlChar **attributes,
+			    int nb_attributes)
+{
+	const msu_didl_field_t *field = NULL;
+	msu_didl_create_class_t *create_class;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(g_fields); ++i) {
+		if (!strcmp(g_fields[i].name, name) &&
+		    !g_strcmp0(g_fields[i].ns, ns)) {
+			field = &g_fields[i];
+			break;
+		}
+	}
+
+	if (!field || (field->mask && !(field->mask & decoder->filter_mask)))
+		goto finished;
+
+	switch (field->type) {
+	case MSU_DIDL_TYPE_CREATE_CLASS:
+		if (!decoder->object->container)
+			goto finished;
+
+		create_class = g_new0(msu_didl_create_class_t, 1);
+		create_class->include_derived = prv_bool_attribute(
+			attributes, nb_attributes, "includeDerived");
+		g_ptr_array_add(decoder->object->create_classes, create_class);
+		break;
+	case MSU_DIDL_TYPE_RES:
+		g_ptr_array_add(decoder->object->resources,
+				prv_res_new(attributes, nb_attributes));
+		break;
+	case MSU_DIDL_TYPE_ARTIST:
+		break;
+	default:
+		if (decoder->seen & (1 << i))
+			goto finished;
+		break;
+	}
+
+	decoder->seen |= 1 << i;
+	decoder->field = field;
+	decoder->text_depth = decoder->depth + 1;
+	decoder->has_text = FALSE;
+	g_string_truncate(decoder->text, 0);
+
+finished:
+
+	return;
+}
+
+static void prv_end_field(msu_didl_decoder_t *decoder)
+{
+	msu_didl_object_t *object = decoder->object;
+	const msu_didl_field_t *field = decoder->field;
+	gpointer member = G_STRUCT_MEMBER_P(object, field->offset);
+	gchar *text = NULL;
+	msu_didl_create_class_t *create_class;
+	msu_didl_res_t *res;
+
+	if (decoder->has_text)
+		text = g_strdup(decoder->text->str);
+
+	switch (field->type) {
+	case MSU_DIDL_TYPE_STRING:
+		*(gchar **) member = text;
+		text = NULL;
+		break;
+	case MSU_DIDL_TYPE_INT:
+		if (text)
+			*(gint *) member = atoi(text);
+		break;
+	case MSU_DIDL_TYPE_UINT:
+		if (text)
+			*(guint *) member = strtoul(text, NULL, 0);
+		break;
+	case MSU_DIDL_TYPE_ARTIST:
+		if (!object->artist && !object->artists->len)
+			object->artist = g_strdup(text);
+		g_ptr_array_add(object->artists, text);
+		text = NULL;
+		break;
+	case MSU_DIDL_TYPE_CREATE_CLASS:
+		create_class = g_ptr_array_index(object->create_classes,
+					object->create_classes->len - 1);
+		create_class->content = text;
+		text = NULL;
+		break;
+	case MSU_DIDL_TYPE_RES:
+		res = g_ptr_array_index(object->resources,
+					object->resources->len - 1);
+		res->uri = text;
+		text = NULL;
+		break;
+	default:
+		break;
+	}
+
+	g_free(text);
+	decoder->field = NULL;
+}
+
+static void prv_end_object(msu_didl_decoder_t *decoder)
+{
+	if (decoder->field)
+		prv_end_field(decoder);
+
+	decoder->cb(decoder->object, decoder->user_data);
+	prv_object_delete(decoder->object);
+	decoder->object = NULL;
+}
+
+static void prv_start_element(void *ctx, const xmlChar *localname,
+			      const xmlChar *prefix, const xmlChar *uri,
+			      int nb_namespaces, const xmlChar **namespaces,
+			      int nb_attributes, int nb_defaulted,
+			      const xmlChar **attributes)
+{
+	msu_didl_decoder_t *decoder = ctx;
+	const gchar *name = (const gchar *) localname;
+
+	if (decoder->depth == 0) {
+		decoder->root_found = TRUE;
+		if (strcmp(name, "DIDL-Lite"))
+			prv_stop(decoder, GUPNP_XML_ERROR_NO_NODE,
+				 "No 'DIDL-Lite' node in the DIDL-Lite XML");
+	} else if (decoder->depth == 1) {
+		decoder->empty = FALSE;
+		if (!strcmp(name, "item") || !strcmp(name, "container")) {
+			decoder->object = prv_object_new(name, attributes,
+							 nb_attributes);
+			decoder->seen = 0;
+		}
+	} else if (decoder->depth == 2 && decoder->object) {
+		prv_start_field(decoder, (const gchar *) uri, name, attributes,
+				nb_attributes);
+	}
+
+	decoder->depth++;
+}
+
+static void prv_end_element(void *ctx, const xmlChar *localname,
+			    const xmlChar *prefix, const xmlChar *uri)
+{
+	msu_didl_decoder_t *decoder = ctx;
+
+	decoder->depth--;
+
+	if (decoder->depth == 2 && decoder->field)
+		prv_end_field(decoder);
+	else if (decoder->depth == 1 && decoder->object)
+		prv_end_object(decoder);
+}
+
+/* As with the GUPnP getters, the text of the children of an element is
+   not part of its content. */
+static void prv_characters(void *ctx, const xmlChar *ch, int len)
+{
+	msu_didl_decoder_t *decoder = ctx;
+
+	if (decoder->field && decoder->depth == decoder->text_depth) {
+		g_string_append_len(decoder->text, (const gchar *) ch, len);
+		decoder->has_text = TRUE;
+	}
+}
+
+static void prv_error(void *ctx, xmlErrorPtr error)
+{
+	MSU_LOG_DEBUG("DIDL-Lite line %d: %s", error->line, error->message);
+}
+
+/* Objects are passed to cb as soon as their end tag is parsed, with
+   the same errors as gupnp_didl_lite_parser_parse_didl.  Malformed
+   documents are parsed as far as possible, as GUPnP does. */
+gboolean msu_didl_decode(const gchar *didl, msu_upnp_prop_mask filter_mask,
+			 msu_didl_object_cb_t cb, gpointer user_data,
+			 GError **error)
+{
+	msu_didl_decoder_t decoder;
+	xmlSAXHandler sax;
+
+	memset(&decoder, 0, sizeof(decoder));
+	decoder.filter_mask = filter_mask;
+	decoder.cb = cb;
+	decoder.user_data = user_data;
+	decoder.empty = TRUE;
+	decoder.text = g_string_new(NULL);
+
+	memset(&sax, 0, sizeof(sax));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = prv_start_element;
+	sax.endElementNs = prv_end_element;
+	sax.characters = prv_characters;
+	sax.cdataBlock = prv_characters;
+	sax.serror = prv_error;
+
+	decoder.ctxt = xmlCreatePushParserCtxt(&sax, &decoder, NULL, 0, NULL);
+	if (!decoder.ctxt) {
+		decoder.error = g_error_new_literal(
+					GUPNP_XML_ERROR,
+					GUPNP_XML_ERROR_PARSE,
+					"Could not parse DIDL-Lite XML");
+		goto finished;
+	}
+
+	(void) xmlCtxtUseOptions(decoder.ctxt,
+				 XML_PARSE_RECOVER | XML_PARSE_NONET);
+	(void) xmlParseChunk(decoder.ctxt, didl, didl ? strlen(didl) : 0, 1);
+	xmlFreeParserCtxt(decoder.ctxt);
+
+	if (decoder.error)
+		goto finished;
+
+	/* The elements left open by a truncated document are closed, as
+	   when it is recovered by GUPnP. */
+	if (decoder.object)
+		prv_end_object(&decoder);
+
+	if (!decoder.root_found)
+		decoder.error = g_error_new_literal(
+					GUPNP_XML_ERROR,
+					GUPNP_XML_ERROR_PARSE,
+					"Could not parse DIDL-Lite XML");
+	else if (decoder.empty)
+		decoder.error = g_error_new_literal(
+				GUPNP_XML_ERROR,
+				GUPNP_XML_ERROR_EMPTY_NODE,
+				"Empty 'DIDL-Lite' node in the DIDL-Lite XML");
+
+finished:
+
+	prv_object_delete(decoder.object);
+	g_string_free(decoder.text, TRUE);
+
+	if (decoder.error)
+		g_propagate_error(error, decoder.error);
+
+	return !decoder.error;
+}
@@ -0,0 +1,87 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_DIDL_H__
+#define MSU_DIDL_H__
+
+#include <glib.h>
+
+#include "async.h"
+
+/* The values of the fields of a DIDL-Lite object, as the GUPnP getters
+   would return them.  Only the fields needed by the filter mask given to
+   msu_didl_decode are read from the document, the others keep their
+   default values. */
+typedef struct msu_didl_res_t_ msu_didl_res_t;
+struct msu_didl_res_t_ {
+	gchar *uri;
+	gchar *protocol_info;
+	gint64 size;
+	gint bitrate;
+	gint sample_freq;
+	gint bits_per_sample;
+	gint duration;
+	gint width;
+	gint height;
+	gint color_depth;
+	guint update_count;
+};
+
+typedef struct msu_didl_create_class_t_ msu_didl_create_class_t;
+struct msu_didl_create_class_t_ {
+	gchar *content;
+	gboolean include_derived;
+};
+
+typedef struct msu_didl_object_t_ msu_didl_object_t;
+struct msu_didl_object_t_ {
+	gboolean container;
+	gchar *id;
+	gchar *parent_id;
+	gchar *ref_id;
+	gchar *upnp_class;
+	gboolean restricted;
+	guint dlna_managed;
+	gint child_count;
+	gboolean searchable;
+	gchar *title;
+	gchar *creator;
+	gchar *artist;
+	GPtrArray *artists;
+	gchar *album;
+	gchar *date;
+	gchar *genre;
+	gint track_number;
+	gchar *album_art;
+	guint update_id;
+	guint container_update_id;
+	guint total_deleted_child_count;
+	GPtrArray *create_classes;
+	GPtrArray *resources;
+};
+
+typedef void (*msu_didl_object_cb_t)(const msu_didl_object_t *object,
+				     gpointer user_data);
+
+gboolean msu_didl_decode(const gchar *didl, msu_upnp_prop_mask filter_mask,
+			 msu_didl_object_cb_t cb, gpointer user_data,
+			 GError **error);
+
+#endif
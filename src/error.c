@@ -38,7 +38,10 @@ static const GDBusErrorEntry g_error_entries[] = {
 	{ MSU_ERROR_DIED, MSU_SERVICE".Died" },
 	{ MSU_ERROR_CANCELLED, MSU_SERVICE".Cancelled" },
 	{ MSU_ERROR_BAD_MIME, MSU_SERVICE".BadMime" },
-	{ MSU_ERROR_IO, MSU_SERVICE".IO" }
+	{ MSU_ERROR_IO, MSU_SERVICE".IO" },
+	{ MSU_ERROR_BUSY, MSU_SERVICE".Busy" },
+	{ MSU_ERROR_TIMEOUT, MSU_SERVICE".Timeout" },
+	{ MSU_ERROR_UNAVAILABLE, MSU_SERVICE".Unavailable" }
 };
 
 GQuark msu_error_quark(void)
@@ -37,7 +37,10 @@ enum msu_error_t_ {
 	MSU_ERROR_DIED,
 	MSU_ERROR_CANCELLED,
 	MSU_ERROR_BAD_MIME,
-	MSU_ERROR_IO
+	MSU_ERROR_IO,
+	MSU_ERROR_BUSY,
+	MSU_ERROR_TIMEOUT,
+	MSU_ERROR_UNAVAILABLE
 };
 typedef enum msu_error_t_ msu_error_t;
 
@@ -0,0 +1,368 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "flight.h"
+#include "log.h"
+#include "worker.h"
+
+/* A Browse or Search request sent to a server, shared by all the tasks
+   that asked for the same thing while it was in progress. */
+typedef struct msu_flight_t_ msu_flight_t;
+struct msu_flight_t_ {
+	gchar *key;
+	GUPnPServiceProxy *proxy;
+	GUPnPServiceProxyAction *action;
+	GPtrArray *waiters;
+	gboolean landed;
+	msu_flight_result_t result;
+	gchar *didl;
+};
+
+struct msu_flight_waiter_t_ {
+	msu_flight_t *flight;
+	msu_flight_cb_t cb;
+	gpointer user_data;
+	GDestroyNotify destroy;
+	gboolean cancelled;
+	gboolean raw;
+};
+
+static GHashTable *g_flights;
+
+static void prv_flight_delete(msu_flight_t *flight)
+{
+	if (flight->result.error)
+		g_error_free(flight->result.error);
+
+	if (flight->result.objects)
+		g_ptr_array_unref(flight->result.objects);
+
+	g_free(flight->didl);
+	g_ptr_array_unref(flight->waiters);
+	g_object_unref(flight->proxy);
+	g_free(flight->key);
+	g_free(flight);
+}
+
+static void prv_waiter_delete(gpointer data)
+{
+	msu_flight_waiter_t *waiter = data;
+
+	if (waiter->destroy)
+		waiter->destroy(waiter->user_data);
+
+	g_free(waiter);
+}
+
+static msu_flight_waiter_t *prv_waiter_new(msu_flight_t *flight,
+					   gboolean raw,
+					   msu_flight_cb_t cb,
+					   gpointer user_data,
+					   GDestroyNotify destroy)
+{
+	msu_flight_waiter_t *waiter;
+
+	waiter = g_new0(msu_flight_waiter_t, 1);
+	waiter->flight = flight;
+	waiter->raw = raw;
+	waiter->cb = cb;
+	waiter->user_data = user_data;
+	waiter->destroy = destroy;
+
+	g_ptr_array_add(flight->waiters, waiter);
+
+	return waiter;
+}
+
+static msu_flight_waiter_t *prv_flight_join(const gchar *key, gboolean raw,
+					    msu_flight_cb_t cb,
+					    gpointer user_data,
+					    GDestroyNotify destroy)
+{
+	msu_flight_t *flight;
+	msu_flight_waiter_t *waiter = NULL;
+
+	if (!g_flights)
+		goto finished;
+
+	flight = g_hash_table_lookup(g_flights, key);
+	if (!flight)
+		goto finished;
+
+	MSU_LOG_DEBUG("Joining request in flight (%u waiters)",
+		      flight->waiters->len);
+
+	waiter = prv_waiter_new(flight, raw, cb, user_data, destroy);
+
+finished:
+
+	return waiter;
+}
+
+static msu_flight_t *prv_flight_new(GUPnPServiceProxy *proxy, gchar *key)
+{
+	msu_flight_t *flight;
+
+	if (!g_flights)
+		g_flights = g_hash_table_new(g_str_hash, g_str_equal);
+
+	flight = g_new0(msu_flight_t, 1);
+	flight->key = key;
+	flight->proxy = g_object_ref(proxy);
+	flight->waiters = g_ptr_array_new_with_free_func(prv_waiter_delete);
+
+	g_hash_table_insert(g_flights, flight->key, flight);
+
+	return flight;
+}
+
+static void prv_flight_collect_object(GUPnPDIDLLiteParser *parser,
+				      GUPnPDIDLLiteObject *object,
+				      gpointer user_data)
+{
+	GPtrArray *objects = user_data;
+
+	g_ptr_array_add(objects, g_object_ref(object));
+}
+
+static gboolean prv_flight_needs_objects(msu_flight_t *flight)
+{
+	msu_flight_waiter_t *waiter;
+	guint i;
+
+	for (i = 0; i < flight->waiters->len; ++i) {
+		waiter = g_ptr_array_index(flight->waiters, i);
+		if (!waiter->cancelled && !waiter->raw)
+			break;
+	}
+
+	return i < flight->waiters->len;
+}
+
+/* Called from a worker thread.  The flight has landed, so nothing else
+   touches its result until it is dispatched. */
+static void prv_flight_parse(msu_worker_job_t *job, gpointer data)
+{
+	msu_flight_t *flight = data;
+	GUPnPDIDLLiteParser *parser;
+
+	parser = gupnp_didl_lite_parser_new();
+
+	g_signal_connect(parser, "object-available",
+			 G_CALLBACK(prv_flight_collect_object),
+			 flight->result.objects);
+
+	(void) gupnp_didl_lite_parser_parse_didl(parser, flight->didl,
+						 &flight->result.error);
+
+	g_object_unref(parser);
+}
+
+/* The parsing of a flight is only cancelled when the service shuts
+   down, in which case its result may be incomplete and the waiters are
+   released without being called. */
+static void prv_flight_dispatch(gboolean cancelled, gpointer data)
+{
+	msu_flight_t *flight = data;
+	msu_flight_waiter_t *waiter;
+	guint i;
+
+	if (cancelled) {
+		MSU_LOG_DEBUG("Dropping result of cancelled request");
+		goto finished;
+	}
+
+	for (i = 0; i < flight->waiters->len; ++i) {
+		waiter = g_ptr_array_index(flight->waiters, i);
+
+		if (!waiter->cancelled)
+			waiter->cb(waiter, &flight->result, waiter->user_data);
+	}
+
+finished:
+
+	prv_flight_delete(flight);
+}
+
+static void prv_flight_cb(GUPnPServiceProxy *proxy,
+			  GUPnPServiceProxyAction *action,
+			  gpointer user_data)
+{
+	msu_flight_t *flight = user_data;
+
+	MSU_LOG_DEBUG("Enter");
+
+	/* Requests made from now on need a new call to the server. */
+	(void) g_hash_table_remove(g_flights, flight->key);
+	flight->landed = TRUE;
+
+	flight->result.objects =
+		g_ptr_array_new_with_free_func(g_object_unref);
+
+	if (!gupnp_service_proxy_end_action(proxy, action,
+					    &flight->result.error,
+					    "Result", G_TYPE_STRING,
+					    &flight->didl,
+					    "TotalMatches", G_TYPE_UINT,
+					    &flight->result.total_matches,
+					    "UpdateID", G_TYPE_UINT,
+					    &flight->result.update_id,
+					    NULL))
+		goto on_error;
+
+	MSU_LOG_DEBUG("Result: %s", flight->didl);
+
+	flight->result.didl = flight->didl;
+
+	/* Large results can take long enough to parse to hold up the
+	   requests of every other client, so they are parsed by a worker
+	   thread. */
+	if (prv_flight_needs_objects(flight)) {
+		(void) msu_worker_push(prv_flight_parse, prv_flight_dispatch,
+				       flight);
+		goto finished;
+	}
+
+on_error:
+
+	prv_flight_dispatch(FALSE, flight);
+
+finished:
+
+	MSU_LOG_DEBUG("Exit");
+}
+
+msu_flight_waiter_t *msu_flight_browse(GUPnPServiceProxy *proxy,
+				       const gchar *object_id,
+				       const gchar *browse_flag,
+				       const gchar *filter,
+				       guint start, guint count,
+				       const gchar *sort_by, gboolean raw,
+				       msu_flight_cb_t cb, gpointer user_data,
+				       GDestroyNotify destroy)
+{
+	msu_flight_t *flight;
+	msu_flight_waiter_t *waiter;
+	gchar *key;
+
+	key = g_strdup_printf("%s\nBrowse\n%s\n%s\n%s\n%u\n%u\n%s",
+			      gupnp_service_info_get_udn(
+				      (GUPnPServiceInfo *)proxy),
+			      object_id, browse_flag, filter, start, count,
+			      sort_by);
+
+	waiter = prv_flight_join(key, raw, cb, user_data, destroy);
+	if (waiter) {
+		g_free(key);
+		goto finished;
+	}
+
+	flight = prv_flight_new(proxy, key);
+	waiter = prv_waiter_new(flight, raw, cb, user_data, destroy);
+
+	flight->action = gupnp_service_proxy_begin_action(
+				proxy, "Browse",
+				prv_flight_cb, flight,
+				"ObjectID", G_TYPE_STRING, object_id,
+				"BrowseFlag", G_TYPE_STRING, browse_flag,
+				"Filter", G_TYPE_STRING, filter,
+				"StartingIndex", G_TYPE_INT, start,
+				"RequestedCount", G_TYPE_INT, count,
+				"SortCriteria", G_TYPE_STRING, sort_by,
+				NULL);
+
+finished:
+
+	return waiter;
+}
+
+msu_flight_waiter_t *msu_flight_search(GUPnPServiceProxy *proxy,
+				       const gchar *container_id,
+				       const gchar *criteria,
+				       const gchar *filter,
+				       guint start, guint count,
+				       const gchar *sort_by, gboolean raw,
+				       msu_flight_cb_t cb, gpointer user_data,
+				       GDestroyNotify destroy)
+{
+	msu_flight_t *flight;
+	msu_flight_waiter_t *waiter;
+	gchar *key;
+
+	key = g_strdup_printf("%s\nSearch\n%s\n%s\n%s\n%u\n%u\n%s",
+			      gupnp_service_info_get_udn(
+				      (GUPnPServiceInfo *)proxy),
+			      container_id, criteria, filter, start, count,
+			      sort_by);
+
+	waiter = prv_flight_join(key, raw, cb, user_data, destroy);
+	if (waiter) {
+		g_free(key);
+		goto finished;
+	}
+
+	flight = prv_flight_new(proxy, key);
+	waiter = prv_waiter_new(flight, raw, cb, user_data, destroy);
+
+	flight->action = gupnp_service_proxy_begin_action(
+				proxy, "Search",
+				prv_flight_cb, flight,
+				"ContainerID", G_TYPE_STRING, container_id,
+				"SearchCriteria", G_TYPE_STRING, criteria,
+				"Filter", G_TYPE_STRING, filter,
+				"StartingIndex", G_TYPE_INT, start,
+				"RequestedCount", G_TYPE_INT, count,
+				"SortCriteria", G_TYPE_STRING, sort_by,
+				NULL);
+
+finished:
+
+	return waiter;
+}
+
+/* The call to the server is only cancelled once none of the tasks
+   sharing it are interested in its result. */
+void msu_flight_cancel(msu_flight_waiter_t *waiter)
+{
+	msu_flight_t *flight = waiter->flight;
+
+	if (flight->landed) {
+		waiter->cancelled = TRUE;
+		goto finished;
+	}
+
+	(void) g_ptr_array_remove(flight->waiters, waiter);
+
+	if (flight->waiters->len)
+		goto finished;
+
+	MSU_LOG_DEBUG("Cancelling request in flight");
+
+	(void) g_hash_table_remove(g_flights, flight->key);
+	gupnp_service_proxy_cancel_action(flight->proxy, flight->action);
+	prv_flight_delete(flight);
+
+finished:
+
+	return;
+}
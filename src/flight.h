@@ -0,0 +1,64 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_FLIGHT_H__
+#define MSU_FLIGHT_H__
+
+#include <libgupnp/gupnp-control-point.h>
+
+typedef struct msu_flight_waiter_t_ msu_flight_waiter_t;
+
+/* error is a GUPNP_XML_ERROR if the server answered but its DIDL could
+   not be parsed, and the server's error otherwise.  objects holds the
+   parsed GUPnPDIDLLiteObjects and didl the DIDL they were parsed from.
+   The DIDL is only parsed if one of the waiters is not raw, so raw
+   waiters must decode didl themselves. */
+typedef struct msu_flight_result_t_ msu_flight_result_t;
+struct msu_flight_result_t_ {
+	GError *error;
+	GPtrArray *objects;
+	const gchar *didl;
+	guint total_matches;
+	guint update_id;
+};
+
+typedef void (*msu_flight_cb_t)(msu_flight_waiter_t *waiter,
+				const msu_flight_result_t *result,
+				gpointer user_data);
+
+msu_flight_waiter_t *msu_flight_browse(GUPnPServiceProxy *proxy,
+				       const gchar *object_id,
+				       const gchar *browse_flag,
+				       const gchar *filter,
+				       guint start, guint count,
+				       const gchar *sort_by, gboolean raw,
+				       msu_flight_cb_t cb, gpointer user_data,
+				       GDestroyNotify destroy);
+msu_flight_waiter_t *msu_flight_search(GUPnPServiceProxy *proxy,
+				       const gchar *container_id,
+				       const gchar *criteria,
+				       const gchar *filter,
+				       guint start, guint count,
+				       const gchar *sort_by, gboolean raw,
+				       msu_flight_cb_t cb, gpointer user_data,
+				       GDestroyNotify destroy);
+void msu_flight_cancel(msu_flight_waiter_t *waiter);
+
+#endif
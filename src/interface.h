@@ -76,6 +76,8 @@
 #define MSU_INTERFACE_PROP_SV_SORT_EXT_CAPABILITIES "SortExtCaps"
 #define MSU_INTERFACE_PROP_SV_FEATURE_LIST "FeatureList"
 #define MSU_INTERFACE_PROP_SV_SERVICE_RESET_TOKEN "ServiceResetToken"
+#define MSU_INTERFACE_PROP_CIRCUIT_STATE "CircuitState"
+#define MSU_INTERFACE_PROP_CACHE_STATISTICS "CacheStatistics"
 
 /* Resources Properties */
 #define MSU_INTERFACE_PROP_MIME_TYPE "MIMEType"
@@ -100,6 +102,10 @@
 #define MSU_INTERFACE_RELEASE "Release"
 #define MSU_INTERFACE_SET_PROTOCOL_INFO "SetProtocolInfo"
 #define MSU_INTERFACE_PREFER_LOCAL_ADDRESSES "PreferLocalAddresses"
+#define MSU_INTERFACE_SET_TASK_PRIORITY "SetTaskPriority"
+#define MSU_INTERFACE_GET_CLIENT_STATISTICS "GetClientStatistics"
+#define MSU_INTERFACE_CANCEL_REQUEST "CancelRequest"
+#define MSU_INTERFACE_SET_REQUEST_TIMEOUT "SetRequestTimeout"
 
 #define MSU_INTERFACE_FOUND_SERVER "FoundServer"
 #define MSU_INTERFACE_LOST_SERVER "LostServer"
@@ -133,6 +139,29 @@
 #define MSU_INTERFACE_QUERY "Query"
 #define MSU_INTERFACE_PROTOCOL_INFO "ProtocolInfo"
 #define MSU_INTERFACE_PREFER "Prefer"
+#define MSU_INTERFACE_PRIORITY "Priority"
+#define MSU_INTERFACE_STATISTICS "Statistics"
+#define MSU_INTERFACE_SERIAL "Serial"
+#define MSU_INTERFACE_TIMEOUT "Timeout"
+
+#define MSU_INTERFACE_STAT_WEIGHT "Weight"
+#define MSU_INTERFACE_STAT_TASKS "Tasks"
+#define MSU_INTERFACE_STAT_TOTAL_WAIT "TotalWait"
+#define MSU_INTERFACE_STAT_MAX_WAIT "MaxWait"
+#define MSU_INTERFACE_STAT_BYTES "Bytes"
+#define MSU_INTERFACE_STAT_OBJECTS "Objects"
+#define MSU_INTERFACE_STAT_OBJECT_HITS "ObjectHits"
+#define MSU_INTERFACE_STAT_OBJECT_MISSES "ObjectMisses"
+#define MSU_INTERFACE_STAT_PAGES "Pages"
+#define MSU_INTERFACE_STAT_PAGE_HITS "PageHits"
+#define MSU_INTERFACE_STAT_PAGE_MISSES "PageMisses"
+#define MSU_INTERFACE_STAT_CHILD_COUNTS "ChildCounts"
+#define MSU_INTERFACE_STAT_CHILD_COUNT_HITS "ChildCountHits"
+#define MSU_INTERFACE_STAT_CHILD_COUNT_MISSES "ChildCountMisses"
+#define MSU_INTERFACE_STAT_PREFETCHES "Prefetches"
+#define MSU_INTERFACE_STAT_PREFETCH_HITS "PrefetchHits"
+#define MSU_INTERFACE_STAT_STORE_HITS "StoreHits"
+#define MSU_INTERFACE_STAT_TIMEOUTS "Timeouts"
 
 #define MSU_INTERFACE_OFFSET "Offset"
 #define MSU_INTERFACE_MAX "Max"
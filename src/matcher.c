@@ -0,0 +1,315 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+
+#include "log.h"
+#include "matcher.h"
+
+#define MSU_MATCHER_WILDCARD "*"
+
+/* GUPnP considers LPCM MIME types with and without parameters to be
+   compatible, so they can not be looked up by MIME type. */
+#define MSU_MATCHER_LPCM "audio/L16"
+
+/* Protocols and MIME types longer than this are not looked up in the
+   index, and the resource is then compared with every protocol info. */
+#define MSU_MATCHER_MAX_FIELD 128
+
+/* protocols maps each protocol to a table of the MIME types used with
+   it, which maps each MIME type to the protocol infos with both.  The
+   protocol infos themselves are owned by infos.  Lookups ignore case,
+   as gupnp_protocol_info_is_compatible does.  Protocol infos with an
+   LPCM MIME type are filed under the wildcard MIME type. */
+struct msu_matcher_t_ {
+	gint ref_count;
+	GPtrArray *infos;
+	GHashTable *protocols;
+};
+
+static guint prv_case_hash(gconstpointer key)
+{
+	const gchar *str = key;
+	guint hash = 5381;
+
+	for (; *str; ++str)
+		hash = (hash << 5) + hash + g_ascii_tolower(*str);
+
+	return hash;
+}
+
+static gboolean prv_case_equal(gconstpointer a, gconstpointer b)
+{
+	return !g_ascii_strcasecmp(a, b);
+}
+
+static gboolean prv_is_wildcard(const gchar *field)
+{
+	return !field || field[0] == '*';
+}
+
+static gboolean prv_is_lpcm(const gchar *mime_type)
+{
+	return !g_ascii_strncasecmp(mime_type, MSU_MATCHER_LPCM,
+				    strlen(MSU_MATCHER_LPCM));
+}
+
+/* Resources whose protocol or MIME type can not be looked up have to be
+   compared with every protocol info. */
+static gboolean prv_is_indexed(const gchar *protocol, const gchar *mime_type)
+{
+	return !prv_is_wildcard(protocol) && !prv_is_wildcard(mime_type) &&
+		!prv_is_lpcm(mime_type);
+}
+
+static void prv_add_info(msu_matcher_t *matcher, GUPnPProtocolInfo *pi)
+{
+	const gchar *protocol;
+	const gchar *mime_type;
+	GHashTable *mime_types;
+	GPtrArray *infos;
+
+	g_ptr_array_add(matcher->infos, pi);
+
+	protocol = gupnp_protocol_info_get_protocol(pi);
+	if (prv_is_wildcard(protocol))
+		protocol = MSU_MATCHER_WILDCARD;
+
+	mime_type = gupnp_protocol_info_get_mime_type(pi);
+	if (prv_is_wildcard(mime_type) || prv_is_lpcm(mime_type))
+		mime_type = MSU_MATCHER_WILDCARD;
+
+	mime_types = g_hash_table_lookup(matcher->protocols, protocol);
+	if (!mime_types) {
+		mime_types = g_hash_table_new_full(
+					prv_case_hash, prv_case_equal, g_free,
+					(GDestroyNotify) g_ptr_array_unref);
+		g_hash_table_insert(matcher->protocols, g_strdup(protocol),
+				    mime_types);
+	}
+
+	infos = g_hash_table_lookup(mime_types, mime_type);
+	if (!infos) {
+		infos = g_ptr_array_new();
+		g_hash_table_insert(mime_types, g_strdup(mime_type), infos);
+	}
+
+	g_ptr_array_add(infos, pi);
+}
+
+msu_matcher_t *msu_matcher_new(const gchar *protocol_info)
+{
+	msu_matcher_t *matcher = NULL;
+	GUPnPProtocolInfo *pi;
+	gchar **pi_str_array;
+	guint i;
+
+	if (!protocol_info)
+		goto finished;
+
+	matcher = g_new0(msu_matcher_t, 1);
+	matcher->ref_count = 1;
+	matcher->infos = g_ptr_array_new_with_free_func(g_object_unref);
+	matcher->protocols = g_hash_table_new_full(
+					prv_case_hash, prv_case_equal, g_free,
+					(GDestroyNotify) g_hash_table_unref);
+
+	pi_str_array = g_strsplit(protocol_info, ",", 0);
+
+	for (i = 0; pi_str_array[i]; ++i) {
+		pi = gupnp_protocol_info_new_from_string(pi_str_array[i],
+							 NULL);
+		if (pi)
+			prv_add_info(matcher, pi);
+	}
+
+	g_strfreev(pi_str_array);
+
+	MSU_LOG_DEBUG("Indexed %u protocol infos under %u protocols",
+		      matcher->infos->len,
+		      g_hash_table_size(matcher->protocols));
+
+finished:
+
+	return matcher;
+}
+
+msu_matcher_t *msu_matcher_ref(msu_matcher_t *matcher)
+{
+	if (matcher)
+		g_atomic_int_inc(&matcher->ref_count);
+
+	return matcher;
+}
+
+void msu_matcher_unref(msu_matcher_t *matcher)
+{
+	if (matcher && g_atomic_int_dec_and_test(&matcher->ref_count)) {
+		g_hash_table_unref(matcher->protocols);
+		g_ptr_array_unref(matcher->infos);
+		g_free(matcher);
+	}
+}
+
+static GPtrArray *prv_lookup(const msu_matcher_t *matcher,
+			     const gchar *protocol, const gchar *mime_type)
+{
+	GHashTable *mime_types;
+	GPtrArray *infos = NULL;
+
+	mime_types = g_hash_table_lookup(matcher->protocols, protocol);
+	if (mime_types)
+		infos = g_hash_table_lookup(mime_types, mime_type);
+
+	return infos;
+}
+
+static gboolean prv_match_infos(GPtrArray *infos, GUPnPProtocolInfo *res_pi)
+{
+	gboolean match = FALSE;
+	guint i;
+
+	if (!infos)
+		goto finished;
+
+	for (i = 0; !match && i < infos->len; ++i)
+		match = gupnp_protocol_info_is_compatible(
+					g_ptr_array_index(infos, i), res_pi);
+
+finished:
+
+	return match;
+}
+
+/* Only the protocol infos with the same protocol and MIME type as the
+   resource, or with wildcards in their place, can be compatible with
+   it. */
+gboolean msu_matcher_match(const msu_matcher_t *matcher,
+			   GUPnPProtocolInfo *res_pi)
+{
+	const gchar *protocol;
+	const gchar *mime_type;
+	const gchar *any = MSU_MATCHER_WILDCARD;
+	gboolean match = FALSE;
+
+	if (!matcher) {
+		match = TRUE;
+		goto finished;
+	}
+
+	if (!res_pi)
+		goto finished;
+
+	protocol = gupnp_protocol_info_get_protocol(res_pi);
+	mime_type = gupnp_protocol_info_get_mime_type(res_pi);
+
+	if (!prv_is_indexed(protocol, mime_type)) {
+		match = prv_match_infos(matcher->infos, res_pi);
+		goto finished;
+	}
+
+	match = prv_match_infos(prv_lookup(matcher, protocol, mime_type),
+				res_pi) ||
+		prv_match_infos(prv_lookup(matcher, protocol, any), res_pi) ||
+		prv_match_infos(prv_lookup(matcher, any, mime_type), res_pi) ||
+		prv_match_infos(prv_lookup(matcher, any, any), res_pi);
+
+finished:
+
+	return match;
+}
+
+/* Copies the field of a protocol info string that starts at str into
+   dest and returns the start of the next one, or NULL if the field is
+   the last one or is too long. */
+static const gchar *prv_copy_field(const gchar *str, gchar *dest)
+{
+	const gchar *end;
+	const gchar *next = NULL;
+
+	end = strchr(str, ':');
+	if (end && end - str < MSU_MATCHER_MAX_FIELD) {
+		memcpy(dest, str, end - str);
+		dest[end - str] = 0;
+		next = end + 1;
+	}
+
+	return next;
+}
+
+/* Tells whether some protocol info might be compatible with the
+   resource, without having to parse the protocol info of the resource
+   into a GUPnPProtocolInfo. */
+static gboolean prv_has_candidates(const msu_matcher_t *matcher,
+				   const gchar *res_protocol_info)
+{
+	gchar protocol[MSU_MATCHER_MAX_FIELD];
+	gchar mime_type[MSU_MATCHER_MAX_FIELD];
+	gchar network[MSU_MATCHER_MAX_FIELD];
+	const gchar *any = MSU_MATCHER_WILDCARD;
+	const gchar *str = res_protocol_info;
+	gboolean retval = TRUE;
+
+	str = prv_copy_field(str, protocol);
+	if (str)
+		str = prv_copy_field(str, network);
+	if (str)
+		str = prv_copy_field(str, mime_type);
+	if (!str)
+		goto finished;
+
+	if (!prv_is_indexed(protocol, mime_type))
+		goto finished;
+
+	retval = prv_lookup(matcher, protocol, mime_type) ||
+		prv_lookup(matcher, protocol, any) ||
+		prv_lookup(matcher, any, mime_type) ||
+		prv_lookup(matcher, any, any);
+
+finished:
+
+	return retval;
+}
+
+gboolean msu_matcher_match_string(const msu_matcher_t *matcher,
+				  const gchar *res_protocol_info)
+{
+	GUPnPProtocolInfo *res_pi;
+	gboolean match = FALSE;
+
+	if (!matcher) {
+		match = TRUE;
+		goto finished;
+	}
+
+	if (!res_protocol_info ||
+	    !prv_has_candidates(matcher, res_protocol_info))
+		goto finished;
+
+	res_pi = gupnp_protocol_info_new_from_string(res_protocol_info, NULL);
+	if (res_pi) {
+		match = msu_matcher_match(matcher, res_pi);
+		g_object_unref(res_pi);
+	}
+
+finished:
+
+	return match;
+}
@@ -0,0 +1,42 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_MATCHER_H__
+#define MSU_MATCHER_H__
+
+#include <glib.h>
+#include <libgupnp-av/gupnp-av.h>
+
+/* A list of protocol infos, such as those supported by a client, parsed
+   once and indexed by protocol and MIME type.  A matcher is never
+   modified once built, so it can be shared with worker threads.  A NULL
+   matcher matches every resource. */
+typedef struct msu_matcher_t_ msu_matcher_t;
+
+msu_matcher_t *msu_matcher_new(const gchar *protocol_info);
+msu_matcher_t *msu_matcher_ref(msu_matcher_t *matcher);
+void msu_matcher_unref(msu_matcher_t *matcher);
+
+gboolean msu_matcher_match(const msu_matcher_t *matcher,
+			   GUPnPProtocolInfo *res_pi);
+gboolean msu_matcher_match_string(const msu_matcher_t *matcher,
+				  const gchar *res_protocol_info);
+
+#endif
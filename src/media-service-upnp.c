@@ -29,15 +29,20 @@
 #include <syslog.h>
 #include <sys/signalfd.h>
 
+#include "arena.h"
+#include "cache.h"
 #include "client.h"
 #include "device.h"
 #include "error.h"
 #include "interface.h"
 #include "log.h"
 #include "path.h"
+#include "pressure.h"
 #include "settings.h"
+#include "store.h"
 #include "async.h"
 #include "upnp.h"
+#include "worker.h"
 
 #ifdef UA_PREFIX
 	#define PRG_NAME UA_PREFIX " dLeyna/" VERSION
@@ -59,6 +64,9 @@ struct msu_context_t_ {
 	msu_task_processor_t *processor;
 	msu_upnp_t *upnp;
 	msu_settings_context_t *settings;
+	msu_pressure_t *pressure;
+	GHashTable *weighted_owners;
+	GArray *weight_watch_ids;
 };
 
 static msu_context_t g_context;
@@ -84,6 +92,22 @@ static const gchar g_msu_root_introspection[] =
 	"      <arg type='b' name='"MSU_INTERFACE_PREFER"'"
 	"           direction='in'/>"
 	"    </method>"
+	"    <method name='"MSU_INTERFACE_SET_TASK_PRIORITY"'>"
+	"      <arg type='s' name='"MSU_INTERFACE_PRIORITY"'"
+	"           direction='in'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_SET_REQUEST_TIMEOUT"'>"
+	"      <arg type='u' name='"MSU_INTERFACE_TIMEOUT"'"
+	"           direction='in'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_CANCEL_REQUEST"'>"
+	"      <arg type='u' name='"MSU_INTERFACE_SERIAL"'"
+	"           direction='in'/>"
+	"    </method>"
+	"    <method name='"MSU_INTERFACE_GET_CLIENT_STATISTICS"'>"
+	"      <arg type='a{sa{sv}}' name='"MSU_INTERFACE_STATISTICS"'"
+	"           direction='out'/>"
+	"    </method>"
 	"    <signal name='"MSU_INTERFACE_FOUND_SERVER"'>"
 	"      <arg type='o' name='"MSU_INTERFACE_PATH"'/>"
 	"    </signal>"
@@ -486,10 +510,101 @@ static gboolean prv_context_quit_cb(gpointer user_data)
 	return FALSE;
 }
 
+static guint prv_get_client_weight(const gchar *client_name)
+{
+	const gchar *name;
+
+	name = g_hash_table_lookup(g_context.weighted_owners, client_name);
+
+	return msu_settings_get_client_weight(g_context.settings,
+					      name ? name : client_name);
+}
+
+static GVariant *prv_get_client_statistics(void)
+{
+	GVariantBuilder vb;
+	GVariantBuilder client_vb;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	msu_client_t *client;
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sa{sv}}"));
+
+	g_hash_table_iter_init(&iter, g_context.watchers);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		client = value;
+
+		g_variant_builder_init(&client_vb, G_VARIANT_TYPE("a{sv}"));
+		g_variant_builder_add(&client_vb, "{sv}",
+				      MSU_INTERFACE_STAT_WEIGHT,
+				      g_variant_new_uint32(
+					      prv_get_client_weight(key)));
+		g_variant_builder_add(&client_vb, "{sv}",
+				      MSU_INTERFACE_STAT_TASKS,
+				      g_variant_new_uint32(
+					      client->tasks_started));
+		g_variant_builder_add(&client_vb, "{sv}",
+				      MSU_INTERFACE_STAT_TOTAL_WAIT,
+				      g_variant_new_uint64(client->total_wait));
+		g_variant_builder_add(&client_vb, "{sv}",
+				      MSU_INTERFACE_STAT_MAX_WAIT,
+				      g_variant_new_uint64(client->max_wait));
+
+		g_variant_builder_add(&vb, "{s@a{sv}}", key,
+				      g_variant_builder_end(&client_vb));
+	}
+
+	return g_variant_ref_sink(g_variant_builder_end(&vb));
+}
+
 static void prv_sync_task_complete(msu_task_t *task)
 {
 	msu_task_complete(task);
-	msu_task_queue_task_completed(task->atom.queue_id);
+	msu_task_queue_task_completed(&task->atom);
+}
+
+static void prv_set_task_priority(msu_task_t *task)
+{
+	const gchar *client_name;
+	msu_client_t *client;
+	const gchar *priority = task->ut.task_priority.priority;
+	GError *error = NULL;
+
+	client_name = g_dbus_method_invocation_get_sender(task->invocation);
+	client = g_hash_table_lookup(g_context.watchers, client_name);
+
+	if (!client)
+		goto finished;
+
+	if (!*priority) {
+		client->override_priority = FALSE;
+	} else if (!strcmp(priority, "high")) {
+		client->override_priority = TRUE;
+		client->priority = MSU_TASK_PRIORITY_HIGH;
+	} else if (!strcmp(priority, "normal")) {
+		client->override_priority = TRUE;
+		client->priority = MSU_TASK_PRIORITY_NORMAL;
+	} else if (!strcmp(priority, "low")) {
+		client->override_priority = TRUE;
+		client->priority = MSU_TASK_PRIORITY_LOW;
+	} else {
+		MSU_LOG_WARNING("Invalid task priority %s", priority);
+
+		error = g_error_new(MSU_ERROR, MSU_ERROR_OPERATION_FAILED,
+				    "Invalid task priority: %s", priority);
+	}
+
+finished:
+
+	if (error) {
+		msu_task_fail(task, error);
+		g_error_free(error);
+	} else {
+		msu_task_complete(task);
+	}
+
+	msu_task_queue_task_completed(&task->atom);
 }
 
 static void prv_process_sync_task(msu_task_t *task)
@@ -505,6 +620,10 @@ static void prv_process_sync_task(msu_task_t *task)
 		task->result = msu_upnp_get_server_ids(g_context.upnp);
 		prv_sync_task_complete(task);
 		break;
+	case MSU_TASK_GET_CLIENT_STATISTICS:
+		task->result = prv_get_client_statistics();
+		prv_sync_task_complete(task);
+		break;
 	case MSU_TASK_SET_PROTOCOL_INFO:
 		client_name =
 			g_dbus_method_invocation_get_sender(task->invocation);
@@ -518,6 +637,10 @@ static void prv_process_sync_task(msu_task_t *task)
 			} else {
 				client->protocol_info = NULL;
 			}
+
+			msu_matcher_unref(client->matcher);
+			client->matcher =
+				msu_matcher_new(client->protocol_info);
 		}
 		prv_sync_task_complete(task);
 		break;
@@ -531,17 +654,29 @@ static void prv_process_sync_task(msu_task_t *task)
 		}
 		prv_sync_task_complete(task);
 		break;
+	case MSU_TASK_SET_TASK_PRIORITY:
+		prv_set_task_priority(task);
+		break;
+	case MSU_TASK_SET_REQUEST_TIMEOUT:
+		client_name =
+			g_dbus_method_invocation_get_sender(task->invocation);
+		client = g_hash_table_lookup(g_context.watchers, client_name);
+		if (client)
+			client->request_timeout =
+					task->ut.request_timeout.timeout;
+		prv_sync_task_complete(task);
+		break;
 	case MSU_TASK_GET_UPLOAD_STATUS:
 		msu_upnp_get_upload_status(g_context.upnp, task);
-		msu_task_queue_task_completed(task->atom.queue_id);
+		msu_task_queue_task_completed(&task->atom);
 		break;
 	case MSU_TASK_GET_UPLOAD_IDS:
 		msu_upnp_get_upload_ids(g_context.upnp, task);
-		msu_task_queue_task_completed(task->atom.queue_id);
+		msu_task_queue_task_completed(&task->atom);
 		break;
 	case MSU_TASK_CANCEL_UPLOAD:
 		msu_upnp_cancel_upload(g_context.upnp, task);
-		msu_task_queue_task_completed(task->atom.queue_id);
+		msu_task_queue_task_completed(&task->atom);
 		break;
 	default:
 		break;
@@ -550,8 +685,23 @@ static void prv_process_sync_task(msu_task_t *task)
 
 static void prv_async_task_complete(msu_task_t *task, GError *error)
 {
+	msu_async_task_t *async_task = (msu_async_task_t *)task;
+	msu_device_t *device = NULL;
+
 	MSU_LOG_DEBUG("Enter");
 
+	/* The task's device may have disappeared while the task was
+	   running. */
+	if (task->target.root_path)
+		device = msu_device_from_path(
+				task->target.root_path,
+				msu_upnp_get_server_udn_map(g_context.upnp));
+
+	if (device)
+		msu_device_record_result(device, error,
+					 error && (async_task->timed_out ||
+						   async_task->server_failed));
+
 	if (error) {
 		msu_task_fail(task, error);
 		g_error_free(error);
@@ -559,11 +709,19 @@ static void prv_async_task_complete(msu_task_t *task, GError *error)
 		msu_task_complete(task);
 	}
 
-	msu_task_queue_task_completed(task->atom.queue_id);
+	msu_task_queue_task_completed(&task->atom);
 
 	MSU_LOG_DEBUG("Exit");
 }
 
+static guint prv_get_request_timeout(msu_client_t *client)
+{
+	if (client && client->request_timeout)
+		return client->request_timeout;
+
+	return msu_settings_get_server_timeout(g_context.settings);
+}
+
 static void prv_process_async_task(msu_task_t *task)
 {
 	msu_async_task_t *async_task = (msu_async_task_t *)task;
@@ -577,6 +735,8 @@ static void prv_process_async_task(msu_task_t *task)
 		g_dbus_method_invocation_get_sender(task->invocation);
 	client = g_hash_table_lookup(g_context.watchers, client_name);
 
+	msu_async_task_set_timeout(async_task, prv_get_request_timeout(client));
+
 	switch (task->type) {
 	case MSU_TASK_GET_CHILDREN:
 		msu_upnp_get_children(g_context.upnp, client, task,
@@ -637,10 +797,31 @@ static void prv_process_async_task(msu_task_t *task)
 	MSU_LOG_DEBUG("Exit");
 }
 
+static void prv_update_client_wait(msu_task_t *task)
+{
+	const gchar *client_name;
+	msu_client_t *client;
+	guint64 wait;
+
+	client_name = g_dbus_method_invocation_get_sender(task->invocation);
+	client = g_hash_table_lookup(g_context.watchers, client_name);
+
+	if (client) {
+		wait = g_get_monotonic_time() - task->atom.queued_at;
+
+		client->tasks_started++;
+		client->total_wait += wait;
+		if (wait > client->max_wait)
+			client->max_wait = wait;
+	}
+}
+
 static void prv_process_task(msu_task_atom_t *task, gpointer user_data)
 {
 	msu_task_t *client_task = (msu_task_t *)task;
 
+	prv_update_client_wait(client_task);
+
 	if (client_task->synchronous)
 		prv_process_sync_task(client_task);
 	else
@@ -763,6 +944,8 @@ static void prv_msu_context_init(void)
 
 static void prv_msu_context_free(void)
 {
+	guint i;
+
 	msu_upnp_delete(g_context.upnp);
 
 	if (g_context.watchers)
@@ -795,10 +978,82 @@ static void prv_msu_context_free(void)
 	if (g_context.root_node_info)
 		g_dbus_node_info_unref(g_context.root_node_info);
 
+	if (g_context.weight_watch_ids) {
+		for (i = 0; i < g_context.weight_watch_ids->len; ++i)
+			g_bus_unwatch_name(g_array_index(
+					g_context.weight_watch_ids, guint, i));
+		g_array_unref(g_context.weight_watch_ids);
+	}
+
+	if (g_context.weighted_owners)
+		g_hash_table_unref(g_context.weighted_owners);
+
+	msu_pressure_delete(g_context.pressure);
+	msu_worker_shutdown();
+	msu_arena_flush_pool();
+
 	if (g_context.settings)
 		msu_settings_delete(g_context.settings);
 }
 
+static void prv_weighted_name_appeared(GDBusConnection *connection,
+				       const gchar *name,
+				       const gchar *name_owner,
+				       gpointer user_data)
+{
+	MSU_LOG_DEBUG("Weighted client %s owned by %s", name, name_owner);
+
+	g_hash_table_insert(g_context.weighted_owners, g_strdup(name_owner),
+			    g_strdup(name));
+}
+
+static gboolean prv_weighted_owner_find(gpointer key, gpointer value,
+					gpointer user_data)
+{
+	return !strcmp(value, user_data);
+}
+
+static void prv_weighted_name_vanished(GDBusConnection *connection,
+				       const gchar *name,
+				       gpointer user_data)
+{
+	(void) g_hash_table_foreach_remove(g_context.weighted_owners,
+					   prv_weighted_owner_find,
+					   (gpointer)name);
+}
+
+static void prv_watch_weighted_names(void)
+{
+	GList *names;
+	GList *next;
+	const gchar *name;
+	guint id;
+
+	g_context.weighted_owners = g_hash_table_new_full(g_str_hash,
+							  g_str_equal,
+							  g_free, g_free);
+	g_context.weight_watch_ids = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	names = msu_settings_get_client_weight_names(g_context.settings);
+
+	/* Unique names are matched directly against the client names.
+	   Well-known names need to be mapped to their current owners. */
+	for (next = names; next; next = next->next) {
+		name = next->data;
+		if (name[0] == ':')
+			continue;
+
+		id = g_bus_watch_name(G_BUS_TYPE_SESSION, name,
+				      G_BUS_NAME_WATCHER_FLAGS_NONE,
+				      prv_weighted_name_appeared,
+				      prv_weighted_name_vanished,
+				      NULL, NULL);
+		g_array_append_val(g_context.weight_watch_ids, id);
+	}
+
+	g_list_free(names);
+}
+
 static void prv_remove_client(const gchar *name)
 {
 	msu_task_processor_remove_queues_for_source(g_context.processor, name);
@@ -818,17 +1073,184 @@ static void prv_lost_client(GDBusConnection *connection, const gchar *name,
 	prv_remove_client(name);
 }
 
+static gboolean prv_task_is_superseded(msu_task_atom_t *atom,
+				       gpointer user_data)
+{
+	msu_task_t *queued = (msu_task_t *)atom;
+	msu_task_t *task = user_data;
+
+	return queued->type == MSU_TASK_GET_CHILDREN &&
+		queued->ut.get_children.containers ==
+		task->ut.get_children.containers &&
+		queued->ut.get_children.items == task->ut.get_children.items &&
+		!strcmp(queued->target.path, task->target.path);
+}
+
+static gboolean prv_check_task_limits(msu_task_t *task,
+				      const gchar *client_name,
+				      const gchar *sink, GError **error)
+{
+	guint tasks;
+	gsize bytes;
+	guint max_tasks;
+	gsize max_bytes;
+
+	msu_settings_get_client_limits(g_context.settings, &max_tasks,
+				       &max_bytes);
+	msu_task_processor_get_source_load(g_context.processor, client_name,
+					   &tasks, &bytes);
+
+	if ((max_tasks && tasks >= max_tasks) ||
+	    (max_bytes && bytes + task->atom.size > max_bytes)) {
+		MSU_LOG_WARNING("Client %s is busy: %u tasks, %"
+				G_GSIZE_FORMAT" bytes queued", client_name,
+				tasks, bytes);
+
+		*error = g_error_new(MSU_ERROR, MSU_ERROR_BUSY,
+				     "Too many requests queued by the client");
+		goto on_error;
+	}
+
+	if (!strcmp(sink, MSU_SINK))
+		goto finished;
+
+	msu_settings_get_server_limits(g_context.settings, &max_tasks,
+				       &max_bytes);
+	msu_task_processor_get_sink_load(g_context.processor, sink,
+					 &tasks, &bytes);
+
+	if ((max_tasks && tasks >= max_tasks) ||
+	    (max_bytes && bytes + task->atom.size > max_bytes)) {
+		MSU_LOG_WARNING("Server %s is busy: %u tasks, %"
+				G_GSIZE_FORMAT" bytes queued", sink,
+				tasks, bytes);
+
+		*error = g_error_new(MSU_ERROR, MSU_ERROR_BUSY,
+				     "Too many requests queued for the server");
+		goto on_error;
+	}
+
+finished:
+
+	return TRUE;
+
+on_error:
+
+	return FALSE;
+}
+
+static gboolean prv_check_circuit(msu_task_t *task, GError **error)
+{
+	msu_device_t *device = task->target.device;
+	gboolean root_object;
+
+	if (!device || task->synchronous)
+		goto finished;
+
+	if (msu_device_is_available(device))
+		goto finished;
+
+	/* Clients can still read the properties of the server object,
+	   to follow the state of the circuit. */
+	root_object = !strcmp(task->target.id, "0");
+	if (root_object && (task->type == MSU_TASK_GET_PROP ||
+			    task->type == MSU_TASK_GET_ALL_PROPS))
+		goto finished;
+
+	MSU_LOG_WARNING("Server %s is unavailable", device->path);
+
+	*error = g_error_new(MSU_ERROR, MSU_ERROR_UNAVAILABLE,
+			     "Server is unavailable");
+	goto on_error;
+
+finished:
+
+	return TRUE;
+
+on_error:
+
+	return FALSE;
+}
+
+static void prv_apply_circuit_limits(void)
+{
+	guint max_failures;
+	guint cool_down;
+
+	msu_settings_get_circuit_limits(g_context.settings, &max_failures,
+					&cool_down);
+	msu_device_set_circuit_limits(max_failures, cool_down);
+}
+
+static void prv_apply_cache_limits(void)
+{
+	gsize max_bytes;
+	gsize server_max_bytes;
+
+	msu_settings_get_cache_limits(g_context.settings, &max_bytes,
+				      &server_max_bytes);
+	msu_cache_set_budgets(max_bytes, server_max_bytes);
+}
+
+static void prv_apply_worker_threads(void)
+{
+	msu_worker_set_threads(
+		msu_settings_get_worker_threads(g_context.settings));
+}
+
+static void prv_apply_client_settings(msu_client_t *client)
+{
+	client->read_ahead = msu_settings_is_read_ahead(g_context.settings);
+	client->streaming_didl =
+		msu_settings_is_streaming_didl(g_context.settings);
+}
+
+static void prv_settings_changed(gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer client;
+
+	prv_apply_circuit_limits();
+	prv_apply_cache_limits();
+	prv_apply_worker_threads();
+
+	g_hash_table_iter_init(&iter, g_context.watchers);
+	while (g_hash_table_iter_next(&iter, NULL, &client))
+		prv_apply_client_settings(client);
+}
+
+static void prv_memory_pressure(gpointer user_data)
+{
+	msu_cache_shed();
+	msu_arena_flush_pool();
+}
+
 static void prv_add_task(msu_task_t *task, const gchar *sink)
 {
 	const gchar *client_name;
 	msu_client_t *client;
 	const msu_task_queue_key_t *queue_id;
+	GError *error = NULL;
 
 	client_name = g_dbus_method_invocation_get_sender(task->invocation);
+	task->atom.size = msu_task_estimate_size(task);
+
+	/* The task is admitted before it takes any resource, or replaces
+	   any of the tasks already queued */
+	if (!prv_check_task_limits(task, client_name, sink, &error) ||
+	    !prv_check_circuit(task, &error)) {
+		msu_task_fail(task, error);
+		msu_task_delete(task);
+		g_error_free(error);
+
+		goto finished;
+	}
 
-	if (!g_hash_table_lookup(g_context.watchers, client_name)) {
+	client = g_hash_table_lookup(g_context.watchers, client_name);
+	if (!client) {
 		client = g_new0(msu_client_t, 1);
 		client->prefer_local_addresses = TRUE;
+		prv_apply_client_settings(client);
 		client->id = g_bus_watch_name(G_BUS_TYPE_SESSION, client_name,
 					      G_BUS_NAME_WATCHER_FLAGS_NONE,
 					      NULL, prv_lost_client, NULL,
@@ -849,7 +1271,69 @@ static void prv_add_task(msu_task_t *task, const gchar *sink)
 						prv_cancel_task,
 						prv_delete_task);
 
+	if (task->type == MSU_TASK_GET_CHILDREN &&
+	    msu_settings_is_drop_superseded_browse(g_context.settings))
+		(void) msu_task_queue_remove_tasks(queue_id,
+						   prv_task_is_superseded,
+						   task);
+
+	/* Manager requests update the client's state and must stay
+	   serialized.  Requests to a server can run in parallel, sharing
+	   the server fairly with the requests of its other clients. */
+	if (strcmp(sink, MSU_SINK)) {
+		msu_task_queue_set_max_running(
+			queue_id,
+			msu_settings_get_max_parallel_tasks(g_context.settings));
+		msu_task_queue_set_weight(queue_id,
+					  prv_get_client_weight(client_name));
+		msu_task_processor_set_sink_max_running(
+			g_context.processor, sink,
+			msu_settings_get_max_server_tasks(g_context.settings));
+
+		if (client->override_priority)
+			task->atom.priority = client->priority;
+	}
+
 	msu_task_queue_add_task(queue_id, &task->atom);
+
+finished:
+
+	return;
+}
+
+static gboolean prv_task_has_serial(msu_task_atom_t *task, gpointer user_data)
+{
+	msu_task_t *client_task = (msu_task_t *)task;
+	GDBusMessage *message;
+
+	if (!client_task->invocation)
+		return FALSE;
+
+	message = g_dbus_method_invocation_get_message(client_task->invocation);
+
+	return g_dbus_message_get_serial(message) == GPOINTER_TO_UINT(user_data);
+}
+
+static void prv_cancel_request(GDBusMethodInvocation *invocation,
+			       GVariant *parameters)
+{
+	const gchar *client_name;
+	guint32 serial;
+
+	client_name = g_dbus_method_invocation_get_sender(invocation);
+	g_variant_get(parameters, "(u)", &serial);
+
+	MSU_LOG_DEBUG("Cancel request %u of client %s", serial, client_name);
+
+	if (msu_task_processor_cancel_task(g_context.processor, client_name,
+					   prv_task_has_serial,
+					   GUINT_TO_POINTER(serial)))
+		g_dbus_method_invocation_return_value(invocation, NULL);
+	else
+		g_dbus_method_invocation_return_error(
+					invocation, MSU_ERROR,
+					MSU_ERROR_OBJECT_NOT_FOUND,
+					"No such request: %u", serial);
 }
 
 static void prv_msu_method_call(GDBusConnection *conn,
@@ -866,6 +1350,8 @@ static void prv_msu_method_call(GDBusConnection *conn,
 		client_name = g_dbus_method_invocation_get_sender(invocation);
 		prv_remove_client(client_name);
 		g_dbus_method_invocation_return_value(invocation, NULL);
+	} else if (!strcmp(method, MSU_INTERFACE_CANCEL_REQUEST)) {
+		prv_cancel_request(invocation, parameters);
 	} else if (!strcmp(method, MSU_INTERFACE_GET_VERSION)) {
 		task = msu_task_get_version_new(invocation);
 		prv_add_task(task, MSU_SINK);
@@ -879,17 +1365,27 @@ static void prv_msu_method_call(GDBusConnection *conn,
 		task = msu_task_prefer_local_addresses_new(invocation,
 							   parameters);
 		prv_add_task(task, MSU_SINK);
+	} else if (!strcmp(method, MSU_INTERFACE_SET_TASK_PRIORITY)) {
+		task = msu_task_set_task_priority_new(invocation, parameters);
+		prv_add_task(task, MSU_SINK);
+	} else if (!strcmp(method, MSU_INTERFACE_SET_REQUEST_TIMEOUT)) {
+		task = msu_task_set_request_timeout_new(invocation, parameters);
+		prv_add_task(task, MSU_SINK);
+	} else if (!strcmp(method, MSU_INTERFACE_GET_CLIENT_STATISTICS)) {
+		task = msu_task_get_client_statistics_new(invocation);
+		prv_add_task(task, MSU_SINK);
 	}
 }
 
 gboolean msu_media_service_get_object_info(const gchar *object_path,
+					   msu_arena_t *arena,
 					   gchar **root_path,
 					   gchar **object_id,
 					   msu_device_t **device,
 					   GError **error)
 {
-	if (!msu_path_get_path_and_id(object_path, root_path, object_id,
-				      error)) {
+	if (!msu_path_get_path_and_id(object_path, arena, root_path,
+				      object_id, error)) {
 		MSU_LOG_WARNING("Bad object %s", object_path);
 
 		goto on_error;
@@ -905,8 +1401,10 @@ gboolean msu_media_service_get_object_info(const gchar *object_path,
 				     "Cannot locate device corresponding to"
 				     " the specified path");
 
-		g_free(*root_path);
-		g_free(*object_id);
+		if (!arena) {
+			g_free(*root_path);
+			g_free(*object_id);
+		}
 
 		goto on_error;
 	}
@@ -924,8 +1422,8 @@ static const gchar *prv_get_device_id(const gchar *object, GError **error)
 	gchar *root_path;
 	gchar *id;
 
-	if (!msu_media_service_get_object_info(object, &root_path, &id, &device,
-					       error))
+	if (!msu_media_service_get_object_info(object, NULL, &root_path, &id,
+					       &device, error))
 		goto on_error;
 
 	g_free(id);
@@ -1294,6 +1792,8 @@ static void prv_unregister_client(gpointer user_data)
 	if (client) {
 		g_bus_unwatch_name(client->id);
 		g_free(client->protocol_info);
+		msu_matcher_unref(client->matcher);
+		g_free(client->browse_path);
 		g_free(client);
 	}
 }
@@ -1322,10 +1822,25 @@ int main(int argc, char *argv[])
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
 		goto on_error;
 
+	/* Results are parsed by a pool of threads. */
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+#endif
+
 	g_type_init();
 
 	msu_log_init(argv[0]);
 	msu_settings_new(&g_context.settings);
+	prv_watch_weighted_names();
+	msu_store_set_enabled(
+		msu_settings_is_persistent_cache(g_context.settings));
+	prv_apply_circuit_limits();
+	prv_apply_cache_limits();
+	prv_apply_worker_threads();
+	msu_settings_set_changed_cb(g_context.settings, prv_settings_changed,
+				    NULL);
+	g_context.pressure = msu_pressure_new(prv_memory_pressure, NULL);
 
 	g_set_prgname(PRG_NAME);
 
@@ -25,6 +25,7 @@
 
 #include <glib.h>
 
+#include "arena.h"
 #include "task-processor.h"
 
 #define MSU_SINK "media-service-upnp"
@@ -34,6 +35,7 @@ typedef struct msu_device_context_t_ msu_device_context_t;
 typedef struct msu_upnp_t_ msu_upnp_t;
 
 gboolean msu_media_service_get_object_info(const gchar *object_path,
+					   msu_arena_t *arena,
 					   gchar **root_path,
 					   gchar **object_id,
 					   msu_device_t **device,
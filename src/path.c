@@ -46,7 +46,8 @@ on_error:
 	return retval;
 }
 
-static gchar *prv_object_name_to_id(const gchar *object_name)
+static gchar *prv_object_name_to_id(const gchar *object_name,
+				    msu_arena_t *arena)
 {
 	gchar *retval = NULL;
 	unsigned int object_len = strlen(object_name);
@@ -57,7 +58,7 @@ static gchar *prv_object_name_to_id(const gchar *object_name)
 	if (object_len & 1)
 		goto on_error;
 
-	retval = g_malloc((object_len >> 1) + 1);
+	retval = msu_arena_alloc0(arena, (object_len >> 1) + 1);
 
 	for (i = 0; i < object_len; i += 2) {
 		hex = g_ascii_xdigit_value(object_name[i]);
@@ -80,12 +81,15 @@ static gchar *prv_object_name_to_id(const gchar *object_name)
 
 on_error:
 
-	g_free(retval);
+	if (!arena)
+		g_free(retval);
 
 	return NULL;
 }
 
-gboolean msu_path_get_path_and_id(const gchar *object_path, gchar **root_path,
+/* root_path and id are allocated from arena. */
+gboolean msu_path_get_path_and_id(const gchar *object_path,
+				  msu_arena_t *arena, gchar **root_path,
 				  gchar **id, GError **error)
 {
 	const gchar *slash;
@@ -95,18 +99,19 @@ gboolean msu_path_get_path_and_id(const gchar *object_path, gchar **root_path,
 		goto on_error;
 
 	if (!slash) {
-		*root_path = g_strdup(object_path);
-		*id = g_strdup("0");
+		*root_path = msu_arena_strdup(arena, object_path);
+		*id = msu_arena_strdup(arena, "0");
 	} else {
 		if (!slash[1])
 			goto on_error;
 
-		coded_id = prv_object_name_to_id(slash + 1);
+		coded_id = prv_object_name_to_id(slash + 1, arena);
 
 		if (!coded_id)
 			goto on_error;
 
-		*root_path = g_strndup(object_path, slash - object_path);
+		*root_path = msu_arena_strndup(arena, object_path,
+					       slash - object_path);
 		*id = coded_id;
 	}
 
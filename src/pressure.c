@@ -0,0 +1,271 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include "log.h"
+#include "pressure.h"
+
+/* Reported when tasks stall for more than 150 ms in a 2 s window waiting
+   for memory.  Unprivileged processes can only use windows that are
+   multiples of 2 s. */
+#define MSU_PRESSURE_PSI_PATH "/proc/pressure/memory"
+#define MSU_PRESSURE_PSI_TRIGGER "some 150000 2000000"
+
+#define MSU_PRESSURE_CGROUP_PATH "/proc/self/cgroup"
+#define MSU_PRESSURE_CGROUP_ROOT "/sys/fs/cgroup"
+#define MSU_PRESSURE_CGROUP_EVENTS "memory.events"
+
+struct msu_pressure_t_ {
+	msu_pressure_cb_t cb;
+	gpointer user_data;
+	guint psi_id;
+	GFileMonitor *monitor;
+	gulong handler_id;
+	gchar *events_path;
+	guint64 events;
+};
+
+static gboolean prv_psi_cb(GIOChannel *source, GIOCondition condition,
+			   gpointer user_data)
+{
+	msu_pressure_t *pressure = user_data;
+	gboolean retval = TRUE;
+
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		MSU_LOG_WARNING("Unable to monitor memory pressure");
+
+		pressure->psi_id = 0;
+		retval = FALSE;
+		goto finished;
+	}
+
+	MSU_LOG_DEBUG("Memory pressure reported by PSI");
+
+	pressure->cb(pressure->user_data);
+
+finished:
+
+	return retval;
+}
+
+static gboolean prv_psi_watch(msu_pressure_t *pressure)
+{
+	GIOChannel *channel;
+	gboolean retval = FALSE;
+	int fd;
+
+	fd = open(MSU_PRESSURE_PSI_PATH, O_RDWR | O_NONBLOCK);
+	if (fd == -1)
+		goto finished;
+
+	if (write(fd, MSU_PRESSURE_PSI_TRIGGER,
+		  strlen(MSU_PRESSURE_PSI_TRIGGER) + 1) == -1) {
+		(void) close(fd);
+		goto finished;
+	}
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+
+	pressure->psi_id = g_io_add_watch(channel, G_IO_PRI, prv_psi_cb,
+					  pressure);
+	g_io_channel_unref(channel);
+
+	retval = TRUE;
+
+finished:
+
+	return retval;
+}
+
+/* Only the unified hierarchy of cgroup v2 has a memory.events file. */
+static gchar *prv_cgroup_events_path(void)
+{
+	gchar *contents = NULL;
+	gchar **lines = NULL;
+	gchar *path = NULL;
+	guint i;
+
+	if (!g_file_get_contents(MSU_PRESSURE_CGROUP_PATH, &contents, NULL,
+				 NULL))
+		goto finished;
+
+	lines = g_strsplit(contents, "\n", 0);
+	for (i = 0; lines[i]; ++i) {
+		if (g_str_has_prefix(lines[i], "0::")) {
+			path = g_build_filename(MSU_PRESSURE_CGROUP_ROOT,
+						lines[i] + 3,
+						MSU_PRESSURE_CGROUP_EVENTS,
+						NULL);
+			break;
+		}
+	}
+
+	if (path && !g_file_test(path, G_FILE_TEST_EXISTS)) {
+		g_free(path);
+		path = NULL;
+	}
+
+finished:
+
+	g_strfreev(lines);
+	g_free(contents);
+
+	return path;
+}
+
+/* Counts the times the cgroup went over its high or max memory limit. */
+static guint64 prv_cgroup_read_events(const gchar *path)
+{
+	gchar *contents = NULL;
+	gchar **lines = NULL;
+	gchar **fields;
+	guint64 events = 0;
+	guint i;
+
+	if (!g_file_get_contents(path, &contents, NULL, NULL))
+		goto finished;
+
+	lines = g_strsplit(contents, "\n", 0);
+	for (i = 0; lines[i]; ++i) {
+		fields = g_strsplit(lines[i], " ", 2);
+
+		if (fields[0] && fields[1] &&
+		    (!strcmp(fields[0], "high") || !strcmp(fields[0], "max") ||
+		     !strcmp(fields[0], "oom")))
+			events += g_ascii_strtoull(fields[1], NULL, 10);
+
+		g_strfreev(fields);
+	}
+
+finished:
+
+	g_strfreev(lines);
+	g_free(contents);
+
+	return events;
+}
+
+static void prv_cgroup_events_cb(GFileMonitor *monitor, GFile *file,
+				 GFile *other_file,
+				 GFileMonitorEvent event_type,
+				 gpointer user_data)
+{
+	msu_pressure_t *pressure = user_data;
+	guint64 events;
+
+	if (event_type != G_FILE_MONITOR_EVENT_CHANGED)
+		goto finished;
+
+	events = prv_cgroup_read_events(pressure->events_path);
+	if (events <= pressure->events)
+		goto finished;
+
+	MSU_LOG_DEBUG("Memory pressure reported by cgroup");
+
+	pressure->events = events;
+	pressure->cb(pressure->user_data);
+
+finished:
+
+	return;
+}
+
+static gboolean prv_cgroup_watch(msu_pressure_t *pressure)
+{
+	GFile *file;
+	gboolean retval = FALSE;
+
+	pressure->events_path = prv_cgroup_events_path();
+	if (!pressure->events_path)
+		goto finished;
+
+	file = g_file_new_for_path(pressure->events_path);
+	pressure->monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE,
+						NULL, NULL);
+	g_object_unref(file);
+
+	if (!pressure->monitor)
+		goto finished;
+
+	pressure->events = prv_cgroup_read_events(pressure->events_path);
+	pressure->handler_id = g_signal_connect(
+					pressure->monitor, "changed",
+					G_CALLBACK(prv_cgroup_events_cb),
+					pressure);
+
+	retval = TRUE;
+
+finished:
+
+	return retval;
+}
+
+/* Returns NULL if the kernel provides no way of monitoring memory
+   pressure. */
+msu_pressure_t *msu_pressure_new(msu_pressure_cb_t cb, gpointer user_data)
+{
+	msu_pressure_t *pressure;
+	gboolean psi;
+	gboolean cgroup;
+
+	pressure = g_new0(msu_pressure_t, 1);
+	pressure->cb = cb;
+	pressure->user_data = user_data;
+
+	psi = prv_psi_watch(pressure);
+	cgroup = prv_cgroup_watch(pressure);
+
+	MSU_LOG_INFO("Memory pressure monitored by PSI: %s, cgroup: %s",
+		     psi ? "T" : "F", cgroup ? "T" : "F");
+
+	if (!psi && !cgroup) {
+		msu_pressure_delete(pressure);
+		pressure = NULL;
+	}
+
+	return pressure;
+}
+
+void msu_pressure_delete(msu_pressure_t *pressure)
+{
+	if (pressure) {
+		if (pressure->psi_id)
+			(void) g_source_remove(pressure->psi_id);
+
+		if (pressure->monitor) {
+			if (pressure->handler_id)
+				g_signal_handler_disconnect(
+					pressure->monitor,
+					pressure->handler_id);
+
+			g_file_monitor_cancel(pressure->monitor);
+			g_object_unref(pressure->monitor);
+		}
+
+		g_free(pressure->events_path);
+		g_free(pressure);
+	}
+}
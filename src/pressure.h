@@ -0,0 +1,33 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_PRESSURE_H__
+#define MSU_PRESSURE_H__
+
+#include <glib.h>
+
+typedef struct msu_pressure_t_ msu_pressure_t;
+
+typedef void (*msu_pressure_cb_t)(gpointer user_data);
+
+msu_pressure_t *msu_pressure_new(msu_pressure_cb_t cb, gpointer user_data);
+void msu_pressure_delete(msu_pressure_t *pressure);
+
+#endif
@@ -525,80 +525,76 @@ on_error:
 	return retval;
 }
 
-static void prv_add_string_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_string_prop(msu_writer_t *writer, const gchar *key,
 				const gchar *value)
 {
 	if (value) {
 		MSU_LOG_DEBUG("Prop %s = %s", key, value);
 
-		g_variant_builder_add(vb, "{sv}", key,
-				      g_variant_new_string(value));
+		msu_writer_add_string(writer, key, value);
 	}
 }
 
-static void prv_add_strv_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_strv_prop(msu_writer_t *writer, const gchar *key,
 			      const gchar **value, unsigned int len)
 {
 	if (len > 0)
-		g_variant_builder_add(vb, "{sv}", key,
-				      g_variant_new_strv(value, len));
+		msu_writer_add_value(writer, key,
+				     g_variant_new_strv(value, len));
 }
 
-static void prv_add_path_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_path_prop(msu_writer_t *writer, const gchar *key,
 			      const gchar *value)
 {
 	if (value) {
 		MSU_LOG_DEBUG("Prop %s = %s", key, value);
 
-		g_variant_builder_add(vb, "{sv}", key,
-				      g_variant_new_object_path(value));
+		msu_writer_add_path(writer, key, value);
 	}
 }
 
-static void prv_add_uint_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_uint_prop(msu_writer_t *writer, const gchar *key,
 			      unsigned int value)
 {
 	MSU_LOG_DEBUG("Prop %s = %u", key, value);
 
-	g_variant_builder_add(vb, "{sv}", key, g_variant_new_uint32(value));
+	msu_writer_add_uint32(writer, key, value);
 }
 
-static void prv_add_int_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_int_prop(msu_writer_t *writer, const gchar *key,
 			     int value)
 {
 	if (value != -1)
-		g_variant_builder_add(vb, "{sv}", key,
-				      g_variant_new_int32(value));
+		msu_writer_add_int32(writer, key, value);
 }
 
-static void prv_add_variant_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_variant_prop(msu_writer_t *writer, const gchar *key,
 				 GVariant *prop)
 {
 	if (prop)
-		g_variant_builder_add(vb, "{sv}", key, prop);
+		msu_writer_add_value(writer, key, prop);
 }
 
-void msu_props_add_child_count(GVariantBuilder *item_vb, gint value)
+void msu_props_add_child_count(msu_writer_t *writer, gint value)
 {
-	prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_CHILD_COUNT, value);
+	prv_add_int_prop(writer, MSU_INTERFACE_PROP_CHILD_COUNT, value);
 }
 
-static void prv_add_bool_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_bool_prop(msu_writer_t *writer, const gchar *key,
 			      gboolean value)
 {
 	MSU_LOG_DEBUG("Prop %s = %u", key, value);
 
-	g_variant_builder_add(vb, "{sv}", key, g_variant_new_boolean(value));
+	msu_writer_add_boolean(writer, key, value);
 }
 
-static void prv_add_int64_prop(GVariantBuilder *vb, const gchar *key,
+static void prv_add_int64_prop(msu_writer_t *writer, const gchar *key,
 			       gint64 value)
 {
 	if (value != -1) {
 		MSU_LOG_DEBUG("Prop %s = %"G_GINT64_FORMAT, key, value);
 
-		g_variant_builder_add(vb, "{sv}", key,
-				      g_variant_new_int64(value));
+		msu_writer_add_int64(writer, key, value);
 	}
 }
 
@@ -621,7 +617,7 @@ static void prv_add_list_dlna_str(gpointer data, gpointer user_data)
 		}
 	}
 
-	prv_add_uint_prop(vb, cap_str, value);
+	g_variant_builder_add(vb, "{sv}", cap_str, g_variant_new_uint32(value));
 }
 
 static GVariant *prv_add_list_dlna_prop(GList *list)
@@ -655,256 +651,170 @@ static GVariant *prv_get_artists_prop(GList *list)
 	return g_variant_builder_end(&vb);
 }
 
-void msu_props_add_device(GUPnPDeviceInfo *proxy,
-			  const msu_device_t *device,
-			  GVariantBuilder *vb)
+/* The properties of a server that come from its description or its
+   capabilities do not change while it is available.  They are built
+   once and shared by all the requests that read them. */
+GVariant *msu_props_build_device(GUPnPDeviceInfo *proxy,
+				 const msu_device_t *device)
 {
+	msu_writer_t *writer;
 	gchar *str;
 	GList *list;
-	GVariant *dlna_caps;
+	GVariant *retval;
+
+	writer = msu_writer_new();
+	(void) msu_writer_begin_object(writer);
 
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_LOCATION,
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_LOCATION,
 			    gupnp_device_info_get_location(proxy));
 
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_UDN,
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_UDN,
 			    gupnp_device_info_get_udn(proxy));
 
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_DEVICE_TYPE,
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_DEVICE_TYPE,
 			    gupnp_device_info_get_device_type(proxy));
 
 	str = gupnp_device_info_get_friendly_name(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_FRIENDLY_NAME, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_FRIENDLY_NAME, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_manufacturer(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_MANUFACTURER, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_MANUFACTURER, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_manufacturer_url(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_MANUFACTURER_URL, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_MANUFACTURER_URL, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_model_description(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_MODEL_DESCRIPTION, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_MODEL_DESCRIPTION, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_model_name(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_MODEL_NAME, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_MODEL_NAME, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_model_number(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_MODEL_NUMBER, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_MODEL_NUMBER, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_model_url(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_MODEL_URL, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_MODEL_URL, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_serial_number(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_SERIAL_NUMBER, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_SERIAL_NUMBER, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_presentation_url(proxy);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_PRESENTATION_URL, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_PRESENTATION_URL, str);
 	g_free(str);
 
 	str = gupnp_device_info_get_icon_url(proxy, NULL, -1, -1, -1, FALSE,
 					     NULL, NULL, NULL, NULL);
-	prv_add_string_prop(vb, MSU_INTERFACE_PROP_ICON_URL, str);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_ICON_URL, str);
 	g_free(str);
 
 	list = gupnp_device_info_list_dlna_capabilities(proxy);
 	if (list != NULL) {
-		dlna_caps = prv_add_list_dlna_prop(list);
-		g_variant_builder_add(vb, "{sv}",
-				      MSU_INTERFACE_PROP_SV_DLNA_CAPABILITIES,
-				      dlna_caps);
+		prv_add_variant_prop(writer,
+				     MSU_INTERFACE_PROP_SV_DLNA_CAPABILITIES,
+				     prv_add_list_dlna_prop(list));
 		g_list_free_full(list, g_free);
 	}
 
-	if (device->search_caps != NULL)
-		g_variant_builder_add(vb, "{sv}",
-				      MSU_INTERFACE_PROP_SV_SEARCH_CAPABILITIES,
-				      device->search_caps);
-
-	if (device->sort_caps != NULL)
-		g_variant_builder_add(vb, "{sv}",
-				      MSU_INTERFACE_PROP_SV_SORT_CAPABILITIES,
-				      device->sort_caps);
-
-	if (device->sort_ext_caps != NULL)
-		g_variant_builder_add(
-				vb, "{sv}",
-				MSU_INTERFACE_PROP_SV_SORT_EXT_CAPABILITIES,
-				device->sort_ext_caps);
-
-	if (device->feature_list != NULL)
-		g_variant_builder_add(vb, "{sv}",
-				      MSU_INTERFACE_PROP_SV_FEATURE_LIST,
-				      device->feature_list);
+	prv_add_variant_prop(writer, MSU_INTERFACE_PROP_SV_SEARCH_CAPABILITIES,
+			     device->search_caps);
+
+	prv_add_variant_prop(writer, MSU_INTERFACE_PROP_SV_SORT_CAPABILITIES,
+			     device->sort_caps);
+
+	prv_add_variant_prop(writer,
+			     MSU_INTERFACE_PROP_SV_SORT_EXT_CAPABILITIES,
+			     device->sort_ext_caps);
+
+	prv_add_variant_prop(writer, MSU_INTERFACE_PROP_SV_FEATURE_LIST,
+			     device->feature_list);
+
+	retval = g_variant_ref_sink(msu_writer_end_object(writer));
+	msu_writer_delete(writer);
+
+	return retval;
 }
 
-GVariant *msu_props_get_device_prop(GUPnPDeviceInfo *proxy,
-				    const msu_device_t *device,
-				    const gchar *prop)
+void msu_props_add_device(GVariant *props, const msu_device_t *device,
+			  msu_writer_t *writer)
 {
-	GVariant *dlna_caps = NULL;
-	GVariant *retval = NULL;
-	const gchar *str = NULL;
-	gchar *copy = NULL;
-	GList *list;
+	GVariantIter iter;
+	const gchar *key;
+	GVariant *value;
 
-	if (!strcmp(MSU_INTERFACE_PROP_LOCATION, prop)) {
-		str = gupnp_device_info_get_location(proxy);
-	} else if (!strcmp(MSU_INTERFACE_PROP_UDN, prop)) {
-		str = gupnp_device_info_get_udn(proxy);
-	} else if (!strcmp(MSU_INTERFACE_PROP_DEVICE_TYPE, prop)) {
-		str = gupnp_device_info_get_device_type(proxy);
-	} else if (!strcmp(MSU_INTERFACE_PROP_FRIENDLY_NAME, prop)) {
-		copy = gupnp_device_info_get_friendly_name(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_MANUFACTURER, prop)) {
-		copy = gupnp_device_info_get_manufacturer(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_MANUFACTURER_URL, prop)) {
-		copy = gupnp_device_info_get_manufacturer_url(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_MODEL_DESCRIPTION, prop)) {
-		copy = gupnp_device_info_get_model_description(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_MODEL_NAME, prop)) {
-		copy = gupnp_device_info_get_model_name(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_MODEL_NUMBER, prop)) {
-		copy = gupnp_device_info_get_model_number(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_MODEL_URL, prop)) {
-		copy = gupnp_device_info_get_model_url(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_SERIAL_NUMBER, prop)) {
-		copy = gupnp_device_info_get_serial_number(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_PRESENTATION_URL, prop)) {
-		copy = gupnp_device_info_get_presentation_url(proxy);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_ICON_URL, prop)) {
-		copy = gupnp_device_info_get_icon_url(proxy, NULL,
-						      -1, -1, -1, FALSE,
-						      NULL, NULL, NULL, NULL);
-		str = copy;
-	} else if (!strcmp(MSU_INTERFACE_PROP_SV_DLNA_CAPABILITIES, prop)) {
-		list = gupnp_device_info_list_dlna_capabilities(proxy);
-		if (list != NULL) {
-			dlna_caps = prv_add_list_dlna_prop(list);
-			g_list_free_full(list, g_free);
-			retval = g_variant_ref_sink(dlna_caps);
+	g_variant_iter_init(&iter, props);
+	while (g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+		msu_writer_add_value(writer, key, value);
+		g_variant_unref(value);
+	}
 
-#if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
-			copy = g_variant_print(dlna_caps, FALSE);
-			MSU_LOG_DEBUG("Prop %s = %s", prop, copy);
-#endif
-		}
-	} else if (!strcmp(MSU_INTERFACE_PROP_SV_SEARCH_CAPABILITIES, prop)) {
-		if (device->search_caps != NULL) {
-			retval = g_variant_ref(device->search_caps);
+	prv_add_string_prop(writer, MSU_INTERFACE_PROP_CIRCUIT_STATE,
+			    msu_device_get_circuit_state(device));
 
-#if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
-			copy = g_variant_print(device->search_caps, FALSE);
-			MSU_LOG_DEBUG("Prop %s = %s", prop, copy);
-#endif
-		}
-	} else if (!strcmp(MSU_INTERFACE_PROP_SV_SORT_CAPABILITIES, prop)) {
-		if (device->sort_caps != NULL) {
-			retval = g_variant_ref(device->sort_caps);
+	prv_add_variant_prop(writer, MSU_INTERFACE_PROP_CACHE_STATISTICS,
+			     msu_device_get_cache_statistics(device));
+}
 
+GVariant *msu_props_get_device_prop(GVariant *props,
+				    const msu_device_t *device,
+				    const gchar *prop)
+{
+	GVariant *retval = NULL;
 #if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
-			copy = g_variant_print(device->sort_caps, FALSE);
-			MSU_LOG_DEBUG("Prop %s = %s", prop, copy);
+	gchar *str;
 #endif
-		}
-	} else if (!strcmp(MSU_INTERFACE_PROP_SV_SORT_EXT_CAPABILITIES, prop)) {
-		if (device->sort_ext_caps != NULL) {
-			retval = g_variant_ref(device->sort_ext_caps);
 
-#if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
-			copy = g_variant_print(device->sort_ext_caps, FALSE);
-			MSU_LOG_DEBUG("Prop %s = %s", prop, copy);
-#endif
-		}
-	} else if (!strcmp(MSU_INTERFACE_PROP_SV_FEATURE_LIST, prop)) {
-		if (device->feature_list != NULL) {
-			retval = g_variant_ref(device->feature_list);
+	if (!strcmp(MSU_INTERFACE_PROP_CIRCUIT_STATE, prop))
+		retval = g_variant_ref_sink(g_variant_new_string(
+					msu_device_get_circuit_state(device)));
+	else if (!strcmp(MSU_INTERFACE_PROP_CACHE_STATISTICS, prop))
+		retval = g_variant_ref_sink(
+				msu_device_get_cache_statistics(device));
+	else
+		retval = g_variant_lookup_value(props, prop, NULL);
 
 #if MSU_LOG_LEVEL & MSU_LOG_LEVEL_DEBUG
-			copy = g_variant_print(device->feature_list, FALSE);
-			MSU_LOG_DEBUG("Prop %s = %s", prop, copy);
-#endif
-		}
+	if (retval) {
+		str = g_variant_print(retval, FALSE);
+		MSU_LOG_DEBUG("Prop %s = %s", prop, str);
+		g_free(str);
 	}
+#endif
 
-	if (!retval) {
-		if (str) {
-			MSU_LOG_DEBUG("Prop %s = %s", prop, str);
-
-			retval = g_variant_ref_sink(g_variant_new_string(str));
-		}
 #if MSU_LOG_LEVEL & MSU_LOG_LEVEL_WARNING
-		else
-			MSU_LOG_WARNING("Property %s not defined", prop);
+	if (!retval)
+		MSU_LOG_WARNING("Property %s not defined", prop);
 #endif
-	}
-
-	g_free(copy);
 
 	return retval;
 }
 
 static GUPnPDIDLLiteResource *prv_match_resource(GUPnPDIDLLiteResource *res,
-						 gchar **pi_str_array)
+						 const msu_matcher_t *matcher)
 {
 	GUPnPDIDLLiteResource *retval = NULL;
-	GUPnPProtocolInfo *res_pi;
-	GUPnPProtocolInfo *pi;
-	unsigned int i;
-	gboolean match;
 
-	if (!pi_str_array) {
+	if (msu_matcher_match(matcher,
+			      gupnp_didl_lite_resource_get_protocol_info(res)))
 		retval = res;
-		goto done;
-	}
-
-	res_pi = gupnp_didl_lite_resource_get_protocol_info(res);
-	if (!res_pi)
-		goto done;
-
-	for (i = 0; pi_str_array[i]; ++i) {
-		pi = gupnp_protocol_info_new_from_string(pi_str_array[i],
-			NULL);
-		if (!pi)
-			continue;
-		match = gupnp_protocol_info_is_compatible(pi, res_pi);
-		g_object_unref(pi);
-		if (match) {
-			retval = res;
-			break;
-		}
-	}
-done:
 
 	return retval;
 }
 
 static GUPnPDIDLLiteResource *prv_get_matching_resource
-	(GUPnPDIDLLiteObject *object, const gchar *protocol_info)
+	(GUPnPDIDLLiteObject *object, const msu_matcher_t *matcher)
 {
 	GUPnPDIDLLiteResource *retval = NULL;
 	GUPnPDIDLLiteResource *res;
 	GList *resources;
 	GList *ptr;
-	gchar **pi_str_array = NULL;
-
-	if (protocol_info)
-		pi_str_array = g_strsplit(protocol_info, ",", 0);
 
 	resources = gupnp_didl_lite_object_get_resources(object);
 	ptr = resources;
@@ -912,7 +822,7 @@ static GUPnPDIDLLiteResource *prv_get_matching_resource
 	while (ptr) {
 		res = ptr->data;
 		if (!retval) {
-			retval = prv_match_resource(res, pi_str_array);
+			retval = prv_match_resource(res, matcher);
 			if (!retval)
 				g_object_unref(res);
 		} else {
@@ -923,13 +833,11 @@ static GUPnPDIDLLiteResource *prv_get_matching_resource
 	}
 
 	g_list_free(resources);
-	if (pi_str_array)
-		g_strfreev(pi_str_array);
 
 	return retval;
 }
 
-static void prv_parse_resources(GVariantBuilder *item_vb,
+static void prv_parse_resources(msu_writer_t *writer,
 				GUPnPDIDLLiteResource *res,
 				msu_upnp_prop_mask filter_mask)
 {
@@ -941,50 +849,50 @@ static void prv_parse_resources(GVariantBuilder *item_vb,
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_SIZE) {
 		int64_val = gupnp_didl_lite_resource_get_size64(res);
-		prv_add_int64_prop(item_vb, MSU_INTERFACE_PROP_SIZE, int64_val);
+		prv_add_int64_prop(writer, MSU_INTERFACE_PROP_SIZE, int64_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_BITRATE) {
 		int_val = gupnp_didl_lite_resource_get_bitrate(res);
-		prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_BITRATE, int_val);
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_BITRATE, int_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_SAMPLE_RATE) {
 		int_val = gupnp_didl_lite_resource_get_sample_freq(res);
-		prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_SAMPLE_RATE,
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_SAMPLE_RATE,
 				 int_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_BITS_PER_SAMPLE) {
 		int_val = gupnp_didl_lite_resource_get_bits_per_sample(res);
-		prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_BITS_PER_SAMPLE,
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_BITS_PER_SAMPLE,
 				 int_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_DURATION) {
 		int_val = (int) gupnp_didl_lite_resource_get_duration(res);
-		prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_DURATION, int_val);
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_DURATION, int_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_WIDTH) {
 		int_val = (int) gupnp_didl_lite_resource_get_width(res);
-		prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_WIDTH, int_val);
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_WIDTH, int_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_HEIGHT) {
 		int_val = (int) gupnp_didl_lite_resource_get_height(res);
-		prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_HEIGHT, int_val);
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_HEIGHT, int_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_COLOR_DEPTH) {
 		int_val = (int) gupnp_didl_lite_resource_get_color_depth(res);
-		prv_add_int_prop(item_vb, MSU_INTERFACE_PROP_COLOR_DEPTH,
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_COLOR_DEPTH,
 				 int_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_UPDATE_COUNT) {
 		uint_val = gupnp_didl_lite_resource_get_update_count(res);
-		prv_add_uint_prop(item_vb, MSU_INTERFACE_PROP_UPDATE_COUNT,
+		prv_add_uint_prop(writer, MSU_INTERFACE_PROP_UPDATE_COUNT,
 				  uint_val);
 	}
 
@@ -992,13 +900,13 @@ static void prv_parse_resources(GVariantBuilder *item_vb,
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_DLNA_PROFILE) {
 		str_val = gupnp_protocol_info_get_dlna_profile(protocol_info);
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_DLNA_PROFILE,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_DLNA_PROFILE,
 				    str_val);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_MIME_TYPE) {
 		str_val = gupnp_protocol_info_get_mime_type(protocol_info);
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_MIME_TYPE,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_MIME_TYPE,
 				    str_val);
 	}
 }
@@ -1177,7 +1085,7 @@ static GVariant *prv_props_get_dlna_managed_dict(GUPnPOCMFlags flags)
 	return g_variant_builder_end(&builder);
 }
 
-gboolean msu_props_add_object(GVariantBuilder *item_vb,
+gboolean msu_props_add_object(msu_writer_t *writer,
 			      GUPnPDIDLLiteObject *object,
 			      const char *root_path,
 			      const gchar *parent_path,
@@ -1210,37 +1118,37 @@ gboolean msu_props_add_object(GVariantBuilder *item_vb,
 	path = msu_path_from_id(root_path, id);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_DISPLAY_NAME)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_DISPLAY_NAME,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_DISPLAY_NAME,
 				    title);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_CREATOR)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_CREATOR,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_CREATOR,
 				    creator);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_PATH)
-		prv_add_path_prop(item_vb, MSU_INTERFACE_PROP_PATH, path);
+		prv_add_path_prop(writer, MSU_INTERFACE_PROP_PATH, path);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_PARENT)
-		prv_add_path_prop(item_vb, MSU_INTERFACE_PROP_PARENT,
+		prv_add_path_prop(writer, MSU_INTERFACE_PROP_PARENT,
 				  parent_path);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_TYPE)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_TYPE,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_TYPE,
 				    media_spec_type);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_RESTRICTED)
-		prv_add_bool_prop(item_vb, MSU_INTERFACE_PROP_RESTRICTED, rest);
+		prv_add_bool_prop(writer, MSU_INTERFACE_PROP_RESTRICTED, rest);
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_DLNA_MANAGED) {
 		flags = gupnp_didl_lite_object_get_dlna_managed(object);
-		prv_add_variant_prop(item_vb,
+		prv_add_variant_prop(writer,
 				     MSU_INTERFACE_PROP_DLNA_MANAGED,
 				     prv_props_get_dlna_managed_dict(flags));
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_OBJECT_UPDATE_ID) {
 		uint_val = gupnp_didl_lite_object_get_update_id(object);
-		prv_add_uint_prop(item_vb, MSU_INTERFACE_PROP_OBJECT_UPDATE_ID,
+		prv_add_uint_prop(writer, MSU_INTERFACE_PROP_OBJECT_UPDATE_ID,
 				  uint_val);
 	}
 
@@ -1253,7 +1161,7 @@ on_error:
 	return retval;
 }
 
-void msu_props_add_container(GVariantBuilder *item_vb,
+void msu_props_add_container(msu_writer_t *writer,
 			     GUPnPDIDLLiteContainer *object,
 			     msu_upnp_prop_mask filter_mask,
 			     gboolean *have_child_count)
@@ -1266,7 +1174,7 @@ void msu_props_add_container(GVariantBuilder *item_vb,
 	if (filter_mask & MSU_UPNP_MASK_PROP_CHILD_COUNT) {
 		child_count = gupnp_didl_lite_container_get_child_count(object);
 		if (child_count >= 0) {
-			prv_add_uint_prop(item_vb,
+			prv_add_uint_prop(writer,
 					  MSU_INTERFACE_PROP_CHILD_COUNT,
 					  (unsigned int) child_count);
 			*have_child_count = TRUE;
@@ -1275,19 +1183,19 @@ void msu_props_add_container(GVariantBuilder *item_vb,
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_SEARCHABLE) {
 		searchable = gupnp_didl_lite_container_get_searchable(object);
-		prv_add_bool_prop(item_vb, MSU_INTERFACE_PROP_SEARCHABLE,
+		prv_add_bool_prop(writer, MSU_INTERFACE_PROP_SEARCHABLE,
 				  searchable);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_CREATE_CLASSES)
-		prv_add_variant_prop(item_vb,
+		prv_add_variant_prop(writer,
 				     MSU_INTERFACE_PROP_CREATE_CLASSES,
 				     prv_compute_create_classes(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID) {
 		uint_val = gupnp_didl_lite_container_get_container_update_id(
 									object);
-		prv_add_uint_prop(item_vb,
+		prv_add_uint_prop(writer,
 				  MSU_INTERFACE_PROP_CONTAINER_UPDATE_ID,
 				  uint_val);
 	}
@@ -1295,7 +1203,7 @@ void msu_props_add_container(GVariantBuilder *item_vb,
 	if (filter_mask & MSU_UPNP_MASK_PROP_TOTAL_DELETED_CHILD_COUNT) {
 		uint_val =
 		gupnp_didl_lite_container_get_total_deleted_child_count(object);
-		prv_add_uint_prop(item_vb,
+		prv_add_uint_prop(writer,
 				  MSU_INTERFACE_PROP_TOTAL_DELETED_CHILD_COUNT,
 				  uint_val);
 	}
@@ -1307,57 +1215,50 @@ static GVariant *prv_compute_resources(GUPnPDIDLLiteObject *object,
 	GUPnPDIDLLiteResource *res = NULL;
 	GList *resources;
 	GList *ptr;
-	GVariantBuilder *res_array_vb;
-	GVariantBuilder *res_vb;
+	msu_writer_t *res_writer;
 	const char *str_val;
 	GVariant *retval;
 
-	res_array_vb = g_variant_builder_new(G_VARIANT_TYPE("aa{sv}"));
+	res_writer = msu_writer_new();
 
 	resources = gupnp_didl_lite_object_get_resources(object);
 	ptr = resources;
 
 	while (ptr) {
 		res = ptr->data;
-		res_vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+		(void) msu_writer_begin_object(res_writer);
 		if (filter_mask & MSU_UPNP_MASK_PROP_URL) {
 			str_val = gupnp_didl_lite_resource_get_uri(res);
 			if (str_val)
-				prv_add_string_prop(res_vb,
+				prv_add_string_prop(res_writer,
 						    MSU_INTERFACE_PROP_URL,
 						    str_val);
 		}
-		prv_parse_resources(res_vb, res, filter_mask);
-		g_variant_builder_add(res_array_vb, "@a{sv}",
-				      g_variant_builder_end(res_vb));
-		g_variant_builder_unref(res_vb);
+		prv_parse_resources(res_writer, res, filter_mask);
 		g_object_unref(ptr->data);
 		ptr = g_list_next(ptr);
 	}
-	retval = g_variant_builder_end(res_array_vb);
-	g_variant_builder_unref(res_array_vb);
+	retval = msu_writer_end(res_writer);
+	msu_writer_delete(res_writer);
 
 	g_list_free(resources);
 
 	return retval;
 }
 
-static void prv_add_resources(GVariantBuilder *item_vb,
+static void prv_add_resources(msu_writer_t *writer,
 			      GUPnPDIDLLiteObject *object,
 			      msu_upnp_prop_mask filter_mask)
 {
-	GVariant *val;
-
-	val = prv_compute_resources(object, filter_mask);
-	g_variant_builder_add(item_vb, "{sv}", MSU_INTERFACE_PROP_RESOURCES,
-			      val);
+	prv_add_variant_prop(writer, MSU_INTERFACE_PROP_RESOURCES,
+			     prv_compute_resources(object, filter_mask));
 }
 
-void msu_props_add_item(GVariantBuilder *item_vb,
+void msu_props_add_item(msu_writer_t *writer,
 			GUPnPDIDLLiteObject *object,
 			const gchar *root_path,
 			msu_upnp_prop_mask filter_mask,
-			const gchar *protocol_info)
+			const msu_matcher_t *matcher)
 {
 	int track_number;
 	GUPnPDIDLLiteResource *res;
@@ -1366,38 +1267,38 @@ void msu_props_add_item(GVariantBuilder *item_vb,
 	GList *list;
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_ARTIST)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_ARTIST,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_ARTIST,
 				    gupnp_didl_lite_object_get_artist(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_ARTISTS) {
 		list = gupnp_didl_lite_object_get_artists(object);
-		prv_add_variant_prop(item_vb, MSU_INTERFACE_PROP_ARTISTS,
+		prv_add_variant_prop(writer, MSU_INTERFACE_PROP_ARTISTS,
 				     prv_get_artists_prop(list));
 		g_list_free_full(list, g_object_unref);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_ALBUM)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_ALBUM,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_ALBUM,
 				    gupnp_didl_lite_object_get_album(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_DATE)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_DATE,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_DATE,
 				    gupnp_didl_lite_object_get_date(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_GENRE)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_GENRE,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_GENRE,
 				    gupnp_didl_lite_object_get_genre(object));
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_TRACK_NUMBER) {
 		track_number = gupnp_didl_lite_object_get_track_number(object);
 		if (track_number >= 0)
-			prv_add_int_prop(item_vb,
+			prv_add_int_prop(writer,
 					 MSU_INTERFACE_PROP_TRACK_NUMBER,
 					 track_number);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_ALBUM_ART_URL)
-		prv_add_string_prop(item_vb, MSU_INTERFACE_PROP_ALBUM_ART_URL,
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_ALBUM_ART_URL,
 				    gupnp_didl_lite_object_get_album_art(
 					    object));
 
@@ -1406,51 +1307,368 @@ void msu_props_add_item(GVariantBuilder *item_vb,
 						GUPNP_DIDL_LITE_ITEM(object));
 		if (str_val != NULL) {
 			path = msu_path_from_id(root_path, str_val);
-			prv_add_path_prop(item_vb, MSU_INTERFACE_PROP_REFPATH,
+			prv_add_path_prop(writer, MSU_INTERFACE_PROP_REFPATH,
 					  path);
 			g_free(path);
 		}
 	}
 
-	res = prv_get_matching_resource(object, protocol_info);
+	res = prv_get_matching_resource(object, matcher);
 	if (res) {
 		if (filter_mask & MSU_UPNP_MASK_PROP_URLS) {
 			str_val = gupnp_didl_lite_resource_get_uri(res);
 			if (str_val)
-				prv_add_strv_prop(item_vb,
+				prv_add_strv_prop(writer,
 						  MSU_INTERFACE_PROP_URLS,
 						  &str_val, 1);
 		}
-		prv_parse_resources(item_vb, res, filter_mask);
+		prv_parse_resources(writer, res, filter_mask);
 		g_object_unref(res);
 	}
 
 	if (filter_mask & MSU_UPNP_MASK_PROP_RESOURCES)
-		prv_add_resources(item_vb, object, filter_mask);
+		prv_add_resources(writer, object, filter_mask);
 }
 
-void msu_props_add_resource(GVariantBuilder *item_vb,
+void msu_props_add_resource(msu_writer_t *writer,
 			    GUPnPDIDLLiteObject *object,
 			    msu_upnp_prop_mask filter_mask,
-			    const gchar *protocol_info)
+			    const msu_matcher_t *matcher)
 {
 	GUPnPDIDLLiteResource *res;
 	const char *str_val;
 
-	res = prv_get_matching_resource(object, protocol_info);
+	res = prv_get_matching_resource(object, matcher);
 	if (res) {
 		if (filter_mask & MSU_UPNP_MASK_PROP_URL) {
 			str_val = gupnp_didl_lite_resource_get_uri(res);
 			if (str_val)
-				prv_add_string_prop(item_vb,
+				prv_add_string_prop(writer,
 						    MSU_INTERFACE_PROP_URL,
 						    str_val);
 		}
-		prv_parse_resources(item_vb, res, filter_mask);
+		prv_parse_resources(writer, res, filter_mask);
 		g_object_unref(res);
 	}
 }
 
+/* The functions below build the same properties as the ones above, from
+   the objects of the streaming DIDL-Lite decoder. */
+
+gboolean msu_props_add_didl_object(msu_writer_t *writer,
+				   const msu_didl_object_t *object,
+				   const char *root_path,
+				   const gchar *parent_path,
+				   msu_upnp_prop_mask filter_mask)
+{
+	gchar *path = NULL;
+	const char *media_spec_type;
+	gboolean retval = FALSE;
+
+	if (!object->id || !object->upnp_class)
+		goto on_error;
+
+	media_spec_type = msu_props_upnp_class_to_media_spec(
+							object->upnp_class);
+	if (!media_spec_type)
+		goto on_error;
+
+	path = msu_path_from_id(root_path, object->id);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_DISPLAY_NAME)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_DISPLAY_NAME,
+				    object->title);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_CREATOR)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_CREATOR,
+				    object->creator);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_PATH)
+		prv_add_path_prop(writer, MSU_INTERFACE_PROP_PATH, path);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_PARENT)
+		prv_add_path_prop(writer, MSU_INTERFACE_PROP_PARENT,
+				  parent_path);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_TYPE)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_TYPE,
+				    media_spec_type);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_RESTRICTED)
+		prv_add_bool_prop(writer, MSU_INTERFACE_PROP_RESTRICTED,
+				  object->restricted);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_DLNA_MANAGED)
+		prv_add_variant_prop(writer,
+				     MSU_INTERFACE_PROP_DLNA_MANAGED,
+				     prv_props_get_dlna_managed_dict(
+					     object->dlna_managed));
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_OBJECT_UPDATE_ID)
+		prv_add_uint_prop(writer, MSU_INTERFACE_PROP_OBJECT_UPDATE_ID,
+				  object->update_id);
+
+	retval = TRUE;
+
+on_error:
+
+	g_free(path);
+
+	return retval;
+}
+
+static GVariant *prv_compute_didl_create_classes(
+					const msu_didl_object_t *object)
+{
+	GVariantBuilder create_classes_vb;
+	msu_didl_create_class_t *create_class;
+	guint i;
+
+	g_variant_builder_init(&create_classes_vb, G_VARIANT_TYPE("a(sb)"));
+
+	for (i = 0; i < object->create_classes->len; ++i) {
+		create_class = g_ptr_array_index(object->create_classes, i);
+		if (create_class->content)
+			g_variant_builder_add(&create_classes_vb, "(sb)",
+					      create_class->content,
+					      create_class->include_derived);
+	}
+
+	return g_variant_builder_end(&create_classes_vb);
+}
+
+void msu_props_add_didl_container(msu_writer_t *writer,
+				  const msu_didl_object_t *object,
+				  msu_upnp_prop_mask filter_mask,
+				  gboolean *have_child_count)
+{
+	*have_child_count = FALSE;
+	if (filter_mask & MSU_UPNP_MASK_PROP_CHILD_COUNT) {
+		if (object->child_count >= 0) {
+			prv_add_uint_prop(writer,
+					  MSU_INTERFACE_PROP_CHILD_COUNT,
+					  (unsigned int) object->child_count);
+			*have_child_count = TRUE;
+		}
+	}
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_SEARCHABLE)
+		prv_add_bool_prop(writer, MSU_INTERFACE_PROP_SEARCHABLE,
+				  object->searchable);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_CREATE_CLASSES)
+		prv_add_variant_prop(writer,
+				     MSU_INTERFACE_PROP_CREATE_CLASSES,
+				     prv_compute_didl_create_classes(object));
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_CONTAINER_UPDATE_ID)
+		prv_add_uint_prop(writer,
+				  MSU_INTERFACE_PROP_CONTAINER_UPDATE_ID,
+				  object->container_update_id);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_TOTAL_DELETED_CHILD_COUNT)
+		prv_add_uint_prop(writer,
+				  MSU_INTERFACE_PROP_TOTAL_DELETED_CHILD_COUNT,
+				  object->total_deleted_child_count);
+}
+
+static void prv_parse_didl_resource(msu_writer_t *writer,
+				    const msu_didl_res_t *res,
+				    msu_upnp_prop_mask filter_mask)
+{
+	GUPnPProtocolInfo *protocol_info = NULL;
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_SIZE)
+		prv_add_int64_prop(writer, MSU_INTERFACE_PROP_SIZE,
+				   res->size);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_BITRATE)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_BITRATE,
+				 res->bitrate);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_SAMPLE_RATE)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_SAMPLE_RATE,
+				 res->sample_freq);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_BITS_PER_SAMPLE)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_BITS_PER_SAMPLE,
+				 res->bits_per_sample);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_DURATION)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_DURATION,
+				 res->duration);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_WIDTH)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_WIDTH, res->width);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_HEIGHT)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_HEIGHT,
+				 res->height);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_COLOR_DEPTH)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_COLOR_DEPTH,
+				 res->color_depth);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_UPDATE_COUNT)
+		prv_add_uint_prop(writer, MSU_INTERFACE_PROP_UPDATE_COUNT,
+				  res->update_count);
+
+	if (!(filter_mask & (MSU_UPNP_MASK_PROP_DLNA_PROFILE |
+			     MSU_UPNP_MASK_PROP_MIME_TYPE)) ||
+	    !res->protocol_info)
+		goto finished;
+
+	protocol_info = gupnp_protocol_info_new_from_string(res->protocol_info,
+							    NULL);
+	if (!protocol_info)
+		goto finished;
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_DLNA_PROFILE)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_DLNA_PROFILE,
+				    gupnp_protocol_info_get_dlna_profile(
+					    protocol_info));
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_MIME_TYPE)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_MIME_TYPE,
+				    gupnp_protocol_info_get_mime_type(
+					    protocol_info));
+
+	g_object_unref(protocol_info);
+
+finished:
+
+	return;
+}
+
+static const msu_didl_res_t *prv_get_matching_didl_resource(
+					const msu_didl_object_t *object,
+					const msu_matcher_t *matcher)
+{
+	const msu_didl_res_t *retval = NULL;
+	const msu_didl_res_t *res;
+	guint i;
+
+	if (!object->resources->len)
+		goto finished;
+
+	if (!matcher) {
+		retval = g_ptr_array_index(object->resources, 0);
+		goto finished;
+	}
+
+	for (i = 0; !retval && i < object->resources->len; ++i) {
+		res = g_ptr_array_index(object->resources, i);
+		if (res->protocol_info &&
+		    msu_matcher_match_string(matcher, res->protocol_info))
+			retval = res;
+	}
+
+finished:
+
+	return retval;
+}
+
+static GVariant *prv_compute_didl_resources(const msu_didl_object_t *object,
+					    msu_upnp_prop_mask filter_mask)
+{
+	msu_writer_t *res_writer;
+	const msu_didl_res_t *res;
+	GVariant *retval;
+	guint i;
+
+	res_writer = msu_writer_new();
+
+	for (i = 0; i < object->resources->len; ++i) {
+		res = g_ptr_array_index(object->resources, i);
+
+		(void) msu_writer_begin_object(res_writer);
+		if (filter_mask & MSU_UPNP_MASK_PROP_URL)
+			prv_add_string_prop(res_writer, MSU_INTERFACE_PROP_URL,
+					    res->uri);
+		prv_parse_didl_resource(res_writer, res, filter_mask);
+	}
+
+	retval = msu_writer_end(res_writer);
+	msu_writer_delete(res_writer);
+
+	return retval;
+}
+
+static GVariant *prv_get_didl_artists_prop(const msu_didl_object_t *object)
+{
+	GVariantBuilder vb;
+	const gchar *artist;
+	guint i;
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("as"));
+
+	for (i = 0; i < object->artists->len; ++i) {
+		artist = g_ptr_array_index(object->artists, i);
+		if (artist)
+			g_variant_builder_add(&vb, "s", artist);
+	}
+
+	return g_variant_builder_end(&vb);
+}
+
+void msu_props_add_didl_item(msu_writer_t *writer,
+			     const msu_didl_object_t *object,
+			     const gchar *root_path,
+			     msu_upnp_prop_mask filter_mask,
+			     const msu_matcher_t *matcher)
+{
+	const msu_didl_res_t *res;
+	char *path;
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_ARTIST)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_ARTIST,
+				    object->artist);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_ARTISTS)
+		prv_add_variant_prop(writer, MSU_INTERFACE_PROP_ARTISTS,
+				     prv_get_didl_artists_prop(object));
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_ALBUM)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_ALBUM,
+				    object->album);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_DATE)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_DATE,
+				    object->date);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_GENRE)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_GENRE,
+				    object->genre);
+
+	if ((filter_mask & MSU_UPNP_MASK_PROP_TRACK_NUMBER) &&
+	    object->track_number >= 0)
+		prv_add_int_prop(writer, MSU_INTERFACE_PROP_TRACK_NUMBER,
+				 object->track_number);
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_ALBUM_ART_URL)
+		prv_add_string_prop(writer, MSU_INTERFACE_PROP_ALBUM_ART_URL,
+				    object->album_art);
+
+	if ((filter_mask & MSU_UPNP_MASK_PROP_REFPATH) && object->ref_id) {
+		path = msu_path_from_id(root_path, object->ref_id);
+		prv_add_path_prop(writer, MSU_INTERFACE_PROP_REFPATH, path);
+		g_free(path);
+	}
+
+	res = prv_get_matching_didl_resource(object, matcher);
+	if (res) {
+		if ((filter_mask & MSU_UPNP_MASK_PROP_URLS) && res->uri)
+			prv_add_strv_prop(writer, MSU_INTERFACE_PROP_URLS,
+					  (const gchar **) &res->uri, 1);
+		prv_parse_didl_resource(writer, res, filter_mask);
+	}
+
+	if (filter_mask & MSU_UPNP_MASK_PROP_RESOURCES)
+		prv_add_variant_prop(writer, MSU_INTERFACE_PROP_RESOURCES,
+				     prv_compute_didl_resources(object,
+								filter_mask));
+}
+
 
 static GVariant *prv_get_resource_property(const gchar *prop,
 					   GUPnPDIDLLiteResource *res)
@@ -1623,7 +1841,7 @@ on_error:
 
 GVariant *msu_props_get_item_prop(const gchar *prop, const gchar *root_path,
 				  GUPnPDIDLLiteObject *object,
-				  const gchar *protocol_info)
+				  const msu_matcher_t *matcher)
 {
 	const gchar *str;
 	gchar *path;
@@ -1712,7 +1930,7 @@ GVariant *msu_props_get_item_prop(const gchar *prop, const gchar *root_path,
 		retval = g_variant_ref_sink(
 			prv_compute_resources(object, MSU_UPNP_MASK_ALL_PROPS));
 	} else {
-		res = prv_get_matching_resource(object, protocol_info);
+		res = prv_get_matching_resource(object, matcher);
 		if (!res)
 			goto on_error;
 
@@ -25,6 +25,9 @@
 
 #include <libgupnp-av/gupnp-av.h>
 #include "async.h"
+#include "didl.h"
+#include "matcher.h"
+#include "writer.h"
 
 #define MSU_UPNP_MASK_PROP_PARENT			(1LL << 0)
 #define MSU_UPNP_MASK_PROP_TYPE				(1LL << 1)
@@ -85,15 +88,17 @@ gboolean msu_props_parse_update_filter(GHashTable *filter_map,
 				       msu_upnp_prop_mask *mask,
 				       gchar **upnp_filter);
 
-void msu_props_add_device(GUPnPDeviceInfo *proxy,
-			  const msu_device_t *device,
-			  GVariantBuilder *vb);
+GVariant *msu_props_build_device(GUPnPDeviceInfo *proxy,
+				 const msu_device_t *device);
 
-GVariant *msu_props_get_device_prop(GUPnPDeviceInfo *proxy,
+void msu_props_add_device(GVariant *props, const msu_device_t *device,
+			  msu_writer_t *writer);
+
+GVariant *msu_props_get_device_prop(GVariant *props,
 				    const msu_device_t *device,
 				    const gchar *prop);
 
-gboolean msu_props_add_object(GVariantBuilder *item_vb,
+gboolean msu_props_add_object(msu_writer_t *writer,
 			      GUPnPDIDLLiteObject *object,
 			      const char *root_path,
 			      const gchar *parent_path,
@@ -102,30 +107,47 @@ gboolean msu_props_add_object(GVariantBuilder *item_vb,
 GVariant *msu_props_get_object_prop(const gchar *prop, const gchar *root_path,
 				    GUPnPDIDLLiteObject *object);
 
-void msu_props_add_container(GVariantBuilder *item_vb,
+void msu_props_add_container(msu_writer_t *writer,
 			     GUPnPDIDLLiteContainer *object,
 			     msu_upnp_prop_mask filter_mask,
 			     gboolean *have_child_count);
 
-void msu_props_add_child_count(GVariantBuilder *item_vb, gint value);
+void msu_props_add_child_count(msu_writer_t *writer, gint value);
 
 GVariant *msu_props_get_container_prop(const gchar *prop,
 				       GUPnPDIDLLiteObject *object);
 
-void msu_props_add_resource(GVariantBuilder *item_vb,
+void msu_props_add_resource(msu_writer_t *writer,
 			    GUPnPDIDLLiteObject *object,
 			    msu_upnp_prop_mask filter_mask,
-			    const gchar *protocol_info);
+			    const msu_matcher_t *matcher);
 
-void msu_props_add_item(GVariantBuilder *item_vb,
+void msu_props_add_item(msu_writer_t *writer,
 			GUPnPDIDLLiteObject *object,
 			const gchar *root_path,
 			msu_upnp_prop_mask filter_mask,
-			const gchar *protocol_info);
+			const msu_matcher_t *matcher);
 
 GVariant *msu_props_get_item_prop(const gchar *prop, const gchar *root_path,
 				  GUPnPDIDLLiteObject *object,
-				  const gchar *protocol_info);
+				  const msu_matcher_t *matcher);
+
+gboolean msu_props_add_didl_object(msu_writer_t *writer,
+				   const msu_didl_object_t *object,
+				   const char *root_path,
+				   const gchar *parent_path,
+				   msu_upnp_prop_mask filter_mask);
+
+void msu_props_add_didl_container(msu_writer_t *writer,
+				  const msu_didl_object_t *object,
+				  msu_upnp_prop_mask filter_mask,
+				  gboolean *have_child_count);
+
+void msu_props_add_didl_item(msu_writer_t *writer,
+			     const msu_didl_object_t *object,
+			     const gchar *root_path,
+			     msu_upnp_prop_mask filter_mask,
+			     const msu_matcher_t *matcher);
 
 const gchar *msu_props_media_spec_to_upnp_class(const gchar *m2spec_class);
 
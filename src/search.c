@@ -83,8 +83,8 @@ gchar *msu_search_translate_search_string(GHashTable *filter_map,
 		} else if (!strcmp(prop, MSU_INTERFACE_PROP_PARENT) ||
 			   !strcmp(prop, MSU_INTERFACE_PROP_PATH)) {
 			value[strlen(value) - 1] = 0;
-			if (!msu_path_get_path_and_id(value + 1, &root_path,
-						      &id, NULL))
+			if (!msu_path_get_path_and_id(value + 1, NULL,
+						      &root_path, &id, NULL))
 				goto on_error;
 			g_free(root_path);
 			g_free(value);
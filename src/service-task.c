@@ -48,18 +48,20 @@ const char *msu_service_task_create_source(void)
 	return source;
 }
 
-void msu_service_task_add(const msu_task_queue_key_t *queue_id,
-			  msu_service_task_action action,
-			  msu_device_t *device,
-			  GUPnPServiceProxy *proxy,
-			  GUPnPServiceProxyActionCallback action_cb,
-			  GDestroyNotify free_func,
-			  gpointer cb_user_data)
+static void prv_service_task_add(const msu_task_queue_key_t *queue_id,
+				msu_service_task_action action,
+				msu_device_t *device,
+				GUPnPServiceProxy *proxy,
+				GUPnPServiceProxyActionCallback action_cb,
+				GDestroyNotify free_func,
+				gpointer cb_user_data,
+				gboolean exclusive)
 {
 	msu_service_task_t *task;
 
 	task = g_new0(msu_service_task_t, 1);
 
+	task->base.exclusive = exclusive;
 	task->t_action = action;
 	task->callback = action_cb;
 	task->free_func = free_func;
@@ -74,6 +76,30 @@ void msu_service_task_add(const msu_task_queue_key_t *queue_id,
 	msu_task_queue_add_task(queue_id, &task->base);
 }
 
+void msu_service_task_add(const msu_task_queue_key_t *queue_id,
+			  msu_service_task_action action,
+			  msu_device_t *device,
+			  GUPnPServiceProxy *proxy,
+			  GUPnPServiceProxyActionCallback action_cb,
+			  GDestroyNotify free_func,
+			  gpointer cb_user_data)
+{
+	prv_service_task_add(queue_id, action, device, proxy, action_cb,
+			     free_func, cb_user_data, FALSE);
+}
+
+void msu_service_task_add_barrier(const msu_task_queue_key_t *queue_id,
+				  msu_service_task_action action,
+				  msu_device_t *device,
+				  GUPnPServiceProxy *proxy,
+				  GUPnPServiceProxyActionCallback action_cb,
+				  GDestroyNotify free_func,
+				  gpointer cb_user_data)
+{
+	prv_service_task_add(queue_id, action, device, proxy, action_cb,
+			     free_func, cb_user_data, TRUE);
+}
+
 void msu_service_task_begin_action_cb(GUPnPServiceProxy *proxy,
 				      GUPnPServiceProxyAction *action,
 				      gpointer user_data)
@@ -83,7 +109,7 @@ void msu_service_task_begin_action_cb(GUPnPServiceProxy *proxy,
 	task->p_action = NULL;
 	task->callback(proxy, action, task->user_data);
 
-	msu_task_queue_task_completed(task->base.queue_id);
+	msu_task_queue_task_completed(&task->base);
 }
 
 void msu_service_task_process_cb(msu_task_atom_t *atom, gpointer user_data)
@@ -96,7 +122,7 @@ void msu_service_task_process_cb(msu_task_atom_t *atom, gpointer user_data)
 	if (failed)
 		msu_task_processor_cancel_queue(task->base.queue_id);
 	else if (!task->p_action)
-		msu_task_queue_task_completed(task->base.queue_id);
+		msu_task_queue_task_completed(&task->base);
 }
 
 void msu_service_task_cancel_cb(msu_task_atom_t *atom, gpointer user_data)
@@ -109,7 +135,7 @@ void msu_service_task_cancel_cb(msu_task_atom_t *atom, gpointer user_data)
 							  task->p_action);
 		task->p_action = NULL;
 
-		msu_task_queue_task_completed(task->base.queue_id);
+		msu_task_queue_task_completed(&task->base);
 	}
 }
 
@@ -47,6 +47,16 @@ void msu_service_task_add(const msu_task_queue_key_t *queue_id,
 			  GDestroyNotify free_func,
 			  gpointer cb_user_data);
 
+/* A barrier task only starts once all the tasks queued before it have
+   completed, and runs before any of the tasks queued after it. */
+void msu_service_task_add_barrier(const msu_task_queue_key_t *queue_id,
+				  msu_service_task_action action,
+				  msu_device_t *device,
+				  GUPnPServiceProxy *proxy,
+				  GUPnPServiceProxyActionCallback action_cb,
+				  GDestroyNotify free_func,
+				  gpointer cb_user_data);
+
 void msu_service_task_begin_action_cb(GUPnPServiceProxy *proxy,
 				      GUPnPServiceProxyAction *action,
 				      gpointer user_data);
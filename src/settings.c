@@ -29,9 +29,28 @@ struct msu_settings_context_t_ {
 	GFileMonitor *monitor;
 	gulong handler_id;
 	guint ev_id;
+	msu_settings_changed_cb_t changed_cb;
+	gpointer changed_data;
 
 	/* Global section */
 	gboolean never_quit;
+	guint max_parallel_tasks;
+	guint max_server_tasks;
+	GHashTable *client_weights;
+	guint client_max_queued_tasks;
+	guint client_max_queued_bytes;
+	guint server_max_queued_tasks;
+	guint server_max_queued_bytes;
+	gboolean drop_superseded_browse;
+	guint server_timeout;
+	guint circuit_max_failures;
+	guint circuit_cool_down;
+	gboolean read_ahead;
+	gboolean persistent_cache;
+	guint cache_max_bytes;
+	guint server_cache_max_bytes;
+	gboolean streaming_didl;
+	guint worker_threads;
 
 	/* Log section */
 	msu_log_type_t log_type;
@@ -42,12 +61,46 @@ struct msu_settings_context_t_ {
 
 #define MSU_SETTINGS_GROUP_GENERAL	"general"
 #define MSU_SETTINGS_KEY_NEVER_QUIT	"never-quit"
+#define MSU_SETTINGS_KEY_MAX_PARALLEL_TASKS	"max-parallel-tasks"
+#define MSU_SETTINGS_KEY_MAX_SERVER_TASKS	"max-server-tasks"
+#define MSU_SETTINGS_KEY_CLIENT_WEIGHTS	"client-weights"
+#define MSU_SETTINGS_KEY_CLIENT_MAX_QUEUED_TASKS	"client-max-queued-tasks"
+#define MSU_SETTINGS_KEY_CLIENT_MAX_QUEUED_BYTES	"client-max-queued-bytes"
+#define MSU_SETTINGS_KEY_SERVER_MAX_QUEUED_TASKS	"server-max-queued-tasks"
+#define MSU_SETTINGS_KEY_SERVER_MAX_QUEUED_BYTES	"server-max-queued-bytes"
+#define MSU_SETTINGS_KEY_DROP_SUPERSEDED_BROWSE	"drop-superseded-browse"
+#define MSU_SETTINGS_KEY_SERVER_TIMEOUT	"server-timeout"
+#define MSU_SETTINGS_KEY_CIRCUIT_MAX_FAILURES	"circuit-max-failures"
+#define MSU_SETTINGS_KEY_CIRCUIT_COOL_DOWN	"circuit-cool-down"
+#define MSU_SETTINGS_KEY_READ_AHEAD	"read-ahead"
+#define MSU_SETTINGS_KEY_PERSISTENT_CACHE	"persistent-cache"
+#define MSU_SETTINGS_KEY_CACHE_MAX_BYTES	"cache-max-bytes"
+#define MSU_SETTINGS_KEY_SERVER_CACHE_MAX_BYTES	"server-cache-max-bytes"
+#define MSU_SETTINGS_KEY_STREAMING_DIDL	"streaming-didl"
+#define MSU_SETTINGS_KEY_WORKER_THREADS	"worker-threads"
 
 #define MSU_SETTINGS_GROUP_LOG		"log"
 #define MSU_SETTINGS_KEY_LOG_TYPE	"log-type"
 #define MSU_SETTINGS_KEY_LOG_LEVEL	"log-level"
 
 #define MSU_SETTINGS_DEFAULT_NEVER_QUIT	MSU_NEVER_QUIT
+#define MSU_SETTINGS_DEFAULT_MAX_PARALLEL_TASKS	4
+#define MSU_SETTINGS_DEFAULT_MAX_SERVER_TASKS	8
+#define MSU_SETTINGS_DEFAULT_CLIENT_WEIGHT	1
+#define MSU_SETTINGS_DEFAULT_CLIENT_MAX_QUEUED_TASKS	512
+#define MSU_SETTINGS_DEFAULT_CLIENT_MAX_QUEUED_BYTES	(4 * 1024 * 1024)
+#define MSU_SETTINGS_DEFAULT_SERVER_MAX_QUEUED_TASKS	2048
+#define MSU_SETTINGS_DEFAULT_SERVER_MAX_QUEUED_BYTES	(16 * 1024 * 1024)
+#define MSU_SETTINGS_DEFAULT_DROP_SUPERSEDED_BROWSE	FALSE
+#define MSU_SETTINGS_DEFAULT_SERVER_TIMEOUT	60
+#define MSU_SETTINGS_DEFAULT_CIRCUIT_MAX_FAILURES	5
+#define MSU_SETTINGS_DEFAULT_CIRCUIT_COOL_DOWN	30
+#define MSU_SETTINGS_DEFAULT_READ_AHEAD	FALSE
+#define MSU_SETTINGS_DEFAULT_PERSISTENT_CACHE	FALSE
+#define MSU_SETTINGS_DEFAULT_CACHE_MAX_BYTES	(16 * 1024 * 1024)
+#define MSU_SETTINGS_DEFAULT_SERVER_CACHE_MAX_BYTES	(4 * 1024 * 1024)
+#define MSU_SETTINGS_DEFAULT_STREAMING_DIDL	FALSE
+#define MSU_SETTINGS_DEFAULT_WORKER_THREADS	2
 #define MSU_SETTINGS_DEFAULT_LOG_TYPE	MSU_LOG_TYPE
 #define MSU_SETTINGS_DEFAULT_LOG_LEVEL	MSU_LOG_LEVEL
 
@@ -58,6 +111,33 @@ do { \
 	MSU_LOG_DEBUG_NL(); \
 	MSU_LOG_DEBUG("[General settings]"); \
 	MSU_LOG_DEBUG("Never Quit: %s", (settings)->never_quit ? "T" : "F"); \
+	MSU_LOG_DEBUG("Max Parallel Tasks: %u", \
+		      (settings)->max_parallel_tasks); \
+	MSU_LOG_DEBUG("Max Server Tasks: %u", (settings)->max_server_tasks); \
+	MSU_LOG_DEBUG("Client Weights: %u", \
+		      g_hash_table_size((settings)->client_weights)); \
+	MSU_LOG_DEBUG("Client Max Queued: %u tasks, %u bytes", \
+		      (settings)->client_max_queued_tasks, \
+		      (settings)->client_max_queued_bytes); \
+	MSU_LOG_DEBUG("Server Max Queued: %u tasks, %u bytes", \
+		      (settings)->server_max_queued_tasks, \
+		      (settings)->server_max_queued_bytes); \
+	MSU_LOG_DEBUG("Drop Superseded Browse: %s", \
+		      (settings)->drop_superseded_browse ? "T" : "F"); \
+	MSU_LOG_DEBUG("Server Timeout: %u", (settings)->server_timeout); \
+	MSU_LOG_DEBUG("Circuit: %u failures, %u s cool-down", \
+		      (settings)->circuit_max_failures, \
+		      (settings)->circuit_cool_down); \
+	MSU_LOG_DEBUG("Read Ahead: %s", \
+		      (settings)->read_ahead ? "T" : "F"); \
+	MSU_LOG_DEBUG("Persistent Cache: %s", \
+		      (settings)->persistent_cache ? "T" : "F"); \
+	MSU_LOG_DEBUG("Cache Max: %u bytes, %u bytes per server", \
+		      (settings)->cache_max_bytes, \
+		      (settings)->server_cache_max_bytes); \
+	MSU_LOG_DEBUG("Streaming DIDL: %s", \
+		      (settings)->streaming_didl ? "T" : "F"); \
+	MSU_LOG_DEBUG("Worker Threads: %u", (settings)->worker_threads); \
 	MSU_LOG_DEBUG_NL(); \
 	MSU_LOG_DEBUG("[Logging settings]"); \
 	MSU_LOG_DEBUG("Log Type : %d", (settings)->log_type); \
@@ -189,6 +269,46 @@ static msu_log_type_t prv_msu_settings_to_log_type(int type)
 	return log_type;
 }
 
+static void prv_msu_settings_to_client_weights(
+					msu_settings_context_t *settings,
+					gchar **str_list, gsize length)
+{
+	gsize i;
+	gchar *sep;
+	gint64 weight;
+
+	/* Each entry has the form <d-Bus name>=<weight> */
+	for (i = 0; i < length; ++i) {
+		sep = strrchr(str_list[i], '=');
+		if (!sep || sep == str_list[i])
+			continue;
+
+		*sep = 0;
+		weight = g_ascii_strtoll(sep + 1, NULL, 10);
+
+		if (weight > 0 && weight <= G_MAXUINT16)
+			g_hash_table_insert(settings->client_weights,
+					    g_strdup(g_strstrip(str_list[i])),
+					    GUINT_TO_POINTER(weight));
+	}
+}
+
+static void prv_msu_settings_read_uint(GKeyFile *keyfile, const gchar *group,
+				       const gchar *key, guint *value)
+{
+	GError *error = NULL;
+	gint int_val;
+
+	int_val = g_key_file_get_integer(keyfile, group, key, &error);
+
+	if (error == NULL) {
+		if (int_val >= 0)
+			*value = int_val;
+	} else {
+		g_error_free(error);
+	}
+}
+
 static void prv_msu_settings_read_keys(msu_settings_context_t *settings)
 {
 	GError *error = NULL;
@@ -196,6 +316,7 @@ static void prv_msu_settings_read_keys(msu_settings_context_t *settings)
 	gboolean b_val;
 	gint int_val;
 	gint *int_star;
+	gchar **str_star;
 	gsize length;
 
 	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_GENERAL,
@@ -209,6 +330,117 @@ static void prv_msu_settings_read_keys(msu_settings_context_t *settings)
 		error = NULL;
 	}
 
+	int_val = g_key_file_get_integer(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+					 MSU_SETTINGS_KEY_MAX_PARALLEL_TASKS,
+					 &error);
+
+	if (error == NULL) {
+		if (int_val > 0)
+			settings->max_parallel_tasks = int_val;
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	int_val = g_key_file_get_integer(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+					 MSU_SETTINGS_KEY_MAX_SERVER_TASKS,
+					 &error);
+
+	if (error == NULL) {
+		if (int_val >= 0)
+			settings->max_server_tasks = int_val;
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_CLIENT_MAX_QUEUED_TASKS,
+				   &settings->client_max_queued_tasks);
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_CLIENT_MAX_QUEUED_BYTES,
+				   &settings->client_max_queued_bytes);
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_SERVER_MAX_QUEUED_TASKS,
+				   &settings->server_max_queued_tasks);
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_SERVER_MAX_QUEUED_BYTES,
+				   &settings->server_max_queued_bytes);
+
+	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				       MSU_SETTINGS_KEY_DROP_SUPERSEDED_BROWSE,
+				       &error);
+
+	if (error == NULL) {
+		settings->drop_superseded_browse = b_val;
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_SERVER_TIMEOUT,
+				   &settings->server_timeout);
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_CIRCUIT_MAX_FAILURES,
+				   &settings->circuit_max_failures);
+
+	int_val = g_key_file_get_integer(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+					 MSU_SETTINGS_KEY_CIRCUIT_COOL_DOWN,
+					 &error);
+
+	if (error == NULL) {
+		if (int_val > 0)
+			settings->circuit_cool_down = int_val;
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				       MSU_SETTINGS_KEY_READ_AHEAD,
+				       &error);
+
+	if (error == NULL) {
+		settings->read_ahead = b_val;
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				       MSU_SETTINGS_KEY_PERSISTENT_CACHE,
+				       &error);
+
+	if (error == NULL) {
+		settings->persistent_cache = b_val;
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_CACHE_MAX_BYTES,
+				   &settings->cache_max_bytes);
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_SERVER_CACHE_MAX_BYTES,
+				   &settings->server_cache_max_bytes);
+
+	b_val = g_key_file_get_boolean(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				       MSU_SETTINGS_KEY_STREAMING_DIDL,
+				       &error);
+
+	if (error == NULL) {
+		settings->streaming_didl = b_val;
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
+
+	prv_msu_settings_read_uint(keyfile, MSU_SETTINGS_GROUP_GENERAL,
+				   MSU_SETTINGS_KEY_WORKER_THREADS,
+				   &settings->worker_threads);
+
 	int_val = g_key_file_get_integer(keyfile, MSU_SETTINGS_GROUP_LOG,
 						  MSU_SETTINGS_KEY_LOG_TYPE,
 						  &error);
@@ -235,11 +467,55 @@ static void prv_msu_settings_read_keys(msu_settings_context_t *settings)
 		g_error_free(error);
 		error = NULL;
 	}
+
+	str_star = g_key_file_get_string_list(keyfile,
+					      MSU_SETTINGS_GROUP_GENERAL,
+					      MSU_SETTINGS_KEY_CLIENT_WEIGHTS,
+					      &length,
+					      &error);
+
+	if (error == NULL) {
+		prv_msu_settings_to_client_weights(settings, str_star, length);
+		g_strfreev(str_star);
+	} else {
+		g_error_free(error);
+		error = NULL;
+	}
 }
 
 static void prv_msu_settings_init_default(msu_settings_context_t *settings)
 {
 	settings->never_quit = MSU_SETTINGS_DEFAULT_NEVER_QUIT;
+	settings->max_parallel_tasks = MSU_SETTINGS_DEFAULT_MAX_PARALLEL_TASKS;
+	settings->max_server_tasks = MSU_SETTINGS_DEFAULT_MAX_SERVER_TASKS;
+	settings->client_max_queued_tasks =
+		MSU_SETTINGS_DEFAULT_CLIENT_MAX_QUEUED_TASKS;
+	settings->client_max_queued_bytes =
+		MSU_SETTINGS_DEFAULT_CLIENT_MAX_QUEUED_BYTES;
+	settings->server_max_queued_tasks =
+		MSU_SETTINGS_DEFAULT_SERVER_MAX_QUEUED_TASKS;
+	settings->server_max_queued_bytes =
+		MSU_SETTINGS_DEFAULT_SERVER_MAX_QUEUED_BYTES;
+	settings->drop_superseded_browse =
+		MSU_SETTINGS_DEFAULT_DROP_SUPERSEDED_BROWSE;
+	settings->server_timeout = MSU_SETTINGS_DEFAULT_SERVER_TIMEOUT;
+	settings->circuit_max_failures =
+		MSU_SETTINGS_DEFAULT_CIRCUIT_MAX_FAILURES;
+	settings->circuit_cool_down = MSU_SETTINGS_DEFAULT_CIRCUIT_COOL_DOWN;
+	settings->read_ahead = MSU_SETTINGS_DEFAULT_READ_AHEAD;
+	settings->persistent_cache = MSU_SETTINGS_DEFAULT_PERSISTENT_CACHE;
+	settings->cache_max_bytes = MSU_SETTINGS_DEFAULT_CACHE_MAX_BYTES;
+	settings->server_cache_max_bytes =
+		MSU_SETTINGS_DEFAULT_SERVER_CACHE_MAX_BYTES;
+	settings->streaming_didl = MSU_SETTINGS_DEFAULT_STREAMING_DIDL;
+	settings->worker_threads = MSU_SETTINGS_DEFAULT_WORKER_THREADS;
+
+	if (settings->client_weights)
+		g_hash_table_remove_all(settings->client_weights);
+	else
+		settings->client_weights = g_hash_table_new_full(g_str_hash,
+								 g_str_equal,
+								 g_free, NULL);
 
 	settings->log_type = MSU_SETTINGS_DEFAULT_LOG_TYPE;
 	settings->log_level = MSU_SETTINGS_DEFAULT_LOG_LEVEL;
@@ -297,6 +573,9 @@ static gboolean prv_msu_settings_monitor_timout_cb(gpointer user_data)
 
 	prv_msu_settings_reload(data);
 
+	if (data->changed_cb)
+		data->changed_cb(data->changed_data);
+
 	data->ev_id = 0;
 	return FALSE;
 }
@@ -355,6 +634,91 @@ gboolean msu_settings_is_never_quit(msu_settings_context_t *settings)
 	return settings->never_quit;
 }
 
+guint msu_settings_get_max_parallel_tasks(msu_settings_context_t *settings)
+{
+	return settings->max_parallel_tasks;
+}
+
+guint msu_settings_get_max_server_tasks(msu_settings_context_t *settings)
+{
+	return settings->max_server_tasks;
+}
+
+guint msu_settings_get_client_weight(msu_settings_context_t *settings,
+				     const gchar *name)
+{
+	gpointer weight;
+
+	weight = g_hash_table_lookup(settings->client_weights, name);
+
+	return weight ? GPOINTER_TO_UINT(weight) :
+		MSU_SETTINGS_DEFAULT_CLIENT_WEIGHT;
+}
+
+GList *msu_settings_get_client_weight_names(msu_settings_context_t *settings)
+{
+	return g_hash_table_get_keys(settings->client_weights);
+}
+
+void msu_settings_get_client_limits(msu_settings_context_t *settings,
+				    guint *max_tasks, gsize *max_bytes)
+{
+	*max_tasks = settings->client_max_queued_tasks;
+	*max_bytes = settings->client_max_queued_bytes;
+}
+
+void msu_settings_get_server_limits(msu_settings_context_t *settings,
+				    guint *max_tasks, gsize *max_bytes)
+{
+	*max_tasks = settings->server_max_queued_tasks;
+	*max_bytes = settings->server_max_queued_bytes;
+}
+
+gboolean msu_settings_is_drop_superseded_browse(
+					msu_settings_context_t *settings)
+{
+	return settings->drop_superseded_browse;
+}
+
+guint msu_settings_get_server_timeout(msu_settings_context_t *settings)
+{
+	return settings->server_timeout;
+}
+
+void msu_settings_get_circuit_limits(msu_settings_context_t *settings,
+				     guint *max_failures, guint *cool_down)
+{
+	*max_failures = settings->circuit_max_failures;
+	*cool_down = settings->circuit_cool_down;
+}
+
+gboolean msu_settings_is_read_ahead(msu_settings_context_t *settings)
+{
+	return settings->read_ahead;
+}
+
+gboolean msu_settings_is_persistent_cache(msu_settings_context_t *settings)
+{
+	return settings->persistent_cache;
+}
+
+void msu_settings_get_cache_limits(msu_settings_context_t *settings,
+				   gsize *max_bytes, gsize *server_max_bytes)
+{
+	*max_bytes = settings->cache_max_bytes;
+	*server_max_bytes = settings->server_cache_max_bytes;
+}
+
+gboolean msu_settings_is_streaming_didl(msu_settings_context_t *settings)
+{
+	return settings->streaming_didl;
+}
+
+guint msu_settings_get_worker_threads(msu_settings_context_t *settings)
+{
+	return settings->worker_threads;
+}
+
 void msu_settings_new(msu_settings_context_t **settings)
 {
 	gchar *sys_path = NULL;
@@ -379,6 +743,14 @@ void msu_settings_new(msu_settings_context_t **settings)
 	g_free(loc_path);
 }
 
+void msu_settings_set_changed_cb(msu_settings_context_t *settings,
+				 msu_settings_changed_cb_t cb,
+				 gpointer user_data)
+{
+	settings->changed_cb = cb;
+	settings->changed_data = user_data;
+}
+
 void msu_settings_delete(msu_settings_context_t *settings)
 {
 	if (settings->monitor) {
@@ -392,5 +764,7 @@ void msu_settings_delete(msu_settings_context_t *settings)
 
 	prv_msu_settings_keyfile_finalize(settings);
 
+	g_hash_table_unref(settings->client_weights);
+
 	g_free(settings);
 }
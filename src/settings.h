@@ -30,9 +30,34 @@
 
 typedef struct msu_settings_context_t_ msu_settings_context_t;
 
+typedef void (*msu_settings_changed_cb_t)(gpointer user_data);
+
 void msu_settings_new(msu_settings_context_t **settings);
 void msu_settings_delete(msu_settings_context_t *settings);
+void msu_settings_set_changed_cb(msu_settings_context_t *settings,
+				 msu_settings_changed_cb_t cb,
+				 gpointer user_data);
 
 gboolean msu_settings_is_never_quit(msu_settings_context_t *settings);
+guint msu_settings_get_max_parallel_tasks(msu_settings_context_t *settings);
+guint msu_settings_get_max_server_tasks(msu_settings_context_t *settings);
+guint msu_settings_get_client_weight(msu_settings_context_t *settings,
+				     const gchar *name);
+GList *msu_settings_get_client_weight_names(msu_settings_context_t *settings);
+void msu_settings_get_client_limits(msu_settings_context_t *settings,
+				    guint *max_tasks, gsize *max_bytes);
+void msu_settings_get_server_limits(msu_settings_context_t *settings,
+				    guint *max_tasks, gsize *max_bytes);
+gboolean msu_settings_is_drop_superseded_browse(
+					msu_settings_context_t *settings);
+guint msu_settings_get_server_timeout(msu_settings_context_t *settings);
+void msu_settings_get_circuit_limits(msu_settings_context_t *settings,
+				     guint *max_failures, guint *cool_down);
+gboolean msu_settings_is_read_ahead(msu_settings_context_t *settings);
+gboolean msu_settings_is_persistent_cache(msu_settings_context_t *settings);
+void msu_settings_get_cache_limits(msu_settings_context_t *settings,
+				   gsize *max_bytes, gsize *server_max_bytes);
+gboolean msu_settings_is_streaming_didl(msu_settings_context_t *settings);
+guint msu_settings_get_worker_threads(msu_settings_context_t *settings);
 
 #endif /* MSU_SETTINGS_H__ */
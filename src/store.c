@@ -0,0 +1,672 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include <libxml/tree.h>
+
+#include "log.h"
+#include "store.h"
+
+/* Changed whenever the layout of the file changes */
+#define MSU_STORE_VERSION 2
+
+/* Version, SystemUpdateID, ServiceResetToken, objects, pages and child
+   counts.  Objects and pages are kept as DIDL-Lite so that they are only
+   parsed when they are looked up.  The entries of each dictionary are
+   sorted by key, so that they can be looked up by binary search. */
+#define MSU_STORE_FORMAT "(uusa{ss}a{s(uus)}a{s(uu)})"
+
+#define MSU_STORE_VERSION_INDEX 0
+#define MSU_STORE_UPDATE_ID_INDEX 1
+#define MSU_STORE_RESET_TOKEN_INDEX 2
+#define MSU_STORE_OBJECTS_INDEX 3
+#define MSU_STORE_PAGES_INDEX 4
+#define MSU_STORE_COUNTS_INDEX 5
+
+/* Maximum number of entries of each kind kept in the file */
+#define MSU_STORE_MAX_OBJECTS 1024
+#define MSU_STORE_MAX_PAGES 256
+#define MSU_STORE_MAX_COUNTS 4096
+
+/* Version, location of the device description and results of the
+   GetSearchCapabilities, GetSortCapabilities,
+   GetSortExtensionCapabilities and GetFeatureList actions */
+#define MSU_STORE_CAPS_FORMAT "(usmsmsmsms)"
+#define MSU_STORE_CAPS_SUFFIX ".caps"
+
+#define MSU_STORE_DIR "media-service-upnp"
+#define MSU_STORE_DIDL_NS "urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/"
+
+/* data maps the file of a previous run.  Its entries can only be used
+   once the server has confirmed that its content has not changed. */
+struct msu_store_t_ {
+	gchar *path;
+	GVariant *data;
+	gboolean valid;
+};
+
+typedef struct msu_store_entry_t_ msu_store_entry_t;
+struct msu_store_entry_t_ {
+	const gchar *key;
+	GVariant *value;
+};
+
+typedef struct msu_store_table_t_ msu_store_table_t;
+struct msu_store_table_t_ {
+	const gchar *type;
+	GArray *entries;
+	GHashTable *keys;
+	guint max_size;
+};
+
+static gboolean g_enabled;
+
+void msu_store_set_enabled(gboolean enabled)
+{
+	g_enabled = enabled;
+}
+
+static gchar *prv_store_path(const gchar *udn)
+{
+	gchar *name;
+	gchar *path;
+
+	name = g_strdup(udn);
+	(void) g_strdelimit(name, "/\\", '_');
+
+	path = g_build_filename(g_get_user_cache_dir(), MSU_STORE_DIR, name,
+				NULL);
+	g_free(name);
+
+	return path;
+}
+
+msu_store_t *msu_store_open(const gchar *udn)
+{
+	msu_store_t *store = NULL;
+	GMappedFile *file;
+	GVariant *data;
+	guint version;
+
+	if (!g_enabled || !udn)
+		goto finished;
+
+	store = g_new0(msu_store_t, 1);
+	store->path = prv_store_path(udn);
+
+	file = g_mapped_file_new(store->path, FALSE, NULL);
+	if (!file)
+		goto finished;
+
+	if (!g_mapped_file_get_length(file)) {
+		g_mapped_file_unref(file);
+		goto finished;
+	}
+
+	/* The file is only mapped.  Its pages are read as entries are
+	   looked up. */
+	data = g_variant_new_from_data(G_VARIANT_TYPE(MSU_STORE_FORMAT),
+				       g_mapped_file_get_contents(file),
+				       g_mapped_file_get_length(file),
+				       FALSE,
+				       (GDestroyNotify) g_mapped_file_unref,
+				       file);
+	store->data = g_variant_ref_sink(data);
+
+	g_variant_get_child(store->data, MSU_STORE_VERSION_INDEX, "u",
+			    &version);
+	if (version != MSU_STORE_VERSION) {
+		MSU_LOG_DEBUG("Ignoring %s: version %u", store->path, version);
+		msu_store_invalidate(store);
+	}
+
+finished:
+
+	return store;
+}
+
+void msu_store_delete(msu_store_t *store)
+{
+	if (store) {
+		msu_store_invalidate(store);
+		g_free(store->path);
+		g_free(store);
+	}
+}
+
+gboolean msu_store_validate(msu_store_t *store, guint system_update_id,
+			    const gchar *reset_token)
+{
+	guint stored_id;
+	const gchar *stored_token;
+
+	if (!store->data)
+		goto finished;
+
+	g_variant_get_child(store->data, MSU_STORE_UPDATE_ID_INDEX, "u",
+			    &stored_id);
+	g_variant_get_child(store->data, MSU_STORE_RESET_TOKEN_INDEX, "&s",
+			    &stored_token);
+
+	store->valid = (stored_id == system_update_id &&
+			!g_strcmp0(stored_token, reset_token));
+
+	MSU_LOG_DEBUG("%s: SystemUpdateID %u/%u, ResetToken %s/%s: %s",
+		      store->path, stored_id, system_update_id, stored_token,
+		      reset_token, store->valid ? "valid" : "outdated");
+
+	if (!store->valid)
+		msu_store_invalidate(store);
+
+finished:
+
+	return store->valid;
+}
+
+void msu_store_invalidate(msu_store_t *store)
+{
+	store->valid = FALSE;
+
+	if (store->data) {
+		g_variant_unref(store->data);
+		store->data = NULL;
+	}
+}
+
+gboolean msu_store_is_valid(const msu_store_t *store)
+{
+	return store->valid;
+}
+
+/* Only the entries visited by the search are read from the file. */
+static GVariant *prv_lookup(msu_store_t *store, gint index, const gchar *key,
+			    const gchar *type)
+{
+	GVariant *dict;
+	GVariant *entry;
+	GVariant *value = NULL;
+	const gchar *entry_key;
+	gsize low = 0;
+	gsize high;
+	gsize mid;
+	gint cmp;
+
+	if (!store->valid)
+		goto finished;
+
+	dict = g_variant_get_child_value(store->data, index);
+	high = g_variant_n_children(dict);
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		entry = g_variant_get_child_value(dict, mid);
+		g_variant_get_child(entry, 0, "&s", &entry_key);
+
+		cmp = strcmp(key, entry_key);
+		if (!cmp)
+			value = g_variant_get_child_value(entry, 1);
+
+		g_variant_unref(entry);
+
+		if (!cmp)
+			break;
+		else if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	g_variant_unref(dict);
+
+	if (value && !g_variant_is_of_type(value, G_VARIANT_TYPE(type))) {
+		g_variant_unref(value);
+		value = NULL;
+	}
+
+finished:
+
+	return value;
+}
+
+static void prv_collect_object(GUPnPDIDLLiteParser *parser,
+			       GUPnPDIDLLiteObject *object,
+			       gpointer user_data)
+{
+	GPtrArray *objects = user_data;
+
+	g_ptr_array_add(objects, g_object_ref(object));
+}
+
+static GPtrArray *prv_parse_didl(const gchar *didl)
+{
+	GUPnPDIDLLiteParser *parser;
+	GPtrArray *objects;
+	GError *error = NULL;
+
+	parser = gupnp_didl_lite_parser_new();
+	objects = g_ptr_array_new_with_free_func(g_object_unref);
+
+	g_signal_connect(parser, "object-available",
+			 G_CALLBACK(prv_collect_object), objects);
+
+	if (!gupnp_didl_lite_parser_parse_didl(parser, didl, &error) &&
+	    error->code != GUPNP_XML_ERROR_EMPTY_NODE) {
+		MSU_LOG_WARNING("Unable to parse stored DIDL: %s",
+				error->message);
+
+		g_ptr_array_unref(objects);
+		objects = NULL;
+	}
+
+	if (error)
+		g_error_free(error);
+
+	g_object_unref(parser);
+
+	return objects;
+}
+
+GUPnPDIDLLiteObject *msu_store_lookup_object(msu_store_t *store,
+					     const gchar *id)
+{
+	GVariant *value;
+	GPtrArray *objects = NULL;
+	GUPnPDIDLLiteObject *object = NULL;
+
+	value = prv_lookup(store, MSU_STORE_OBJECTS_INDEX, id, "s");
+	if (!value)
+		goto finished;
+
+	objects = prv_parse_didl(g_variant_get_string(value, NULL));
+	if (objects && objects->len)
+		object = g_object_ref(g_ptr_array_index(objects, 0));
+
+	MSU_LOG_DEBUG("Object %s found in %s", id, store->path);
+
+finished:
+
+	if (objects)
+		g_ptr_array_unref(objects);
+
+	if (value)
+		g_variant_unref(value);
+
+	return object;
+}
+
+GPtrArray *msu_store_lookup_page(msu_store_t *store, const gchar *key,
+				 guint *update_id, guint *total_matches)
+{
+	GVariant *value;
+	const gchar *didl;
+	GPtrArray *objects = NULL;
+
+	value = prv_lookup(store, MSU_STORE_PAGES_INDEX, key, "(uus)");
+	if (!value)
+		goto finished;
+
+	g_variant_get(value, "(uu&s)", update_id, total_matches, &didl);
+	objects = prv_parse_didl(didl);
+
+	g_variant_unref(value);
+
+finished:
+
+	return objects;
+}
+
+gboolean msu_store_lookup_child_count(msu_store_t *store, const gchar *id,
+				      msu_cache_count_t *count)
+{
+	GVariant *value;
+
+	value = prv_lookup(store, MSU_STORE_COUNTS_INDEX, id, "(uu)");
+	if (value) {
+		g_variant_get(value, "(uu)", &count->count, &count->update_id);
+		g_variant_unref(value);
+	}
+
+	return value != NULL;
+}
+
+/* The objects of a page come from the same response, so the namespaces
+   declared by its root element cover all of them. */
+static void prv_append_xmlns(GString *didl, xmlNode *node)
+{
+	xmlNode *root;
+	xmlNs *ns;
+	gchar *attr;
+
+	root = xmlDocGetRootElement(node->doc);
+
+	for (ns = root->nsDef; ns; ns = ns->next) {
+		if (ns->prefix)
+			attr = g_markup_printf_escaped(" xmlns:%s=\"%s\"",
+						       (const gchar *)ns->prefix,
+						       (const gchar *)ns->href);
+		else
+			attr = g_markup_printf_escaped(" xmlns=\"%s\"",
+						       (const gchar *)ns->href);
+
+		g_string_append(didl, attr);
+		g_free(attr);
+	}
+}
+
+static gchar *prv_didl_new(GPtrArray *objects)
+{
+	GString *didl;
+	xmlNode *node;
+	xmlBuffer *buffer;
+	guint i;
+
+	didl = g_string_new("<DIDL-Lite");
+
+	if (objects->len) {
+		node = gupnp_didl_lite_object_get_xml_node(
+					g_ptr_array_index(objects, 0));
+		prv_append_xmlns(didl, node);
+	} else {
+		g_string_append(didl, " xmlns=\"" MSU_STORE_DIDL_NS "\"");
+	}
+
+	g_string_append_c(didl, '>');
+
+	buffer = xmlBufferCreate();
+
+	for (i = 0; i < objects->len; ++i) {
+		node = gupnp_didl_lite_object_get_xml_node(
+					g_ptr_array_index(objects, i));
+		xmlBufferEmpty(buffer);
+		(void) xmlNodeDump(buffer, node->doc, node, 0, 0);
+		g_string_append(didl, (const gchar *)xmlBufferContent(buffer));
+	}
+
+	xmlBufferFree(buffer);
+
+	g_string_append(didl, "</DIDL-Lite>");
+
+	return g_string_free(didl, FALSE);
+}
+
+static void prv_table_init(msu_store_table_t *table, const gchar *type,
+			   guint max_size)
+{
+	table->type = type;
+	table->entries = g_array_new(FALSE, FALSE, sizeof(msu_store_entry_t));
+	table->keys = g_hash_table_new(g_str_hash, g_str_equal);
+	table->max_size = max_size;
+}
+
+static gint prv_entry_compare(gconstpointer a, gconstpointer b)
+{
+	const msu_store_entry_t *entry_a = a;
+	const msu_store_entry_t *entry_b = b;
+
+	return strcmp(entry_a->key, entry_b->key);
+}
+
+/* The entries are written in the order prv_lookup searches them in. */
+static GVariant *prv_table_end(msu_store_table_t *table)
+{
+	GVariantBuilder builder;
+	msu_store_entry_t *entry;
+	guint i;
+
+	g_array_sort(table->entries, prv_entry_compare);
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE(table->type));
+
+	for (i = 0; i < table->entries->len; ++i) {
+		entry = &g_array_index(table->entries, msu_store_entry_t, i);
+		g_variant_builder_add(&builder, "{s@*}", entry->key,
+				      entry->value);
+		g_variant_unref(entry->value);
+	}
+
+	g_array_unref(table->entries);
+	g_hash_table_unref(table->keys);
+
+	return g_variant_builder_end(&builder);
+}
+
+/* key must outlive the table.  value is sunk if it is floating. */
+static void prv_table_add(msu_store_table_t *table, const gchar *key,
+			  GVariant *value)
+{
+	msu_store_entry_t entry;
+
+	if (g_hash_table_size(table->keys) >= table->max_size ||
+	    g_hash_table_lookup(table->keys, key)) {
+		g_variant_unref(g_variant_ref_sink(value));
+		goto finished;
+	}
+
+	entry.key = key;
+	entry.value = g_variant_ref_sink(value);
+
+	g_hash_table_insert(table->keys, (gpointer)key, (gpointer)key);
+	g_array_append_val(table->entries, entry);
+
+finished:
+
+	return;
+}
+
+/* Entries of the previous run that were not used in this one are still
+   valid if the content of the server has not changed. */
+static void prv_table_merge(msu_store_table_t *table, GVariant *data,
+			    gint index)
+{
+	GVariant *dict;
+	GVariantIter iter;
+	const gchar *key;
+	GVariant *value;
+
+	dict = g_variant_get_child_value(data, index);
+	g_variant_iter_init(&iter, dict);
+
+	while (g_variant_iter_next(&iter, "{&s@*}", &key, &value)) {
+		prv_table_add(table, key, value);
+		g_variant_unref(value);
+	}
+
+	g_variant_unref(dict);
+}
+
+static void prv_save_object(gpointer key, gpointer value, gpointer user_data)
+{
+	GPtrArray *objects;
+	gchar *didl;
+
+	objects = g_ptr_array_new();
+	g_ptr_array_add(objects, value);
+	didl = prv_didl_new(objects);
+	g_ptr_array_unref(objects);
+
+	prv_table_add(user_data, key, g_variant_new_string(didl));
+	g_free(didl);
+}
+
+static void prv_save_page(gpointer key, gpointer value, gpointer user_data)
+{
+	msu_cache_page_t *page = value;
+	gchar *didl;
+
+	didl = prv_didl_new(page->objects);
+	prv_table_add(user_data, key, g_variant_new("(uus)", page->update_id,
+						     page->total_matches,
+						     didl));
+	g_free(didl);
+}
+
+static void prv_save_child_count(gpointer key, gpointer value,
+				 gpointer user_data)
+{
+	msu_cache_count_t *count = value;
+
+	prv_table_add(user_data, key, g_variant_new("(uu)", count->count,
+						    count->update_id));
+}
+
+/* The file is replaced atomically, so that the mapping of the previous
+   one stays valid while the new one is written. */
+void msu_store_save(msu_store_t *store, msu_cache_t *cache,
+		    guint system_update_id, const gchar *reset_token)
+{
+	msu_store_table_t objects;
+	msu_store_table_t pages;
+	msu_store_table_t counts;
+	GVariant *data;
+	gchar *dir;
+	GError *error = NULL;
+
+	prv_table_init(&objects, "a{ss}", MSU_STORE_MAX_OBJECTS);
+	prv_table_init(&pages, "a{s(uus)}", MSU_STORE_MAX_PAGES);
+	prv_table_init(&counts, "a{s(uu)}", MSU_STORE_MAX_COUNTS);
+
+	msu_cache_foreach_object(cache, prv_save_object, &objects);
+	msu_cache_foreach_page(cache, prv_save_page, &pages);
+	msu_cache_foreach_child_count(cache, prv_save_child_count, &counts);
+
+	if (store->valid) {
+		prv_table_merge(&objects, store->data, MSU_STORE_OBJECTS_INDEX);
+		prv_table_merge(&pages, store->data, MSU_STORE_PAGES_INDEX);
+		prv_table_merge(&counts, store->data, MSU_STORE_COUNTS_INDEX);
+	}
+
+	data = g_variant_new("(uus@a{ss}@a{s(uus)}@a{s(uu)})",
+			     MSU_STORE_VERSION, system_update_id, reset_token,
+			     prv_table_end(&objects), prv_table_end(&pages),
+			     prv_table_end(&counts));
+	data = g_variant_ref_sink(data);
+
+	dir = g_path_get_dirname(store->path);
+	(void) g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+
+	if (!g_file_set_contents(store->path, g_variant_get_data(data),
+				 g_variant_get_size(data), &error)) {
+		MSU_LOG_WARNING("Unable to save %s: %s", store->path,
+				error->message);
+		g_error_free(error);
+	} else {
+		MSU_LOG_DEBUG("Saved %s (SystemUpdateID %u)", store->path,
+			      system_update_id);
+	}
+
+	g_variant_unref(data);
+}
+
+static gchar *prv_caps_path(msu_store_t *store)
+{
+	return g_strconcat(store->path, MSU_STORE_CAPS_SUFFIX, NULL);
+}
+
+/* The capabilities are only reused if the server still has the same
+   description location. */
+gboolean msu_store_lookup_capabilities(msu_store_t *store,
+				       const gchar *location,
+				       msu_store_caps_t *caps)
+{
+	gchar *path;
+	gchar *contents = NULL;
+	gsize length;
+	GVariant *data = NULL;
+	guint version;
+	const gchar *stored_location;
+	gboolean found = FALSE;
+
+	path = prv_caps_path(store);
+
+	if (!g_file_get_contents(path, &contents, &length, NULL))
+		goto finished;
+
+	data = g_variant_new_from_data(G_VARIANT_TYPE(MSU_STORE_CAPS_FORMAT),
+				       contents, length, FALSE, g_free,
+				       contents);
+	data = g_variant_ref_sink(data);
+
+	g_variant_get_child(data, 0, "u", &version);
+	g_variant_get_child(data, 1, "&s", &stored_location);
+
+	if (version != MSU_STORE_VERSION ||
+	    g_strcmp0(stored_location, location)) {
+		MSU_LOG_DEBUG("Ignoring %s: location %s", path,
+			      stored_location);
+		goto finished;
+	}
+
+	msu_store_clear_capabilities(caps);
+	g_variant_get(data, "(u&smsmsmsms)", &version, &stored_location,
+		      &caps->search_caps, &caps->sort_caps,
+		      &caps->sort_ext_caps, &caps->feature_list);
+
+	found = TRUE;
+
+finished:
+
+	if (data)
+		g_variant_unref(data);
+
+	g_free(path);
+
+	return found;
+}
+
+void msu_store_save_capabilities(msu_store_t *store, const gchar *location,
+				 const msu_store_caps_t *caps)
+{
+	GVariant *data;
+	gchar *path;
+	gchar *dir;
+	GError *error = NULL;
+
+	data = g_variant_new(MSU_STORE_CAPS_FORMAT, MSU_STORE_VERSION,
+			     location, caps->search_caps, caps->sort_caps,
+			     caps->sort_ext_caps, caps->feature_list);
+	data = g_variant_ref_sink(data);
+
+	path = prv_caps_path(store);
+
+	dir = g_path_get_dirname(path);
+	(void) g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+
+	if (!g_file_set_contents(path, g_variant_get_data(data),
+				 g_variant_get_size(data), &error)) {
+		MSU_LOG_WARNING("Unable to save %s: %s", path, error->message);
+		g_error_free(error);
+	}
+
+	g_free(path);
+	g_variant_unref(data);
+}
+
+void msu_store_clear_capabilities(msu_store_caps_t *caps)
+{
+	g_free(caps->search_caps);
+	g_free(caps->sort_caps);
+	g_free(caps->sort_ext_caps);
+	g_free(caps->feature_list);
+
+	memset(caps, 0, sizeof(*caps));
+}
@@ -0,0 +1,68 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_STORE_H__
+#define MSU_STORE_H__
+
+#include <glib.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "cache.h"
+
+typedef struct msu_store_t_ msu_store_t;
+
+/* The results of the capability actions of a server, NULL for those that
+   failed. */
+typedef struct msu_store_caps_t_ msu_store_caps_t;
+struct msu_store_caps_t_ {
+	gchar *search_caps;
+	gchar *sort_caps;
+	gchar *sort_ext_caps;
+	gchar *feature_list;
+};
+
+void msu_store_set_enabled(gboolean enabled);
+
+msu_store_t *msu_store_open(const gchar *udn);
+void msu_store_delete(msu_store_t *store);
+
+gboolean msu_store_validate(msu_store_t *store, guint system_update_id,
+			    const gchar *reset_token);
+void msu_store_invalidate(msu_store_t *store);
+gboolean msu_store_is_valid(const msu_store_t *store);
+
+GUPnPDIDLLiteObject *msu_store_lookup_object(msu_store_t *store,
+					     const gchar *id);
+GPtrArray *msu_store_lookup_page(msu_store_t *store, const gchar *key,
+				 guint *update_id, guint *total_matches);
+gboolean msu_store_lookup_child_count(msu_store_t *store, const gchar *id,
+				      msu_cache_count_t *count);
+
+void msu_store_save(msu_store_t *store, msu_cache_t *cache,
+		    guint system_update_id, const gchar *reset_token);
+
+gboolean msu_store_lookup_capabilities(msu_store_t *store,
+				       const gchar *location,
+				       msu_store_caps_t *caps);
+void msu_store_save_capabilities(msu_store_t *store, const gchar *location,
+				 const msu_store_caps_t *caps);
+void msu_store_clear_capabilities(msu_store_caps_t *caps);
+
+#endif
@@ -23,11 +23,24 @@
 #ifndef MSU_TASK_ATOM_H__
 #define MSU_TASK_ATOM_H__
 
+#include <glib.h>
+
 typedef struct msu_task_queue_key_t_ msu_task_queue_key_t;
 
+enum msu_task_priority_t_ {
+	MSU_TASK_PRIORITY_HIGH,
+	MSU_TASK_PRIORITY_NORMAL,
+	MSU_TASK_PRIORITY_LOW
+};
+typedef enum msu_task_priority_t_ msu_task_priority_t;
+
 typedef struct msu_task_atom_t_ msu_task_atom_t;
 struct msu_task_atom_t_ {
 	const msu_task_queue_key_t *queue_id;
+	gboolean exclusive; /* must not run alongside any other task */
+	msu_task_priority_t priority;
+	gint64 queued_at;
+	gsize size; /* approximate memory footprint, for admission control */
 };
 
 #endif /* MSU_TASK_ATOM_H__ */
@@ -26,59 +26,78 @@
 #include "task-processor.h"
 #include "log.h"
 
+/* Maximum number of tasks started by a single run of the dispatcher,
+   so that a long backlog cannot starve the rest of the main loop */
+#define MSU_TASK_PROCESSOR_MAX_BATCH 64
+
 struct msu_task_processor_t_ {
-	GHashTable *task_queues;
+	GHashTable *task_sources;
+	GHashTable *task_sinks;
+	GQueue *ready_sinks;
+	guint idle_id;
 	guint running_tasks;
 	gboolean quitting;
 	GSourceFunc on_quit_cb;
 };
 
+/* All the queues sharing the same source, i.e., all the queues of a
+   given client.  Used to find the queues of a client without walking
+   the queues of every other client. */
+typedef struct msu_task_source_t_ msu_task_source_t;
+struct msu_task_source_t_ {
+	gchar *name;
+	GPtrArray *queues;
+};
+
+/* All the queues sharing the same sink, i.e., all the clients of a
+   given server.  Tasks from these queues are dispatched in a weighted
+   round robin manner, so that each queue gets its share of the sink. */
+typedef struct msu_task_sink_t_ msu_task_sink_t;
+struct msu_task_sink_t_ {
+	msu_task_processor_t *processor;
+	gchar *name;
+	GPtrArray *queues;
+	guint running;
+	guint max_running;
+	guint next;
+	gboolean ready;
+};
+
 typedef struct msu_task_queue_t_ msu_task_queue_t;
 struct msu_task_queue_t_ {
-	GPtrArray *tasks;
+	msu_task_queue_key_t *key;
+	msu_task_source_t *source;
+	msu_task_sink_t *sink;
+	GQueue *tasks;
 	msu_task_process_cb_t task_process_cb;
 	msu_task_cancel_cb_t task_cancel_cb;
 	msu_task_delete_cb_t task_delete_cb;
 	msu_task_finally_cb_t task_queue_finally_cb;
-	msu_task_atom_t *current_task;
-	guint idle_id;
+	GPtrArray *running;
+	GPtrArray *detached;
+	guint max_running;
+	guint weight;
+	guint deficit;
+	guint share;
+	gsize bytes;
+	gboolean started;
 	gboolean defer_remove;
 	guint32 flags;
 	gpointer user_data;
 	gboolean cancelled;
 };
 
+/* The key is the handle of the queue.  It stays valid, and resolves
+   directly to the queue, until the queue is removed. */
 struct msu_task_queue_key_t_ {
 	msu_task_processor_t *processor;
+	msu_task_queue_t *queue;
 	gchar *source;
 	gchar *sink;
 };
 
-static guint prv_task_queue_key_hash_cb(gconstpointer ptr)
+static void prv_task_queue_key_free(msu_task_queue_key_t *queue_key)
 {
-	const msu_task_queue_key_t *queue_key = ptr;
-	guint hash;
-
-	hash = g_str_hash(queue_key->source);
-	hash ^= g_str_hash(queue_key->sink);
-
-	return hash;
-}
-
-static gboolean prv_task_queue_key_equal_cb(gconstpointer ptr1,
-					    gconstpointer ptr2)
-{
-	const msu_task_queue_key_t *queue_key1 = ptr1;
-	const msu_task_queue_key_t *queue_key2 = ptr2;
-
-	return !strcmp(queue_key1->source, queue_key2->source) &&
-		!strcmp(queue_key1->sink, queue_key2->sink);
-}
-
-static void prv_task_queue_key_free_cb(gpointer ptr)
-{
-	msu_task_queue_key_t *queue_key = ptr;
-
 	g_free(queue_key->source);
 	g_free(queue_key->sink);
 	g_free(queue_key);
@@ -103,14 +122,90 @@ static gboolean prv_task_queue_finally_cb(gpointer data)
 	return FALSE;
 }
 
-static void prv_task_queue_free_cb(gpointer data)
+static void prv_task_source_free_cb(gpointer data)
 {
-	msu_task_queue_t *task_queue = data;
+	msu_task_source_t *source = data;
+
+	g_ptr_array_unref(source->queues);
+	g_free(source->name);
+	g_free(source);
+}
+
+static msu_task_source_t *prv_task_source_get(msu_task_processor_t *processor,
+					      const gchar *name)
+{
+	msu_task_source_t *source;
+
+	source = g_hash_table_lookup(processor->task_sources, name);
+
+	if (!source) {
+		source = g_new0(msu_task_source_t, 1);
+		source->name = g_strdup(name);
+		source->queues = g_ptr_array_new();
+		g_hash_table_insert(processor->task_sources, source->name,
+				    source);
+	}
+
+	return source;
+}
+
+static void prv_task_source_remove_queue(msu_task_processor_t *processor,
+					 msu_task_source_t *source,
+					 msu_task_queue_t *queue)
+{
+	(void) g_ptr_array_remove(source->queues, queue);
+
+	if (source->queues->len == 0)
+		g_hash_table_remove(processor->task_sources, source->name);
+}
+
+static void prv_task_sink_free_cb(gpointer data)
+{
+	msu_task_sink_t *sink = data;
+
+	if (sink->ready)
+		g_queue_remove(sink->processor->ready_sinks, sink);
+
+	g_ptr_array_unref(sink->queues);
+	g_free(sink->name);
+	g_free(sink);
+}
 
+static msu_task_sink_t *prv_task_sink_get(msu_task_processor_t *processor,
+					  const gchar *name)
+{
+	msu_task_sink_t *sink;
+
+	sink = g_hash_table_lookup(processor->task_sinks, name);
+
+	if (!sink) {
+		sink = g_new0(msu_task_sink_t, 1);
+		sink->processor = processor;
+		sink->name = g_strdup(name);
+		sink->queues = g_ptr_array_new();
+		g_hash_table_insert(processor->task_sinks, sink->name, sink);
+	}
+
+	return sink;
+}
+
+static void prv_task_sink_remove_queue(msu_task_sink_t *sink,
+				       msu_task_queue_t *queue)
+{
+	(void) g_ptr_array_remove(sink->queues, queue);
+
+	if (sink->queues->len == 0)
+		g_hash_table_remove(sink->processor->task_sinks, sink->name);
+}
+
+static void prv_task_queue_free(msu_task_queue_t *task_queue)
+{
 	MSU_LOG_DEBUG("Enter");
 
-	g_ptr_array_foreach(task_queue->tasks, prv_task_free_cb, task_queue);
-	g_ptr_array_unref(task_queue->tasks);
+	g_queue_foreach(task_queue->tasks, prv_task_free_cb, task_queue);
+	g_queue_free(task_queue->tasks);
+	g_ptr_array_unref(task_queue->running);
+	g_ptr_array_unref(task_queue->detached);
 
 	if (task_queue->task_queue_finally_cb)
 		g_idle_add(prv_task_queue_finally_cb, task_queue);
@@ -120,6 +215,51 @@ static void prv_task_queue_free_cb(gpointer data)
 	MSU_LOG_DEBUG("Exit");
 }
 
+static void prv_task_queue_remove(msu_task_queue_t *task_queue)
+{
+	msu_task_queue_key_t *queue_id = task_queue->key;
+
+	MSU_LOG_DEBUG("Removing queue <%s,%s>", queue_id->source,
+		      queue_id->sink);
+
+	prv_task_source_remove_queue(queue_id->processor, task_queue->source,
+				     task_queue);
+	prv_task_sink_remove_queue(task_queue->sink, task_queue);
+	prv_task_queue_free(task_queue);
+	prv_task_queue_key_free(queue_id);
+}
+
+/* Removing a queue, or completing a task, modifies the arrays the
+   queue or the task belongs to.  Queues and tasks to be cancelled are
+   therefore collected first, by appending them to copy. */
+static GPtrArray *prv_task_array_copy(GPtrArray *array, GPtrArray *copy)
+{
+	guint i;
+
+	if (!copy)
+		copy = g_ptr_array_sized_new(array->len);
+
+	for (i = 0; i < array->len; ++i)
+		g_ptr_array_add(copy, g_ptr_array_index(array, i));
+
+	return copy;
+}
+
+static GPtrArray *prv_task_processor_get_queues(
+					msu_task_processor_t *processor)
+{
+	GHashTableIter iter;
+	gpointer value;
+	GPtrArray *queues = g_ptr_array_new();
+
+	g_hash_table_iter_init(&iter, processor->task_sinks);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		(void) prv_task_array_copy(((msu_task_sink_t *)value)->queues,
+					    queues);
+
+	return queues;
+}
+
 msu_task_processor_t *msu_task_processor_new(GSourceFunc on_quit_cb)
 {
 	msu_task_processor_t *processor;
@@ -128,11 +268,15 @@ msu_task_processor_t *msu_task_processor_new(GSourceFunc on_quit_cb)
 
 	processor = g_malloc(sizeof(*processor));
 
-	processor->task_queues = g_hash_table_new_full(
-						prv_task_queue_key_hash_cb,
-						prv_task_queue_key_equal_cb,
-						prv_task_queue_key_free_cb,
-						prv_task_queue_free_cb);
+	processor->task_sources = g_hash_table_new_full(
+						g_str_hash, g_str_equal,
+						NULL,
+						prv_task_source_free_cb);
+	processor->task_sinks = g_hash_table_new_full(g_str_hash, g_str_equal,
+						      NULL,
+						      prv_task_sink_free_cb);
+	processor->ready_sinks = g_queue_new();
+	processor->idle_id = 0;
 	processor->running_tasks = 0;
 	processor->quitting = FALSE;
 	processor->on_quit_cb = on_quit_cb;
@@ -144,9 +288,22 @@ msu_task_processor_t *msu_task_processor_new(GSourceFunc on_quit_cb)
 
 void msu_task_processor_free(msu_task_processor_t *processor)
 {
+	GPtrArray *queues;
+	guint i;
+
 	MSU_LOG_DEBUG("Enter");
 
-	g_hash_table_unref(processor->task_queues);
+	if (processor->idle_id)
+		(void) g_source_remove(processor->idle_id);
+
+	queues = prv_task_processor_get_queues(processor);
+	for (i = 0; i < queues->len; ++i)
+		prv_task_queue_remove(g_ptr_array_index(queues, i));
+	g_ptr_array_unref(queues);
+
+	g_hash_table_unref(processor->task_sources);
+	g_hash_table_unref(processor->task_sinks);
+	g_queue_free(processor->ready_sinks);
 	g_free(processor);
 
 	MSU_LOG_DEBUG("Exit");
@@ -166,72 +323,106 @@ const msu_task_queue_key_t *msu_task_processor_add_queue(
 
 	MSU_LOG_DEBUG("Enter - queue <%s,%s>", source, sink);
 
+	queue = g_malloc0(sizeof(*queue));
+
 	key = g_malloc(sizeof(*key));
 	key->processor = processor;
+	key->queue = queue;
 	key->source = g_strdup(source);
 	key->sink = g_strdup(sink);
 
-	queue = g_malloc0(sizeof(*queue));
+	queue->key = key;
+	queue->source = prv_task_source_get(processor, source);
+	queue->sink = prv_task_sink_get(processor, sink);
 	queue->task_process_cb = task_process_cb;
 	queue->task_cancel_cb = task_cancel_cb;
 	queue->task_delete_cb = task_delete_cb;
-	queue->tasks = g_ptr_array_new();
+	queue->tasks = g_queue_new();
+	queue->running = g_ptr_array_new();
+	queue->detached = g_ptr_array_new();
+	queue->max_running = 1;
+	queue->weight = 1;
+	queue->started = (flags & MSU_TASK_QUEUE_FLAG_AUTO_START) != 0;
 	queue->flags = flags;
 
-	g_hash_table_insert(processor->task_queues, key, queue);
+	g_ptr_array_add(queue->source->queues, queue);
+	g_ptr_array_add(queue->sink->queues, queue);
 
 	MSU_LOG_DEBUG("Exit");
 
 	return key;
 }
 
+/* Detached tasks have been cancelled individually while running.  They
+   no longer hold a slot but the queue must wait for their completion
+   before it can be released. */
+static gboolean prv_task_queue_is_busy(msu_task_queue_t *queue)
+{
+	return queue->running->len > 0 || queue->detached->len > 0;
+}
+
+static void prv_task_queue_delete_task(msu_task_queue_t *task_queue,
+				       msu_task_atom_t *task)
+{
+	task_queue->bytes -= task->size;
+	task_queue->task_delete_cb(task, task_queue->user_data);
+}
+
 static void prv_task_cancel_and_free_cb(gpointer data, gpointer user_data)
 {
 	msu_task_queue_t *task_queue = user_data;
 
 	task_queue->task_cancel_cb(data, task_queue->user_data);
-	task_queue->task_delete_cb(data, task_queue->user_data);
+	prv_task_queue_delete_task(task_queue, data);
 }
 
-static void prv_task_queue_cancel(const msu_task_queue_key_t *queue_id,
-				  msu_task_queue_t *task_queue)
+static void prv_task_queue_cancel_running(msu_task_queue_t *task_queue)
 {
-	task_queue->cancelled = TRUE;
+	msu_task_cancel_cb_t task_cancel_cb = task_queue->task_cancel_cb;
+	gpointer user_data = task_queue->user_data;
+	GPtrArray *running;
+	guint i;
 
-	g_ptr_array_foreach(task_queue->tasks, prv_task_cancel_and_free_cb,
-			    task_queue);
-	g_ptr_array_set_size(task_queue->tasks, 0);
+	/* Cancelling a task may complete it synchronously and thus modify,
+	   or even free, the queue.  Work on a copy of the running tasks. */
+	running = prv_task_array_copy(task_queue->running, NULL);
 
-	if (task_queue->idle_id) {
-		(void) g_source_remove(task_queue->idle_id);
-		task_queue->idle_id = 0;
-	}
+	for (i = 0; i < running->len; ++i)
+		task_cancel_cb(g_ptr_array_index(running, i), user_data);
 
-	if (task_queue->current_task) {
-		task_queue->task_cancel_cb(task_queue->current_task,
-					   task_queue->user_data);
-	} else if (task_queue->flags & MSU_TASK_QUEUE_FLAG_AUTO_REMOVE) {
-		MSU_LOG_DEBUG("Removing queue <%s,%s>",
-			      queue_id->source, queue_id->sink);
-		g_hash_table_remove(queue_id->processor->task_queues, queue_id);
-	}
+	g_ptr_array_unref(running);
+}
+
+static void prv_task_queue_cancel_pending(msu_task_queue_t *task_queue)
+{
+	task_queue->cancelled = TRUE;
+
+	g_queue_foreach(task_queue->tasks, prv_task_cancel_and_free_cb,
+			task_queue);
+	g_queue_clear(task_queue->tasks);
 }
 
-static void prv_task_queue_cancel_cb(gpointer key, gpointer value,
-				     gpointer user_data)
+static void prv_task_queue_cancel(msu_task_queue_t *task_queue)
 {
-	msu_task_queue_key_t *queue_id = key;
-	msu_task_queue_t *task_queue = value;
+	prv_task_queue_cancel_pending(task_queue);
 
-	prv_task_queue_cancel(queue_id, task_queue);
+	if (prv_task_queue_is_busy(task_queue))
+		prv_task_queue_cancel_running(task_queue);
+	else if (task_queue->flags & MSU_TASK_QUEUE_FLAG_AUTO_REMOVE)
+		prv_task_queue_remove(task_queue);
 }
 
 static void prv_cancel_all_queues(msu_task_processor_t *processor)
 {
+	GPtrArray *queues;
+	guint i;
+
 	MSU_LOG_DEBUG("Enter");
 
-	g_hash_table_foreach(processor->task_queues, prv_task_queue_cancel_cb,
-			     NULL);
+	queues = prv_task_processor_get_queues(processor);
+	for (i = 0; i < queues->len; ++i)
+		prv_task_queue_cancel(g_ptr_array_index(queues, i));
+	g_ptr_array_unref(queues);
 
 	MSU_LOG_DEBUG("Exit");
 }
@@ -252,86 +443,76 @@ void msu_task_processor_set_quitting(msu_task_processor_t *processor)
 
 void msu_task_processor_cancel_queue(const msu_task_queue_key_t *queue_id)
 {
-	msu_task_queue_t *queue;
-
 	MSU_LOG_DEBUG("Cancel queue <%s,%s>", queue_id->source, queue_id->sink);
 
-	queue = g_hash_table_lookup(queue_id->processor->task_queues,
-				    queue_id);
-	prv_task_queue_cancel(queue_id, queue);
+	prv_task_queue_cancel(queue_id->queue);
 
 	MSU_LOG_DEBUG("Exit");
 }
 
-static gboolean prv_free_queue_for_source(gpointer key, gpointer value,
-				      gpointer user_data)
+static void prv_task_queue_release(msu_task_queue_t *queue)
 {
-	msu_task_queue_key_t *queue_key = key;
-	msu_task_queue_t *queue = value;
-	const gchar *source = user_data;
-	gboolean ret_val = FALSE;
+	if (queue->defer_remove)
+		goto exit;
 
-	if (!strcmp(source, queue_key->source) && !queue->defer_remove) {
-		queue->defer_remove = (queue->current_task != NULL);
-		prv_task_queue_cancel(queue_key, queue);
-		if (!queue->defer_remove) {
-			MSU_LOG_DEBUG("Removing queue <%s,%s>",
-				      queue_key->source, queue_key->sink);
-			ret_val = TRUE;
-			goto end;
-		}
+	if (prv_task_queue_is_busy(queue)) {
+		/* The queue is removed when its last task completes */
+		queue->defer_remove = TRUE;
+		prv_task_queue_cancel_pending(queue);
+		prv_task_queue_cancel_running(queue);
+	} else {
+		prv_task_queue_cancel_pending(queue);
+		prv_task_queue_remove(queue);
 	}
 
-end:
+exit:
 
-	return ret_val;
+	return;
 }
 
 void msu_task_processor_remove_queues_for_source(
 						msu_task_processor_t *processor,
 						const gchar *source)
 {
-	MSU_LOG_DEBUG("Enter - Source <%s>", source);
-
-	g_hash_table_foreach_remove(processor->task_queues,
-				    prv_free_queue_for_source,
-				    (gpointer)source);
+	msu_task_source_t *task_source;
+	GPtrArray *queues;
+	guint i;
 
-	MSU_LOG_DEBUG("Exit");
-}
+	MSU_LOG_DEBUG("Enter - Source <%s>", source);
 
-static gboolean prv_free_queue_for_sink(gpointer key, gpointer value,
-				    gpointer user_data)
-{
-	msu_task_queue_key_t *queue_key = key;
-	msu_task_queue_t *queue = value;
-	const gchar *sink = user_data;
-	gboolean ret_val = FALSE;
+	task_source = g_hash_table_lookup(processor->task_sources, source);
+	if (!task_source)
+		goto exit;
 
-	if (!strcmp(sink, queue_key->sink) && !queue->defer_remove) {
-		queue->defer_remove = (queue->current_task != NULL);
-		prv_task_queue_cancel(queue_key, queue);
-		if (!queue->defer_remove) {
-			MSU_LOG_DEBUG("Removing queue <%s,%s>",
-				      queue_key->source, queue_key->sink);
-			ret_val = TRUE;
-			goto end;
-		}
-	}
+	queues = prv_task_array_copy(task_source->queues, NULL);
+	for (i = 0; i < queues->len; ++i)
+		prv_task_queue_release(g_ptr_array_index(queues, i));
+	g_ptr_array_unref(queues);
 
-end:
+exit:
 
-	return ret_val;
+	MSU_LOG_DEBUG("Exit");
 }
 
 void msu_task_processor_remove_queues_for_sink(msu_task_processor_t *processor,
 					       const gchar *sink)
 {
+	msu_task_sink_t *task_sink;
+	GPtrArray *queues;
+	guint i;
+
 	MSU_LOG_DEBUG("Enter - Sink <%s>", sink);
 
-	g_hash_table_foreach_remove(processor->task_queues,
-				    prv_free_queue_for_sink,
-				    (gpointer)sink);
+	task_sink = g_hash_table_lookup(processor->task_sinks, sink);
+	if (!task_sink)
+		goto exit;
+
+	queues = prv_task_array_copy(task_sink->queues, NULL);
+	for (i = 0; i < queues->len; ++i)
+		prv_task_queue_release(g_ptr_array_index(queues, i));
+	g_ptr_array_unref(queues);
+
+exit:
 
 	MSU_LOG_DEBUG("Exit");
 }
@@ -341,42 +522,296 @@ const msu_task_queue_key_t *msu_task_processor_lookup_queue(
 					const gchar *source,
 					const gchar *sink)
 {
-	msu_task_queue_key_t key;
-	msu_task_queue_key_t *orig_key = NULL;
+	msu_task_source_t *task_source;
 	msu_task_queue_t *queue;
+	const msu_task_queue_key_t *queue_id = NULL;
+	guint i;
+
+	task_source = g_hash_table_lookup(processor->task_sources, source);
+	if (!task_source)
+		goto exit;
+
+	/* A client rarely talks to more than a handful of servers */
+	for (i = 0; i < task_source->queues->len; ++i) {
+		queue = g_ptr_array_index(task_source->queues, i);
+
+		if (!strcmp(sink, queue->sink->name)) {
+			queue_id = queue->key;
+			break;
+		}
+	}
+
+exit:
+
+	return queue_id;
+}
+
+static gboolean prv_task_queue_can_start(msu_task_queue_t *queue)
+{
+	msu_task_atom_t *task;
+	gboolean can_start = FALSE;
+	guint i;
+
+	if (g_queue_is_empty(queue->tasks))
+		goto exit;
+
+	/* A cancelled exclusive task keeps the queue to itself until its
+	   cancellation has completed */
+	for (i = 0; i < queue->detached->len; ++i) {
+		task = g_ptr_array_index(queue->detached, i);
+		if (task->exclusive)
+			goto exit;
+	}
+
+	if (queue->running->len == 0) {
+		/* Cancelled tasks are still running on the server */
+		task = g_queue_peek_head(queue->tasks);
+		can_start = !task->exclusive || queue->detached->len == 0;
+		goto exit;
+	}
+
+	if (queue->running->len >= queue->max_running)
+		goto exit;
 
-	key.source = (gchar *)source;
-	key.sink = (gchar *)sink;
+	/* An exclusive task is always the only one running */
+	task = g_ptr_array_index(queue->running, 0);
+	if (task->exclusive)
+		goto exit;
 
-	g_hash_table_lookup_extended(processor->task_queues,
-				     &key,
-				     (gpointer *)&orig_key,
-				     (gpointer *)&queue);
+	/* An exclusive task waits for the running ones to drain */
+	task = g_queue_peek_head(queue->tasks);
+	can_start = !task->exclusive;
 
-	return orig_key;
+exit:
+
+	return can_start;
 }
 
-static gboolean prv_task_queue_process_task(gpointer user_data)
+/* Splits the tasks the sink can run between the queues that have tasks
+   waiting, in proportion to their weights.  Queues with no backlog get
+   no share, whatever they have running.  The slots left over by the
+   rounding are handed out one each, starting from the queue whose turn
+   it is, so that they rotate between the queues. */
+static void prv_task_sink_update_shares(msu_task_sink_t *sink)
 {
-	msu_task_queue_key_t *queue_id = user_data;
 	msu_task_queue_t *queue;
+	guint weight = 0;
+	guint assigned = 0;
+	guint remainder;
+	guint i;
+
+	for (i = 0; i < sink->queues->len; ++i) {
+		queue = g_ptr_array_index(sink->queues, i);
+		queue->share = 0;
+
+		if (!g_queue_is_empty(queue->tasks))
+			weight += queue->weight;
+	}
+
+	if (!weight || !sink->max_running)
+		goto exit;
+
+	for (i = 0; i < sink->queues->len; ++i) {
+		queue = g_ptr_array_index(sink->queues, i);
+
+		if (!g_queue_is_empty(queue->tasks)) {
+			queue->share = sink->max_running * queue->weight /
+				weight;
+			assigned += queue->share;
+		}
+	}
+
+	remainder = sink->max_running - assigned;
+
+	for (i = 0; i < sink->queues->len && remainder; ++i) {
+		queue = g_ptr_array_index(sink->queues,
+					  (sink->next + i) % sink->queues->len);
+
+		if (!g_queue_is_empty(queue->tasks)) {
+			queue->share++;
+			remainder--;
+		}
+	}
+
+exit:
+
+	return;
+}
+
+static gboolean prv_task_sink_queue_ready(msu_task_queue_t *queue)
+{
+	return queue->started && !queue->defer_remove &&
+		prv_task_queue_can_start(queue);
+}
+
+/* A queue may not hold more than its weighted share of the tasks the
+   sink can run, so that no client can monopolize a server */
+static gboolean prv_task_sink_queue_eligible(msu_task_sink_t *sink,
+					     msu_task_queue_t *queue)
+{
+	if (!prv_task_sink_queue_ready(queue))
+		return FALSE;
+
+	return !sink->max_running || queue->running->len == 0 ||
+		queue->running->len < queue->share;
+}
+
+static gboolean prv_task_sink_can_start(msu_task_sink_t *sink)
+{
+	msu_task_queue_t *queue;
+	guint i;
+	gboolean can_start = FALSE;
+
+	if (sink->max_running && sink->running >= sink->max_running)
+		goto exit;
+
+	/* A slot that no queue within its share can use goes to any queue
+	   that can use it, so the sink never idles with tasks waiting */
+	for (i = 0; i < sink->queues->len && !can_start; ++i) {
+		queue = g_ptr_array_index(sink->queues, i);
+		can_start = prv_task_sink_queue_ready(queue);
+	}
+
+exit:
+
+	return can_start;
+}
+
+/* Deficit round robin where every task costs one unit: each eligible
+   queue, when its turn comes, can start up to weight tasks before the
+   turn passes to the next queue.  Queues with nothing to start lose
+   their remaining deficit.  When every queue that can start a task has
+   used up its share, the slot goes to the first of them in turn. */
+static msu_task_queue_t *prv_task_sink_select_queue(msu_task_sink_t *sink)
+{
+	msu_task_queue_t *queue;
+	msu_task_queue_t *selected = NULL;
+	guint i;
+
+	if (sink->max_running && sink->running >= sink->max_running)
+		goto exit;
+
+	prv_task_sink_update_shares(sink);
+
+	for (i = 0; i < sink->queues->len; ++i) {
+		if (sink->next >= sink->queues->len)
+			sink->next = 0;
+
+		queue = g_ptr_array_index(sink->queues, sink->next);
+
+		if (prv_task_sink_queue_eligible(sink, queue)) {
+			if (queue->deficit == 0)
+				queue->deficit = queue->weight;
+
+			if (--queue->deficit == 0)
+				sink->next++;
+
+			selected = queue;
+			goto exit;
+		}
+
+		queue->deficit = 0;
+		sink->next++;
+	}
+
+	for (i = 0; i < sink->queues->len; ++i) {
+		queue = g_ptr_array_index(sink->queues,
+					  (sink->next + i) % sink->queues->len);
+
+		if (prv_task_sink_queue_ready(queue)) {
+			selected = queue;
+			break;
+		}
+	}
+
+exit:
+
+	return selected;
+}
+
+static gboolean prv_task_processor_dispatch(gpointer user_data);
+
+static void prv_task_sink_schedule(msu_task_sink_t *sink)
+{
+	msu_task_processor_t *processor = sink->processor;
+
+	if (!sink->ready && prv_task_sink_can_start(sink)) {
+		sink->ready = TRUE;
+		g_queue_push_tail(processor->ready_sinks, sink);
+	}
+
+	if (sink->ready && !processor->idle_id)
+		processor->idle_id = g_idle_add(prv_task_processor_dispatch,
+						processor);
+}
+
+static void prv_task_sink_process_task(msu_task_sink_t *sink)
+{
+	const msu_task_queue_key_t *queue_id;
+	msu_task_queue_t *queue;
+	msu_task_atom_t *task;
+
+	queue = prv_task_sink_select_queue(sink);
+	if (!queue)
+		goto exit;
+
+	queue_id = queue->key;
 
 	MSU_LOG_DEBUG("Enter - Start task processing for queue <%s,%s>",
 		      queue_id->source, queue_id->sink);
 
-	queue = g_hash_table_lookup(queue_id->processor->task_queues,
-				    queue_id);
-
 	queue->cancelled = FALSE;
-	queue->idle_id = 0;
-	queue->current_task = g_ptr_array_index(queue->tasks, 0);
-	g_ptr_array_remove_index(queue->tasks, 0);
+	task = g_queue_pop_head(queue->tasks);
+	g_ptr_array_add(queue->running, task);
+	sink->running++;
 	queue_id->processor->running_tasks++;
-	queue->task_process_cb(queue->current_task, queue->user_data);
+
+	/* Put the sink back in the ready list before processing the task,
+	   as a synchronous task may complete, and release the queue and the
+	   sink, from within task_process_cb */
+	prv_task_sink_schedule(sink);
+
+	MSU_LOG_DEBUG("%u task(s) running on queue <%s,%s>, %u on sink",
+		      queue->running->len, queue_id->source, queue_id->sink,
+		      sink->running);
+
+	queue->task_process_cb(task, queue->user_data);
 
 	MSU_LOG_DEBUG("Exit");
 
-	return FALSE;
+exit:
+
+	return;
+}
+
+/* Single dispatch source for the whole processor.  Each run starts one
+   task from each ready sink in turn, until no sink is ready or the
+   batch limit is reached. */
+static gboolean prv_task_processor_dispatch(gpointer user_data)
+{
+	msu_task_processor_t *processor = user_data;
+	msu_task_sink_t *sink;
+	guint batch = 0;
+	gboolean more;
+
+	while (batch < MSU_TASK_PROCESSOR_MAX_BATCH) {
+		sink = g_queue_pop_head(processor->ready_sinks);
+		if (!sink)
+			break;
+
+		sink->ready = FALSE;
+		prv_task_sink_process_task(sink);
+		batch++;
+	}
+
+	more = !g_queue_is_empty(processor->ready_sinks);
+	if (!more)
+		processor->idle_id = 0;
+
+	MSU_LOG_DEBUG("Dispatched %u task(s), %s", batch,
+		      more ? "more pending" : "idle");
+
+	return more;
 }
 
 void msu_task_queue_start(const msu_task_queue_key_t *queue_id)
@@ -386,20 +821,51 @@ void msu_task_queue_start(const msu_task_queue_key_t *queue_id)
 	MSU_LOG_DEBUG("Enter - Starting queue <%s,%s>", queue_id->source,
 		      queue_id->sink);
 
-	queue = g_hash_table_lookup(queue_id->processor->task_queues,
-				    queue_id);
+	queue = queue_id->queue;
 
 	if (queue->defer_remove)
 		goto exit;
 
-	if (!queue->current_task && !queue->idle_id)
-		queue->idle_id = g_idle_add(prv_task_queue_process_task,
-					    (gpointer)queue_id);
+	queue->started = TRUE;
+	prv_task_sink_schedule(queue->sink);
 
 exit:
 	MSU_LOG_DEBUG("Exit");
 }
 
+static void prv_task_queue_insert(msu_task_queue_t *queue,
+				  msu_task_atom_t *task)
+{
+	GList *prev = NULL;
+	msu_task_atom_t *prev_task;
+
+	/* Tasks are kept sorted by priority, in FIFO order within the same
+	   priority.  A task never overtakes an exclusive task, and an
+	   exclusive task never overtakes anything, so that the order of
+	   the requests modifying a server is preserved. */
+	if (!task->exclusive) {
+		prev = g_queue_peek_tail_link(queue->tasks);
+
+		while (prev) {
+			prev_task = prev->data;
+			if (prev_task->exclusive ||
+			    prev_task->priority <= task->priority)
+				break;
+			prev = prev->prev;
+		}
+
+		if (!prev)
+			prev = queue->tasks->head;
+		else
+			prev = prev->next;
+	}
+
+	if (prev)
+		g_queue_insert_before(queue->tasks, prev, task);
+	else
+		g_queue_push_tail(queue->tasks, task);
+}
+
 void msu_task_queue_add_task(const msu_task_queue_key_t *queue_id,
 			     msu_task_atom_t *task)
 {
@@ -408,55 +874,55 @@ void msu_task_queue_add_task(const msu_task_queue_key_t *queue_id,
 	MSU_LOG_DEBUG("Enter - Task added to queue <%s,%s>", queue_id->source,
 		      queue_id->sink);
 
-	queue = g_hash_table_lookup(queue_id->processor->task_queues,
-				    queue_id);
+	queue = queue_id->queue;
 
 	task->queue_id = queue_id;
-	g_ptr_array_add(queue->tasks, task);
+	task->queued_at = g_get_monotonic_time();
+	queue->bytes += task->size;
+	prv_task_queue_insert(queue, task);
 
 	if (queue->defer_remove)
 		goto exit;
 
-	if (queue->flags & MSU_TASK_QUEUE_FLAG_AUTO_START) {
-		if (!queue->current_task && !queue->idle_id)
-			queue->idle_id = g_idle_add(prv_task_queue_process_task,
-						    (gpointer)queue_id);
-	}
+	prv_task_sink_schedule(queue->sink);
 
 exit:
 	MSU_LOG_DEBUG("Exit");
 }
 
-void msu_task_queue_task_completed(const msu_task_queue_key_t *queue_id)
+void msu_task_queue_task_completed(msu_task_atom_t *task)
 {
 	msu_task_queue_t *queue;
+	const msu_task_queue_key_t *queue_id = task->queue_id;
 	msu_task_processor_t *processor = queue_id->processor;
 
 	MSU_LOG_DEBUG("Enter - Task completed for queue <%s,%s>",
 		      queue_id->source, queue_id->sink);
 
-	queue = g_hash_table_lookup(processor->task_queues, queue_id);
+	queue = queue_id->queue;
 
-	if (queue->current_task) {
-		queue->task_delete_cb(queue->current_task, queue->user_data);
-		queue->current_task = NULL;
+	if (g_ptr_array_remove(queue->running, task)) {
+		queue->sink->running--;
+		prv_task_queue_delete_task(queue, task);
+	} else if (g_ptr_array_remove(queue->detached, task)) {
+		prv_task_queue_delete_task(queue, task);
 	}
 
 	processor->running_tasks--;
 
+	/* A slot has been freed on the sink.  It may be used by any of
+	   the queues sharing that sink, not only by this one. */
+	prv_task_sink_schedule(queue->sink);
+
 	if (processor->quitting && !processor->running_tasks) {
 		g_idle_add(processor->on_quit_cb, NULL);
 	} else if (queue->defer_remove) {
-		MSU_LOG_DEBUG("Removing queue <%s,%s>",
-			      queue_id->source, queue_id->sink);
-		g_hash_table_remove(processor->task_queues, queue_id);
-	} else if (queue->tasks->len > 0) {
-		queue->idle_id = g_idle_add(prv_task_queue_process_task,
-					    (gpointer)queue_id);
-	} else if (queue->flags & MSU_TASK_QUEUE_FLAG_AUTO_REMOVE) {
-		MSU_LOG_DEBUG("Removing queue <%s,%s>",
-			      queue_id->source, queue_id->sink);
-		g_hash_table_remove(processor->task_queues, queue_id);
+		if (!prv_task_queue_is_busy(queue))
+			prv_task_queue_remove(queue);
+	} else if (g_queue_is_empty(queue->tasks) &&
+		   (queue->flags & MSU_TASK_QUEUE_FLAG_AUTO_REMOVE) &&
+		   !prv_task_queue_is_busy(queue)) {
+		prv_task_queue_remove(queue);
 	}
 
 	MSU_LOG_DEBUG("Exit");
@@ -465,31 +931,218 @@ void msu_task_queue_task_completed(const msu_task_queue_key_t *queue_id)
 void msu_task_queue_set_finally(const msu_task_queue_key_t *queue_id,
 				msu_task_finally_cb_t finally_cb)
 {
-	msu_task_queue_t *queue;
-	msu_task_processor_t *processor = queue_id->processor;
+	queue_id->queue->task_queue_finally_cb = finally_cb;
+}
 
-	queue = g_hash_table_lookup(processor->task_queues, queue_id);
+void msu_task_queue_set_user_data(const msu_task_queue_key_t *queue_id,
+				  gpointer user_data)
+{
+	queue_id->queue->user_data = user_data;
+}
+
+gpointer msu_task_queue_get_user_data(const msu_task_queue_key_t *queue_id)
+{
+	return queue_id->queue->user_data;
+}
 
-	queue->task_queue_finally_cb = finally_cb;
+void msu_task_queue_set_max_running(const msu_task_queue_key_t *queue_id,
+				    guint max_running)
+{
+	queue_id->queue->max_running = max_running ? max_running : 1;
 }
 
-void msu_task_queue_set_user_data(const msu_task_queue_key_t *queue_id,
+void msu_task_queue_set_weight(const msu_task_queue_key_t *queue_id,
+			       guint weight)
+{
+	queue_id->queue->weight = weight ? weight : 1;
+}
+
+void msu_task_processor_set_sink_max_running(msu_task_processor_t *processor,
+					     const gchar *sink,
+					     guint max_running)
+{
+	msu_task_sink_t *task_sink;
+
+	task_sink = g_hash_table_lookup(processor->task_sinks, sink);
+
+	if (task_sink) {
+		task_sink->max_running = max_running;
+		prv_task_sink_schedule(task_sink);
+	}
+}
+
+guint msu_task_queue_remove_tasks(const msu_task_queue_key_t *queue_id,
+				  msu_task_match_cb_t match_cb,
 				  gpointer user_data)
 {
 	msu_task_queue_t *queue;
-	msu_task_processor_t *processor = queue_id->processor;
+	GList *link;
+	GList *next;
+	msu_task_atom_t *task;
+	guint removed = 0;
+
+	queue = queue_id->queue;
+
+	/* Only pending tasks are removed, running ones are left alone */
+	for (link = queue->tasks->head; link; link = next) {
+		next = link->next;
+		task = link->data;
+
+		if (match_cb(task, user_data)) {
+			g_queue_delete_link(queue->tasks, link);
+			prv_task_cancel_and_free_cb(task, queue);
+			removed++;
+		}
+	}
 
-	queue = g_hash_table_lookup(processor->task_queues, queue_id);
+	MSU_LOG_DEBUG("Removed %u task(s) from queue <%s,%s>", removed,
+		      queue_id->source, queue_id->sink);
 
-	queue->user_data = user_data;
+	return removed;
 }
 
-gpointer msu_task_queue_get_user_data(const msu_task_queue_key_t *queue_id)
+static void prv_task_queue_add_load(msu_task_queue_t *queue, guint *tasks,
+				    gsize *bytes)
+{
+	*tasks += queue->tasks->length + queue->running->len;
+	*bytes += queue->bytes;
+}
+
+void msu_task_processor_get_source_load(msu_task_processor_t *processor,
+					const gchar *source,
+					guint *tasks, gsize *bytes)
 {
+	msu_task_source_t *task_source;
+	guint i;
+
+	*tasks = 0;
+	*bytes = 0;
+
+	task_source = g_hash_table_lookup(processor->task_sources, source);
+	if (!task_source)
+		goto exit;
+
+	for (i = 0; i < task_source->queues->len; ++i)
+		prv_task_queue_add_load(
+				g_ptr_array_index(task_source->queues, i),
+				tasks, bytes);
+
+exit:
+
+	return;
+}
+
+void msu_task_processor_get_sink_load(msu_task_processor_t *processor,
+				      const gchar *sink,
+				      guint *tasks, gsize *bytes)
+{
+	msu_task_sink_t *task_sink;
+	guint i;
+
+	*tasks = 0;
+	*bytes = 0;
+
+	task_sink = g_hash_table_lookup(processor->task_sinks, sink);
+	if (!task_sink)
+		goto exit;
+
+	for (i = 0; i < task_sink->queues->len; ++i)
+		prv_task_queue_add_load(g_ptr_array_index(task_sink->queues, i),
+					tasks, bytes);
+
+exit:
+
+	return;
+}
+
+/* A sink has capacity when a task queued for it now would start straight
+   away: no task is waiting for it and it runs fewer tasks than it can. */
+gboolean msu_task_processor_sink_has_capacity(msu_task_processor_t *processor,
+					      const gchar *sink)
+{
+	msu_task_sink_t *task_sink;
 	msu_task_queue_t *queue;
-	msu_task_processor_t *processor = queue_id->processor;
+	gboolean has_capacity = FALSE;
+	guint i;
+
+	task_sink = g_hash_table_lookup(processor->task_sinks, sink);
+	if (!task_sink) {
+		has_capacity = TRUE;
+		goto exit;
+	}
+
+	if (task_sink->max_running &&
+	    task_sink->running >= task_sink->max_running)
+		goto exit;
+
+	for (i = 0; i < task_sink->queues->len; ++i) {
+		queue = g_ptr_array_index(task_sink->queues, i);
+		if (!g_queue_is_empty(queue->tasks))
+			goto exit;
+	}
+
+	has_capacity = TRUE;
+
+exit:
+
+	return has_capacity;
+}
+
+gboolean msu_task_processor_cancel_task(msu_task_processor_t *processor,
+					const gchar *source,
+					msu_task_match_cb_t match_cb,
+					gpointer user_data)
+{
+	msu_task_source_t *task_source;
+	msu_task_queue_t *queue = NULL;
+	msu_task_atom_t *task = NULL;
+	GList *link = NULL;
+	guint i;
+	guint j;
+
+	task_source = g_hash_table_lookup(processor->task_sources, source);
+	if (!task_source)
+		goto exit;
+
+	for (j = 0; !task && j < task_source->queues->len; ++j) {
+		queue = g_ptr_array_index(task_source->queues, j);
 
-	queue = g_hash_table_lookup(processor->task_queues, queue_id);
+		for (link = queue->tasks->head; link; link = link->next)
+			if (match_cb(link->data, user_data)) {
+				task = link->data;
+				break;
+			}
+
+		for (i = 0; !task && i < queue->running->len; ++i)
+			if (match_cb(g_ptr_array_index(queue->running, i),
+				     user_data))
+				task = g_ptr_array_index(queue->running, i);
+	}
+
+	if (!task)
+		goto exit;
+
+	if (link) {
+		MSU_LOG_DEBUG("Cancel pending task of queue <%s,%s>",
+			      task->queue_id->source, task->queue_id->sink);
+
+		g_queue_delete_link(queue->tasks, link);
+		prv_task_cancel_and_free_cb(task, queue);
+	} else {
+		MSU_LOG_DEBUG("Cancel running task of queue <%s,%s>",
+			      task->queue_id->source, task->queue_id->sink);
+
+		/* The task releases its slot straight away, without waiting
+		   for its cancellation to complete */
+		(void) g_ptr_array_remove(queue->running, task);
+		g_ptr_array_add(queue->detached, task);
+		queue->sink->running--;
+		prv_task_sink_schedule(queue->sink);
+
+		queue->task_cancel_cb(task, queue->user_data);
+	}
+
+exit:
 
-	return queue->user_data;
+	return task != NULL;
 }
@@ -44,6 +44,8 @@ typedef void (*msu_task_cancel_cb_t)(msu_task_atom_t *task,
 typedef void (*msu_task_delete_cb_t)(msu_task_atom_t *task,
 				     gpointer user_data);
 typedef void (*msu_task_finally_cb_t)(gboolean cancelled, gpointer user_data);
+typedef gboolean (*msu_task_match_cb_t)(msu_task_atom_t *task,
+					gpointer user_data);
 
 msu_task_processor_t *msu_task_processor_new(GSourceFunc on_quit_cb);
 void msu_task_processor_free(msu_task_processor_t *processor);
@@ -61,6 +63,21 @@ const msu_task_queue_key_t *msu_task_processor_lookup_queue(
 					const gchar *source,
 					const gchar *sink);
 void msu_task_processor_cancel_queue(const msu_task_queue_key_t *queue_id);
+void msu_task_processor_set_sink_max_running(msu_task_processor_t *processor,
+					     const gchar *sink,
+					     guint max_running);
+gboolean msu_task_processor_cancel_task(msu_task_processor_t *processor,
+					const gchar *source,
+					msu_task_match_cb_t match_cb,
+					gpointer user_data);
+void msu_task_processor_get_source_load(msu_task_processor_t *processor,
+					const gchar *source,
+					guint *tasks, gsize *bytes);
+void msu_task_processor_get_sink_load(msu_task_processor_t *processor,
+				      const gchar *sink,
+				      guint *tasks, gsize *bytes);
+gboolean msu_task_processor_sink_has_capacity(msu_task_processor_t *processor,
+					      const gchar *sink);
 void msu_task_processor_remove_queues_for_source(
 						msu_task_processor_t *processor,
 						const gchar *source);
@@ -70,11 +87,18 @@ void msu_task_processor_remove_queues_for_sink(msu_task_processor_t *processor,
 void msu_task_queue_start(const msu_task_queue_key_t *queue_id);
 void msu_task_queue_add_task(const msu_task_queue_key_t *queue_id,
 			     msu_task_atom_t *task);
-void msu_task_queue_task_completed(const msu_task_queue_key_t *queue_id);
+void msu_task_queue_task_completed(msu_task_atom_t *task);
 void msu_task_queue_set_finally(const msu_task_queue_key_t *queue_id,
 				msu_task_finally_cb_t finally_cb);
 void msu_task_queue_set_user_data(const msu_task_queue_key_t *queue_id,
 				  gpointer user_data);
 gpointer msu_task_queue_get_user_data(const msu_task_queue_key_t *queue_id);
+void msu_task_queue_set_max_running(const msu_task_queue_key_t *queue_id,
+				    guint max_running);
+void msu_task_queue_set_weight(const msu_task_queue_key_t *queue_id,
+			       guint weight);
+guint msu_task_queue_remove_tasks(const msu_task_queue_key_t *queue_id,
+				  msu_task_match_cb_t match_cb,
+				  gpointer user_data);
 
 #endif /* MSU_TASK_PROCESSOR_H__ */
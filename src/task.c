@@ -20,12 +20,26 @@
  *
  */
 
+#include <string.h>
+
 #include "error.h"
 #include "async.h"
 
+static msu_task_t *prv_task_new(gsize size)
+{
+	msu_arena_t *arena;
+	msu_task_t *task;
+
+	arena = msu_arena_new();
+	task = msu_arena_alloc0(arena, size);
+	task->arena = arena;
+
+	return task;
+}
+
 msu_task_t *msu_task_get_version_new(GDBusMethodInvocation *invocation)
 {
-	msu_task_t *task = g_new0(msu_task_t, 1);
+	msu_task_t *task = prv_task_new(sizeof(msu_task_t));
 
 	task->type = MSU_TASK_GET_VERSION;
 	task->invocation = invocation;
@@ -38,7 +52,7 @@ msu_task_t *msu_task_get_version_new(GDBusMethodInvocation *invocation)
 
 msu_task_t *msu_task_get_servers_new(GDBusMethodInvocation *invocation)
 {
-	msu_task_t *task = g_new0(msu_task_t, 1);
+	msu_task_t *task = prv_task_new(sizeof(msu_task_t));
 
 	task->type = MSU_TASK_GET_SERVERS;
 	task->invocation = invocation;
@@ -48,6 +62,19 @@ msu_task_t *msu_task_get_servers_new(GDBusMethodInvocation *invocation)
 	return task;
 }
 
+msu_task_t *msu_task_get_client_statistics_new(
+					GDBusMethodInvocation *invocation)
+{
+	msu_task_t *task = prv_task_new(sizeof(msu_task_t));
+
+	task->type = MSU_TASK_GET_CLIENT_STATISTICS;
+	task->invocation = invocation;
+	task->result_format = "(@a{sa{sv}})";
+	task->synchronous = TRUE;
+
+	return task;
+}
+
 static void prv_msu_task_delete(msu_task_t *task)
 {
 	if (!task->synchronous)
@@ -57,25 +84,14 @@ static void prv_msu_task_delete(msu_task_t *task)
 	case MSU_TASK_GET_CHILDREN:
 		if (task->ut.get_children.filter)
 			g_variant_unref(task->ut.get_children.filter);
-		g_free(task->ut.get_children.sort_by);
-		break;
-	case MSU_TASK_GET_ALL_PROPS:
-		g_free(task->ut.get_props.interface_name);
-		break;
-	case MSU_TASK_GET_PROP:
-		g_free(task->ut.get_prop.interface_name);
-		g_free(task->ut.get_prop.prop_name);
 		break;
 	case MSU_TASK_SEARCH:
-		g_free(task->ut.search.query);
 		if (task->ut.search.filter)
 			g_variant_unref(task->ut.search.filter);
-		g_free(task->ut.search.sort_by);
 		break;
 	case MSU_TASK_GET_RESOURCE:
 		if (task->ut.resource.filter)
 			g_variant_unref(task->ut.resource.filter);
-		g_free(task->ut.resource.protocol_info);
 		break;
 	case MSU_TASK_SET_PROTOCOL_INFO:
 		if (task->ut.protocol_info.protocol_info)
@@ -111,25 +127,49 @@ static void prv_msu_task_delete(msu_task_t *task)
 		break;
 	}
 
-	g_free(task->target.path);
-	g_free(task->target.root_path);
-	g_free(task->target.id);
-
 	if (task->result)
 		g_variant_unref(task->result);
 
-	g_free(task);
+	msu_arena_delete(task->arena);
 }
 
 static gboolean prv_set_task_target_info(msu_task_t *task, const gchar *path,
 					 GError **error)
 {
-	task->target.path = g_strdup(path);
+	task->target.path = msu_arena_strdup(task->arena, path);
 	g_strstrip(task->target.path);
 
-	return msu_media_service_get_object_info(path, &task->target.root_path,
-					       &task->target.id,
-					       &task->target.device, error);
+	return msu_media_service_get_object_info(path, task->arena,
+						 &task->target.root_path,
+						 &task->target.id,
+						 &task->target.device, error);
+}
+
+static msu_task_priority_t prv_task_default_priority(msu_task_type_t type)
+{
+	msu_task_priority_t priority;
+
+	switch (type) {
+	case MSU_TASK_GET_CHILDREN:
+	case MSU_TASK_GET_ALL_PROPS:
+	case MSU_TASK_GET_PROP:
+		priority = MSU_TASK_PRIORITY_HIGH;
+		break;
+	case MSU_TASK_SEARCH:
+	case MSU_TASK_UPLOAD_TO_ANY:
+	case MSU_TASK_UPLOAD:
+	case MSU_TASK_GET_UPLOAD_STATUS:
+	case MSU_TASK_GET_UPLOAD_IDS:
+	case MSU_TASK_CREATE_PLAYLIST:
+	case MSU_TASK_CREATE_PLAYLIST_IN_ANY:
+		priority = MSU_TASK_PRIORITY_LOW;
+		break;
+	default:
+		priority = MSU_TASK_PRIORITY_NORMAL;
+		break;
+	}
+
+	return priority;
 }
 
 static msu_task_t *prv_m2spec_task_new(msu_task_type_t type,
@@ -142,10 +182,10 @@ static msu_task_t *prv_m2spec_task_new(msu_task_type_t type,
 	msu_task_t *task;
 
 	if (synchronous) {
-		task = g_new0(msu_task_t, 1);
+		task = prv_task_new(sizeof(msu_task_t));
 		task->synchronous = TRUE;
 	} else {
-		task = (msu_task_t *)g_new0(msu_async_task_t, 1);
+		task = prv_task_new(sizeof(msu_async_task_t));
 	}
 
 	if (!prv_set_task_target_info(task, path, error)) {
@@ -158,6 +198,7 @@ static msu_task_t *prv_m2spec_task_new(msu_task_type_t type,
 	task->type = type;
 	task->invocation = invocation;
 	task->result_format = result_format;
+	task->atom.priority = prv_task_default_priority(type);
 
 finished:
 
@@ -184,7 +225,7 @@ msu_task_t *msu_task_get_children_new(GDBusMethodInvocation *invocation,
 		      &task->ut.get_children.count,
 		      &task->ut.get_children.filter);
 
-	task->ut.get_children.sort_by = g_strdup("");
+	task->ut.get_children.sort_by = msu_arena_strdup(task->arena, "");
 
 finished:
 
@@ -198,6 +239,7 @@ msu_task_t *msu_task_get_children_ex_new(GDBusMethodInvocation *invocation,
 					 GError **error)
 {
 	msu_task_t *task;
+	const gchar *sort_by;
 
 	task = prv_m2spec_task_new(MSU_TASK_GET_CHILDREN, invocation, path,
 				   "(@aa{sv})", error, FALSE);
@@ -207,11 +249,13 @@ msu_task_t *msu_task_get_children_ex_new(GDBusMethodInvocation *invocation,
 	task->ut.get_children.containers = containers;
 	task->ut.get_children.items = items;
 
-	g_variant_get(parameters, "(uu@ass)",
+	g_variant_get(parameters, "(uu@as&s)",
 		      &task->ut.get_children.start,
 		      &task->ut.get_children.count,
 		      &task->ut.get_children.filter,
-		      &task->ut.get_children.sort_by);
+		      &sort_by);
+	task->ut.get_children.sort_by = msu_arena_strdup(task->arena,
+							 sort_by);
 
 finished:
 
@@ -223,14 +267,19 @@ msu_task_t *msu_task_get_prop_new(GDBusMethodInvocation *invocation,
 				  GError **error)
 {
 	msu_task_t *task;
+	const gchar *interface_name;
+	const gchar *prop_name;
 
 	task = prv_m2spec_task_new(MSU_TASK_GET_PROP, invocation, path, "(v)",
 				   error, FALSE);
 	if (!task)
 		goto finished;
 
-	g_variant_get(parameters, "(ss)", &task->ut.get_prop.interface_name,
-		      &task->ut.get_prop.prop_name);
+	g_variant_get(parameters, "(&s&s)", &interface_name, &prop_name);
+	task->ut.get_prop.interface_name = msu_arena_strdup(task->arena,
+							    interface_name);
+	task->ut.get_prop.prop_name = msu_arena_strdup(task->arena,
+						       prop_name);
 
 	g_strstrip(task->ut.get_prop.interface_name);
 	g_strstrip(task->ut.get_prop.prop_name);
@@ -245,13 +294,16 @@ msu_task_t *msu_task_get_props_new(GDBusMethodInvocation *invocation,
 				   GError **error)
 {
 	msu_task_t *task;
+	const gchar *interface_name;
 
 	task = prv_m2spec_task_new(MSU_TASK_GET_ALL_PROPS, invocation, path,
 				   "(@a{sv})", error, FALSE);
 	if (!task)
 		goto finished;
 
-	g_variant_get(parameters, "(s)", &task->ut.get_props.interface_name);
+	g_variant_get(parameters, "(&s)", &interface_name);
+	task->ut.get_props.interface_name = msu_arena_strdup(task->arena,
+							     interface_name);
 	g_strstrip(task->ut.get_props.interface_name);
 
 finished:
@@ -264,17 +316,19 @@ msu_task_t *msu_task_search_new(GDBusMethodInvocation *invocation,
 				GError **error)
 {
 	msu_task_t *task;
+	const gchar *query;
 
 	task = prv_m2spec_task_new(MSU_TASK_SEARCH, invocation, path,
 				   "(@aa{sv})", error, FALSE);
 	if (!task)
 		goto finished;
 
-	g_variant_get(parameters, "(suu@as)", &task->ut.search.query,
+	g_variant_get(parameters, "(&suu@as)", &query,
 		      &task->ut.search.start, &task->ut.search.count,
 		      &task->ut.search.filter);
 
-	task->ut.search.sort_by = g_strdup("");
+	task->ut.search.query = msu_arena_strdup(task->arena, query);
+	task->ut.search.sort_by = msu_arena_strdup(task->arena, "");
 
 finished:
 	return task;
@@ -285,15 +339,20 @@ msu_task_t *msu_task_search_ex_new(GDBusMethodInvocation *invocation,
 				   GError **error)
 {
 	msu_task_t *task;
+	const gchar *query;
+	const gchar *sort_by;
 
 	task = prv_m2spec_task_new(MSU_TASK_SEARCH, invocation, path,
 				   "(@aa{sv}u)", error, FALSE);
 	if (!task)
 		goto finished;
 
-	g_variant_get(parameters, "(suu@ass)", &task->ut.search.query,
+	g_variant_get(parameters, "(&suu@as&s)", &query,
 		      &task->ut.search.start, &task->ut.search.count,
-		      &task->ut.search.filter, &task->ut.search.sort_by);
+		      &task->ut.search.filter, &sort_by);
+
+	task->ut.search.query = msu_arena_strdup(task->arena, query);
+	task->ut.search.sort_by = msu_arena_strdup(task->arena, sort_by);
 
 	task->multiple_retvals = TRUE;
 
@@ -307,15 +366,17 @@ msu_task_t *msu_task_get_resource_new(GDBusMethodInvocation *invocation,
 				      GError **error)
 {
 	msu_task_t *task;
+	const gchar *protocol_info;
 
 	task = prv_m2spec_task_new(MSU_TASK_GET_RESOURCE, invocation, path,
 				   "(@a{sv})", error, FALSE);
 	if (!task)
 		goto finished;
 
-	g_variant_get(parameters, "(s@as)",
-		      &task->ut.resource.protocol_info,
+	g_variant_get(parameters, "(&s@as)", &protocol_info,
 		      &task->ut.resource.filter);
+	task->ut.resource.protocol_info = msu_arena_strdup(task->arena,
+							   protocol_info);
 
 finished:
 
@@ -325,7 +386,7 @@ finished:
 msu_task_t *msu_task_set_protocol_info_new(GDBusMethodInvocation *invocation,
 					   GVariant *parameters)
 {
-	msu_task_t *task = g_new0(msu_task_t, 1);
+	msu_task_t *task = prv_task_new(sizeof(msu_task_t));
 
 	task->type = MSU_TASK_SET_PROTOCOL_INFO;
 	task->invocation = invocation;
@@ -335,6 +396,35 @@ msu_task_t *msu_task_set_protocol_info_new(GDBusMethodInvocation *invocation,
 	return task;
 }
 
+msu_task_t *msu_task_set_task_priority_new(GDBusMethodInvocation *invocation,
+					   GVariant *parameters)
+{
+	msu_task_t *task = prv_task_new(sizeof(msu_task_t));
+	const gchar *priority;
+
+	task->type = MSU_TASK_SET_TASK_PRIORITY;
+	task->invocation = invocation;
+	task->synchronous = TRUE;
+	g_variant_get(parameters, "(&s)", &priority);
+	task->ut.task_priority.priority = msu_arena_strdup(task->arena,
+							   priority);
+
+	return task;
+}
+
+msu_task_t *msu_task_set_request_timeout_new(GDBusMethodInvocation *invocation,
+					     GVariant *parameters)
+{
+	msu_task_t *task = prv_task_new(sizeof(msu_task_t));
+
+	task->type = MSU_TASK_SET_REQUEST_TIMEOUT;
+	task->invocation = invocation;
+	task->synchronous = TRUE;
+	g_variant_get(parameters, "(u)", &task->ut.request_timeout.timeout);
+
+	return task;
+}
+
 static msu_task_t *prv_upload_new_generic(msu_task_type_t type,
 					  GDBusMethodInvocation *invocation,
 					  const gchar *path,
@@ -352,6 +442,7 @@ static msu_task_t *prv_upload_new_generic(msu_task_type_t type,
 		      &task->ut.upload.file_path);
 	g_strstrip(task->ut.upload.file_path);
 	task->multiple_retvals = TRUE;
+	task->atom.exclusive = TRUE;
 
 finished:
 
@@ -362,7 +453,7 @@ msu_task_t *msu_task_prefer_local_addresses_new(
 					GDBusMethodInvocation *invocation,
 					GVariant *parameters)
 {
-	msu_task_t *task = g_new0(msu_task_t, 1);
+	msu_task_t *task = prv_task_new(sizeof(msu_task_t));
 
 	task->type = MSU_TASK_SET_PREFER_LOCAL_ADDRESSES;
 	task->invocation = invocation;
@@ -454,6 +545,13 @@ msu_task_t *msu_task_delete_new(GDBusMethodInvocation *invocation,
 
 	task = prv_m2spec_task_new(MSU_TASK_DELETE_OBJECT, invocation,
 				   path, NULL, error, FALSE);
+	if (!task)
+		goto finished;
+
+	task->atom.exclusive = TRUE;
+
+finished:
+
 	return task;
 }
 
@@ -475,6 +573,7 @@ msu_task_t *msu_task_create_container_new_generic(
 		      &task->ut.create_container.display_name,
 		      &task->ut.create_container.type,
 		      &task->ut.create_container.child_types);
+	task->atom.exclusive = TRUE;
 
 finished:
 
@@ -502,6 +601,7 @@ msu_task_t *msu_task_create_playlist_new(GDBusMethodInvocation *invocation,
 		      &task->ut.playlist.item_path);
 
 	task->multiple_retvals = TRUE;
+	task->atom.exclusive = TRUE;
 
 finished:
 
@@ -523,12 +623,88 @@ msu_task_t *msu_task_update_new(GDBusMethodInvocation *invocation,
 	g_variant_get(parameters, "(@a{sv}@as)",
 		      &task->ut.update.to_add_update,
 		      &task->ut.update.to_delete);
+	task->atom.exclusive = TRUE;
 
 finished:
 
 	return task;
 }
 
+static gsize prv_str_size(const gchar *str)
+{
+	return str ? strlen(str) + 1 : 0;
+}
+
+static gsize prv_variant_size(GVariant *variant)
+{
+	return variant ? g_variant_get_size(variant) : 0;
+}
+
+gsize msu_task_estimate_size(msu_task_t *task)
+{
+	gsize size;
+
+	size = task->synchronous ? sizeof(msu_task_t) :
+		sizeof(msu_async_task_t);
+
+	size += prv_str_size(task->target.path);
+	size += prv_str_size(task->target.root_path);
+	size += prv_str_size(task->target.id);
+
+	switch (task->type) {
+	case MSU_TASK_GET_CHILDREN:
+		size += prv_variant_size(task->ut.get_children.filter);
+		size += prv_str_size(task->ut.get_children.sort_by);
+		break;
+	case MSU_TASK_GET_ALL_PROPS:
+		size += prv_str_size(task->ut.get_props.interface_name);
+		break;
+	case MSU_TASK_GET_PROP:
+		size += prv_str_size(task->ut.get_prop.interface_name);
+		size += prv_str_size(task->ut.get_prop.prop_name);
+		break;
+	case MSU_TASK_SEARCH:
+		size += prv_str_size(task->ut.search.query);
+		size += prv_variant_size(task->ut.search.filter);
+		size += prv_str_size(task->ut.search.sort_by);
+		break;
+	case MSU_TASK_GET_RESOURCE:
+		size += prv_variant_size(task->ut.resource.filter);
+		size += prv_str_size(task->ut.resource.protocol_info);
+		break;
+	case MSU_TASK_SET_PROTOCOL_INFO:
+		size += prv_str_size(task->ut.protocol_info.protocol_info);
+		break;
+	case MSU_TASK_UPLOAD_TO_ANY:
+	case MSU_TASK_UPLOAD:
+		size += prv_str_size(task->ut.upload.display_name);
+		size += prv_str_size(task->ut.upload.file_path);
+		break;
+	case MSU_TASK_CREATE_CONTAINER:
+	case MSU_TASK_CREATE_CONTAINER_IN_ANY:
+		size += prv_str_size(task->ut.create_container.display_name);
+		size += prv_str_size(task->ut.create_container.type);
+		size += prv_variant_size(task->ut.create_container.child_types);
+		break;
+	case MSU_TASK_UPDATE_OBJECT:
+		size += prv_variant_size(task->ut.update.to_add_update);
+		size += prv_variant_size(task->ut.update.to_delete);
+		break;
+	case MSU_TASK_CREATE_PLAYLIST:
+	case MSU_TASK_CREATE_PLAYLIST_IN_ANY:
+		size += prv_str_size(task->ut.playlist.title);
+		size += prv_str_size(task->ut.playlist.creator);
+		size += prv_str_size(task->ut.playlist.genre);
+		size += prv_str_size(task->ut.playlist.desc);
+		size += prv_variant_size(task->ut.playlist.item_path);
+		break;
+	default:
+		break;
+	}
+
+	return size;
+}
+
 void msu_task_complete(msu_task_t *task)
 {
 	GVariant *variant = NULL;
@@ -26,6 +26,7 @@
 #include <gio/gio.h>
 #include <glib.h>
 
+#include "arena.h"
 #include "media-service-upnp.h"
 #include "task-atom.h"
 
@@ -39,6 +40,9 @@ enum msu_task_type_t_ {
 	MSU_TASK_GET_RESOURCE,
 	MSU_TASK_SET_PREFER_LOCAL_ADDRESSES,
 	MSU_TASK_SET_PROTOCOL_INFO,
+	MSU_TASK_SET_TASK_PRIORITY,
+	MSU_TASK_SET_REQUEST_TIMEOUT,
+	MSU_TASK_GET_CLIENT_STATISTICS,
 	MSU_TASK_UPLOAD_TO_ANY,
 	MSU_TASK_UPLOAD,
 	MSU_TASK_GET_UPLOAD_STATUS,
@@ -102,6 +106,16 @@ struct msu_task_set_protocol_info_t_ {
 	gchar *protocol_info;
 };
 
+typedef struct msu_task_set_task_priority_t_ msu_task_set_task_priority_t;
+struct msu_task_set_task_priority_t_ {
+	gchar *priority;
+};
+
+typedef struct msu_task_set_request_timeout_t_ msu_task_set_request_timeout_t;
+struct msu_task_set_request_timeout_t_ {
+	guint timeout;
+};
+
 typedef struct msu_task_upload_t_ msu_task_upload_t;
 struct msu_task_upload_t_ {
 	gchar *display_name;
@@ -143,9 +157,12 @@ struct msu_task_target_info_t_ {
 	msu_device_t *device;
 };
 
+/* The task itself, its target and the strings of its parameters are
+   allocated from arena and are released with it. */
 typedef struct msu_task_t_ msu_task_t;
 struct msu_task_t_ {
 	msu_task_atom_t atom; /* pseudo inheritance - MUST be first field */
+	msu_arena_t *arena;
 	msu_task_type_t type;
 	msu_task_target_info_t target;
 	const gchar *result_format;
@@ -161,6 +178,8 @@ struct msu_task_t_ {
 		msu_task_get_resource_t resource;
 		msu_task_set_prefer_local_addresses_t prefer_local_addresses;
 		msu_task_set_protocol_info_t protocol_info;
+		msu_task_set_task_priority_t task_priority;
+		msu_task_set_request_timeout_t request_timeout;
 		msu_task_upload_t upload;
 		msu_task_upload_action_t upload_action;
 		msu_task_create_container_t create_container;
@@ -171,6 +190,8 @@ struct msu_task_t_ {
 
 msu_task_t *msu_task_get_version_new(GDBusMethodInvocation *invocation);
 msu_task_t *msu_task_get_servers_new(GDBusMethodInvocation *invocation);
+msu_task_t *msu_task_get_client_statistics_new(
+					GDBusMethodInvocation *invocation);
 msu_task_t *msu_task_get_children_new(GDBusMethodInvocation *invocation,
 				      const gchar *path, GVariant *parameters,
 				      gboolean items, gboolean containers,
@@ -197,6 +218,10 @@ msu_task_t *msu_task_get_resource_new(GDBusMethodInvocation *invocation,
 				      GError **error);
 msu_task_t *msu_task_set_protocol_info_new(GDBusMethodInvocation *invocation,
 					   GVariant *parameters);
+msu_task_t *msu_task_set_task_priority_new(GDBusMethodInvocation *invocation,
+					   GVariant *parameters);
+msu_task_t *msu_task_set_request_timeout_new(GDBusMethodInvocation *invocation,
+					     GVariant *parameters);
 msu_task_t *msu_task_prefer_local_addresses_new(
 					GDBusMethodInvocation *invocation,
 					GVariant *parameters);
@@ -235,6 +260,8 @@ msu_task_t *msu_task_update_new(GDBusMethodInvocation *invocation,
 				const gchar *path, GVariant *parameters,
 				GError **error);
 
+gsize msu_task_estimate_size(msu_task_t *task);
+
 void msu_task_cancel(msu_task_t *task);
 void msu_task_complete(msu_task_t *task);
 void msu_task_fail(msu_task_t *task, GError *error);
@@ -535,7 +535,7 @@ void msu_upnp_get_children(msu_upnp_t *upnp, msu_client_t *client,
 
 	MSU_LOG_DEBUG("Sort By %s", sort_by);
 
-	cb_task_data->protocol_info = client->protocol_info;
+	cb_task_data->matcher = msu_matcher_ref(client->matcher);
 
 	msu_device_get_children(client, task, upnp_filter, sort_by);
 
@@ -570,7 +570,7 @@ void msu_upnp_get_all_props(msu_upnp_t *upnp, msu_client_t *client,
 
 	MSU_LOG_DEBUG("Root Object = %d", root_object);
 
-	cb_task_data->protocol_info = client->protocol_info;
+	cb_task_data->matcher = msu_matcher_ref(client->matcher);
 
 	msu_device_get_all_props(client, task, root_object);
 
@@ -601,7 +601,7 @@ void msu_upnp_get_prop(msu_upnp_t *upnp, msu_client_t *client,
 
 	MSU_LOG_DEBUG("Root Object = %d", root_object);
 
-	cb_task_data->protocol_info = client->protocol_info;
+	cb_task_data->matcher = msu_matcher_ref(client->matcher);
 	prop_map = g_hash_table_lookup(upnp->filter_map, task_data->prop_name);
 
 	msu_device_get_prop(client, task, prop_map, root_object);
@@ -661,7 +661,7 @@ void msu_upnp_search(msu_upnp_t *upnp, msu_client_t *client,
 
 	MSU_LOG_DEBUG("Sort By %s", sort_by);
 
-	cb_task_data->protocol_info = client->protocol_info;
+	cb_task_data->matcher = msu_matcher_ref(client->matcher);
 
 	msu_device_search(client, task, upnp_filter, upnp_query, sort_by);
 on_error:
@@ -690,6 +690,8 @@ void msu_upnp_get_resource(msu_upnp_t *upnp, msu_client_t *client,
 
 	cb_data->cb = cb;
 	cb_task_data = &cb_data->ut.get_all;
+	cb_task_data->matcher =
+		msu_matcher_new(task->ut.resource.protocol_info);
 
 	MSU_LOG_DEBUG("Root Path %s Id %s", task->target.root_path,
 		      task->target.id);
@@ -0,0 +1,244 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <libxml/parser.h>
+
+#include "log.h"
+#include "worker.h"
+
+/* While jobs are outstanding, a timeout is run every
+   MSU_WORKER_PROBE_INTERVAL ms.  The time by which the main loop runs it
+   late is time during which no other request could be dispatched, and
+   is logged when it exceeds MSU_WORKER_STALL_THRESHOLD us. */
+#define MSU_WORKER_PROBE_INTERVAL 20
+#define MSU_WORKER_STALL_THRESHOLD 5000
+
+struct msu_worker_job_t_ {
+	msu_worker_func_t func;
+	msu_worker_done_t done;
+	gpointer data;
+	gint cancelled;
+	gboolean threaded;
+	gint64 elapsed;
+	GList *link;
+};
+
+/* The jobs whose done functions have not been called yet.  Only used
+   from the main loop. */
+static GQueue g_jobs = G_QUEUE_INIT;
+static GThreadPool *g_pool;
+static guint g_threads;
+
+static guint g_probe_id;
+static gint64 g_probe_time;
+static gint64 g_max_stall;
+
+static gboolean prv_probe_cb(gpointer user_data)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 stall;
+
+	stall = now - g_probe_time - MSU_WORKER_PROBE_INTERVAL * 1000;
+
+	if (stall > MSU_WORKER_STALL_THRESHOLD) {
+		if (stall > g_max_stall)
+			g_max_stall = stall;
+
+		MSU_LOG_DEBUG("Main loop stalled for %" G_GINT64_FORMAT
+			      " us, %" G_GINT64_FORMAT " us at most", stall,
+			      g_max_stall);
+	}
+
+	if (g_queue_is_empty(&g_jobs)) {
+		g_probe_id = 0;
+		return FALSE;
+	}
+
+	g_probe_time = now;
+
+	return TRUE;
+}
+
+static void prv_probe_start(void)
+{
+	if (g_probe_id)
+		goto finished;
+
+	g_probe_time = g_get_monotonic_time();
+	g_probe_id = g_timeout_add(MSU_WORKER_PROBE_INTERVAL, prv_probe_cb,
+				   NULL);
+
+finished:
+
+	return;
+}
+
+static gboolean prv_job_done(gpointer user_data)
+{
+	msu_worker_job_t *job = user_data;
+	gint64 start;
+
+	g_queue_delete_link(&g_jobs, job->link);
+
+	start = g_get_monotonic_time();
+	job->done(g_atomic_int_get(&job->cancelled), job->data);
+
+	/* The time spent by the job in the main loop is time during which
+	   no other request could be dispatched.  That includes its done
+	   function, which always runs there. */
+	MSU_LOG_DEBUG("Job ran for %" G_GINT64_FORMAT " us %s, then for %"
+		      G_GINT64_FORMAT " us in the main loop", job->elapsed,
+		      job->threaded ? "in a worker" : "in the main loop",
+		      g_get_monotonic_time() - start);
+
+	g_free(job);
+
+	return FALSE;
+}
+
+static void prv_job_run(msu_worker_job_t *job)
+{
+	gint64 start;
+
+	if (g_atomic_int_get(&job->cancelled))
+		goto finished;
+
+	start = g_get_monotonic_time();
+	job->func(job, job->data);
+	job->elapsed = g_get_monotonic_time() - start;
+
+finished:
+
+	return;
+}
+
+static void prv_pool_func(gpointer data, gpointer user_data)
+{
+	prv_job_run(data);
+	(void) g_idle_add(prv_job_done, data);
+}
+
+static gboolean prv_idle_func(gpointer user_data)
+{
+	prv_job_run(user_data);
+
+	return prv_job_done(user_data);
+}
+
+/* The pool is kept once created, so that the jobs already queued still
+   run after the number of threads is set to 0. */
+void msu_worker_set_threads(guint threads)
+{
+	if (threads == g_threads)
+		goto finished;
+
+	MSU_LOG_DEBUG("Using %u worker threads", threads);
+
+	g_threads = threads;
+
+	if (!threads)
+		goto finished;
+
+	if (!g_pool) {
+		/* libxml2 must be initialised before it is used by several
+		   threads. */
+		xmlInitParser();
+
+		g_pool = g_thread_pool_new(prv_pool_func, NULL, threads,
+					   FALSE, NULL);
+	} else {
+		g_thread_pool_set_max_threads(g_pool, threads, NULL);
+	}
+
+finished:
+
+	return;
+}
+
+/* The jobs that have not completed are cancelled.  Those still queued
+   are skipped by the pool, which is freed once the running ones have
+   returned, and the done functions of all of them are called before
+   returning, as the main loop is no longer run to do so. */
+void msu_worker_shutdown(void)
+{
+	msu_worker_job_t *job;
+	GSource *source;
+	GList *link;
+
+	for (link = g_jobs.head; link; link = link->next)
+		msu_worker_cancel(link->data);
+
+	if (g_pool) {
+		g_thread_pool_free(g_pool, FALSE, TRUE);
+		g_pool = NULL;
+	}
+
+	g_threads = 0;
+
+	if (g_probe_id) {
+		g_source_remove(g_probe_id);
+		g_probe_id = 0;
+	}
+
+	while (!g_queue_is_empty(&g_jobs)) {
+		job = g_queue_peek_head(&g_jobs);
+
+		source = g_main_context_find_source_by_user_data(NULL, job);
+		if (source)
+			g_source_destroy(source);
+
+		(void) prv_job_done(job);
+	}
+}
+
+msu_worker_job_t *msu_worker_push(msu_worker_func_t func,
+				  msu_worker_done_t done, gpointer data)
+{
+	msu_worker_job_t *job;
+
+	job = g_new0(msu_worker_job_t, 1);
+	job->func = func;
+	job->done = done;
+	job->data = data;
+
+	g_queue_push_tail(&g_jobs, job);
+	job->link = g_queue_peek_tail_link(&g_jobs);
+
+	prv_probe_start();
+
+	if (g_threads) {
+		job->threaded = TRUE;
+		g_thread_pool_push(g_pool, job, NULL);
+	} else {
+		(void) g_idle_add(prv_idle_func, job);
+	}
+
+	return job;
+}
+
+void msu_worker_cancel(msu_worker_job_t *job)
+{
+	g_atomic_int_set(&job->cancelled, TRUE);
+}
+
+gboolean msu_worker_is_cancelled(msu_worker_job_t *job)
+{
+	return g_atomic_int_get(&job->cancelled);
+}
@@ -0,0 +1,44 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_WORKER_H__
+#define MSU_WORKER_H__
+
+#include <glib.h>
+
+typedef struct msu_worker_job_t_ msu_worker_job_t;
+
+/* func is called from a thread of the pool, unless the job is cancelled
+   before it starts, and done is then called from the main loop.  done is
+   called exactly once and the job must not be used after that.  The jobs
+   run in the main loop when the pool has no threads.  On shutdown, done
+   is called for every job that has not completed, as cancelled. */
+typedef void (*msu_worker_func_t)(msu_worker_job_t *job, gpointer data);
+typedef void (*msu_worker_done_t)(gboolean cancelled, gpointer data);
+
+void msu_worker_set_threads(guint threads);
+void msu_worker_shutdown(void);
+
+msu_worker_job_t *msu_worker_push(msu_worker_func_t func,
+				  msu_worker_done_t done, gpointer data);
+void msu_worker_cancel(msu_worker_job_t *job);
+gboolean msu_worker_is_cancelled(msu_worker_job_t *job);
+
+#endif
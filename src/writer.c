@@ -0,0 +1,448 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+
+#include "log.h"
+#include "writer.h"
+
+/* Dictionary entries, and the dictionaries holding them, are aligned on
+   8 bytes, the alignment of the variant of an entry. */
+#define MSU_WRITER_ALIGN(size) (((size) + 7) & ~((gsize) 7))
+
+typedef struct msu_writer_entry_t_ msu_writer_entry_t;
+struct msu_writer_entry_t_ {
+	guint object;
+	gsize start;
+	gsize end;
+};
+
+/* The serialized entries of all the objects are kept in data, each
+   aligned on 8 bytes, and are only grouped by object and framed once
+   the writer is ended. */
+struct msu_writer_t_ {
+	GByteArray *data;
+	GArray *entries;
+	guint objects;
+	guint object;
+	guint first_entry;
+	gsize first_byte;
+};
+
+/* order lists the entries grouped by object, from order[firsts[i]] to
+   order[firsts[i + 1]] for object i, and sizes the serialized size of
+   the dictionary of each object. */
+typedef struct msu_writer_layout_t_ msu_writer_layout_t;
+struct msu_writer_layout_t_ {
+	guint *order;
+	guint *firsts;
+	gsize *sizes;
+};
+
+static const guint8 g_zeros[8];
+
+msu_writer_t *msu_writer_new(void)
+{
+	msu_writer_t *writer;
+
+	writer = g_new0(msu_writer_t, 1);
+	writer->data = g_byte_array_new();
+	writer->entries = g_array_new(FALSE, FALSE,
+				      sizeof(msu_writer_entry_t));
+
+	return writer;
+}
+
+void msu_writer_delete(msu_writer_t *writer)
+{
+	if (writer) {
+		g_byte_array_unref(writer->data);
+		g_array_unref(writer->entries);
+		g_free(writer);
+	}
+}
+
+guint msu_writer_begin_object(msu_writer_t *writer)
+{
+	writer->object = writer->objects++;
+	writer->first_entry = writer->entries->len;
+	writer->first_byte = writer->data->len;
+
+	return writer->object;
+}
+
+void msu_writer_reopen_object(msu_writer_t *writer, guint object)
+{
+	writer->object = object;
+}
+
+/* Only the object begun last can be dropped, and only until another
+   object is reopened. */
+void msu_writer_drop_object(msu_writer_t *writer)
+{
+	g_byte_array_set_size(writer->data, writer->first_byte);
+	g_array_set_size(writer->entries, writer->first_entry);
+	writer->objects--;
+}
+
+static void prv_pad(GByteArray *data)
+{
+	if (data->len & 7)
+		(void) g_byte_array_append(data, g_zeros, 8 - (data->len & 7));
+}
+
+/* The size of the framing offsets of a container whose content takes
+   body_size bytes, as chosen by GVariant: the smallest that can hold
+   the size of the whole container. */
+static gsize prv_offset_size(gsize body_size, gsize offsets)
+{
+	gsize size;
+
+	if (body_size + offsets <= G_MAXUINT8)
+		size = 1;
+	else if (body_size + offsets * 2 <= G_MAXUINT16)
+		size = 2;
+	else if (body_size + offsets * 4 <= G_MAXUINT32)
+		size = 4;
+	else
+		size = 8;
+
+	return size;
+}
+
+/* Framing offsets are always little-endian. */
+static void prv_write_offset(guint8 *dest, gsize offset, gsize size)
+{
+	gsize i;
+
+	for (i = 0; i < size; ++i) {
+		dest[i] = offset & 0xff;
+		offset >>= 8;
+	}
+}
+
+static gsize prv_begin_entry(msu_writer_t *writer, const gchar *key,
+			     gsize *key_end)
+{
+	gsize start;
+
+	prv_pad(writer->data);
+	start = writer->data->len;
+
+	(void) g_byte_array_append(writer->data, (const guint8 *)key,
+				   strlen(key) + 1);
+	*key_end = writer->data->len - start;
+
+	prv_pad(writer->data);
+
+	return start;
+}
+
+/* The value of the variant is followed by its type and the entry by the
+   end of its key. */
+static void prv_end_entry(msu_writer_t *writer, gsize start, gsize key_end,
+			  const gchar *type)
+{
+	msu_writer_entry_t entry;
+	guint8 offset[8];
+	gsize size;
+
+	(void) g_byte_array_append(writer->data, g_zeros, 1);
+	(void) g_byte_array_append(writer->data, (const guint8 *)type,
+				   strlen(type));
+
+	size = prv_offset_size(writer->data->len - start, 1);
+	prv_write_offset(offset, key_end, size);
+	(void) g_byte_array_append(writer->data, offset, size);
+
+	entry.object = writer->object;
+	entry.start = start;
+	entry.end = writer->data->len;
+	g_array_append_val(writer->entries, entry);
+}
+
+static void prv_add_fixed(msu_writer_t *writer, const gchar *key,
+			  gconstpointer value, gsize size, const gchar *type)
+{
+	gsize start;
+	gsize key_end;
+
+	start = prv_begin_entry(writer, key, &key_end);
+	(void) g_byte_array_append(writer->data, value, size);
+	prv_end_entry(writer, start, key_end, type);
+}
+
+void msu_writer_add_string(msu_writer_t *writer, const gchar *key,
+			   const gchar *value)
+{
+	if (!g_utf8_validate(value, -1, NULL)) {
+		MSU_LOG_WARNING("Invalid UTF-8 value for %s", key);
+		goto finished;
+	}
+
+	prv_add_fixed(writer, key, value, strlen(value) + 1, "s");
+
+finished:
+
+	return;
+}
+
+void msu_writer_add_path(msu_writer_t *writer, const gchar *key,
+			 const gchar *value)
+{
+	if (!g_variant_is_object_path(value)) {
+		MSU_LOG_WARNING("Invalid object path for %s", key);
+		goto finished;
+	}
+
+	prv_add_fixed(writer, key, value, strlen(value) + 1, "o");
+
+finished:
+
+	return;
+}
+
+void msu_writer_add_uint32(msu_writer_t *writer, const gchar *key,
+			   guint32 value)
+{
+	prv_add_fixed(writer, key, &value, sizeof(value), "u");
+}
+
+void msu_writer_add_int32(msu_writer_t *writer, const gchar *key,
+			  gint32 value)
+{
+	prv_add_fixed(writer, key, &value, sizeof(value), "i");
+}
+
+void msu_writer_add_int64(msu_writer_t *writer, const gchar *key,
+			  gint64 value)
+{
+	prv_add_fixed(writer, key, &value, sizeof(value), "x");
+}
+
+void msu_writer_add_boolean(msu_writer_t *writer, const gchar *key,
+			    gboolean value)
+{
+	guint8 byte = value ? 1 : 0;
+
+	prv_add_fixed(writer, key, &byte, sizeof(byte), "b");
+}
+
+/* For the values that are not of a basic type.  value is consumed if it
+   is floating. */
+void msu_writer_add_value(msu_writer_t *writer, const gchar *key,
+			  GVariant *value)
+{
+	gsize start;
+	gsize key_end;
+	gsize pos;
+
+	(void) g_variant_ref_sink(value);
+
+	start = prv_begin_entry(writer, key, &key_end);
+
+	pos = writer->data->len;
+	g_byte_array_set_size(writer->data, pos + g_variant_get_size(value));
+	g_variant_store(value, writer->data->data + pos);
+
+	prv_end_entry(writer, start, key_end, g_variant_get_type_string(value));
+
+	g_variant_unref(value);
+}
+
+static void prv_layout_new(msu_writer_t *writer, msu_writer_layout_t *layout)
+{
+	msu_writer_entry_t *entry;
+	guint *next;
+	gsize body;
+	guint count;
+	guint i;
+	guint j;
+
+	layout->order = g_new(guint, writer->entries->len);
+	layout->firsts = g_new0(guint, writer->objects + 1);
+	layout->sizes = g_new(gsize, writer->objects);
+	next = g_new(guint, writer->objects);
+
+	for (i = 0; i < writer->entries->len; ++i) {
+		entry = &g_array_index(writer->entries, msu_writer_entry_t, i);
+		layout->firsts[entry->object + 1]++;
+	}
+
+	for (i = 0; i < writer->objects; ++i) {
+		layout->firsts[i + 1] += layout->firsts[i];
+		next[i] = layout->firsts[i];
+	}
+
+	for (i = 0; i < writer->entries->len; ++i) {
+		entry = &g_array_index(writer->entries, msu_writer_entry_t, i);
+		layout->order[next[entry->object]++] = i;
+	}
+
+	for (i = 0; i < writer->objects; ++i) {
+		body = 0;
+
+		for (j = layout->firsts[i]; j < layout->firsts[i + 1]; ++j) {
+			entry = &g_array_index(writer->entries,
+					       msu_writer_entry_t,
+					       layout->order[j]);
+			body = MSU_WRITER_ALIGN(body) +
+				entry->end - entry->start;
+		}
+
+		count = layout->firsts[i + 1] - layout->firsts[i];
+		layout->sizes[i] = count ?
+			body + count * prv_offset_size(body, count) : 0;
+	}
+
+	g_free(next);
+}
+
+static void prv_layout_free(msu_writer_layout_t *layout)
+{
+	g_free(layout->sizes);
+	g_free(layout->firsts);
+	g_free(layout->order);
+}
+
+/* dest must be aligned on 8 bytes. */
+static void prv_write_object(msu_writer_t *writer,
+			     const msu_writer_layout_t *layout,
+			     guint object, guint8 *dest)
+{
+	msu_writer_entry_t *entry;
+	const guint *order;
+	gsize offset_size;
+	gsize body = 0;
+	gsize pos;
+	guint count;
+	guint i;
+
+	order = layout->order + layout->firsts[object];
+	count = layout->firsts[object + 1] - layout->firsts[object];
+
+	for (i = 0; i < count; ++i) {
+		entry = &g_array_index(writer->entries, msu_writer_entry_t,
+				       order[i]);
+
+		memset(dest + body, 0, MSU_WRITER_ALIGN(body) - body);
+		body = MSU_WRITER_ALIGN(body);
+
+		memcpy(dest + body, writer->data->data + entry->start,
+		       entry->end - entry->start);
+		body += entry->end - entry->start;
+	}
+
+	offset_size = prv_offset_size(body, count);
+	pos = 0;
+
+	for (i = 0; i < count; ++i) {
+		entry = &g_array_index(writer->entries, msu_writer_entry_t,
+				       order[i]);
+
+		pos = MSU_WRITER_ALIGN(pos) + entry->end - entry->start;
+		prv_write_offset(dest + body + i * offset_size, pos,
+				 offset_size);
+	}
+}
+
+/* Returns a floating aa{sv} holding the dictionaries of all the objects,
+   copying their entries once. */
+GVariant *msu_writer_end(msu_writer_t *writer)
+{
+	msu_writer_layout_t layout;
+	GVariant *retval;
+	guint8 *buffer;
+	gsize offset_size;
+	gsize body = 0;
+	gsize pos = 0;
+	guint i;
+
+	if (!writer->objects) {
+		retval = g_variant_new_array(G_VARIANT_TYPE("a{sv}"), NULL, 0);
+		goto finished;
+	}
+
+	prv_layout_new(writer, &layout);
+
+	for (i = 0; i < writer->objects; ++i)
+		body = MSU_WRITER_ALIGN(body) + layout.sizes[i];
+
+	offset_size = prv_offset_size(body, writer->objects);
+	buffer = g_malloc(body + writer->objects * offset_size);
+
+	for (i = 0; i < writer->objects; ++i) {
+		memset(buffer + pos, 0, MSU_WRITER_ALIGN(pos) - pos);
+		pos = MSU_WRITER_ALIGN(pos);
+
+		prv_write_object(writer, &layout, i, buffer + pos);
+		pos += layout.sizes[i];
+
+		prv_write_offset(buffer + body + i * offset_size, pos,
+				 offset_size);
+	}
+
+	retval = g_variant_new_from_data(G_VARIANT_TYPE("aa{sv}"), buffer,
+					 body + writer->objects * offset_size,
+					 TRUE, g_free, buffer);
+
+	prv_layout_free(&layout);
+
+finished:
+
+	return retval;
+}
+
+/* Returns a floating a{sv} holding the dictionary of the only object of
+   the writer, which is empty if no object was begun, or if it was
+   dropped. */
+GVariant *msu_writer_end_object(msu_writer_t *writer)
+{
+	msu_writer_layout_t layout;
+	GVariant *retval;
+	guint8 *buffer;
+
+	if (!writer->objects) {
+		retval = g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0);
+		goto finished;
+	}
+
+	prv_layout_new(writer, &layout);
+
+	if (!layout.sizes[0]) {
+		retval = g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0);
+		goto on_empty;
+	}
+
+	buffer = g_malloc(layout.sizes[0]);
+	prv_write_object(writer, &layout, 0, buffer);
+
+	retval = g_variant_new_from_data(G_VARIANT_TYPE("a{sv}"), buffer,
+					 layout.sizes[0], TRUE, g_free,
+					 buffer);
+
+on_empty:
+
+	prv_layout_free(&layout);
+
+finished:
+
+	return retval;
+}
@@ -0,0 +1,57 @@
+/*
+ * media-service-upnp
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef MSU_WRITER_H__
+#define MSU_WRITER_H__
+
+#include <glib.h>
+
+/* Serializes the a{sv} dictionaries of a list of objects straight into
+   the GVariant wire format, without building a GVariant for each of
+   their properties.  Properties are added to the object begun last, or
+   to the object reopened last. */
+typedef struct msu_writer_t_ msu_writer_t;
+
+msu_writer_t *msu_writer_new(void);
+void msu_writer_delete(msu_writer_t *writer);
+
+guint msu_writer_begin_object(msu_writer_t *writer);
+void msu_writer_reopen_object(msu_writer_t *writer, guint object);
+void msu_writer_drop_object(msu_writer_t *writer);
+
+void msu_writer_add_string(msu_writer_t *writer, const gchar *key,
+			   const gchar *value);
+void msu_writer_add_path(msu_writer_t *writer, const gchar *key,
+			 const gchar *value);
+void msu_writer_add_uint32(msu_writer_t *writer, const gchar *key,
+			   guint32 value);
+void msu_writer_add_int32(msu_writer_t *writer, const gchar *key,
+			  gint32 value);
+void msu_writer_add_int64(msu_writer_t *writer, const gchar *key,
+			  gint64 value);
+void msu_writer_add_boolean(msu_writer_t *writer, const gchar *key,
+			    gboolean value);
+void msu_writer_add_value(msu_writer_t *writer, const gchar *key,
+			  GVariant *value);
+
+GVariant *msu_writer_end(msu_writer_t *writer);
+GVariant *msu_writer_end_object(msu_writer_t *writer);
+
+#endif
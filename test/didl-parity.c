@@ -0,0 +1,535 @@
+/*
+ * didl-parity
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ ******************************************************************************/
+
+/* Checks that the streaming DIDL-Lite decoder builds the same
+   properties as the GUPnP parser, for a few hand-written documents and
+   for responses of common servers found in test/didl, with a few
+   filters and with and without a client protocol info.  Also checks
+   that the decoder ignores elements of other namespaces that share
+   their local name with a DIDL-Lite field.  Exits with a non-zero status
+   if any of them differ. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "didl.h"
+#include "matcher.h"
+#include "media-service-upnp.h"
+#include "path.h"
+#include "props.h"
+#include "writer.h"
+
+#define DIDL_PARITY_ROOT_PATH "/com/intel/MediaServiceUPnP/server/0"
+
+#define DIDL_PARITY_HEADER \
+	"<DIDL-Lite xmlns=\"urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/\" " \
+	"xmlns:dc=\"http://purl.org/dc/elements/1.1/\" " \
+	"xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\" " \
+	"xmlns:dlna=\"urn:schemas-dlna-org:metadata-1-0/\">"
+
+#define DIDL_PARITY_FOOTER "</DIDL-Lite>"
+
+#define DIDL_PARITY_CORPUS_DIR "didl"
+
+static const gchar *g_fixtures[] = {
+	/* Containers */
+	DIDL_PARITY_HEADER
+	"<container id=\"1\" parentID=\"0\" childCount=\"12\" "
+	"searchable=\"1\" restricted=\"false\" "
+	"dlna:dlnaManaged=\"0000001F\">"
+	"<dc:title>Music &amp; more</dc:title>"
+	"<upnp:class>object.container.storageFolder</upnp:class>"
+	"<upnp:createClass includeDerived=\"true\">object.item.audioItem"
+	"</upnp:createClass>"
+	"<upnp:createClass>object.container</upnp:createClass>"
+	"<upnp:containerUpdateID>7</upnp:containerUpdateID>"
+	"<upnp:totalDeletedChildCount>3</upnp:totalDeletedChildCount>"
+	"</container>"
+	"<container id=\"2\" parentID=\"0\" restricted=\"1\">"
+	"<dc:title>No child count</dc:title>"
+	"<upnp:class>object.container.album.musicAlbum</upnp:class>"
+	"</container>"
+	DIDL_PARITY_FOOTER,
+
+	/* Music tracks, with several artists and resources */
+	DIDL_PARITY_HEADER
+	"<item id=\"10\" parentID=\"2\" restricted=\"1\">"
+	"<dc:title><![CDATA[Track <1>]]></dc:title>"
+	"<dc:creator>Someone</dc:creator>"
+	"<upnp:artist>First</upnp:artist>"
+	"<upnp:artist role=\"Performer\">Second</upnp:artist>"
+	"<upnp:album>An album</upnp:album>"
+	"<upnp:genre>Rock</upnp:genre>"
+	"<dc:date>2012-10-01</dc:date>"
+	"<upnp:originalTrackNumber>4</upnp:originalTrackNumber>"
+	"<upnp:albumArtURI>http://server/art/10.jpg</upnp:albumArtURI>"
+	"<upnp:objectUpdateID>42</upnp:objectUpdateID>"
+	"<upnp:class>object.item.audioItem.musicTrack</upnp:class>"
+	"<res protocolInfo=\"http-get:*:audio/mpeg:DLNA.ORG_PN=MP3\" "
+	"size=\"12345678901\" duration=\"0:03:25.500\" bitrate=\"16000\" "
+	"sampleFrequency=\"44100\" bitsPerSample=\"16\" "
+	"updateCount=\"2\">http://server/10.mp3</res>"
+	"<res protocolInfo=\"http-get:*:audio/L16:*\">http://server/10.pcm"
+	"</res>"
+	"</item>"
+	"<item id=\"11\" parentID=\"2\" restricted=\"0\">"
+	"<dc:title>No resources</dc:title>"
+	"<upnp:class>object.item.audioItem.musicTrack</upnp:class>"
+	"</item>"
+	DIDL_PARITY_FOOTER,
+
+	/* Pictures, videos and references */
+	DIDL_PARITY_HEADER
+	"<item id=\"20\" parentID=\"3\" restricted=\"1\">"
+	"<dc:title>A picture</dc:title>"
+	"<upnp:class>object.item.imageItem.photo</upnp:class>"
+	"<res protocolInfo=\"http-get:*:image/jpeg:DLNA.ORG_PN=JPEG_LRG\" "
+	"resolution=\"1920x1080\" colorDepth=\"24\" size=\"524288\">"
+	"http://server/20.jpg</res>"
+	"</item>"
+	"<item id=\"21\" parentID=\"3\" refID=\"20\" restricted=\"1\">"
+	"<dc:title>A reference</dc:title>"
+	"<upnp:class>object.item.imageItem.photo</upnp:class>"
+	"</item>"
+	"<item id=\"22\" parentID=\"3\" restricted=\"1\">"
+	"<dc:title>A video</dc:title>"
+	"<upnp:class>object.item.videoItem.movie</upnp:class>"
+	"<res protocolInfo=\"http-get:*:video/mp4:*\" "
+	"duration=\"1:30:00\" resolution=\"1280x720\">"
+	"http://server/22.mp4</res>"
+	"</item>"
+	DIDL_PARITY_FOOTER,
+
+	/* Objects the properties cannot be built for, and empty fields */
+	DIDL_PARITY_HEADER
+	"<item parentID=\"4\" restricted=\"1\">"
+	"<dc:title>No id</dc:title>"
+	"<upnp:class>object.item</upnp:class>"
+	"</item>"
+	"<item id=\"30\" parentID=\"4\" restricted=\"1\">"
+	"<dc:title>Unknown class</dc:title>"
+	"<upnp:class>vendor.item</upnp:class>"
+	"</item>"
+	"<item id=\"31\" parentID=\"4\" restricted=\"1\">"
+	"<dc:title></dc:title>"
+	"<upnp:artist></upnp:artist>"
+	"<upnp:class>object.item</upnp:class>"
+	"<res></res>"
+	"</item>"
+	DIDL_PARITY_FOOTER,
+
+	/* Vendor elements with the local name of a DIDL-Lite field.  GUPnP
+	   matches fields by local name only and takes the first one, so
+	   they follow the DIDL-Lite fields here. */
+	DIDL_PARITY_HEADER
+	"<item id=\"40\" parentID=\"5\" restricted=\"1\">"
+	"<dc:title>Title</dc:title>"
+	"<foo:title xmlns:foo=\"urn:x\">Vendor title</foo:title>"
+	"<upnp:class>object.item.audioItem</upnp:class>"
+	"<foo:class xmlns:foo=\"urn:x\">vendor.item</foo:class>"
+	"</item>"
+	DIDL_PARITY_FOOTER
+};
+
+/* Responses to BrowseDirectChildren of MiniDLNA, Rygel, Serviio and
+   Windows Media Player, in test/didl */
+static const gchar *g_corpora[] = {
+	"minidlna-album.xml",
+	"rygel-root.xml",
+	"serviio-videos.xml",
+	"wmp-photos.xml"
+};
+
+/* A client that accepts any resource, and one that only accepts LPCM
+   audio, MPEG-2 video and small JPEG pictures */
+static const gchar *g_protocol_infos[] = {
+	NULL,
+	"http-get:*:audio/L16:*,http-get:*:video/mpeg:*,"
+	"http-get:*:image/jpeg:DLNA.ORG_PN=JPEG_SM"
+};
+
+/* A vendor element before dc:title, which the decoder, unlike GUPnP,
+   must not take for the title */
+static const gchar g_vendor_first[] =
+	DIDL_PARITY_HEADER
+	"<item id=\"41\" parentID=\"5\" restricted=\"1\">"
+	"<foo:title xmlns:foo=\"urn:x\">Vendor title</foo:title>"
+	"<dc:title>Title</dc:title>"
+	"<upnp:class>object.item.audioItem</upnp:class>"
+	"</item>"
+	DIDL_PARITY_FOOTER;
+
+static const msu_upnp_prop_mask g_filters[] = {
+	MSU_UPNP_MASK_ALL_PROPS,
+	MSU_UPNP_MASK_PROP_DISPLAY_NAME | MSU_UPNP_MASK_PROP_PATH |
+	MSU_UPNP_MASK_PROP_TYPE | MSU_UPNP_MASK_PROP_URLS,
+	MSU_UPNP_MASK_PROP_ARTISTS | MSU_UPNP_MASK_PROP_RESOURCES |
+	MSU_UPNP_MASK_PROP_URL | MSU_UPNP_MASK_PROP_DURATION |
+	MSU_UPNP_MASK_PROP_CREATE_CLASSES,
+	0
+};
+
+typedef struct didl_parity_t_ didl_parity_t;
+struct didl_parity_t_ {
+	msu_writer_t *writer;
+	msu_upnp_prop_mask filter_mask;
+	const msu_matcher_t *matcher;
+};
+
+typedef struct didl_parity_document_t_ didl_parity_document_t;
+struct didl_parity_document_t_ {
+	gchar *name;
+	gchar *didl;
+};
+
+/* The entry points of the main module used by the other modules, none
+   of which are reached by this program. */
+
+gboolean msu_media_service_get_object_info(const gchar *object_path,
+					   msu_arena_t *arena,
+					   gchar **root_path,
+					   gchar **object_id,
+					   msu_device_t **device,
+					   GError **error)
+{
+	return FALSE;
+}
+
+gboolean msu_main_is_running(void)
+{
+	return FALSE;
+}
+
+msu_upnp_t *msu_media_service_get_upnp(void)
+{
+	return NULL;
+}
+
+msu_task_processor_t *msu_media_service_get_task_processor(void)
+{
+	return NULL;
+}
+
+static gchar *prv_parent_path(const gchar *parent_id)
+{
+	gchar *path;
+
+	if (!parent_id || !strcmp(parent_id, "-1") || !strcmp(parent_id, ""))
+		path = g_strdup(DIDL_PARITY_ROOT_PATH);
+	else
+		path = msu_path_from_id(DIDL_PARITY_ROOT_PATH, parent_id);
+
+	return path;
+}
+
+static void prv_gupnp_object(GUPnPDIDLLiteParser *parser,
+			     GUPnPDIDLLiteObject *object,
+			     gpointer user_data)
+{
+	didl_parity_t *parity = user_data;
+	gboolean have_child_count;
+	gchar *parent_path;
+
+	parent_path = prv_parent_path(
+			gupnp_didl_lite_object_get_parent_id(object));
+
+	(void) msu_writer_begin_object(parity->writer);
+
+	if (!msu_props_add_object(parity->writer, object,
+				  DIDL_PARITY_ROOT_PATH, parent_path,
+				  parity->filter_mask)) {
+		msu_writer_drop_object(parity->writer);
+		goto finished;
+	}
+
+	if (GUPNP_IS_DIDL_LITE_CONTAINER(object))
+		msu_props_add_container(parity->writer,
+					(GUPnPDIDLLiteContainer *) object,
+					parity->filter_mask,
+					&have_child_count);
+	else
+		msu_props_add_item(parity->writer, object,
+				   DIDL_PARITY_ROOT_PATH, parity->filter_mask,
+				   parity->matcher);
+
+finished:
+
+	g_free(parent_path);
+}
+
+static void prv_decoded_object(const msu_didl_object_t *object,
+			       gpointer user_data)
+{
+	didl_parity_t *parity = user_data;
+	gboolean have_child_count;
+	gchar *parent_path;
+
+	parent_path = prv_parent_path(object->parent_id);
+
+	(void) msu_writer_begin_object(parity->writer);
+
+	if (!msu_props_add_didl_object(parity->writer, object,
+				       DIDL_PARITY_ROOT_PATH, parent_path,
+				       parity->filter_mask)) {
+		msu_writer_drop_object(parity->writer);
+		goto finished;
+	}
+
+	if (object->container)
+		msu_props_add_didl_container(parity->writer, object,
+					     parity->filter_mask,
+					     &have_child_count);
+	else
+		msu_props_add_didl_item(parity->writer, object,
+					DIDL_PARITY_ROOT_PATH,
+					parity->filter_mask, parity->matcher);
+
+finished:
+
+	g_free(parent_path);
+}
+
+static GVariant *prv_parse(const gchar *didl, msu_upnp_prop_mask filter_mask,
+			   const msu_matcher_t *matcher)
+{
+	GUPnPDIDLLiteParser *parser;
+	didl_parity_t parity;
+	GVariant *retval = NULL;
+	GError *error = NULL;
+
+	parity.writer = msu_writer_new();
+	parity.filter_mask = filter_mask;
+	parity.matcher = matcher;
+
+	parser = gupnp_didl_lite_parser_new();
+	g_signal_connect(parser, "object-available",
+			 G_CALLBACK(prv_gupnp_object), &parity);
+
+	if (!gupnp_didl_lite_parser_parse_didl(parser, didl, &error)) {
+		printf("GUPnP parser failed: %s\n", error->message);
+		g_error_free(error);
+		goto on_error;
+	}
+
+	retval = g_variant_ref_sink(msu_writer_end(parity.writer));
+
+on_error:
+
+	g_object_unref(parser);
+	msu_writer_delete(parity.writer);
+
+	return retval;
+}
+
+static GVariant *prv_decode(const gchar *didl, msu_upnp_prop_mask filter_mask,
+			    const msu_matcher_t *matcher)
+{
+	didl_parity_t parity;
+	GVariant *retval = NULL;
+	GError *error = NULL;
+
+	parity.writer = msu_writer_new();
+	parity.filter_mask = filter_mask;
+	parity.matcher = matcher;
+
+	if (!msu_didl_decode(didl, filter_mask, prv_decoded_object, &parity,
+			     &error)) {
+		printf("Streaming decoder failed: %s\n", error->message);
+		g_error_free(error);
+		goto on_error;
+	}
+
+	retval = g_variant_ref_sink(msu_writer_end(parity.writer));
+
+on_error:
+
+	msu_writer_delete(parity.writer);
+
+	return retval;
+}
+
+static gboolean prv_check(const didl_parity_document_t *document,
+			  guint filter, guint protocol_info)
+{
+	msu_matcher_t *matcher;
+	GVariant *parsed;
+	GVariant *decoded;
+	gchar *parsed_str;
+	gchar *decoded_str;
+	gboolean retval;
+
+	matcher = msu_matcher_new(g_protocol_infos[protocol_info]);
+
+	parsed = prv_parse(document->didl, g_filters[filter], matcher);
+	decoded = prv_decode(document->didl, g_filters[filter], matcher);
+
+	msu_matcher_unref(matcher);
+
+	retval = parsed && decoded && g_variant_equal(parsed, decoded);
+	if (retval)
+		goto finished;
+
+	parsed_str = parsed ? g_variant_print(parsed, FALSE) : NULL;
+	decoded_str = decoded ? g_variant_print(decoded, FALSE) : NULL;
+
+	printf("%s, filter %u, protocol info %u differs\nGUPnP:     %s\n"
+	       "Streaming: %s\n", document->name, filter, protocol_info,
+	       parsed_str, decoded_str);
+
+	g_free(parsed_str);
+	g_free(decoded_str);
+
+finished:
+
+	if (parsed)
+		g_variant_unref(parsed);
+
+	if (decoded)
+		g_variant_unref(decoded);
+
+	return retval;
+}
+
+static gboolean prv_check_vendor_first(void)
+{
+	GVariant *decoded;
+	GVariant *object;
+	const gchar *title = NULL;
+	gboolean retval = FALSE;
+
+	decoded = prv_decode(g_vendor_first, MSU_UPNP_MASK_PROP_DISPLAY_NAME,
+			     NULL);
+	if (!decoded || g_variant_n_children(decoded) != 1)
+		goto on_error;
+
+	object = g_variant_get_child_value(decoded, 0);
+	(void) g_variant_lookup(object, "DisplayName", "&s", &title);
+	retval = !g_strcmp0(title, "Title");
+	g_variant_unref(object);
+
+on_error:
+
+	if (!retval)
+		printf("Vendor title before dc:title: DisplayName %s\n",
+		       title ? title : "missing");
+
+	if (decoded)
+		g_variant_unref(decoded);
+
+	return retval;
+}
+
+static void prv_document_free(gpointer data)
+{
+	didl_parity_document_t *document = data;
+
+	g_free(document->name);
+	g_free(document->didl);
+	g_free(document);
+}
+
+/* The corpora are looked up in the source tree, which make check
+   exports as srcdir. */
+static GPtrArray *prv_documents_new(void)
+{
+	GPtrArray *documents;
+	didl_parity_document_t *document;
+	const gchar *srcdir;
+	gchar *path;
+	GError *error = NULL;
+	guint i;
+
+	documents = g_ptr_array_new_with_free_func(prv_document_free);
+
+	for (i = 0; i < G_N_ELEMENTS(g_fixtures); ++i) {
+		document = g_new0(didl_parity_document_t, 1);
+		document->name = g_strdup_printf("Fixture %u", i);
+		document->didl = g_strdup(g_fixtures[i]);
+		g_ptr_array_add(documents, document);
+	}
+
+	srcdir = g_getenv("srcdir");
+	if (!srcdir)
+		srcdir = ".";
+
+	for (i = 0; i < G_N_ELEMENTS(g_corpora); ++i) {
+		document = g_new0(didl_parity_document_t, 1);
+		document->name = g_strdup(g_corpora[i]);
+
+		path = g_build_filename(srcdir, "test", DIDL_PARITY_CORPUS_DIR,
+					g_corpora[i], NULL);
+
+		if (!g_file_get_contents(path, &document->didl, NULL, &error)) {
+			printf("Unable to read %s: %s\n", path,
+			       error->message);
+			g_clear_error(&error);
+		}
+
+		g_free(path);
+		g_ptr_array_add(documents, document);
+	}
+
+	return documents;
+}
+
+int main(int argc, char *argv[])
+{
+	GPtrArray *documents;
+	didl_parity_document_t *document;
+	guint checks = 0;
+	guint failed = 0;
+	guint filter;
+	guint protocol_info;
+	guint i;
+
+	g_type_init();
+
+	documents = prv_documents_new();
+
+	for (i = 0; i < documents->len; ++i) {
+		document = g_ptr_array_index(documents, i);
+
+		for (filter = 0; filter < G_N_ELEMENTS(g_filters); ++filter) {
+			for (protocol_info = 0;
+			     protocol_info < G_N_ELEMENTS(g_protocol_infos);
+			     ++protocol_info) {
+				checks++;
+
+				if (!document->didl ||
+				    !prv_check(document, filter,
+					       protocol_info))
+					failed++;
+			}
+		}
+	}
+
+	checks++;
+	if (!prv_check_vendor_first())
+		failed++;
+
+	printf("%u of %u checks failed\n", failed, checks);
+
+	g_ptr_array_unref(documents);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,256 @@
+/*
+ * dispatch-bench
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2012 Intel Corporation. All rights reserved.
+ *
+ ******************************************************************************/
+
+/* Times the dispatch of synchronous tasks by the task processor, which
+   starts them from a single batched idle source, against the previous
+   scheme, in which each queue started its tasks one by one from its own
+   idle source.  The queues and their tasks are created before the timing
+   starts on both sides, so that only the dispatch is measured.
+
+   Usage: dispatch-bench [queues] [tasks per queue] */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "task-processor.h"
+
+#define DISPATCH_BENCH_QUEUES 64
+#define DISPATCH_BENCH_TASKS 1000
+
+typedef struct dispatch_bench_t_ dispatch_bench_t;
+struct dispatch_bench_t_ {
+	guint queues;
+	guint tasks;
+	guint completed;
+	guint iterations;
+	gint64 elapsed;
+};
+
+/* Per-queue idle scheme, as used before the batched dispatcher: each
+   queue keeps its backlog in a GPtrArray, is looked up by its key in the
+   table of queues, and starts its next task from its own idle source once
+   the previous one has completed. */
+
+typedef struct legacy_queue_t_ legacy_queue_t;
+struct legacy_queue_t_ {
+	dispatch_bench_t *bench;
+	GHashTable *queues;
+	gchar *key;
+	GPtrArray *tasks;
+	msu_task_atom_t *current_task;
+	guint idle_id;
+};
+
+static void prv_legacy_task_completed(legacy_queue_t *queue);
+
+static gboolean prv_legacy_process_task(gpointer user_data)
+{
+	legacy_queue_t *queue = user_data;
+
+	queue = g_hash_table_lookup(queue->queues, queue->key);
+
+	queue->idle_id = 0;
+	queue->current_task = g_ptr_array_index(queue->tasks, 0);
+	g_ptr_array_remove_index(queue->tasks, 0);
+
+	/* The task is processed and completes synchronously */
+	queue->bench->completed++;
+	prv_legacy_task_completed(queue);
+
+	return FALSE;
+}
+
+static void prv_legacy_task_completed(legacy_queue_t *queue)
+{
+	queue = g_hash_table_lookup(queue->queues, queue->key);
+
+	g_free(queue->current_task);
+	queue->current_task = NULL;
+
+	if (queue->tasks->len > 0)
+		queue->idle_id = g_idle_add(prv_legacy_process_task, queue);
+}
+
+static void prv_legacy_queue_free(gpointer data)
+{
+	legacy_queue_t *queue = data;
+
+	g_ptr_array_unref(queue->tasks);
+	g_free(queue->key);
+	g_free(queue);
+}
+
+static void prv_run_legacy(dispatch_bench_t *bench)
+{
+	GHashTable *queues;
+	legacy_queue_t **started;
+	legacy_queue_t *queue;
+	guint total = bench->queues * bench->tasks;
+	gint64 start;
+	guint i;
+	guint j;
+
+	queues = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+				       prv_legacy_queue_free);
+	started = g_new(legacy_queue_t *, bench->queues);
+
+	for (i = 0; i < bench->queues; ++i) {
+		queue = g_new0(legacy_queue_t, 1);
+		queue->bench = bench;
+		queue->queues = queues;
+		queue->key = g_strdup_printf("source/sink-%u", i);
+		queue->tasks = g_ptr_array_new();
+
+		for (j = 0; j < bench->tasks; ++j)
+			g_ptr_array_add(queue->tasks,
+					g_new0(msu_task_atom_t, 1));
+
+		g_hash_table_insert(queues, queue->key, queue);
+		started[i] = queue;
+	}
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < bench->queues; ++i)
+		started[i]->idle_id = g_idle_add(prv_legacy_process_task,
+						 started[i]);
+
+	while (bench->completed < total) {
+		(void) g_main_context_iteration(NULL, TRUE);
+		bench->iterations++;
+	}
+
+	bench->elapsed = g_get_monotonic_time() - start;
+
+	g_free(started);
+	g_hash_table_unref(queues);
+}
+
+/* Batched dispatcher of the task processor */
+
+static void prv_batched_process_cb(msu_task_atom_t *task, gpointer user_data)
+{
+	dispatch_bench_t *bench = user_data;
+
+	bench->completed++;
+	msu_task_queue_task_completed(task);
+}
+
+static void prv_batched_cancel_cb(msu_task_atom_t *task, gpointer user_data)
+{
+}
+
+static void prv_batched_delete_cb(msu_task_atom_t *task, gpointer user_data)
+{
+	g_free(task);
+}
+
+static gboolean prv_quit_cb(gpointer user_data)
+{
+	return FALSE;
+}
+
+static void prv_run_batched(dispatch_bench_t *bench)
+{
+	msu_task_processor_t *processor;
+	const msu_task_queue_key_t **queue_ids;
+	guint total = bench->queues * bench->tasks;
+	gchar *sink;
+	gint64 start;
+	guint i;
+	guint j;
+
+	processor = msu_task_processor_new(prv_quit_cb);
+	queue_ids = g_new(const msu_task_queue_key_t *, bench->queues);
+
+	/* One sink per queue, so that both schemes run the same number of
+	   tasks side by side */
+	for (i = 0; i < bench->queues; ++i) {
+		sink = g_strdup_printf("sink-%u", i);
+		queue_ids[i] = msu_task_processor_add_queue(
+					processor, "source", sink, 0,
+					prv_batched_process_cb,
+					prv_batched_cancel_cb,
+					prv_batched_delete_cb);
+		msu_task_queue_set_user_data(queue_ids[i], bench);
+		g_free(sink);
+
+		for (j = 0; j < bench->tasks; ++j)
+			msu_task_queue_add_task(queue_ids[i],
+						g_new0(msu_task_atom_t, 1));
+	}
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < bench->queues; ++i)
+		msu_task_queue_start(queue_ids[i]);
+
+	while (bench->completed < total) {
+		(void) g_main_context_iteration(NULL, TRUE);
+		bench->iterations++;
+	}
+
+	bench->elapsed = g_get_monotonic_time() - start;
+
+	g_free(queue_ids);
+	msu_task_processor_free(processor);
+}
+
+static void prv_report(const gchar *name, const dispatch_bench_t *bench)
+{
+	guint total = bench->queues * bench->tasks;
+
+	printf("%-8s %8u tasks %8u iterations %10.3f ms %8.1f ns/task\n",
+	       name, total, bench->iterations, bench->elapsed / 1000.0,
+	       total ? bench->elapsed * 1000.0 / total : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	dispatch_bench_t legacy = { 0 };
+	dispatch_bench_t batched = { 0 };
+	guint queues = DISPATCH_BENCH_QUEUES;
+	guint tasks = DISPATCH_BENCH_TASKS;
+
+	if (argc > 1)
+		queues = strtoul(argv[1], NULL, 10);
+
+	if (argc > 2)
+		tasks = strtoul(argv[2], NULL, 10);
+
+	if (!queues || !tasks) {
+		fprintf(stderr, "Usage: %s [queues] [tasks per queue]\n",
+			argv[0]);
+		return 1;
+	}
+
+	legacy.queues = batched.queues = queues;
+	legacy.tasks = batched.tasks = tasks;
+
+	prv_run_legacy(&legacy);
+	prv_run_batched(&batched);
+
+	prv_report("legacy", &legacy);
+	prv_report("batched", &batched);
+
+	return 0;
+}
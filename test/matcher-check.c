@@ -0,0 +1,254 @@
+/*
+ * matcher-check
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ ******************************************************************************/
+
+/* Checks that the protocol info matcher agrees with comparing the
+   resource with every protocol info of the client's list, using
+   gupnp_protocol_info_is_compatible, on random lists and resources.
+   The fields are drawn from small sets that mix case, wildcards, LPCM
+   MIME types, DLNA profiles, missing fields and fields too long to be
+   looked up.  Exits with a non-zero status if any of them differ. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "matcher.h"
+
+#define MATCHER_CHECK_LISTS 90000
+#define MATCHER_CHECK_MAX_INFOS 6
+#define MATCHER_CHECK_RESOURCES 4
+#define MATCHER_CHECK_SEED 2013
+
+/* Longer than the fields the matcher looks up in its index */
+#define MATCHER_CHECK_LONG_FIELD 200
+
+typedef struct matcher_check_t_ matcher_check_t;
+struct matcher_check_t_ {
+	GRand *rand;
+	gchar *long_mime_type;
+	guint checks;
+	guint failed;
+};
+
+static const gchar *g_protocols[] = {
+	"http-get", "HTTP-GET", "rtsp-rtp-udp", "internal", "*"
+};
+
+static const gchar *g_networks[] = {
+	"*", "192.168.0.2", "192.168.0.3"
+};
+
+static const gchar *g_mime_types[] = {
+	"audio/mpeg", "Audio/MPEG", "audio/L16",
+	"audio/L16;rate=44100;channels=2", "audio/l16;rate=48000",
+	"video/mp4", "image/jpeg", "*", NULL /* long MIME type */
+};
+
+static const gchar *g_additional_infos[] = {
+	"*", "DLNA.ORG_PN=MP3", "DLNA.ORG_PN=LPCM",
+	"DLNA.ORG_PN=JPEG_SM;DLNA.ORG_OP=01",
+	"DLNA.ORG_PN=AVC_MP4_BL_CIF15_AAC_520;DLNA.ORG_FLAGS=01700000000000"
+	"000000000000000000"
+};
+
+static const gchar *prv_pick(matcher_check_t *check, const gchar **values,
+			     guint count)
+{
+	const gchar *value;
+
+	value = values[g_rand_int_range(check->rand, 0, count)];
+
+	return value ? value : check->long_mime_type;
+}
+
+/* One time in sixteen, the protocol info lacks its last fields */
+static gchar *prv_protocol_info_new(matcher_check_t *check)
+{
+	const gchar *protocol;
+	const gchar *network;
+	const gchar *mime_type;
+	const gchar *additional_info;
+
+	protocol = prv_pick(check, g_protocols, G_N_ELEMENTS(g_protocols));
+	network = prv_pick(check, g_networks, G_N_ELEMENTS(g_networks));
+	mime_type = prv_pick(check, g_mime_types, G_N_ELEMENTS(g_mime_types));
+	additional_info = prv_pick(check, g_additional_infos,
+				   G_N_ELEMENTS(g_additional_infos));
+
+	if (!g_rand_int_range(check->rand, 0, 16))
+		return g_strdup_printf("%s:%s", protocol, network);
+
+	return g_strdup_printf("%s:%s:%s:%s", protocol, network, mime_type,
+			       additional_info);
+}
+
+static gchar *prv_list_new(matcher_check_t *check)
+{
+	GString *list;
+	gchar *info;
+	guint count;
+	guint i;
+
+	list = g_string_new("");
+	count = g_rand_int_range(check->rand, 0, MATCHER_CHECK_MAX_INFOS + 1);
+
+	for (i = 0; i < count; ++i) {
+		if (i)
+			g_string_append_c(list, ',');
+
+		info = prv_protocol_info_new(check);
+		g_string_append(list, info);
+		g_free(info);
+	}
+
+	return g_string_free(list, FALSE);
+}
+
+/* The reference parses the list as the matcher does and compares the
+   resource with every protocol info of the list. */
+static GPtrArray *prv_reference_new(const gchar *list)
+{
+	GPtrArray *infos;
+	GUPnPProtocolInfo *pi;
+	gchar **pi_str_array;
+	guint i;
+
+	infos = g_ptr_array_new_with_free_func(g_object_unref);
+	pi_str_array = g_strsplit(list, ",", 0);
+
+	for (i = 0; pi_str_array[i]; ++i) {
+		pi = gupnp_protocol_info_new_from_string(pi_str_array[i],
+							 NULL);
+		if (pi)
+			g_ptr_array_add(infos, pi);
+	}
+
+	g_strfreev(pi_str_array);
+
+	return infos;
+}
+
+static gboolean prv_reference_match(GPtrArray *infos,
+				    GUPnPProtocolInfo *res_pi)
+{
+	gboolean match = FALSE;
+	guint i;
+
+	for (i = 0; !match && res_pi && i < infos->len; ++i)
+		match = gupnp_protocol_info_is_compatible(
+					g_ptr_array_index(infos, i), res_pi);
+
+	return match;
+}
+
+static void prv_compare(matcher_check_t *check, const gchar *name,
+			const gchar *list, const gchar *res,
+			gboolean matched, gboolean expected)
+{
+	check->checks++;
+
+	if (matched != expected) {
+		printf("%s: [%s] %s [%s]\n", name, list,
+		       matched ? "matched" : "did not match", res);
+		check->failed++;
+	}
+}
+
+static void prv_check_list(matcher_check_t *check)
+{
+	msu_matcher_t *matcher;
+	GPtrArray *infos;
+	GUPnPProtocolInfo *res_pi;
+	gchar *list;
+	gchar *res;
+	gboolean expected;
+	guint i;
+
+	list = prv_list_new(check);
+	matcher = msu_matcher_new(list);
+	infos = prv_reference_new(list);
+
+	for (i = 0; i < MATCHER_CHECK_RESOURCES; ++i) {
+		res = prv_protocol_info_new(check);
+		res_pi = gupnp_protocol_info_new_from_string(res, NULL);
+		expected = prv_reference_match(infos, res_pi);
+
+		prv_compare(check, "msu_matcher_match", list, res,
+			    msu_matcher_match(matcher, res_pi), expected);
+		prv_compare(check, "msu_matcher_match_string", list, res,
+			    msu_matcher_match_string(matcher, res), expected);
+
+		if (res_pi)
+			g_object_unref(res_pi);
+		g_free(res);
+	}
+
+	g_ptr_array_unref(infos);
+	msu_matcher_unref(matcher);
+	g_free(list);
+}
+
+/* A client that has not set its protocol info accepts every resource */
+static void prv_check_no_list(matcher_check_t *check)
+{
+	msu_matcher_t *matcher;
+	GUPnPProtocolInfo *res_pi;
+	const gchar *res = "http-get:*:audio/mpeg:*";
+
+	matcher = msu_matcher_new(NULL);
+	res_pi = gupnp_protocol_info_new_from_string(res, NULL);
+
+	prv_compare(check, "msu_matcher_match", "", res,
+		    msu_matcher_match(matcher, res_pi), TRUE);
+	prv_compare(check, "msu_matcher_match_string", "", res,
+		    msu_matcher_match_string(matcher, res), TRUE);
+
+	g_object_unref(res_pi);
+}
+
+int main(int argc, char *argv[])
+{
+	matcher_check_t check;
+	gchar *long_field;
+	guint i;
+
+	g_type_init();
+
+	check.checks = check.failed = 0;
+	check.rand = g_rand_new_with_seed(MATCHER_CHECK_SEED);
+
+	long_field = g_strnfill(MATCHER_CHECK_LONG_FIELD, 'x');
+	check.long_mime_type = g_strconcat("audio/", long_field, NULL);
+	g_free(long_field);
+
+	prv_check_no_list(&check);
+
+	for (i = 0; i < MATCHER_CHECK_LISTS; ++i)
+		prv_check_list(&check);
+
+	printf("%u of %u checks failed\n", check.failed, check.checks);
+
+	g_free(check.long_mime_type);
+	g_rand_free(check.rand);
+
+	return check.failed ? 1 : 0;
+}
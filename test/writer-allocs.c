@@ -0,0 +1,349 @@
+/*
+ * writer-allocs
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ ******************************************************************************/
+
+/* Counts the heap allocations made to build the aa{sv} result of a page
+   of music tracks, with the writer and with a GVariantBuilder for every
+   object and resource, as results were built before the writer.  Both
+   must give the same result.  Exits with a non-zero status if they do
+   not, or if the writer does not allocate less.
+
+   g_mem_set_vtable is ignored by GLib since 2.46, so malloc, calloc and
+   realloc themselves are replaced, and GSlice is made to use them.  Both
+   counts include formatting the path and URL of every object. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "writer.h"
+
+#define WRITER_ALLOCS_OBJECTS 1000
+
+#define WRITER_ALLOCS_ROOT_PATH "/com/intel/MediaServiceUPnP/server/0"
+
+typedef struct writer_allocs_count_t_ writer_allocs_count_t;
+struct writer_allocs_count_t_ {
+	guint allocations;
+	guint reallocations;
+};
+
+/* What was kept for every object of a list before the writer */
+typedef struct writer_allocs_builder_t_ writer_allocs_builder_t;
+struct writer_allocs_builder_t_ {
+	GVariantBuilder *vb;
+	gchar *id;
+	gboolean needs_child_count;
+};
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gboolean g_counting;
+static writer_allocs_count_t g_count;
+
+void *malloc(size_t size)
+{
+	if (g_counting)
+		g_count.allocations++;
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (g_counting)
+		g_count.allocations++;
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (g_counting) {
+		if (ptr)
+			g_count.reallocations++;
+		else
+			g_count.allocations++;
+	}
+
+	return __libc_realloc(ptr, size);
+}
+
+static void prv_count_start(void)
+{
+	memset(&g_count, 0, sizeof(g_count));
+	g_counting = TRUE;
+}
+
+static writer_allocs_count_t prv_count_stop(void)
+{
+	g_counting = FALSE;
+
+	return g_count;
+}
+
+static void prv_builder_delete(gpointer data)
+{
+	writer_allocs_builder_t *builder = data;
+
+	g_variant_builder_unref(builder->vb);
+	g_free(builder->id);
+	g_free(builder);
+}
+
+static GVariant *prv_builder_resources(const gchar *url)
+{
+	GVariantBuilder *res_array_vb;
+	GVariantBuilder *res_vb;
+	GVariant *retval;
+
+	res_array_vb = g_variant_builder_new(G_VARIANT_TYPE("aa{sv}"));
+
+	res_vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(res_vb, "{sv}", "URL", g_variant_new_string(url));
+	g_variant_builder_add(res_vb, "{sv}", "MIMEType",
+			      g_variant_new_string("audio/mpeg"));
+	g_variant_builder_add(res_vb, "{sv}", "Size",
+			      g_variant_new_int64(4718592));
+	g_variant_builder_add(res_vb, "{sv}", "Duration",
+			      g_variant_new_int32(245));
+	g_variant_builder_add(res_array_vb, "@a{sv}",
+			      g_variant_builder_end(res_vb));
+	g_variant_builder_unref(res_vb);
+
+	retval = g_variant_builder_end(res_array_vb);
+	g_variant_builder_unref(res_array_vb);
+
+	return retval;
+}
+
+static void prv_builder_object(GPtrArray *vbs, guint i)
+{
+	writer_allocs_builder_t *builder;
+	const gchar *artists[] = { "Artist" };
+	const gchar *urls[1];
+	gchar *path;
+	gchar *url;
+
+	builder = g_new0(writer_allocs_builder_t, 1);
+	builder->vb = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+
+	path = g_strdup_printf("%s/%x", WRITER_ALLOCS_ROOT_PATH, i);
+	url = g_strdup_printf("http://192.168.0.2:8200/MediaItems/%u.mp3", i);
+	urls[0] = url;
+
+	g_variant_builder_add(builder->vb, "{sv}", "Path",
+			      g_variant_new_object_path(path));
+	g_variant_builder_add(builder->vb, "{sv}", "Parent",
+			      g_variant_new_object_path(
+				      WRITER_ALLOCS_ROOT_PATH "/1"));
+	g_variant_builder_add(builder->vb, "{sv}", "Type",
+			      g_variant_new_string("music"));
+	g_variant_builder_add(builder->vb, "{sv}", "DisplayName",
+			      g_variant_new_string("Track title"));
+	g_variant_builder_add(builder->vb, "{sv}", "Restricted",
+			      g_variant_new_boolean(TRUE));
+	g_variant_builder_add(builder->vb, "{sv}", "Artist",
+			      g_variant_new_string("Artist"));
+	g_variant_builder_add(builder->vb, "{sv}", "Artists",
+			      g_variant_new_strv(artists, 1));
+	g_variant_builder_add(builder->vb, "{sv}", "Album",
+			      g_variant_new_string("Album"));
+	g_variant_builder_add(builder->vb, "{sv}", "Date",
+			      g_variant_new_string("2013-01-01"));
+	g_variant_builder_add(builder->vb, "{sv}", "Genre",
+			      g_variant_new_string("Rock"));
+	g_variant_builder_add(builder->vb, "{sv}", "TrackNumber",
+			      g_variant_new_int32(i % 20 + 1));
+	g_variant_builder_add(builder->vb, "{sv}", "URLs",
+			      g_variant_new_strv(urls, 1));
+	g_variant_builder_add(builder->vb, "{sv}", "MIMEType",
+			      g_variant_new_string("audio/mpeg"));
+	g_variant_builder_add(builder->vb, "{sv}", "Size",
+			      g_variant_new_int64(4718592));
+	g_variant_builder_add(builder->vb, "{sv}", "Duration",
+			      g_variant_new_int32(245));
+	g_variant_builder_add(builder->vb, "{sv}", "Resources",
+			      prv_builder_resources(url));
+
+	g_ptr_array_add(vbs, builder);
+
+	g_free(url);
+	g_free(path);
+}
+
+static GVariant *prv_builder_page(void)
+{
+	writer_allocs_builder_t *builder;
+	GPtrArray *vbs;
+	GVariantBuilder vb;
+	GVariant *retval;
+	guint i;
+
+	vbs = g_ptr_array_new_with_free_func(prv_builder_delete);
+
+	for (i = 0; i < WRITER_ALLOCS_OBJECTS; ++i)
+		prv_builder_object(vbs, i);
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("aa{sv}"));
+
+	for (i = 0; i < vbs->len; ++i) {
+		builder = g_ptr_array_index(vbs, i);
+		g_variant_builder_add(&vb, "@a{sv}",
+				      g_variant_builder_end(builder->vb));
+	}
+
+	retval = g_variant_ref_sink(g_variant_builder_end(&vb));
+
+	g_ptr_array_unref(vbs);
+
+	return retval;
+}
+
+static GVariant *prv_writer_resources(const gchar *url)
+{
+	msu_writer_t *res_writer;
+	GVariant *retval;
+
+	res_writer = msu_writer_new();
+
+	(void) msu_writer_begin_object(res_writer);
+	msu_writer_add_string(res_writer, "URL", url);
+	msu_writer_add_string(res_writer, "MIMEType", "audio/mpeg");
+	msu_writer_add_int64(res_writer, "Size", 4718592);
+	msu_writer_add_int32(res_writer, "Duration", 245);
+
+	retval = msu_writer_end(res_writer);
+	msu_writer_delete(res_writer);
+
+	return retval;
+}
+
+static void prv_writer_object(msu_writer_t *writer, guint i)
+{
+	const gchar *artists[] = { "Artist" };
+	const gchar *urls[1];
+	gchar *path;
+	gchar *url;
+
+	path = g_strdup_printf("%s/%x", WRITER_ALLOCS_ROOT_PATH, i);
+	url = g_strdup_printf("http://192.168.0.2:8200/MediaItems/%u.mp3", i);
+	urls[0] = url;
+
+	(void) msu_writer_begin_object(writer);
+
+	msu_writer_add_path(writer, "Path", path);
+	msu_writer_add_path(writer, "Parent", WRITER_ALLOCS_ROOT_PATH "/1");
+	msu_writer_add_string(writer, "Type", "music");
+	msu_writer_add_string(writer, "DisplayName", "Track title");
+	msu_writer_add_boolean(writer, "Restricted", TRUE);
+	msu_writer_add_string(writer, "Artist", "Artist");
+	msu_writer_add_value(writer, "Artists",
+			     g_variant_new_strv(artists, 1));
+	msu_writer_add_string(writer, "Album", "Album");
+	msu_writer_add_string(writer, "Date", "2013-01-01");
+	msu_writer_add_string(writer, "Genre", "Rock");
+	msu_writer_add_int32(writer, "TrackNumber", i % 20 + 1);
+	msu_writer_add_value(writer, "URLs", g_variant_new_strv(urls, 1));
+	msu_writer_add_string(writer, "MIMEType", "audio/mpeg");
+	msu_writer_add_int64(writer, "Size", 4718592);
+	msu_writer_add_int32(writer, "Duration", 245);
+	msu_writer_add_value(writer, "Resources", prv_writer_resources(url));
+
+	g_free(url);
+	g_free(path);
+}
+
+static GVariant *prv_writer_page(void)
+{
+	msu_writer_t *writer;
+	GVariant *retval;
+	guint i;
+
+	writer = msu_writer_new();
+
+	for (i = 0; i < WRITER_ALLOCS_OBJECTS; ++i)
+		prv_writer_object(writer, i);
+
+	retval = g_variant_ref_sink(msu_writer_end(writer));
+
+	msu_writer_delete(writer);
+
+	return retval;
+}
+
+int main(int argc, char *argv[])
+{
+	writer_allocs_count_t builder_count;
+	writer_allocs_count_t writer_count;
+	GVariant *built;
+	GVariant *written;
+	guint checks = 0;
+	guint failed = 0;
+
+	/* GSlice reads G_SLICE before main is entered, so the program runs
+	   itself again once it is set. */
+	if (g_strcmp0(g_getenv("G_SLICE"), "always-malloc")) {
+		(void) g_setenv("G_SLICE", "always-malloc", TRUE);
+		(void) execv("/proc/self/exe", argv);
+
+		printf("Unable to set G_SLICE, slice allocations are not "
+		       "counted\n");
+	}
+
+	prv_count_start();
+	built = prv_builder_page();
+	builder_count = prv_count_stop();
+
+	prv_count_start();
+	written = prv_writer_page();
+	writer_count = prv_count_stop();
+
+	printf("%u objects: %u allocations and %u reallocations with "
+	       "GVariantBuilder\n", WRITER_ALLOCS_OBJECTS,
+	       builder_count.allocations, builder_count.reallocations);
+	printf("%u objects: %u allocations and %u reallocations with the "
+	       "writer\n", WRITER_ALLOCS_OBJECTS, writer_count.allocations,
+	       writer_count.reallocations);
+
+	checks++;
+	if (!g_variant_equal(built, written)) {
+		printf("The results differ\n");
+		failed++;
+	}
+
+	checks++;
+	if (writer_count.allocations + writer_count.reallocations >=
+	    builder_count.allocations + builder_count.reallocations) {
+		printf("The writer does not allocate less\n");
+		failed++;
+	}
+
+	printf("%u of %u checks failed\n", failed, checks);
+
+	g_variant_unref(written);
+	g_variant_unref(built);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * writer-check
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2013 Intel Corporation. All rights reserved.
+ *
+ ******************************************************************************/
+
+/* Checks that the writer serializes the same bytes as GVariantBuilder,
+   for empty and dropped objects, for every type of value, and for
+   dictionaries and arrays of dictionaries on both sides of the sizes at
+   which GVariant moves to 2 and 4 byte framing offsets.  Exits with a
+   non-zero status if any of them differ. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "writer.h"
+
+/* Sizes of string values swept around the 1 and 2 byte offset limits */
+#define WRITER_CHECK_SMALL_MIN 200
+#define WRITER_CHECK_SMALL_MAX 300
+#define WRITER_CHECK_LARGE_MIN (G_MAXUINT16 - 100)
+#define WRITER_CHECK_LARGE_MAX (G_MAXUINT16 + 20)
+
+typedef struct writer_check_t_ writer_check_t;
+struct writer_check_t_ {
+	msu_writer_t *writer;
+	GVariantBuilder objects;
+	GVariantBuilder object;
+	guint checks;
+	guint failed;
+};
+
+static void prv_check_new(writer_check_t *check)
+{
+	check->writer = msu_writer_new();
+	g_variant_builder_init(&check->objects, G_VARIANT_TYPE("aa{sv}"));
+}
+
+static void prv_begin_object(writer_check_t *check)
+{
+	(void) msu_writer_begin_object(check->writer);
+	g_variant_builder_init(&check->object, G_VARIANT_TYPE("a{sv}"));
+}
+
+static void prv_end_object(writer_check_t *check)
+{
+	g_variant_builder_add_value(&check->objects,
+				    g_variant_builder_end(&check->object));
+}
+
+static void prv_drop_object(writer_check_t *check)
+{
+	msu_writer_drop_object(check->writer);
+	g_variant_builder_clear(&check->object);
+}
+
+static void prv_add_string(writer_check_t *check, const gchar *key,
+			   const gchar *value)
+{
+	msu_writer_add_string(check->writer, key, value);
+	g_variant_builder_add(&check->object, "{sv}", key,
+			      g_variant_new_string(value));
+}
+
+static void prv_add_values(writer_check_t *check)
+{
+	const gchar *artists[] = { "First", "Second" };
+	GVariantBuilder vb;
+
+	prv_add_string(check, "DisplayName", "Music");
+
+	msu_writer_add_path(check->writer, "Path",
+			    "/com/intel/MediaServiceUPnP/server/0/1");
+	g_variant_builder_add(&check->object, "{sv}", "Path",
+			      g_variant_new_object_path(
+				"/com/intel/MediaServiceUPnP/server/0/1"));
+
+	msu_writer_add_uint32(check->writer, "ChildCount", 12);
+	g_variant_builder_add(&check->object, "{sv}", "ChildCount",
+			      g_variant_new_uint32(12));
+
+	msu_writer_add_int32(check->writer, "TrackNumber", -5);
+	g_variant_builder_add(&check->object, "{sv}", "TrackNumber",
+			      g_variant_new_int32(-5));
+
+	msu_writer_add_int64(check->writer, "Size", G_GINT64_CONSTANT(1) << 40);
+	g_variant_builder_add(&check->object, "{sv}", "Size",
+			      g_variant_new_int64(G_GINT64_CONSTANT(1) << 40));
+
+	msu_writer_add_boolean(check->writer, "Searchable", TRUE);
+	g_variant_builder_add(&check->object, "{sv}", "Searchable",
+			      g_variant_new_boolean(TRUE));
+
+	msu_writer_add_value(check->writer, "Artists",
+			     g_variant_new_strv(artists, 2));
+	g_variant_builder_add(&check->object, "{sv}", "Artists",
+			      g_variant_new_strv(artists, 2));
+
+	msu_writer_add_value(check->writer, "Empty",
+			     g_variant_new_strv(NULL, 0));
+	g_variant_builder_add(&check->object, "{sv}", "Empty",
+			      g_variant_new_strv(NULL, 0));
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&vb, "{sv}", "URL",
+			      g_variant_new_string("http://server/1.mp3"));
+	msu_writer_add_value(check->writer, "Resources",
+			     g_variant_builder_end(&vb));
+
+	g_variant_builder_init(&vb, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&vb, "{sv}", "URL",
+			      g_variant_new_string("http://server/1.mp3"));
+	g_variant_builder_add(&check->object, "{sv}", "Resources",
+			      g_variant_builder_end(&vb));
+}
+
+/* Consumes written, which is floating, and the reference to built. */
+static void prv_compare(writer_check_t *check, const gchar *name,
+			GVariant *written, GVariant *built)
+{
+	gboolean same;
+
+	(void) g_variant_ref_sink(written);
+
+	same = g_variant_is_of_type(written, g_variant_get_type(built)) &&
+		g_variant_get_size(written) == g_variant_get_size(built) &&
+		!memcmp(g_variant_get_data(written), g_variant_get_data(built),
+			g_variant_get_size(built));
+
+	check->checks++;
+	if (!same) {
+		printf("%s: %" G_GSIZE_FORMAT " bytes written, %"
+		       G_GSIZE_FORMAT " bytes expected\n", name,
+		       g_variant_get_size(written), g_variant_get_size(built));
+		check->failed++;
+	}
+
+	g_variant_unref(written);
+	g_variant_unref(built);
+}
+
+/* Compares the array of all the objects, and the first object alone
+   when there is only one. */
+static void prv_check_end(writer_check_t *check, const gchar *name,
+			  guint objects)
+{
+	GVariant *objects_v;
+	GVariant *object_v;
+
+	objects_v = g_variant_ref_sink(g_variant_builder_end(&check->objects));
+
+	if (objects < 2) {
+		if (objects)
+			object_v = g_variant_get_child_value(objects_v, 0);
+		else
+			object_v = g_variant_ref_sink(g_variant_new_array(
+					G_VARIANT_TYPE("{sv}"), NULL, 0));
+
+		prv_compare(check, name,
+			    msu_writer_end_object(check->writer), object_v);
+	}
+
+	prv_compare(check, name, msu_writer_end(check->writer), objects_v);
+
+	msu_writer_delete(check->writer);
+}
+
+static void prv_check_empty(writer_check_t *check)
+{
+	prv_check_new(check);
+	prv_check_end(check, "No object", 0);
+
+	prv_check_new(check);
+	prv_begin_object(check);
+	prv_end_object(check);
+	prv_check_end(check, "Empty object", 1);
+
+	prv_check_new(check);
+	prv_begin_object(check);
+	prv_add_string(check, "DisplayName", "Dropped");
+	prv_drop_object(check);
+	prv_check_end(check, "Dropped object", 0);
+
+	prv_check_new(check);
+	prv_begin_object(check);
+	prv_end_object(check);
+	prv_begin_object(check);
+	prv_add_values(check);
+	prv_end_object(check);
+	prv_begin_object(check);
+	prv_end_object(check);
+	prv_check_end(check, "Empty objects around values", 3);
+}
+
+static void prv_check_values(writer_check_t *check)
+{
+	prv_check_new(check);
+	prv_begin_object(check);
+	prv_add_values(check);
+	prv_end_object(check);
+	prv_check_end(check, "Values", 1);
+}
+
+/* Dictionaries of one and two entries, and arrays of one and three
+   dictionaries, whose sizes go past an offset limit as length grows. */
+static void prv_check_sizes(writer_check_t *check, gsize min, gsize max)
+{
+	gchar *value;
+	gchar *name;
+	gsize length;
+	guint entries;
+	guint objects;
+	guint i;
+	guint j;
+
+	value = g_malloc(max + 1);
+	memset(value, 'x', max);
+
+	for (length = min; length <= max; ++length) {
+		value[length] = 0;
+
+		for (entries = 1; entries <= 2; ++entries) {
+			for (objects = 1; objects <= 3; objects += 2) {
+				prv_check_new(check);
+
+				for (i = 0; i < objects; ++i) {
+					prv_begin_object(check);
+					for (j = 0; j < entries; ++j)
+						prv_add_string(check, "URL",
+							       value + i);
+					prv_end_object(check);
+				}
+
+				name = g_strdup_printf(
+					"%u objects of %u strings of %"
+					G_GSIZE_FORMAT " bytes", objects,
+					entries, length);
+				prv_check_end(check, name, objects);
+				g_free(name);
+			}
+		}
+
+		value[length] = 'x';
+	}
+
+	g_free(value);
+}
+
+int main(int argc, char *argv[])
+{
+	writer_check_t check;
+
+	check.checks = check.failed = 0;
+
+	prv_check_empty(&check);
+	prv_check_values(&check);
+	prv_check_sizes(&check, WRITER_CHECK_SMALL_MIN, WRITER_CHECK_SMALL_MAX);
+	prv_check_sizes(&check, WRITER_CHECK_LARGE_MIN, WRITER_CHECK_LARGE_MAX);
+
+	printf("%u of %u checks failed\n", check.failed, check.checks);
+
+	return check.failed ? 1 : 0;
+}